@@ -389,6 +389,36 @@ def plotPolarization(collimated=1):
    polarH1.Draw("hist")
    return polarH1
 
+def checkConvolution(collimated=1, tolerance=1e-6):
+   """
+   Compare the fast beam-crystal convolution applied to the coherent
+   spectrum against the direct pairwise algorithm, using the current
+   nbins and energy limits. Prints and returns the largest difference
+   between the two, relative to the peak of the convolved spectrum,
+   and warns if it exceeds tolerance.
+   """
+   x0 = Emin / E0
+   x1 = Emax / E0
+   xvals = array('d', nbins * [0])
+   yfast = array('d', nbins * [0])
+   ydirect = array('d', nbins * [0])
+   colFlag = generator.getCollimatedFlag()
+   generator.setCollimatedFlag(collimated)
+   for i in range(0, nbins):
+      xvals[i] = x0 + (i + 0.5) * (x1 - x0) / nbins;
+      yfast[i] = dRcdx([xvals[i]])
+      ydirect[i] = yfast[i]
+   generator.setCollimatedFlag(colFlag)
+   generator.applyBeamCrystalConvolution(nbins, xvals, yfast)
+   generator.applyBeamCrystalConvolution_direct(nbins, xvals, ydirect)
+   ymax = max([abs(y) for y in ydirect]) + 1e-99
+   maxdiff = max([abs(yfast[i] - ydirect[i]) for i in range(0, nbins)])
+   print "maximum relative difference between fast and direct", \
+         "beam-crystal convolution is", maxdiff / ymax
+   if maxdiff / ymax > tolerance:
+      print "Warning - difference exceeds tolerance", tolerance
+   return maxdiff / ymax
+
 def acceptance(vars):
    """
    TF1 user function that can be used to plot the collimator acceptance
@@ -23,7 +23,9 @@
 //    of AdaptiveSampler among many threads with the calls to mutating
 //    methods protected by a mutex, or you can construct an AdapativeSample
 //    instance for each thread and then pause at regular intervals to 
-//    combine their statistics using save/merge/restore.
+//    combine their statistics using save/merge/restore. Within a single
+//    process, the AdaptiveSamplerTrainer class does the latter in memory,
+//    and can also adapt the combined tree while the threads are running.
 //
 // 3) Users must provide their uniform random number generator function to
 //    the AdaptiveSampler constructor. If the sample method is to be called
@@ -66,7 +68,7 @@
 //         Each cell in the tree requires memory resources to hold the
 //         statistics that it collects for the hits that are generated
 //         within that cell. All cells in the tree have the same size,
-//         approximately 40 + (8 * 3^ndim) for ndim dimensions. The
+//         approximately 100 + (48 * ndim) bytes for ndim dimensions. The
 //         number of cells that are needed to achieve a certain target
 //         efficiency depends on the problem. Generally one should
 //         plan to accommodate as many cells as memory resources can
@@ -132,6 +134,25 @@
 //    elements of the u vector (first argument). If nfixed > 0 then
 //    it needs to be passed as the last argument to the constructor
 //    of AdaptiveSampler.
+//
+// 8) The sampler state can be saved in either of two formats. The text
+//    format written by default is human readable, but for deep trees the
+//    files are large and slow to parse. The binary format selected with
+//    saveState(filename, optimized, BINARY_FORMAT) holds exactly the same
+//    information, stored as fixed-size little-endian records in the same
+//    cell order as the text format, behind a header that carries the
+//    format version, the dimension, the mask of fixed dimensions, the
+//    cell count and a checksum over the cell records. mergeState() and
+//    restoreState() recognize either format automatically, and read
+//    binary files through a read-only memory map. The adapt utility
+//    converts state files between the two formats.
+//
+// 9) For trees with millions of cells, the search for cells to split in
+//    adapt() can be spread over several threads, see setAdaptation_threads.
+//    Each leaf is checked independently against criteria that depend only
+//    on its own statistics and the totals for the tree, and the splits are
+//    then applied serially in depth-first order, so the adapted tree is the
+//    same whatever the number of threads.
 
 #include <assert.h>
 #include <cmath>
@@ -139,8 +160,103 @@
 #include <sstream>
 #include <iostream>
 #include <exception>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "AdaptiveSampler.hh"
 
+// Scratch arrays for sample() and feedback() are allocated on the
+// stack for problems up to this dimension, on the heap above it.
+#define MAX_STACK_NDIM 16
+
+// Number of leaf cells handed to an adaptation thread at a time.
+#define ADAPT_CHUNK_SIZE 4096
+
+// Layout of the binary state format, see note 8 above. All integer
+// and floating point values are stored in little-endian byte order.
+//   offset  size  contents
+//        0     8  magic string ASTATE_BINARY_MAGIC
+//        8     4  format version ASTATE_BINARY_VERSION
+//       12     4  header size in bytes ASTATE_BINARY_HEADER_SIZE
+//       16     4  fNdim
+//       20     4  fNfixed
+//       24     8  mask of fixed dimensions, bit i set for axis i
+//       32     4  flags, bit 0 set if subsets are optimized
+//       36     4  fMaximum_depth
+//       40     4  fMaximum_cells
+//       44     4  reserved
+//       48     8  fSampling_threshold
+//       56     8  fEfficiency_target
+//       64     8  number of cell records that follow
+//       72     8  FNV-1a checksum of the cell records
+// Each cell record is (48 + 48 * fNdim) bytes long, containing divAxis
+// (4 bytes + 4 bytes padding), nhit (8), sum_wI, sum_wI2, sum_wI4 and
+// subset (8 each), followed by sum_wI2d[3*fNdim] and sum_wI4d[3*fNdim].
+// Cells are written depth-first, parent before subcells, exactly as in
+// the text format.
+#define ASTATE_BINARY_MAGIC "ASAMPLR\n"
+#define ASTATE_BINARY_VERSION 1
+#define ASTATE_BINARY_HEADER_SIZE 80
+
+static void put_uint32(unsigned char *p, uint32_t v)
+{
+   for (int i=0; i < 4; ++i)
+      p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static void put_uint64(unsigned char *p, uint64_t v)
+{
+   for (int i=0; i < 8; ++i)
+      p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static void put_double(unsigned char *p, double v)
+{
+   uint64_t u;
+   memcpy(&u, &v, 8);
+   put_uint64(p, u);
+}
+
+static uint32_t get_uint32(const unsigned char *p)
+{
+   uint32_t v = 0;
+   for (int i=3; i >= 0; --i)
+      v = (v << 8) | p[i];
+   return v;
+}
+
+static uint64_t get_uint64(const unsigned char *p)
+{
+   uint64_t v = 0;
+   for (int i=7; i >= 0; --i)
+      v = (v << 8) | p[i];
+   return v;
+}
+
+static double get_double(const unsigned char *p)
+{
+   uint64_t u = get_uint64(p);
+   double v;
+   memcpy(&v, &u, 8);
+   return v;
+}
+
+static void update_checksum(uint64_t &checksum,
+                            const unsigned char *p, size_t n)
+{
+   for (size_t i=0; i < n; ++i) {
+      checksum ^= p[i];
+      checksum *= 1099511628211ULL;
+   }
+}
+
 int AdaptiveSampler::verbosity = 3;
 
 AdaptiveSampler::AdaptiveSampler(int dim, Uniform01 user_generator, int nfixed)
@@ -150,11 +266,12 @@ AdaptiveSampler::AdaptiveSampler(int dim, Uniform01 user_generator, int nfixed)
    fMaximum_cells(1000000),
    fSampling_threshold(0.01),
    fEfficiency_target(0.9),
-   fMinimum_sum_wI2_delta(0)
+   fMinimum_sum_wI2_delta(0),
+   fAdaptation_threads(1)
 {
    fRandom = user_generator;
-   fTopCell = new Cell(dim, nfixed);
-   fTopCell->subset = 1;
+   clear_tree();
+   fNodes[0].subset = 1;
    reset_stats();
 }
 
@@ -165,15 +282,17 @@ AdaptiveSampler::AdaptiveSampler(const AdaptiveSampler &src)
    fMaximum_cells(src.fMaximum_cells),
    fSampling_threshold(src.fSampling_threshold),
    fEfficiency_target(src.fEfficiency_target),
-   fMinimum_sum_wI2_delta(src.fMinimum_sum_wI2_delta)
+   fMinimum_sum_wI2_delta(src.fMinimum_sum_wI2_delta),
+   fAdaptation_threads(src.fAdaptation_threads),
+   fNodes(src.fNodes),
+   fStats(src.fStats),
+   fSums(src.fSums)
 {
    fRandom = src.fRandom;
-   fTopCell = new Cell(*src.fTopCell);
 }
 
 AdaptiveSampler::~AdaptiveSampler()
 {
-   delete fTopCell;
 }
 
 AdaptiveSampler AdaptiveSampler::operator=(const AdaptiveSampler &src)
@@ -181,6 +300,81 @@ AdaptiveSampler AdaptiveSampler::operator=(const AdaptiveSampler &src)
    return AdaptiveSampler(src);
 }
 
+int AdaptiveSampler::new_cell(int super)
+{
+   // Append a new unsplit cell with empty statistics to the arena,
+   // and return its index.
+
+   Node node = {-1, 0, 0};
+   Stats stats = {0, 0, 0, 0, 0, 0, 0, 0, 0, super};
+   fNodes.push_back(node);
+   fStats.push_back(stats);
+   fSums.resize(fSums.size() + 6 * fNdim, 0);
+   return fNodes.size() - 1;
+}
+
+int AdaptiveSampler::new_subcells(int cell)
+{
+   // Allocate the three subcells of cell consecutively at the end
+   // of the arena, and return the index of the first one.
+
+   int first = new_cell(cell);
+   new_cell(cell);
+   new_cell(cell);
+   fNodes[cell].subcell = first;
+   return first;
+}
+
+void AdaptiveSampler::clear_tree()
+{
+   fNodes.clear();
+   fStats.clear();
+   fSums.clear();
+   new_cell(-1);
+}
+
+int AdaptiveSampler::compact_tree()
+{
+   // Drop the cells that can no longer be reached from the top cell,
+   // as happens when a merged state has a leaf where this tree had a
+   // split, and renumber the rest in top-down order so that subcells
+   // still follow their parent in consecutive groups of three. Returns
+   // the number of cells dropped.
+
+   int ncells = fNodes.size();
+   std::vector<int> order(1, 0);
+   for (unsigned int k=0; k < order.size(); ++k) {
+      const Node &node = fNodes[order[k]];
+      if (node.divAxis > -1) {
+         for (int i=0; i < 3; ++i)
+            order.push_back(node.subcell + i);
+      }
+   }
+   int nkept = order.size();
+   if (nkept == ncells)
+      return 0;
+   std::vector<int> newindex(ncells, -1);
+   for (int k=0; k < nkept; ++k)
+      newindex[order[k]] = k;
+   std::vector<Node> nodes(nkept);
+   std::vector<Stats> stats(nkept);
+   std::vector<double> sums(nkept * 6 * fNdim);
+   for (int k=0; k < nkept; ++k) {
+      int cell = order[k];
+      nodes[k] = fNodes[cell];
+      nodes[k].subcell = (nodes[k].divAxis > -1)?
+                         newindex[fNodes[cell].subcell] : 0;
+      stats[k] = fStats[cell];
+      stats[k].super = (k > 0)? newindex[fStats[cell].super] : -1;
+      std::copy(&fSums[cell * 6 * fNdim], &fSums[(cell + 1) * 6 * fNdim],
+                &sums[k * 6 * fNdim]);
+   }
+   fNodes.swap(nodes);
+   fStats.swap(stats);
+   fSums.swap(sums);
+   return ncells - nkept;
+}
+
 double AdaptiveSampler::sample(double *u)
 {
    for (int i=0; i < fNfixed; ++i) {
@@ -193,46 +387,48 @@ double AdaptiveSampler::sample(double *u)
       }
    }
    int depth;
-   double *u0 = new double[fNdim];
-   double *u1 = new double[fNdim];
-   double *uu = new double[fNdim + 1];
+   double ubuf[3 * MAX_STACK_NDIM + 1];
+   double *u0 = (fNdim > MAX_STACK_NDIM)? new double[3 * fNdim + 1] : ubuf;
+   double *u1 = u0 + fNdim;
+   double *uu = u1 + fNdim;
    (*fRandom)(fNdim - fNfixed + 1, uu + fNfixed);
-   Cell *cell = findCell(uu[fNdim], depth, u0, u1, u);
+   int cell = findCell(uu[fNdim], depth, u0, u1, u);
    for (int i=fNfixed; i < fNdim; ++i) {
       u[i] = uu[i] * u0[i] + (1 - uu[i]) * u1[i];
    }
-   delete [] u0;
-   delete [] u1;
-   delete [] uu;
+   if (u0 != ubuf)
+      delete [] u0;
    // WARNING: strong condition is assumed here!
    // All splits along axes 0..fNfixed must be each
    // assigned the full subset of the parent cell.
    // You can use check_subsets() to verify this.
    double dNu = (depth > 0)? pow(1/3., depth) : 1;
-   return dNu / cell->subset;
+   return dNu / fNodes[cell].subset;
 }
 
-AdaptiveSampler::Cell *AdaptiveSampler::findCell(double ucell,
-                                                 int &depth, 
-                                                 double *u0,
-                                                 double *u1,
-                                                 const double *u)
+int AdaptiveSampler::findCell(double ucell,
+                              int &depth, 
+                              double *u0,
+                              double *u1,
+                              const double *u) const
 {
    std::fill(u0, u0 + fNdim, 0);
    std::fill(u1, u1 + fNdim, 1);
    depth = 0;
-   Cell *sel = fTopCell;
-   while (sel->divAxis > -1) {
+   int sel = 0;
+   while (fNodes[sel].divAxis > -1) {
+      const Node &node = fNodes[sel];
       int i;
-      int j = sel->divAxis;
+      int j = node.divAxis;
       double du = (u1[j] - u0[j]) / 3;
       if (j < fNfixed) {
          i = int((u[j] - u0[j]) / du);
       }
       else {
+         const Node *sub = &fNodes[node.subcell];
          for (i=0; i < 2; i++) {
-            if (ucell >= sel->subcell[i]->subset)
-               ucell -= sel->subcell[i]->subset;
+            if (ucell >= sub[i].subset)
+               ucell -= sub[i].subset;
             else
                break;
          }
@@ -240,31 +436,32 @@ AdaptiveSampler::Cell *AdaptiveSampler::findCell(double ucell,
       }
       u0[j] = u0[j] + du * i;
       u1[j] = u0[j] + du;
-      sel = sel->subcell[i];
+      sel = node.subcell + i;
    }
    return sel;
 }
 
-AdaptiveSampler::Cell *AdaptiveSampler::findCell(const double *u,
-                                                 int &depth,
-                                                 double *u0,
-                                                 double *u1) const
+int AdaptiveSampler::findCell(const double *u,
+                              int &depth,
+                              double *u0,
+                              double *u1) const
 {
    std::fill(u0, u0 + fNdim, 0);
    std::fill(u1, u1 + fNdim, 1);
    depth = 0;
-   Cell *sel = fTopCell;
-   while (sel->divAxis > -1) {
-      int j = sel->divAxis;
+   int sel = 0;
+   while (fNodes[sel].divAxis > -1) {
+      const Node &node = fNodes[sel];
+      int j = node.divAxis;
       double du = (u1[j] - u0[j]) / 3;
       int i = floor((u[j] - u0[j]) / du);
       i = (i < 0)? 0 : (i < 3)? i : 2;
       u0[j] = u0[j] + du * i;
       u1[j] = u0[j] + du;
-      if (sel->subcell[i] == 0) {
+      if (node.subcell == 0) {
          std::cerr << "bad romans!" << std::endl;
       }
-      sel = sel->subcell[i];
+      sel = node.subcell + i;
       if (j >= fNfixed)
          ++depth;
    }
@@ -274,33 +471,182 @@ AdaptiveSampler::Cell *AdaptiveSampler::findCell(const double *u,
 void AdaptiveSampler::feedback(const double *u, double wI)
 {
    int depth;
-   double *u0 = new double[fNdim];
-   double *u1 = new double[fNdim];
-   Cell *cell = findCell(u, depth, u0, u1);
-   cell->nhit += 1;
-   cell->sum_wI += wI;
+   double ubuf[2 * MAX_STACK_NDIM];
+   double *u0 = (fNdim > MAX_STACK_NDIM)? new double[2 * fNdim] : ubuf;
+   double *u1 = u0 + fNdim;
+   int cell = findCell(u, depth, u0, u1);
+   Stats &stats = fStats[cell];
+   stats.nhit += 1;
+   stats.sum_wI += wI;
    double wI2 = wI*wI;
-   cell->sum_wI2 += wI2;
-   cell->sum_wI4 += wI2*wI2;
+   stats.sum_wI2 += wI2;
+   stats.sum_wI4 += wI2*wI2;
+   double *cell_wI2d = sum_wI2d(cell);
+   double *cell_wI4d = sum_wI4d(cell);
    for (int n=0; n < fNdim; ++n) {
       double du = (u1[n] - u0[n]) / 3;
       int s = (u[n] - u0[n]) / du;
       assert (s >= 0 && s < 3);
-      cell->sum_wI2d[3*n+s] += wI2;
-      cell->sum_wI4d[3*n+s] += wI2*wI2;
+      cell_wI2d[3*n+s] += wI2;
+      cell_wI4d[3*n+s] += wI2*wI2;
    }
-   delete [] u0;
-   delete [] u1;
+   if (u0 != ubuf)
+      delete [] u0;
+}
+
+int AdaptiveSampler::sample(int n, double *u, double *w, int *cells)
+{
+   // Batch form of sample(u) that generates n points at once. The
+   // points are stored consecutively in u[n*fNdim], with the first
+   // fNfixed elements of each point supplied by the caller as input.
+   // The weights are returned in w[n], and if cells is not null the
+   // index of the leaf cell containing each point in cells[n]. The
+   // random numbers for all n points are drawn from the user generator
+   // in a single call, in the same order that n successive calls to
+   // sample(u) would consume them. Return value is n.
+
+   int nrand = fNdim - fNfixed + 1;
+   std::vector<double> randoms(n * nrand);
+   if (n > 0)
+      (*fRandom)(n * nrand, &randoms[0]);
+   double ubuf[3 * MAX_STACK_NDIM];
+   double *u0 = (fNdim > MAX_STACK_NDIM)? new double[3 * fNdim] : ubuf;
+   double *u1 = u0 + fNdim;
+   double *dNu = u1 + fNdim;
+   int ndNu = (fNdim > MAX_STACK_NDIM)? fNdim : MAX_STACK_NDIM;
+   for (int depth=0; depth < ndNu; ++depth)
+      dNu[depth] = (depth > 0)? pow(1/3., depth) : 1;
+   for (int k=0; k < n; ++k) {
+      double *uk = u + k * fNdim;
+      const double *rk = &randoms[k * nrand];
+      for (int i=0; i < fNfixed; ++i) {
+         if (uk[i] < 0 || uk[i] >= 1) {
+            std::cerr << "AdaptiveSampler::sample error - "
+                      << "fixed parameter " << i  << " is "
+                      << "outside the allowed interval [0,1), "
+                      << "value is " << uk[i] << std::endl;
+            uk[i] = 0;
+         }
+      }
+      int depth;
+      int cell = findCell(rk[nrand - 1], depth, u0, u1, uk);
+      for (int i=fNfixed; i < fNdim; ++i) {
+         double r = rk[i - fNfixed];
+         uk[i] = r * u0[i] + (1 - r) * u1[i];
+      }
+      double dN = (depth < ndNu)? dNu[depth] : pow(1/3., depth);
+      w[k] = dN / fNodes[cell].subset;
+      if (cells)
+         cells[k] = cell;
+   }
+   if (u0 != ubuf)
+      delete [] u0;
+   return n;
+}
+
+void AdaptiveSampler::findBounds(int cell, double *u0, double *u1) const
+{
+   // Reconstruct the bounds of a cell by walking up to the top of the
+   // tree and then replaying the splits on the way back down, with the
+   // same arithmetic as findCell so that the bounds agree exactly.
+
+   int path[256];
+   std::vector<int> longpath;
+   int depth = 0;
+   for (int here=cell; fStats[here].super > -1; here=fStats[here].super) {
+      if (depth < 256)
+         path[depth] = here;
+      else
+         longpath.push_back(here);
+      ++depth;
+   }
+   std::fill(u0, u0 + fNdim, 0);
+   std::fill(u1, u1 + fNdim, 1);
+   for (int d=depth-1; d >= 0; --d) {
+      int here = (d < 256)? path[d] : longpath[d - 256];
+      int super = fStats[here].super;
+      int j = fNodes[super].divAxis;
+      int i = here - fNodes[super].subcell;
+      double du = (u1[j] - u0[j]) / 3;
+      u0[j] = u0[j] + du * i;
+      u1[j] = u0[j] + du;
+   }
+}
+
+void AdaptiveSampler::feedback(int n, const double *u, const double *wI,
+                               const int *cells)
+{
+   // Batch form of feedback(u, wI) for n points stored consecutively
+   // in u[n*fNdim], with integrand values wI[n]. If cells is supplied,
+   // it should contain the cell indices returned by the batch sample()
+   // that generated these points. The points are then grouped by cell
+   // so that the cell bounds are found only once per group instead of
+   // by a full descent of the tree for every point. Indices that no
+   // longer refer to a leaf, because the tree has changed since the
+   // points were generated, fall back to the per-point descent.
+   // The statistics accumulated are identical to those from n calls
+   // to feedback(u, wI) in the same order.
+
+   double ubuf[2 * MAX_STACK_NDIM];
+   double *u0 = (fNdim > MAX_STACK_NDIM)? new double[2 * fNdim] : ubuf;
+   double *u1 = u0 + fNdim;
+   std::vector<int> order;
+   if (cells) {
+      order.resize(n);
+      for (int k=0; k < n; ++k)
+         order[k] = k;
+      std::stable_sort(order.begin(), order.end(),
+                       [cells](int a, int b) { return cells[a] < cells[b]; });
+   }
+   int ncells = fNodes.size();
+   int bounds_cell = -1;
+   for (int m=0; m < n; ++m) {
+      int k = (cells)? order[m] : m;
+      const double *uk = u + k * fNdim;
+      int cell;
+      if (cells && cells[k] >= 0 && cells[k] < ncells &&
+          fNodes[cells[k]].divAxis == -1)
+      {
+         cell = cells[k];
+         if (cell != bounds_cell) {
+            findBounds(cell, u0, u1);
+            bounds_cell = cell;
+         }
+      }
+      else {
+         int depth;
+         cell = findCell(uk, depth, u0, u1);
+         bounds_cell = -1;
+      }
+      Stats &stats = fStats[cell];
+      stats.nhit += 1;
+      stats.sum_wI += wI[k];
+      double wI2 = wI[k]*wI[k];
+      stats.sum_wI2 += wI2;
+      stats.sum_wI4 += wI2*wI2;
+      double *cell_wI2d = sum_wI2d(cell);
+      double *cell_wI4d = sum_wI4d(cell);
+      for (int i=0; i < fNdim; ++i) {
+         double du = (u1[i] - u0[i]) / 3;
+         int s = (uk[i] - u0[i]) / du;
+         assert (s >= 0 && s < 3);
+         cell_wI2d[3*i+s] += wI2;
+         cell_wI4d[3*i+s] += wI2*wI2;
+      }
+   }
+   if (u0 != ubuf)
+      delete [] u0;
 }
 
 int AdaptiveSampler::adapt()
 {
-   int ncells = fTopCell->sum_stats();
-   std::cout << "starting sum_wI2 is " << fTopCell->sum_wI2 << std::endl;
-   double sum_wI2_target = pow(fTopCell->sum_wI, 2) / 
-                              (fTopCell->nhit * fEfficiency_target);
-   double sum_wI2_error = sqrt(fTopCell->sum_wI4) + 1e-99;
-   double gain_sig = (fTopCell->sum_wI2 - sum_wI2_target) / sum_wI2_error;
+   int ncells = sum_stats();
+   const Stats &top = fStats[0];
+   std::cout << "starting sum_wI2 is " << top.sum_wI2 << std::endl;
+   double sum_wI2_target = pow(top.sum_wI, 2) / 
+                              (top.nhit * fEfficiency_target);
+   double sum_wI2_error = sqrt(top.sum_wI4) + 1e-99;
+   double gain_sig = (top.sum_wI2 - sum_wI2_target) / sum_wI2_error;
    if (gain_sig > 3) {
       if (verbosity > 0)
          std::cout << "adapt - sample statistics indicate that significant"
@@ -320,13 +666,12 @@ int AdaptiveSampler::adapt()
    }
    std::cout << "Looking for cells containing at least " 
              << fSampling_threshold * 100 << "% of the total "
-             << "sample sum_wI2 = " << fTopCell->sum_wI2
+             << "sample sum_wI2 = " << top.sum_wI2
              << std::endl;
 
-   fMinimum_sum_wI2_delta = (fTopCell->sum_wI2 - sum_wI2_target) / 
+   fMinimum_sum_wI2_delta = (top.sum_wI2 - sum_wI2_target) / 
                             (fMaximum_cells - ncells);
-   std::vector<int> cellIndex;
-   int newcells = recursively_update(cellIndex);
+   int newcells = update_tree();
    if (verbosity > 0) {
       if (newcells) {
          if (verbosity > 0)
@@ -346,189 +691,324 @@ int AdaptiveSampler::adapt()
                 << ", new value predicted to be " << getEfficiency(true)
                 << std::endl;
    }
-   std::cout << "optimized sum_wI2 is " << fTopCell->opt_wI2 << std::endl;
+   std::cout << "optimized sum_wI2 is " << fStats[0].opt_wI2 << std::endl;
    return newcells;
 }
 
-int AdaptiveSampler::recursively_update(std::vector<int> index)
+int AdaptiveSampler::evaluate_split(int cell, int depth,
+                                    double top_sum_wI2) const
 {
-   Cell *cell = fTopCell;
-   unsigned int depth;
-   std::stringstream cellpath;
-   for (depth=0; depth < index.size(); ++depth) {
-      cellpath << "/" << cell->divAxis << ":" << index[depth];
-      cell = cell->subcell[index[depth]];
-   }
+   // This is the adaptation algorithm: all of the power
+   // of AdaptiveSampler lies in this little bit of code.
+   // Decide whether leaf cell at the given depth should be split, and
+   // return the best axis to split it along, or one of the negative
+   // split_verdict_t codes saying why not. This only reads the tree,
+   // so it can be called concurrently for different cells.
 
-   int count = 0;
+   const Stats &stats = fStats[cell];
    double efficiency = 0;
-   if (cell->nhit > 0 && cell->sum_wI2 > 0) {
-      efficiency = pow(cell->sum_wI, 2) / (cell->nhit * cell->sum_wI2);
+   if (stats.nhit > 0 && stats.sum_wI2 > 0) {
+      efficiency = pow(stats.sum_wI, 2) / (stats.nhit * stats.sum_wI2);
+   }
+   if (stats.sum_wI2 > fSampling_threshold * top_sum_wI2 &&
+       efficiency < fEfficiency_target &&
+       (unsigned int)depth < fMaximum_depth)
+   {
+      const double *cell_wI2d = &fSums[cell * 6 * fNdim];
+      int best_axis = -1;
+      double best_sum_wI2 = 1e99;
+      for (int n=0; n < fNdim; ++n) {
+         double sum_wI2 = pow(sqrt(cell_wI2d[3*n]) +
+                              sqrt(cell_wI2d[3*n+1]) +
+                              sqrt(cell_wI2d[3*n+2]), 2) / 3;
+         if (sum_wI2 < best_sum_wI2) {
+            best_sum_wI2 = sum_wI2;
+            best_axis = n;
+         }
+      }
+      if (best_sum_wI2 > stats.sum_wI2)
+         return SPLIT_INCONSISTENT;
+      else if (stats.sum_wI2 - best_sum_wI2 > fMinimum_sum_wI2_delta)
+         return (best_sum_wI2 > 0)? best_axis : SPLIT_NO_STATISTICS;
+      else
+         return SPLIT_BELOW_DELTA;
+   }
+   else if (stats.sum_wI2 < fSampling_threshold * top_sum_wI2) {
+      return SPLIT_BELOW_THRESHOLD;
+   }
+   else if (efficiency >= fEfficiency_target) {
+      return SPLIT_EFFICIENT;
+   }
+   return SPLIT_MAXIMUM_DEPTH;
+}
+
+int AdaptiveSampler::update_tree()
+{
+   // Visit every leaf of the tree in depth-first order, and split the
+   // ones that pass the criteria in evaluate_split(). The split decisions
+   // depend only on the statistics of each leaf and on the totals for
+   // the whole tree, so they are evaluated for all leaves in parallel
+   // by fAdaptation_threads threads, and stored by leaf. The splits are
+   // then applied by a single thread in the depth-first order, so the
+   // new tree is exactly the same regardless of the number of threads.
+
+   std::vector<int> leaves;
+   std::vector<int> depths;
+   std::vector<int> stack(1, 0);
+   std::vector<int> stack_depth(1, 0);
+   while (stack.size() > 0) {
+      int cell = stack.back();
+      int depth = stack_depth.back();
+      stack.pop_back();
+      stack_depth.pop_back();
+      if (fNodes[cell].divAxis < 0) {
+         leaves.push_back(cell);
+         depths.push_back(depth);
+      }
+      else {
+         for (int i=2; i >= 0; --i) {
+            stack.push_back(fNodes[cell].subcell + i);
+            stack_depth.push_back(depth + 1);
+         }
+      }
    }
-   if (cell->divAxis < 0) {
 
-      // This is the adaptation algorithm: all of the power
-      // of AdaptiveSampler lies in this little bit of code.
+   auto start_time = std::chrono::steady_clock::now();
+   int nleaves = leaves.size();
+   int nthreads = fAdaptation_threads;
+   if (nthreads > nleaves / ADAPT_CHUNK_SIZE + 1)
+      nthreads = nleaves / ADAPT_CHUNK_SIZE + 1;
+   const double top_sum_wI2 = fStats[0].sum_wI2;
+   std::vector<int> verdict(nleaves);
+   std::atomic<int> next_chunk(0);
+   std::atomic<int> leaves_done(0);
+   auto worker = [&](bool report) {
+      // progress is only worth reporting for really big trees
+      report = report && (nleaves > 10 * ADAPT_CHUNK_SIZE);
+      int next_report = nleaves / 10;
+      while (true) {
+         int first = ADAPT_CHUNK_SIZE * next_chunk.fetch_add(1);
+         if (first >= nleaves)
+            break;
+         int last = std::min(first + ADAPT_CHUNK_SIZE, nleaves);
+         for (int n=first; n < last; ++n) {
+            verdict[n] = evaluate_split(leaves[n], depths[n], top_sum_wI2);
+         }
+         int done = (leaves_done += last - first);
+         if (report && done >= next_report && verbosity > 1) {
+            std::cout << "adapt - checked " << done << " of " << nleaves
+                      << " cells" << std::endl;
+            next_report = done + nleaves / 10;
+         }
+      }
+   };
+   std::vector<std::thread> threads;
+   for (int i=1; i < nthreads; ++i)
+      threads.push_back(std::thread(worker, false));
+   worker(true);
+   for (unsigned int i=0; i < threads.size(); ++i)
+      threads[i].join();
+   auto check_time = std::chrono::steady_clock::now();
 
+   int count = 0;
+   for (int n=0; n < nleaves; ++n) {
+      int cell = leaves[n];
+      const Stats stats = fStats[cell];
       if (verbosity > 3) {
-         std::cout << "checking if we should partition " << cellpath.str()
-                   << " with sum_wI2=" << cell->sum_wI2
-                   << " +/- " << sqrt(cell->sum_wI4)
+         std::cout << "checking if we should partition " << cellpath(cell)
+                   << " with sum_wI2=" << stats.sum_wI2
+                   << " +/- " << sqrt(stats.sum_wI4)
                    << std::endl;
-      }
-      if (cell->sum_wI2 > fSampling_threshold * fTopCell->sum_wI2 &&
-          efficiency < fEfficiency_target &&
-          depth < fMaximum_depth)
-      {
-         if (verbosity > 3) {
-            std::cout << "checking if to split at cell " << depth
-                      << " with sum_wI2 = " << cell->sum_wI2
-                      << " +/- " << sqrt(cell->sum_wI4)
+         if (verdict[n] >= 0 || verdict[n] == SPLIT_INCONSISTENT ||
+             verdict[n] == SPLIT_NO_STATISTICS ||
+             verdict[n] == SPLIT_BELOW_DELTA)
+         {
+            std::cout << "checking if to split at cell " << depths[n]
+                      << " with sum_wI2 = " << stats.sum_wI2
+                      << " +/- " << sqrt(stats.sum_wI4)
                       << " with fMinimum_sum_wI2_delta = "
                       << fMinimum_sum_wI2_delta
                       << std::endl;
          }
-         int best_axis = -1;
-         double best_sum_wI2 = 1e99;
-         for (int n=0; n < fNdim; ++n) {
-            double sum_wI2 = pow(sqrt(cell->sum_wI2d[3*n]) +
-                                 sqrt(cell->sum_wI2d[3*n+1]) +
-                                 sqrt(cell->sum_wI2d[3*n+2]), 2) / 3;
-            if (sum_wI2 < best_sum_wI2) {
-               best_sum_wI2 = sum_wI2;
-               best_axis = n;
-            }
-         }
-         if (best_sum_wI2 > cell->sum_wI2) {
-            std::cerr << "AdaptiveSampler::recursive_update error - "
-                      << "best_sum_wI2 > sum_wI2, this cannot be!"
-                      << std::endl;
-            exit(7);
-         }
-         else if (cell->sum_wI2 - best_sum_wI2 > fMinimum_sum_wI2_delta) {
-            if (best_sum_wI2 > 0) {
-               cell->divAxis = best_axis;
-               for (int s=0; s < 3; ++s) {
-                  cell->subcell[s] = new Cell(fNdim, fNfixed);
-                  cell->subcell[s]->nhit = cell->nhit / 3;
-                  cell->subcell[s]->sum_wI = cell->sum_wI / 3;
-                  cell->subcell[s]->sum_wI2 = cell->sum_wI2d[3*best_axis + s];
-                  cell->subcell[s]->sum_wI4 = cell->sum_wI4d[3*best_axis + s];
-                  cell->subcell[s]->subset = (best_axis < fNfixed)?
-                                             cell->subset : cell->subset / 3;
-               }
-               if (verbosity > 2) {
-                  std::cout << "splitting this cell[";
-                  for (unsigned int i=0; i < depth; i++) {
-                     std::cout << ((i > 0)? "," : "") << index[i];
-                  }
-                  std::cout << "] along axis " << best_axis << std::endl;
-               }
-               count += 1;
-            }
-            else {
-               if (verbosity > 3) {
-                  std::cout << "nope, missing statistics to find best axis!"
-                            << std::endl;
-               }
-            }
+      }
+      if (verdict[n] >= 0) {
+         int best_axis = verdict[n];
+         int first = new_subcells(cell);
+         fNodes[cell].divAxis = best_axis;
+         for (int s=0; s < 3; ++s) {
+            Stats &sub = fStats[first + s];
+            sub.nhit = stats.nhit / 3;
+            sub.sum_wI = stats.sum_wI / 3;
+            sub.sum_wI2 = sum_wI2d(cell)[3*best_axis + s];
+            sub.sum_wI4 = sum_wI4d(cell)[3*best_axis + s];
+            fNodes[first + s].subset = (best_axis < fNfixed)?
+                                       fNodes[cell].subset :
+                                       fNodes[cell].subset / 3;
          }
-         else {
-            if (verbosity > 3) {
-               std::cout << "nope, fails to make the threshold!" << std::endl;
+         if (verbosity > 2) {
+            std::string id = address(cell).substr(1);
+            std::cout << "splitting this cell[";
+            for (unsigned int i=0; i < id.size(); i++) {
+               std::cout << ((i > 0)? "," : "") << id[i];
             }
+            std::cout << "] along axis " << best_axis << std::endl;
          }
+         count += 1;
       }
-      else if (cell->sum_wI2 < fSampling_threshold * fTopCell->sum_wI2) {
-         if (verbosity > 3) {
+      else if (verdict[n] == SPLIT_INCONSISTENT) {
+         std::cerr << "AdaptiveSampler::recursive_update error - "
+                   << "best_sum_wI2 > sum_wI2, this cannot be!"
+                   << std::endl;
+         exit(7);
+      }
+      else if (verbosity > 3) {
+         if (verdict[n] == SPLIT_NO_STATISTICS)
+            std::cout << "nope, missing statistics to find best axis!"
+                      << std::endl;
+         else if (verdict[n] == SPLIT_BELOW_DELTA)
+            std::cout << "nope, fails to make the threshold!" << std::endl;
+         else if (verdict[n] == SPLIT_BELOW_THRESHOLD)
             std::cout << "nope, fails the statistical significance test!"
                       << std::endl;
-         }
-      }
-      else if (efficiency >= fEfficiency_target) {
-         if (verbosity > 3) {
-            std::cout << "nope, efficiency is " << efficiency
+         else if (verdict[n] == SPLIT_EFFICIENT)
+            std::cout << "nope, efficiency is "
+                      << pow(stats.sum_wI, 2) / (stats.nhit * stats.sum_wI2)
                       << ", already meets the target value!"
                       << std::endl;
-         }
-      }
-      else {
-         if (verbosity > 3) {
+         else
             std::cout << "nope, this cell cannot be split any further!"
                       << std::endl;
-         }
       }
    }
-   else {
-      index.push_back(0);
-      for (int i=0; i < 3; ++i) {
-         index[depth] = i;
-         count += recursively_update(index);
-      }
-      index.pop_back();
+   auto end_time = std::chrono::steady_clock::now();
+   if (verbosity > 1) {
+      std::chrono::duration<double> tcheck = check_time - start_time;
+      std::chrono::duration<double> tsplit = end_time - check_time;
+      std::cout << "adapt - checked " << nleaves << " cells in "
+                << tcheck.count() << " s using " << nthreads
+                << ((nthreads > 1)? " threads" : " thread")
+                << ", applied " << count << " splits in "
+                << tsplit.count() << " s" << std::endl;
    }
    return count;
 }
 
+std::string AdaptiveSampler::cellpath(int cell) const
+{
+   // Return the path to cell from the top of the tree, in the form
+   // /axis:index/axis:index/... used in the adapt() diagnostics.
+
+   std::string path;
+   for (int here=cell; fStats[here].super > -1; here=fStats[here].super) {
+      int super = fStats[here].super;
+      path.insert(0, "/" + std::to_string(fNodes[super].divAxis) + ":" +
+                  std::to_string(here - fNodes[super].subcell));
+   }
+   return path;
+}
+
 void AdaptiveSampler::reset_stats()
 {
-   fTopCell->reset_stats();
+   for (unsigned int cell=0; cell < fStats.size(); ++cell) {
+      Stats &stats = fStats[cell];
+      stats.nhit = 0;
+      stats.sum_wI = 0;
+      stats.sum_wI2 = 0;
+      stats.sum_wI4 = 0;
+      stats.sum_wI2s = 0;
+   }
+   std::fill(fSums.begin(), fSums.end(), 0);
+}
+
+int AdaptiveSampler::sum_stats() const
+{
+   // Accumulate the statistics of every split cell from its subcells,
+   // and return the total number of cells in the tree. Subcells always
+   // have higher indices than their parent, so a single sweep through
+   // the arena from the end towards the top cell visits every subcell
+   // before its parent, without any recursion.
+
+   for (int cell = fNodes.size() - 1; cell >= 0; --cell) {
+      const Node &node = fNodes[cell];
+      Stats &stats = fStats[cell];
+      if (node.divAxis > -1) {
+         stats.nhit = 0;
+         stats.sum_wI = 0;
+         stats.sum_wI2 = 0;
+         stats.sum_wI4 = 0;
+         stats.sum_wI2s = 0;
+         for (int n=0; n < 3; ++n) {
+            const Stats &sub = fStats[node.subcell + n];
+            stats.nhit += sub.nhit;
+            stats.sum_wI += sub.sum_wI;
+            stats.sum_wI2 += sub.sum_wI2;
+            stats.sum_wI4 += sub.sum_wI4;
+            stats.sum_wI2s += sub.sum_wI2s;
+         }
+      }
+      if (node.divAxis < fNfixed) {
+         stats.sum_wI2s = sqrt(stats.nhit * stats.sum_wI2);
+      }
+   }
+   return fNodes.size();
 }
 
 long int AdaptiveSampler::getNsample() const
 {
-   fTopCell->sum_stats();
-   return fTopCell->nhit;
+   sum_stats();
+   return fStats[0].nhit;
 }
 
 double AdaptiveSampler::getWItotal() const
 {
-   fTopCell->sum_stats();
-   return fTopCell->sum_wI;
+   sum_stats();
+   return fStats[0].sum_wI;
 }
 
 double AdaptiveSampler::getWI2total(bool optimized)
 {
-   fTopCell->sum_stats();
+   sum_stats();
    if (optimized) {
       optimize_tree();
-      return fTopCell->opt_wI2;
+      return fStats[0].opt_wI2;
    }
-   return fTopCell->sum_wI2;
+   return fStats[0].sum_wI2;
 }
 
 double AdaptiveSampler::getEfficiency(bool optimized)
 {
-   fTopCell->sum_stats();
-   if (fTopCell->nhit == 0)
+   sum_stats();
+   const Stats &top = fStats[0];
+   if (top.nhit == 0)
       return 0;
    else if (optimized) {
       optimize_tree();
-      return pow(fTopCell->sum_wI, 2) / 
-             (fTopCell->opt_wI2 * fTopCell->opt_nhit + 1e-99);
+      return pow(top.sum_wI, 2) / 
+             (top.opt_wI2 * top.opt_nhit + 1e-99);
    }
-   return pow(fTopCell->sum_wI, 2) / 
-          (fTopCell->sum_wI2 * fTopCell->nhit);
+   return pow(top.sum_wI, 2) / 
+          (top.sum_wI2 * top.nhit);
 }
 
 double AdaptiveSampler::getResult(double *error,
                                   double *error_uncertainty)
 {
-   fTopCell->sum_stats();
-   double eff = pow(fTopCell->sum_wI, 2) /
-                   (fTopCell->sum_wI2 * fTopCell->nhit);
-   double result = (eff > 0)? fTopCell->sum_wI / fTopCell->nhit : 0;
+   sum_stats();
+   const Stats &top = fStats[0];
+   double eff = pow(top.sum_wI, 2) /
+                   (top.sum_wI2 * top.nhit);
+   double result = (eff > 0)? top.sum_wI / top.nhit : 0;
    if (error) {
       if (eff > 0)
-         *error = sqrt((1 - eff) * fTopCell->sum_wI2) / fTopCell->nhit;
+         *error = sqrt((1 - eff) * top.sum_wI2) / top.nhit;
       else
          *error = 0;
    }
     
    if (error_uncertainty) {
      if (eff > 0)
-         *error_uncertainty = sqrt((1 - eff) / fTopCell->sum_wI2) / 2 *
-                              sqrt(fTopCell->sum_wI4) / fTopCell->nhit;
+         *error_uncertainty = sqrt((1 - eff) / top.sum_wI2) / 2 *
+                              sqrt(top.sum_wI4) / top.nhit;
      else
          *error_uncertainty = 0;
    }
@@ -538,23 +1018,24 @@ double AdaptiveSampler::getResult(double *error,
 double AdaptiveSampler::getReweighted(double *error,
                                       double *error_uncertainty)
 {
-   fTopCell->sum_stats();
+   sum_stats();
    optimize_tree();
-   double eff = pow(fTopCell->sum_wI, 2) / 
-                (fTopCell->opt_wI2 * fTopCell->opt_nhit + 1e-99);
-   double result = (eff > 0)? fTopCell->sum_wI / fTopCell->opt_nhit : 0;
+   const Stats &top = fStats[0];
+   double eff = pow(top.sum_wI, 2) / 
+                (top.opt_wI2 * top.opt_nhit + 1e-99);
+   double result = (eff > 0)? top.sum_wI / top.opt_nhit : 0;
    if (error) {
       if (eff > 0)
-         *error = sqrt((1 - eff) * fTopCell->opt_wI2) / 
-                  (fTopCell->opt_nhit + 1e-99);
+         *error = sqrt((1 - eff) * top.opt_wI2) / 
+                  (top.opt_nhit + 1e-99);
       else
          *error = 0;
    }
    if (error_uncertainty) {
       if (eff > 0)
-         *error_uncertainty = sqrt((1 - eff) / fTopCell->opt_wI2) / 2 *
-                              sqrt(fTopCell->opt_wI4) /
-                              (fTopCell->opt_nhit + 1e-99);
+         *error_uncertainty = sqrt((1 - eff) / top.opt_wI2) / 2 *
+                              sqrt(top.opt_wI4) /
+                              (top.opt_nhit + 1e-99);
       else
          *error_uncertainty = 0;
    }
@@ -573,7 +1054,7 @@ int AdaptiveSampler::getNfixed() const
 
 int AdaptiveSampler::getNcells() const
 {
-   return fTopCell->sum_stats();
+   return sum_stats();
 }
 
 void AdaptiveSampler::setAdaptation_sampling_threshold(double threshold)
@@ -616,13 +1097,23 @@ int AdaptiveSampler::getAdaptation_maximum_cells() const
    return fMaximum_cells;
 }
 
+void AdaptiveSampler::setAdaptation_threads(int nthreads)
+{
+   fAdaptation_threads = (nthreads > 0)? nthreads : 1;
+}
+
+int AdaptiveSampler::getAdaptation_threads() const
+{
+   return fAdaptation_threads;
+}
+
 void AdaptiveSampler::optimize_tree()
 {
-   fTopCell->sum_stats();
-   if (fTopCell->sum_wI > 0) {
-      fTopCell->opt_nhit = fTopCell->nhit;
-      fTopCell->opt_subset = 1;
-      fTopCell->optimize();
+   sum_stats();
+   if (fStats[0].sum_wI > 0) {
+      fStats[0].opt_nhit = fStats[0].nhit;
+      fStats[0].opt_subset = 1;
+      optimize();
    }
 }
 
@@ -632,17 +1123,19 @@ void AdaptiveSampler::display_tree(bool optimized)
    double *u1 = new double[fNdim];
    std::fill(u0, u0 + fNdim, 0);
    std::fill(u1, u1 + fNdim, 1);
-   display_tree(fTopCell, 1, "o", u0, u1, optimized);
+   display_tree(0, 1, "o", u0, u1, optimized);
    delete [] u0;
    delete [] u1;
 }
 
-double AdaptiveSampler::display_tree(Cell *cell, double subset, std::string id,
+double AdaptiveSampler::display_tree(int cell, double subset, std::string id,
                                      double *u0, double *u1, bool optimized)
 {
    char numeric[80];
    std::cout << id << ": ";
-   double cell_subset = (optimized)? cell->opt_subset : cell->subset;
+   const Node &node = fNodes[cell];
+   const Stats &stats = fStats[cell];
+   double cell_subset = (optimized)? stats.opt_subset : node.subset;
    snprintf(numeric, 80, "%9.5e", cell_subset);
    std::cout << numeric;
    if (cell_subset > subset * 0.9995) {
@@ -653,28 +1146,28 @@ double AdaptiveSampler::display_tree(Cell *cell, double subset, std::string id,
       std::cout << numeric;
    }
 
-   if (cell->divAxis > -1) {
+   if (node.divAxis > -1) {
       double ssum = 0;
-      double u0m = u0[cell->divAxis];
-      double u1m = u1[cell->divAxis];
+      double u0m = u0[node.divAxis];
+      double u1m = u1[node.divAxis];
       double du = (u1m - u0m) / 3.;
       snprintf(numeric, 80, " [%15.13f,%15.13f] ", u0m, u1m);
-      std::cout << " split along axis " << cell->divAxis << numeric;
+      std::cout << " split along axis " << node.divAxis << numeric;
       double dlev = -log(du) / log(3.);
       snprintf(numeric, 80, " (1/3^%d) ", int(dlev));
       std::cout << numeric;
-      std::cout << ((optimized)? cell->opt_nhit : cell->nhit)
-                << " " << cell->sum_wI
-                << " " << ((optimized)? cell->opt_wI2 : cell->sum_wI2)
-                << " " << ((optimized)? cell->opt_wI4 : cell->sum_wI4)
+      std::cout << ((optimized)? stats.opt_nhit : stats.nhit)
+                << " " << stats.sum_wI
+                << " " << ((optimized)? stats.opt_wI2 : stats.sum_wI2)
+                << " " << ((optimized)? stats.opt_wI4 : stats.sum_wI4)
                 << std::endl;
       for (int n=0; n < 3; ++n) {
-         u0[cell->divAxis] = u0m + du * n;
-         u1[cell->divAxis] = u0m + du * (n + 1);
-         ssum += display_tree(cell->subcell[n], cell_subset, 
+         u0[node.divAxis] = u0m + du * n;
+         u1[node.divAxis] = u0m + du * (n + 1);
+         ssum += display_tree(node.subcell + n, cell_subset, 
                               id + std::to_string(n), u0, u1, optimized);
       }
-      ssum /= (cell->divAxis < fNfixed)? 3 : 1;
+      ssum /= (node.divAxis < fNfixed)? 3 : 1;
       if (fabs(ssum - cell_subset) > 1e-15 * cell_subset) {
          std::cerr << "Error in AdaptiveSampler::display_tree - "
                    << "subcell subsets fail to obey the sum rule, "
@@ -684,21 +1177,25 @@ double AdaptiveSampler::display_tree(Cell *cell, double subset, std::string id,
                    << "   difference = " << ssum - cell_subset
                    << std::endl;
       }
-      u0[cell->divAxis] = u0m;
-      u1[cell->divAxis] = u1m;
+      u0[node.divAxis] = u0m;
+      u1[node.divAxis] = u1m;
    }
    else {
-      std::cout << ((optimized)? cell->opt_nhit : cell->nhit )
-                << " " << cell->sum_wI
-                << " " << ((optimized)? cell->opt_wI2 : cell->sum_wI2)
-                << " " << ((optimized)? cell->opt_wI4 : cell->sum_wI4)
+      std::cout << ((optimized)? stats.opt_nhit : stats.nhit )
+                << " " << stats.sum_wI
+                << " " << ((optimized)? stats.opt_wI2 : stats.sum_wI2)
+                << " " << ((optimized)? stats.opt_wI4 : stats.sum_wI4)
                 << std::endl;
    }
    return cell_subset;
 }
 
-int AdaptiveSampler::saveState(const std::string filename, bool optimized) const
+
+int AdaptiveSampler::saveState(const std::string filename, bool optimized,
+                               state_format_t format) const
 {
+   if (format == BINARY_FORMAT)
+      return saveBinaryState(filename, optimized);
    std::ofstream fout(filename);
    fout << "fNdim=" << fNdim << std::endl;
    fout << "fNfixed=" << fNfixed << std::endl;
@@ -707,13 +1204,20 @@ int AdaptiveSampler::saveState(const std::string filename, bool optimized) const
    fout << "fMaximum_cells=" << fMaximum_cells << std::endl;
    fout << "fEfficiency_target=" << fEfficiency_target << std::endl;
    fout << "=" << std::endl;
-   int ncells = fTopCell->serialize(fout, optimized);
+   int ncells = serialize(fout, 0, optimized);
    return (ncells > 0);
 }
 
 int AdaptiveSampler::mergeState(const std::string filename)
 {
+   char magic[8] = "";
    std::ifstream fin(filename);
+   if (fin.read(magic, 8) && memcmp(magic, ASTATE_BINARY_MAGIC, 8) == 0) {
+      fin.close();
+      return mergeBinaryState(filename);
+   }
+   fin.clear();
+   fin.seekg(0);
    if (!fin.is_open()) {
 #ifdef EXTRA_ADAPTIVE_SAMPLER_WARNINGS
       std::cerr << "AdaptiveSampler::mergeState error - "
@@ -753,23 +1257,317 @@ int AdaptiveSampler::mergeState(const std::string filename)
                 << "required keyword missing in " << filename
                 << std::endl;
    }
-   int ncells = fTopCell->deserialize(fin);
+   int ncells = deserialize(fin, 0);
+   compact_tree();
    return (ncells > 0);
 }
 
-int AdaptiveSampler::restoreState(const std::string filename)
+int AdaptiveSampler::saveBinaryState(const std::string filename,
+                                     bool optimized) const
+{
+   // Write the state in the binary format described at the top of this
+   // file. The cell count and checksum are only known after the cells
+   // have been written, so they are filled into the header at the end.
+
+   std::ofstream fout(filename, std::ios::binary);
+   if (!fout.is_open()) {
+      std::cerr << "AdaptiveSampler::saveState error - "
+                << "unable to open " << filename << " for output."
+                << std::endl;
+      return 0;
+   }
+   uint64_t fixed_mask = 0;
+   for (int i=0; i < fNfixed && i < 64; ++i)
+      fixed_mask |= (1ULL << i);
+   unsigned char header[ASTATE_BINARY_HEADER_SIZE];
+   memset(header, 0, ASTATE_BINARY_HEADER_SIZE);
+   memcpy(header, ASTATE_BINARY_MAGIC, 8);
+   put_uint32(header + 8, ASTATE_BINARY_VERSION);
+   put_uint32(header + 12, ASTATE_BINARY_HEADER_SIZE);
+   put_uint32(header + 16, fNdim);
+   put_uint32(header + 20, fNfixed);
+   put_uint64(header + 24, fixed_mask);
+   put_uint32(header + 32, (optimized)? 1 : 0);
+   put_uint32(header + 36, fMaximum_depth);
+   put_uint32(header + 40, fMaximum_cells);
+   put_double(header + 48, fSampling_threshold);
+   put_double(header + 56, fEfficiency_target);
+   fout.write((const char*)header, ASTATE_BINARY_HEADER_SIZE);
+   unsigned long long int checksum = 14695981039346656037ULL;
+   int ncells = serialize_binary(fout, 0, optimized, checksum);
+   put_uint64(header + 64, ncells);
+   put_uint64(header + 72, checksum);
+   fout.seekp(64);
+   fout.write((const char*)header + 64, 16);
+   fout.close();
+   if (fout.fail()) {
+      std::cerr << "AdaptiveSampler::saveState error - "
+                << "write to " << filename << " failed."
+                << std::endl;
+      return 0;
+   }
+   return (ncells > 0);
+}
+
+int AdaptiveSampler::serialize_binary(std::ofstream &ofs, int cell,
+                                      bool optimized,
+                                      unsigned long long int &checksum) const
+{
+   const Node &node = fNodes[cell];
+   const Stats &stats = fStats[cell];
+   const double *sums = &fSums[cell * 6 * fNdim];
+   unsigned char rbuf[48 + 48 * MAX_STACK_NDIM];
+   unsigned int recsize = 48 + 48 * fNdim;
+   unsigned char *rec = (fNdim > MAX_STACK_NDIM)? 
+                        new unsigned char[recsize] : rbuf;
+   put_uint32(rec, node.divAxis);
+   put_uint32(rec + 4, 0);
+   put_uint64(rec + 8, stats.nhit);
+   put_double(rec + 16, std::isfinite(stats.sum_wI)? stats.sum_wI : 0);
+   put_double(rec + 24, std::isfinite(stats.sum_wI2)? stats.sum_wI2 : 0);
+   put_double(rec + 32, std::isfinite(stats.sum_wI4)? stats.sum_wI4 : 0);
+   put_double(rec + 40, (optimized)? stats.opt_subset : node.subset);
+   for (int i=0; i < 6*fNdim; ++i) {
+      put_double(rec + 48 + 8*i, std::isfinite(sums[i])? sums[i] : 0);
+   }
+   uint64_t sum = checksum;
+   update_checksum(sum, rec, recsize);
+   checksum = sum;
+   ofs.write((const char*)rec, recsize);
+   if (rec != rbuf)
+      delete [] rec;
+   int count = 1;
+   if (node.divAxis > -1) {
+      count += serialize_binary(ofs, node.subcell, optimized, checksum);
+      count += serialize_binary(ofs, node.subcell + 1, optimized, checksum);
+      count += serialize_binary(ofs, node.subcell + 2, optimized, checksum);
+   }
+   return count;
+}
+
+int AdaptiveSampler::mergeBinaryState(const std::string filename)
+{
+   // Merge the state from a file in the binary format, read through a
+   // read-only memory map. The header and checksum are verified before
+   // anything is merged, so a damaged file leaves the sampler unchanged.
+
+   int fd = open(filename.c_str(), O_RDONLY);
+   if (fd < 0) {
+      return 0;
+   }
+   struct stat st;
+   if (fstat(fd, &st) != 0 || st.st_size < ASTATE_BINARY_HEADER_SIZE) {
+      std::cerr << "AdaptiveSampler::mergeState error - "
+                << "binary state file " << filename << " is truncated."
+                << std::endl;
+      close(fd);
+      return 0;
+   }
+   size_t fsize = st.st_size;
+   void *map = mmap(0, fsize, PROT_READ, MAP_PRIVATE, fd, 0);
+   close(fd);
+   if (map == MAP_FAILED) {
+      std::cerr << "AdaptiveSampler::mergeState error - "
+                << "unable to map " << filename << " for input."
+                << std::endl;
+      return 0;
+   }
+   const unsigned char *header = (const unsigned char*)map;
+   const unsigned char *end = header + fsize;
+   uint32_t version = get_uint32(header + 8);
+   uint32_t header_size = get_uint32(header + 12);
+   int ndim = get_uint32(header + 16);
+   int nfixed = get_uint32(header + 20);
+   uint64_t fixed_mask = get_uint64(header + 24);
+   uint64_t ncells = get_uint64(header + 64);
+   uint64_t checksum = get_uint64(header + 72);
+   uint64_t expected_mask = 0;
+   for (int i=0; i < nfixed && i < 64; ++i)
+      expected_mask |= (1ULL << i);
+   size_t recsize = 48 + 48 * ndim;
+   int ncount = 0;
+   if (version != ASTATE_BINARY_VERSION || 
+       header_size != ASTATE_BINARY_HEADER_SIZE)
+   {
+      std::cerr << "AdaptiveSampler::mergeState error - "
+                << "binary state file " << filename
+                << " has unsupported format version " << version
+                << std::endl;
+   }
+   else if (ndim != fNdim) {
+      std::cerr << "AdaptiveSampler::mergeState error - "
+                << "cannot merge with state saved in " << filename
+                << " because they have different dimensions,"
+                << " this Ndim=" << fNdim << ", file Ndim=" << ndim
+                << std::endl;
+   }
+   else if (fixed_mask != expected_mask) {
+      std::cerr << "AdaptiveSampler::mergeState error - "
+                << "binary state file " << filename
+                << " has an inconsistent fixed dimension mask."
+                << std::endl;
+   }
+   else if (ncells == 0 || ncells > (fsize - header_size) / recsize ||
+            header_size + ncells * recsize != fsize)
+   {
+      std::cerr << "AdaptiveSampler::mergeState error - "
+                << "binary state file " << filename << " is truncated."
+                << std::endl;
+   }
+   else {
+      const unsigned char *rec = header + header_size;
+      uint64_t sum = 14695981039346656037ULL;
+      update_checksum(sum, rec, ncells * recsize);
+      if (sum != checksum) {
+         std::cerr << "AdaptiveSampler::mergeState error - "
+                   << "checksum mismatch in binary state file "
+                   << filename << ", file is corrupted."
+                   << std::endl;
+      }
+      else {
+         fNfixed = nfixed;
+         fMaximum_depth = get_uint32(header + 36);
+         fMaximum_cells = get_uint32(header + 40);
+         fSampling_threshold = get_double(header + 48);
+         fEfficiency_target = get_double(header + 56);
+         ncount = deserialize_binary(rec, end, 0);
+         compact_tree();
+      }
+   }
+   munmap(map, fsize);
+   return (ncount > 0);
+}
+
+int AdaptiveSampler::deserialize_binary(const unsigned char *&rec,
+                                        const unsigned char *end, int cell)
 {
-   if (fTopCell->divAxis > -1) {
+   size_t recsize = 48 + 48 * fNdim;
+   if (rec + recsize > end) {
+      std::cerr << "AdaptiveSampler::mergeState error - "
+                << "binary state file ends in the middle of the tree."
+                << std::endl;
+      return 0;
+   }
+   Stats &stats = fStats[cell];
+   fNodes[cell].divAxis = (int32_t)get_uint32(rec);
+   stats.nhit += get_uint64(rec + 8);
+   stats.sum_wI += get_double(rec + 16);
+   stats.sum_wI2 += get_double(rec + 24);
+   stats.sum_wI4 += get_double(rec + 32);
+   fNodes[cell].subset = get_double(rec + 40);
+   double *sums = &fSums[cell * 6 * fNdim];
+   for (int i=0; i < 6*fNdim; ++i) {
+      sums[i] += get_double(rec + 48 + 8*i);
+   }
+   rec += recsize;
+   int count = 1;
+   if (fNodes[cell].divAxis > -1) {
+      if (fNodes[cell].subcell == 0) {
+         new_subcells(cell);
+      }
       for (int i=0; i < 3; ++i) {
-         delete fTopCell->subcell[i];
-         fTopCell->subcell[i] = 0;
+         int n = deserialize_binary(rec, end, fNodes[cell].subcell + i);
+         if (n == 0)
+            return 0;
+         count += n;
       }
    }
-   fTopCell->divAxis = -1;
+   return count;
+}
+
+int AdaptiveSampler::getStateDimensions(const std::string filename,
+                                        int &ndim, int &nfixed)
+{
+   // Read the dimension and number of fixed dimensions from the header
+   // of a state file in either format, without loading the tree.
+   // Returns 1 on success, 0 if the file cannot be read.
+
+   std::ifstream fin(filename, std::ios::binary);
+   unsigned char header[ASTATE_BINARY_HEADER_SIZE];
+   if (!fin.read((char*)header, 24))
+      return 0;
+   if (memcmp(header, ASTATE_BINARY_MAGIC, 8) == 0) {
+      ndim = get_uint32(header + 16);
+      nfixed = get_uint32(header + 20);
+      return 1;
+   }
+   fin.clear();
+   fin.seekg(0);
+   std::string line;
+   if (!std::getline(fin, line) || 
+       sscanf(line.c_str(), "fNdim=%d", &ndim) != 1 ||
+       !std::getline(fin, line) ||
+       sscanf(line.c_str(), "fNfixed=%d", &nfixed) != 1)
+   {
+      return 0;
+   }
+   return 1;
+}
+
+int AdaptiveSampler::restoreState(const std::string filename)
+{
+   clear_tree();
+   fNodes[0].subset = 1;
    reset_stats();
    return mergeState(filename);
 }
 
+int AdaptiveSampler::mergeStats(const AdaptiveSampler &src)
+{
+   // Add the statistics accumulated in src into this sampler, which
+   // must have the identical tree. Returns 1 on success, or 0 if the
+   // two trees are different, in which case nothing is merged.
+
+   if (!sameTree(src))
+      return 0;
+   for (unsigned int cell=0; cell < fStats.size(); ++cell) {
+      Stats &stats = fStats[cell];
+      const Stats &srcstats = src.fStats[cell];
+      stats.nhit += srcstats.nhit;
+      stats.sum_wI += srcstats.sum_wI;
+      stats.sum_wI2 += srcstats.sum_wI2;
+      stats.sum_wI4 += srcstats.sum_wI4;
+   }
+   for (unsigned int i=0; i < fSums.size(); ++i) {
+      fSums[i] += src.fSums[i];
+   }
+   return 1;
+}
+
+void AdaptiveSampler::copyTree(const AdaptiveSampler &src)
+{
+   // Replace the tree of this sampler with a copy of the tree in src,
+   // including its adaptation parameters, but with empty statistics.
+
+   fNdim = src.fNdim;
+   fNfixed = src.fNfixed;
+   fMaximum_depth = src.fMaximum_depth;
+   fMaximum_cells = src.fMaximum_cells;
+   fSampling_threshold = src.fSampling_threshold;
+   fEfficiency_target = src.fEfficiency_target;
+   fMinimum_sum_wI2_delta = src.fMinimum_sum_wI2_delta;
+   fAdaptation_threads = src.fAdaptation_threads;
+   fNodes = src.fNodes;
+   fStats = src.fStats;
+   fSums.resize(src.fSums.size());
+   reset_stats();
+}
+
+bool AdaptiveSampler::sameTree(const AdaptiveSampler &src) const
+{
+   if (fNdim != src.fNdim || fNodes.size() != src.fNodes.size())
+      return false;
+   for (unsigned int cell=0; cell < fNodes.size(); ++cell) {
+      if (fNodes[cell].divAxis != src.fNodes[cell].divAxis ||
+          fNodes[cell].subcell != src.fNodes[cell].subcell ||
+          fNodes[cell].subset != src.fNodes[cell].subset)
+      {
+         return false;
+      }
+   }
+   return true;
+}
+
 int AdaptiveSampler::getVerbosity()
 {
    return verbosity;
@@ -782,92 +1580,112 @@ void AdaptiveSampler::setVerbosity(int verbose)
 
 int AdaptiveSampler::check_subsets(bool optimized)
 {
-   return fTopCell->check_subsets(optimized);
+   return check_subsets(0, optimized);
 }
 
-void AdaptiveSampler::Cell::optimize()
+void AdaptiveSampler::optimize()
 {
-   // Assume opt_nhit and opt_subset already set upon entry,
-   // task is to assign opt_wI2, opt_wI4 for this cell, and
-   // all opt_* parameters for child nodes in the tree.
-   if (divAxis > -1) {
-      if (divAxis < nfixed) {
-         opt_wI2 = 0;
-         opt_wI4 = 0;
-         double r = (opt_nhit + 1e-99) / nhit;
+   // Assume opt_nhit and opt_subset already set upon entry for the
+   // top cell, task is to assign opt_wI2, opt_wI4 for all cells and
+   // the opt_nhit, opt_subset for all cells below the top. The first
+   // pass runs down the tree assigning opt_nhit and opt_subset to the
+   // subcells, the second runs back up accumulating opt_wI2, opt_wI4.
+   for (unsigned int cell=0; cell < fNodes.size(); ++cell) {
+      const Node &node = fNodes[cell];
+      const Stats &stats = fStats[cell];
+      if (node.divAxis < 0) {
+         continue;
+      }
+      else if (node.divAxis < fNfixed) {
+         double r = (stats.opt_nhit + 1e-99) / stats.nhit;
          for (int n=0; n < 3; ++n) {
-            subcell[n]->opt_nhit = subcell[n]->nhit * r;
-            subcell[n]->opt_subset = opt_subset;
-            subcell[n]->optimize();
-            opt_wI2 += subcell[n]->opt_wI2;
-            opt_wI4 += subcell[n]->opt_wI4;
+            Stats &sub = fStats[node.subcell + n];
+            sub.opt_nhit = sub.nhit * r;
+            sub.opt_subset = stats.opt_subset;
          }
       }
       else {
-         opt_wI2 = 0;
-         opt_wI4 = 0;
          for (int n=0; n < 3; ++n) {
-            double r = subcell[n]->sum_wI2s / sum_wI2s;
+            Stats &sub = fStats[node.subcell + n];
+            double r = sub.sum_wI2s / stats.sum_wI2s;
             // double r0 = 5e-3;  // minimum subset fraction
             // r = (r + r0) / (1 + 3*r0);
             // r = (nhit > 100)? r : 1;
-            subcell[n]->opt_nhit = opt_nhit * r;
+            sub.opt_nhit = stats.opt_nhit * r;
             if (n == 2) {
-               double opt_ntot = subcell[0]->opt_nhit +
-                                 subcell[1]->opt_nhit +
-                                 subcell[2]->opt_nhit;
-               assert (abs(opt_ntot - opt_nhit) < 2);
+               double opt_ntot = fStats[node.subcell].opt_nhit +
+                                 fStats[node.subcell + 1].opt_nhit +
+                                 fStats[node.subcell + 2].opt_nhit;
+               assert (abs(opt_ntot - stats.opt_nhit) < 2);
             }
-            subcell[n]->opt_subset = opt_subset * r;
-            subcell[n]->optimize();
-            opt_wI2 += subcell[n]->opt_wI2;
-            opt_wI4 += subcell[n]->opt_wI4;
+            sub.opt_subset = stats.opt_subset * r;
          }
       }
    }
-   else if (nhit > 0) {
-      double r = (opt_nhit + 1e-99) / nhit;
-      opt_wI2 = sum_wI2 / r;
-      opt_wI4 = sum_wI4 / pow(r,3);
+   for (int cell = fNodes.size() - 1; cell >= 0; --cell) {
+      const Node &node = fNodes[cell];
+      Stats &stats = fStats[cell];
+      if (node.divAxis > -1) {
+         stats.opt_wI2 = 0;
+         stats.opt_wI4 = 0;
+         for (int n=0; n < 3; ++n) {
+            stats.opt_wI2 += fStats[node.subcell + n].opt_wI2;
+            stats.opt_wI4 += fStats[node.subcell + n].opt_wI4;
+         }
+      }
+      else if (stats.nhit > 0) {
+         double r = (stats.opt_nhit + 1e-99) / stats.nhit;
+         stats.opt_wI2 = stats.sum_wI2 / r;
+         stats.opt_wI4 = stats.sum_wI4 / pow(r,3);
+      }
    }
 }
 
-int AdaptiveSampler::Cell::serialize(std::ofstream &ofs, bool optimized)
+int AdaptiveSampler::serialize(std::ofstream &ofs, int cell,
+                               bool optimized) const
 {
-   ofs << "divAxis=" << divAxis << std::endl;
-   if (nhit != 0)
-      ofs << "nhit=" << nhit << std::endl;
-   if (sum_wI != 0)
-      ofs << "sum_wI=" << (std::isfinite(sum_wI)? sum_wI : 0) << std::endl;
-   if (sum_wI2 != 0)
-      ofs << "sum_wI2=" << (std::isfinite(sum_wI2)? sum_wI2 : 0) << std::endl;
-   if (sum_wI4 != 0)
-      ofs << "sum_wI4=" << (std::isfinite(sum_wI4)? sum_wI4 : 0) << std::endl;
-   for (int i=0; i < 3*ndim; ++i) {
-      if (sum_wI2d[i] != 0)
+   const Node &node = fNodes[cell];
+   const Stats &stats = fStats[cell];
+   const double *cell_wI2d = &fSums[cell * 6 * fNdim];
+   const double *cell_wI4d = cell_wI2d + 3 * fNdim;
+   ofs << "divAxis=" << node.divAxis << std::endl;
+   if (stats.nhit != 0)
+      ofs << "nhit=" << stats.nhit << std::endl;
+   if (stats.sum_wI != 0)
+      ofs << "sum_wI=" << (std::isfinite(stats.sum_wI)? stats.sum_wI : 0)
+          << std::endl;
+   if (stats.sum_wI2 != 0)
+      ofs << "sum_wI2=" << (std::isfinite(stats.sum_wI2)? stats.sum_wI2 : 0)
+          << std::endl;
+   if (stats.sum_wI4 != 0)
+      ofs << "sum_wI4=" << (std::isfinite(stats.sum_wI4)? stats.sum_wI4 : 0)
+          << std::endl;
+   for (int i=0; i < 3*fNdim; ++i) {
+      if (cell_wI2d[i] != 0)
          ofs << "sum_wI2d[" << i << "]=" 
-             << (std::isfinite(sum_wI2d[i])? sum_wI2d[i] : 0) << std::endl;
+             << (std::isfinite(cell_wI2d[i])? cell_wI2d[i] : 0) << std::endl;
    }
-   for (int i=0; i < 3*ndim; ++i) {
-      if (sum_wI4d[i] != 0)
+   for (int i=0; i < 3*fNdim; ++i) {
+      if (cell_wI4d[i] != 0)
          ofs << "sum_wI4d[" << i << "]=" 
-             << (std::isfinite(sum_wI4d[i])? sum_wI4d[i] : 0) << std::endl;
+             << (std::isfinite(cell_wI4d[i])? cell_wI4d[i] : 0) << std::endl;
    }
    if (optimized)
-      ofs << "subset=" << std::setprecision(20) << opt_subset << std::endl;
+      ofs << "subset=" << std::setprecision(20) << stats.opt_subset << std::endl;
    else
-      ofs << "subset=" << std::setprecision(20) << subset << std::endl;
+      ofs << "subset=" << std::setprecision(20) << node.subset << std::endl;
    ofs << "=" << std::endl;
    int count = 1;
-   if (divAxis > -1) {
-      count += subcell[0]->serialize(ofs, optimized);
-      count += subcell[1]->serialize(ofs, optimized);
-      count += subcell[2]->serialize(ofs, optimized);
+   if (node.divAxis > -1) {
+      count += serialize(ofs, node.subcell, optimized);
+      count += serialize(ofs, node.subcell + 1, optimized);
+      count += serialize(ofs, node.subcell + 2, optimized);
    }
    return count;
 }
 
-int AdaptiveSampler::Cell::deserialize(std::ifstream &ifs, double subset_multiplier)
+int AdaptiveSampler::deserialize(std::ifstream &ifs, int cell,
+                                 double subset_multiplier)
 {
    std::map<std::string,double> keyval;
    while (true) {
@@ -880,25 +1698,28 @@ int AdaptiveSampler::Cell::deserialize(std::ifstream &ifs, double subset_multipl
       ifs >> keyval[key];
       std::getline(ifs, key);
    }
-   divAxis = keyval.at("divAxis");
-   nhit += keyval["nhit"];
-   sum_wI += keyval["sum_wI"];
-   sum_wI2 += keyval["sum_wI2"];
-   sum_wI4 += keyval["sum_wI4"];
-   subset = keyval.at("subset") * subset_multiplier;
+   Stats &stats = fStats[cell];
+   fNodes[cell].divAxis = keyval.at("divAxis");
+   stats.nhit += keyval["nhit"];
+   stats.sum_wI += keyval["sum_wI"];
+   stats.sum_wI2 += keyval["sum_wI2"];
+   stats.sum_wI4 += keyval["sum_wI4"];
+   fNodes[cell].subset = keyval.at("subset") * subset_multiplier;
+   double *cell_wI2d = sum_wI2d(cell);
+   double *cell_wI4d = sum_wI4d(cell);
    std::map<std::string,double>::iterator it;
    for (it = keyval.begin(); it != keyval.end(); ++it) {
       if (it->first.substr(0,8) == "sum_wI2u") {
          int n3dim=1;
-         for (int n=0; n < ndim; ++n)
+         for (int n=0; n < fNdim; ++n)
             n3dim *= 3;
          int j;
          if (sscanf(it->first.c_str(), "sum_wI2u[%d]=", &j) == 1) {
             assert (j < n3dim);
-            for (int n=0; n < ndim; ++n) {
+            for (int n=0; n < fNdim; ++n) {
                double wI2 = it->second;
-               sum_wI2d[n*3+(j%3)] += wI2;
-               sum_wI4d[n*3+(j%3)] += wI2*wI2 * n3dim/nhit;
+               cell_wI2d[n*3+(j%3)] += wI2;
+               cell_wI4d[n*3+(j%3)] += wI2*wI2 * n3dim/stats.nhit;
                j /= 3;
             }
          }
@@ -906,42 +1727,49 @@ int AdaptiveSampler::Cell::deserialize(std::ifstream &ifs, double subset_multipl
       else if (it->first.substr(0,8) == "sum_wI2d") {
          int j;
          if (sscanf(it->first.c_str(), "sum_wI2d[%d]=", &j) == 1) {
-            assert (j < 3*ndim);
-            sum_wI2d[j] += it->second;
+            assert (j < 3*fNdim);
+            cell_wI2d[j] += it->second;
          }
       }
       else if (it->first.substr(0,8) == "sum_wI4d") {
          int j;
          if (sscanf(it->first.c_str(), "sum_wI4d[%d]=", &j) == 1) {
-            assert (j < 3*ndim);
-            sum_wI4d[j] += it->second;
+            assert (j < 3*fNdim);
+            cell_wI4d[j] += it->second;
          }
       }
    }
    int count = 1;
-   if (divAxis > -1) {
+   if (fNodes[cell].divAxis > -1) {
       //subset_multiplier *= (divAxis < 1)? 3 : 1;
+      if (fNodes[cell].subcell == 0) {
+         new_subcells(cell);
+      }
       for (int i=0; i < 3; ++i) {
-         if (subcell[i] == 0) {
-            subcell[i] = new Cell(ndim, nfixed);
-         }
-         count += subcell[i]->deserialize(ifs, subset_multiplier);
+         count += deserialize(ifs, fNodes[cell].subcell + i,
+                              subset_multiplier);
       }
    }
    return count;
 }
 
-int AdaptiveSampler::Cell::check_subsets(bool optimized, std::string id)
+
+int AdaptiveSampler::check_subsets(int cell, bool optimized, std::string id)
 {
+   const int divAxis = fNodes[cell].divAxis;
    if (divAxis < 0) {
       return 0;
    }
+   const long int nhit = fStats[cell].nhit;
+   const double subset = fNodes[cell].subset;
+   const Node *subnode = &fNodes[fNodes[cell].subcell];
+   const Stats *subcell = &fStats[fNodes[cell].subcell];
 
    // test trinomial statistics at each node
    int warnings = 0;
-   long int Ntot = subcell[0]->nhit + subcell[1]->nhit + subcell[2]->nhit;
+   long int Ntot = subcell[0].nhit + subcell[1].nhit + subcell[2].nhit;
    if (Ntot != nhit) {
-      std::cerr << "Error in AdaptiveSampler::Cell::check_subsets - "
+      std::cerr << "Error in AdaptiveSampler::check_subsets - "
                 << "nhit consistency check #1 failed for cell " << id
                 << std::endl
                 << "  split cell nhit=" << nhit
@@ -949,29 +1777,29 @@ int AdaptiveSampler::Cell::check_subsets(bool optimized, std::string id)
                 << std::endl;
       return 999;
    }
-   if (divAxis < nfixed) {
-      if (subcell[0]->subset != subset ||
-          subcell[1]->subset != subset ||
-          subcell[2]->subset != subset)
+   if (divAxis < fNfixed) {
+      if (subnode[0].subset != subset ||
+          subnode[1].subset != subset ||
+          subnode[2].subset != subset)
       {
-         std::cerr << "Error in AdaptiveSampler::Cell::check_subsets - "
+         std::cerr << "Error in AdaptiveSampler::check_subsets - "
                    << "subset consistency check #1 failed for cell " << id
                    << std::endl
                    << "  split fixed cell subset=" << subset
                    << ", subcell subsets="
-                   << subcell[0]->subset << ","
-                   << subcell[1]->subset << ","
-                   << subcell[2]->subset
+                   << subnode[0].subset << ","
+                   << subnode[1].subset << ","
+                   << subnode[2].subset
                    << std::endl;
          return 999;
       }
    }
    else {
-      double subsetsum = subcell[0]->subset + 
-                         subcell[1]->subset +
-                         subcell[2]->subset;
+      double subsetsum = subnode[0].subset + 
+                         subnode[1].subset +
+                         subnode[2].subset;
       if (fabs(subsetsum - subset) > subset * 1e-12) {
-         std::cerr << "Error in AdaptiveSampler::Cell::check_subsets - "
+         std::cerr << "Error in AdaptiveSampler::check_subsets - "
                    << "subset consistency check #2 failed for cell " << id
                    << std::endl
                    << "  split cell subset=" << subset
@@ -980,28 +1808,28 @@ int AdaptiveSampler::Cell::check_subsets(bool optimized, std::string id)
          return 999;
       }
       for (int i=0; i < 3; ++i) {
-         double p = subcell[i]->subset / (subset + 1e-99);
+         double p = subnode[i].subset / (subset + 1e-99);
          double mu = nhit * p;
          double sigma = sqrt(nhit * p * (1-p));
-         double p1 = subcell[(i+1)%3]->subset / (subset + 1e-99);
+         double p1 = subnode[(i+1)%3].subset / (subset + 1e-99);
          double mu1 = nhit * p1;
          double sigma1 = sqrt(nhit * p1 * (1-p1));
-         double p2 = subcell[(i+2)%3]->subset / (subset + 1e-99);
+         double p2 = subnode[(i+2)%3].subset / (subset + 1e-99);
          double mu2 = nhit * p2;
          double sigma2 = sqrt(nhit * p2 * (1-p2));
-         if (subcell[i]->nhit < 30) {
+         if (subcell[i].nhit < 30) {
             double prob = 1;
             for (int k=1; k <= nhit; ++k) {
-               if (k <=subcell[i]->nhit)
+               if (k <=subcell[i].nhit)
                   prob *= p * double(nhit - k + 1) / k;
                else
                   prob *= 1 - p;
             }
             if (prob < 1e-6) {
-               std::cerr << "Warning in AdaptiveSampler::Cell::check_subsets - "
+               std::cerr << "Warning in AdaptiveSampler::check_subsets - "
                          << "nhit - subset probability < 1e-6, cell "
                          << id << ", subcell " << i 
-                         << " has nhit=" << subcell[i]->nhit
+                         << " has nhit=" << subcell[i].nhit
                          << ", expected " << mu << " +/- " << sigma
                          << ", P-value " << prob
                          << std::endl;
@@ -1010,69 +1838,150 @@ int AdaptiveSampler::Cell::check_subsets(bool optimized, std::string id)
                          << std::endl;
                std::cerr << "  Other branch of this cell:"
                          << "  subcell " << (i+1)%3
-                         << " with nhit=" << subcell[(i+1)%3]->nhit
+                         << " with nhit=" << subcell[(i+1)%3].nhit
                          << ", expected " << mu1 << " +/- " << sigma1
-                         << ", " << (subcell[(i+1)%3]->nhit - mu1) / sigma1
+                         << ", " << (subcell[(i+1)%3].nhit - mu1) / sigma1
                          << " sigma." << std::endl;
                std::cerr << "  Other branch of this cell:"
                          << "  subcell " << (i+2)%3
-                         << " with nhit=" << subcell[(i+2)%3]->nhit
+                         << " with nhit=" << subcell[(i+2)%3].nhit
                          << ", expected " << mu2 << " +/- " << sigma2
-                         << ", " << (subcell[(i+2)%3]->nhit - mu2) / sigma2
+                         << ", " << (subcell[(i+2)%3].nhit - mu2) / sigma2
                          << " sigma." << std::endl;
                warnings++;
             }
          }
-         else if (fabs(subcell[i]->nhit - mu) > 5 * sigma) {
-            std::cerr << "Warning in AdaptiveSampler::Cell::check_subsets - "
+         else if (fabs(subcell[i].nhit - mu) > 5 * sigma) {
+            std::cerr << "Warning in AdaptiveSampler::check_subsets - "
                       << "nhit - subset mismatch > 5 sigma, cell "
                       << id << ", subcell " << i 
-                      << " has nhit=" << subcell[i]->nhit
+                      << " has nhit=" << subcell[i].nhit
                       << ", expected " << mu << " +/- " << sigma
-                      << ", " << (subcell[i]->nhit - mu) / sigma
+                      << ", " << (subcell[i].nhit - mu) / sigma
                       << " sigma!" << std::endl;
             std::cerr << "  This cell is splits " << nhit
                       << " events along axis " << divAxis
                       << std::endl;
             std::cerr << "  Other branch of this cell:"
                       << "  subcell " << (i+1)%3
-                      << " with nhit=" << subcell[(i+1)%3]->nhit
+                      << " with nhit=" << subcell[(i+1)%3].nhit
                       << ", expected " << mu1 << " +/- " << sigma1
-                      << ", " << (subcell[(i+1)%3]->nhit - mu1) / sigma1
+                      << ", " << (subcell[(i+1)%3].nhit - mu1) / sigma1
                       << " sigma." << std::endl;
             std::cerr << "  Other branch of this cell:"
                       << "  subcell " << (i+2)%3
-                      << " with nhit=" << subcell[(i+2)%3]->nhit
+                      << " with nhit=" << subcell[(i+2)%3].nhit
                       << ", expected " << mu2 << " +/- " << sigma2
-                      << ", " << (subcell[(i+2)%3]->nhit - mu2) / sigma2
+                      << ", " << (subcell[(i+2)%3].nhit - mu2) / sigma2
                       << " sigma." << std::endl;
             warnings++;
          }
       }
    }
    for (int i=0; i < 3; ++i) {
-      warnings += subcell[i]->check_subsets(optimized,
-                                            id + std::to_string(i));
+      warnings += check_subsets(fNodes[cell].subcell + i, optimized,
+                                id + std::to_string(i));
    }
    return warnings;
 }
 
-std::string AdaptiveSampler::Cell::address()
+std::string AdaptiveSampler::address(int cell) const
 {
-   // assumes sum_stats has been called, so super is filled in
+   // returns the path to this cell from the top of the tree
    std::string a;
-   Cell *here = this;
-   while (here != 0 && here->super != 0) {
-      std::string sn = "?";
-      for (int n=0; n < 3; ++n) {
-         if (here->super->subcell[n] == here) {
-            sn = std::to_string(n);
-            here = here->super;
-            break;
-         }
-      }
-      a.insert(0, sn);
+   int here = cell;
+   while (here > 0 && fStats[here].super > -1) {
+      int super = fStats[here].super;
+      a.insert(0, std::to_string(here - fNodes[super].subcell));
+      here = super;
    }
-		 a.insert(0, "o");
+   a.insert(0, "o");
    return a;
 }
+
+AdaptiveSamplerTrainer::AdaptiveSamplerTrainer(AdaptiveSampler *master,
+                                               long int adapt_interval)
+ : fMaster(master),
+   fAdapt_interval(adapt_interval),
+   fNsince_adapt(0),
+   fNmerged(0),
+   fNdiscarded(0),
+   fNadapted(0)
+{}
+
+AdaptiveSamplerTrainer::~AdaptiveSamplerTrainer()
+{}
+
+AdaptiveSampler *AdaptiveSamplerTrainer::newShard()
+{
+   std::lock_guard<std::mutex> lock(fMutex);
+   AdaptiveSampler *shard = new AdaptiveSampler(*fMaster);
+   shard->reset_stats();
+   return shard;
+}
+
+int AdaptiveSamplerTrainer::synchronize(AdaptiveSampler *shard, bool wait)
+{
+   // Reduce the statistics accumulated in shard into the master tree,
+   // adapt the master if enough new statistics have been collected,
+   // and bring the shard up to date with the master tree. Returns the
+   // number of cells added to the master by this call, or -1 if wait
+   // is false and another thread holds the lock.
+
+   long int nsample = shard->getNsample();
+   std::unique_lock<std::mutex> lock(fMutex, std::defer_lock);
+   if (wait)
+      lock.lock();
+   else if (!lock.try_lock())
+      return -1;
+
+   if (fMaster->mergeStats(*shard)) {
+      fNsince_adapt += nsample;
+      fNmerged += nsample;
+   }
+   else {
+      fNdiscarded += nsample;
+   }
+   int newcells = 0;
+   if (fAdapt_interval > 0 && fNsince_adapt >= fAdapt_interval) {
+      newcells = fMaster->adapt();
+      if (newcells > 0) {
+         fMaster->reset_stats();
+         ++fNadapted;
+      }
+      fNsince_adapt = 0;
+   }
+   if (fMaster->sameTree(*shard))
+      shard->reset_stats();
+   else
+      shard->copyTree(*fMaster);
+   return newcells;
+}
+
+int AdaptiveSamplerTrainer::saveState(const std::string filename,
+                                      bool optimized)
+{
+   std::lock_guard<std::mutex> lock(fMutex);
+   return fMaster->saveState(filename, optimized);
+}
+
+double AdaptiveSamplerTrainer::getEfficiency()
+{
+   std::lock_guard<std::mutex> lock(fMutex);
+   return fMaster->getEfficiency();
+}
+
+long int AdaptiveSamplerTrainer::getNmerged() const
+{
+   return fNmerged;
+}
+
+long int AdaptiveSamplerTrainer::getNdiscarded() const
+{
+   return fNdiscarded;
+}
+
+int AdaptiveSamplerTrainer::getNadapted() const
+{
+   return fNadapted;
+}
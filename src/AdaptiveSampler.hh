@@ -95,6 +95,28 @@
 //    double sigma = sqrt((1 - effic) * sum[2]) / sum[0];
 //    std::cout << "result_IS is " << mu << " +/- " << sigma << std::endl;
 //
+//    Generators that produce large numbers of points with no other work
+//    to do in between can use the batch forms of sample and feedback,
+//    which draw the random numbers for a whole block of points in one
+//    call to the user generator, and accept the weights back as an array.
+//    The cell indices returned by the batch sample() can be passed back
+//    to the batch feedback() to skip the second descent of the tree, as
+//    long as the tree has not been changed by adapt() in the meantime.
+//
+//    const int N = 1000;
+//    std::vector<double> u(N*D), w(N), wI(N);
+//    std::vector<int> cells(N);
+//    for (int i=0; i < nMC; i += N) {
+//       sampler.sample(N, &u[0], &w[0], &cells[0]);
+//       for (int n=0; n < N; ++n)
+//          wI[n] = w[n] * ... compute your integrand at &u[n*D] ...
+//       sampler.feedback(N, &u[0], &wI[0], &cells[0]);
+//    }
+//
+//    The batch calls consume the user generator in exactly the same order
+//    as N successive calls to sample(u), so the same seed produces the
+//    same sequence of points either way.
+//
 // 4) NEW FEATURE: Support for Parametric Models
 //    Prior to this introduction of this new feature, it was assumed that the
 //    user's integrand function wI(u) is a deterministic function of the random
@@ -133,6 +155,7 @@
 #include <iomanip>
 #include <sstream>
 #include <assert.h>
+#include <mutex>
 
 using Uniform01 = void (*)(int n, double *randoms);
 
@@ -147,6 +170,9 @@ class AdaptiveSampler {
    // action methods
    double sample(double *u);
    void feedback(const double *u, double wI);
+   int sample(int n, double *u, double *w, int *cells=0);
+   void feedback(int n, const double *u, const double *wI,
+                 const int *cells=0);
    void optimize_tree();
    int adapt();
    void reset_stats();
@@ -166,6 +192,7 @@ class AdaptiveSampler {
    double getAdaptation_efficiency_target() const;
    int getAdaptation_maximum_depth() const;
    int getAdaptation_maximum_cells() const;
+   int getAdaptation_threads() const;
    static int getVerbosity();
    
    // setter methods
@@ -173,12 +200,25 @@ class AdaptiveSampler {
    void setAdaptation_efficiency_target(double target);
    void setAdaptation_maximum_depth(int depth);
    void setAdaptation_maximum_cells(int ncells);
+   void setAdaptation_threads(int nthreads);
    static void setVerbosity(int verbose);
 
    // persistency methods
-   int saveState(const std::string filename, bool optimized=false) const;
+   enum state_format_t {
+      TEXT_FORMAT = 0,
+      BINARY_FORMAT = 1
+   };
+   int saveState(const std::string filename, bool optimized=false,
+                 state_format_t format=TEXT_FORMAT) const;
    int mergeState(const std::string filename);
    int restoreState(const std::string filename);
+   static int getStateDimensions(const std::string filename,
+                                 int &ndim, int &nfixed);
+
+   // in-memory merging methods
+   int mergeStats(const AdaptiveSampler &src);
+   void copyTree(const AdaptiveSampler &src);
+   bool sameTree(const AdaptiveSampler &src) const;
 
    // diagnostic methods
    void display_tree(bool optimized=false);
@@ -196,35 +236,29 @@ class AdaptiveSampler {
    double fSampling_threshold;
    double fEfficiency_target;
    double fMinimum_sum_wI2_delta;
+   int fAdaptation_threads;
    static int verbosity;
 
-   class Cell;
-   Cell *fTopCell;
-
-   Cell *findCell(double ucell, int &depth, 
-                  double *u0, double *u1,
-                  const double *u);
-   Cell *findCell(const double *u, int &depth, 
-                  double *u0, double *u1) const;
-   int recursively_update(std::vector<int> index);
-   double display_tree(Cell *cell, double subset, std::string id,
-                       double *u0, double *u1, bool optimized=false);
-
-   // internal weighting tables
+   // internal weighting tables --
+   // the cells of the sampling tree are stored in a flat arena and
+   // addressed by index, with the top cell at index 0 and the three
+   // subcells of a split cell stored consecutively at higher indices
+   // than their parent. The fields visited while descending the tree
+   // in sample() and feedback() are kept in the compact fNodes array,
+   // apart from the cell statistics in fStats and fSums, so that each
+   // step of the descent touches as little memory as possible.
 
-   class Cell {
-    public:
-      int ndim;
-      int nfixed;
-      int divAxis;
+   struct Node {
+      int divAxis;     // split axis, or -1 for a leaf cell
+      int subcell;     // index of the first of 3 subcells, 0 for a leaf
+      double subset;
+   };
+   struct Stats {
       long int nhit;
       double sum_wI;
       double sum_wI2;
       double sum_wI4;
       double sum_wI2s;
-      double *sum_wI2d;
-      double *sum_wI4d;
-      double subset;
       // optimized transforms of the above statistics
       double opt_nhit;
       // sum_wI is an invariant;
@@ -234,120 +268,109 @@ class AdaptiveSampler {
       // sum_wI2d is input for optimization;
       // sum_wI4d is input for optimization;
       double opt_subset;
+      int super;
+   };
+   std::vector<Node> fNodes;
+   mutable std::vector<Stats> fStats;
+   std::vector<double> fSums;  // per cell sum_wI2d[3*ndim], sum_wI4d[3*ndim]
 
-      Cell *subcell[3];
-      Cell *super;
+   double *sum_wI2d(int cell) {
+      return &fSums[cell * 6 * fNdim];
+   }
+   double *sum_wI4d(int cell) {
+      return &fSums[cell * 6 * fNdim + 3 * fNdim];
+   }
+   int new_cell(int super);
+   int new_subcells(int cell);
+   void clear_tree();
+   int compact_tree();
 
-      Cell(int dim, int fixed=0)
-       : ndim(dim),
-         nfixed(fixed),
-         divAxis(-1),
-         nhit(0),
-         sum_wI(0),
-         sum_wI2(0),
-         sum_wI4(0),
-         sum_wI2s(0),
-         subset(0),
-         opt_nhit(0),
-         opt_wI2(0), 
-         opt_wI4(0),
-         opt_subset(0)
-      {
-         sum_wI2d = new double[3*ndim];
-         sum_wI4d = new double[3*ndim];
-         std::fill(sum_wI2d, sum_wI2d + 3*ndim, 0);
-         std::fill(sum_wI4d, sum_wI4d + 3*ndim, 0);
-         subcell[0] = 0;
-         subcell[1] = 0;
-         subcell[2] = 0;
-         super = 0;
-      }
-      Cell(const Cell &src) {
-         ndim = src.ndim;
-         nfixed = src.nfixed;
-         divAxis = src.divAxis;
-         nhit = src.nhit;
-         sum_wI = src.sum_wI;
-         sum_wI2 = src.sum_wI2;
-         sum_wI4 = src.sum_wI4;
-         sum_wI2s = src.sum_wI2s;
-         sum_wI2d = new double[3*ndim];
-         sum_wI4d = new double[3*ndim];
-         for (int i=0; i < 3*ndim; ++i) {
-            sum_wI2d[i] = src.sum_wI2d[i];
-            sum_wI4d[i] = src.sum_wI4d[i];
-         }
-         subset = src.subset;
-         opt_nhit = src.opt_nhit;
-         opt_wI2 = src.opt_wI2;
-         opt_wI4 = src.opt_wI4;
-         opt_subset = src.opt_subset;
-         if (src.subcell[0] != 0) {
-            subcell[0] = new Cell(*src.subcell[0]);
-            subcell[1] = new Cell(*src.subcell[1]);
-            subcell[2] = new Cell(*src.subcell[2]);
-         }
-         else {
-            subcell[0] = 0;
-            subcell[1] = 0;
-            subcell[2] = 0;
-         }
-         super = 0;
-      }
-      ~Cell() {
-         if (subcell[0] != 0) {
-            delete subcell[0];
-            delete subcell[1];
-            delete subcell[2];
-         }
-         delete [] sum_wI2d;
-         delete [] sum_wI4d;
-      }
-      Cell operator=(const Cell &src) {
-         return Cell(src);
-      }
-      void reset_stats() {
-         nhit = 0;
-         sum_wI = 0;
-         sum_wI2 = 0;
-         sum_wI4 = 0;
-         sum_wI2s = 0;
-         std::fill(sum_wI2d, sum_wI2d + 3*ndim, 0);
-         std::fill(sum_wI4d, sum_wI4d + 3*ndim, 0);
-         if (divAxis > -1) {
-            subcell[0]->reset_stats();
-            subcell[1]->reset_stats();
-            subcell[2]->reset_stats();
-         }
-      }
-      int sum_stats()
-      {
-         int count = 1;
-         if (divAxis > -1) {
-            nhit = 0;
-            sum_wI = 0;
-            sum_wI2 = 0;
-            sum_wI4 = 0;
-            sum_wI2s = 0;
-            for (int n=0; n < 3; ++n) {
-               count += subcell[n]->sum_stats();
-               nhit += subcell[n]->nhit;
-               sum_wI += subcell[n]->sum_wI;
-               sum_wI2 += subcell[n]->sum_wI2;
-               sum_wI4 += subcell[n]->sum_wI4;
-               sum_wI2s += subcell[n]->sum_wI2s;
-               subcell[n]->super = this;
-            }
-         }
-         if (divAxis < nfixed) {
-            sum_wI2s = sqrt(nhit * sum_wI2);
-         }
-         return count;
-      }
-      void optimize();
-      int serialize(std::ofstream &ofs, bool optimized=false);
-      int deserialize(std::ifstream &ifs, double subset_multiplier=1);
-      int check_subsets(bool optimized=false, std::string id="0");
-      std::string address();
+   int findCell(double ucell, int &depth, 
+                double *u0, double *u1,
+                const double *u) const;
+   int findCell(const double *u, int &depth, 
+                double *u0, double *u1) const;
+   void findBounds(int cell, double *u0, double *u1) const;
+   enum split_verdict_t {
+      SPLIT_INCONSISTENT = -1,
+      SPLIT_NO_STATISTICS = -2,
+      SPLIT_BELOW_DELTA = -3,
+      SPLIT_BELOW_THRESHOLD = -4,
+      SPLIT_EFFICIENT = -5,
+      SPLIT_MAXIMUM_DEPTH = -6
    };
+   int evaluate_split(int cell, int depth, double top_sum_wI2) const;
+   int update_tree();
+   std::string cellpath(int cell) const;
+   double display_tree(int cell, double subset, std::string id,
+                       double *u0, double *u1, bool optimized=false);
+
+   int sum_stats() const;
+   void optimize();
+   int serialize(std::ofstream &ofs, int cell, bool optimized=false) const;
+   int deserialize(std::ifstream &ifs, int cell, double subset_multiplier=1);
+   int saveBinaryState(const std::string filename, bool optimized) const;
+   int mergeBinaryState(const std::string filename);
+   int serialize_binary(std::ofstream &ofs, int cell, bool optimized,
+                        unsigned long long int &checksum) const;
+   int deserialize_binary(const unsigned char *&rec,
+                          const unsigned char *end, int cell);
+   int check_subsets(int cell, bool optimized=false, std::string id="0");
+   std::string address(int cell) const;
+};
+
+// AdaptiveSamplerTrainer - in-memory concurrent training of a single
+//                          AdaptiveSampler tree by many threads
+//
+// usage:
+//    Each thread draws and feeds back events through its own shard,
+//    a private AdaptiveSampler that starts out as a copy of the shared
+//    master tree with empty statistics. At regular intervals the thread
+//    calls synchronize() with its shard, which adds the statistics that
+//    the shard has accumulated into the master tree and resets them in
+//    the shard. Once adapt_interval new samples have been accumulated in
+//    the master, the synchronizing thread runs adapt() on the master, and
+//    the new tree is handed out to every shard at its next synchronize.
+//    Statistics that a shard collected on an outdated tree cannot be
+//    attributed to the cells of the new one, so they are dropped and
+//    counted in getNdiscarded(). If synchronize() is called with wait
+//    false, it returns -1 without doing anything if another thread is
+//    currently synchronizing, so generation never stalls on the lock.
+//    File-based merging with saveState/mergeState remains available
+//    for combining the results of separate jobs offline.
+//
+//    AdaptiveSamplerTrainer trainer(master, 1000000);
+//    AdaptiveSampler *shard = trainer.newShard();   // in each thread
+//    ... sample() and feedback() on shard as usual ...
+//    if (nevents % 10000 == 0)
+//       trainer.synchronize(shard, false);
+//    ...
+//    trainer.synchronize(shard);                    // at thread end
+//    trainer.saveState("combined.astate");
+
+class AdaptiveSamplerTrainer {
+ public:
+   AdaptiveSamplerTrainer(AdaptiveSampler *master, long int adapt_interval=0);
+   ~AdaptiveSamplerTrainer();
+
+   AdaptiveSampler *newShard();
+   int synchronize(AdaptiveSampler *shard, bool wait=true);
+   int saveState(const std::string filename, bool optimized=false);
+   double getEfficiency();
+   long int getNmerged() const;
+   long int getNdiscarded() const;
+   int getNadapted() const;
+
+ protected:
+   AdaptiveSampler *fMaster;
+   long int fAdapt_interval;
+   long int fNsince_adapt;
+   long int fNmerged;
+   long int fNdiscarded;
+   int fNadapted;
+   std::mutex fMutex;
+
+ private:
+   AdaptiveSamplerTrainer(const AdaptiveSamplerTrainer &src) = delete;
+   AdaptiveSamplerTrainer &operator=(const AdaptiveSamplerTrainer &src) = delete;
 };
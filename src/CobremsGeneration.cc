@@ -53,6 +53,10 @@
 
 #include <iostream>
 #include <stdio.h>
+#include <stdint.h>
+#include <thread>
+#include <sstream>
+#include <string>
 #include <CobremsGeneration.hh>
 #include <boost/math/special_functions/expint.hpp>
 #include <boost/math/special_functions/erf.hpp>
@@ -61,6 +65,7 @@ const double CobremsGeneration::dpi = 3.1415926535897;
 const double CobremsGeneration::me = 0.510998910e-3;
 const double CobremsGeneration::alpha = 7.2973525698e-3;
 const double CobremsGeneration::hbarc = 0.1973269718e-15;
+const double CobremsGeneration::fAcceptanceTolerance = 1e-5;
 
 CobremsGeneration::CobremsGeneration(double Emax_GeV, double Epeak_GeV)
 {
@@ -81,6 +86,7 @@ CobremsGeneration::CobremsGeneration(double Emax_GeV, double Epeak_GeV)
    fPhotonEnergyMin = 0.120; // GeV
    setPolarizedFlag(false);
    setCollimatedFlag(false);
+   fSigma2MScoef.Ebeam = 0;
 
 #if COBREMS_GENERATOR_VERBOSITY > 0
    std::cout << std::endl
@@ -271,6 +277,28 @@ void CobremsGeneration::printTargetCrystalInfo()
    }
 }
 
+static double smearing_term(double dalph, double var0, double varMS)
+{
+   // Smearing function in the crystal angle alpha for the beam-crystal
+   // convolution, where var0 is the variance of the beam divergence and
+   // mosaic spread, and varMS is the variance of multiple scattering in
+   // the radiator, which is folded in as a uniform-in-depth distribution.
+
+   if (varMS / var0 > 1e-4) {
+      return dalph / varMS *
+                    (boost::math::erf(dalph / sqrt(2 * (var0 + varMS))) -
+                     boost::math::erf(dalph / sqrt(2 * var0))) +
+             sqrt(2 / CobremsGeneration::dpi) / varMS *
+                    (exp(-dalph*dalph / (2 * (var0 + varMS))) *
+                                         sqrt(var0 + varMS) -
+                     exp(-dalph*dalph / (2 * var0)) * sqrt(var0));
+   }
+   else {
+      return exp(-dalph*dalph / (2 * var0)) / 
+             sqrt(2 * CobremsGeneration::dpi * var0);
+   }
+}
+
 void CobremsGeneration::applyBeamCrystalConvolution(int nbins, double *xvalues,
                                                               double *yvalues)
 {
@@ -303,7 +331,20 @@ void CobremsGeneration::applyBeamCrystalConvolution(int nbins, double *xvalues,
    // and applies it to the input spectrum represented by the yvalues
    // array. The yvalues array is overwritten with the convoluted spectrum.
    // For simplicity, the xvalues are assumed to be equally spaced.
-
+   //
+   // The smearing function depends on the pair of bins only through the
+   // angle difference dalph, so it is tabulated once per call on a fine
+   // grid in |dalph| instead of being evaluated for every pair of bins.
+   // It falls to zero within machine precision beyond 10 sigma of the
+   // total angular spread, so each sum over bins is limited to the window
+   // where it is non-zero. This reduces the cost from O(nbins^2) special
+   // function calls to O(nbins * window) table lookups, which matters for
+   // fine binning. The bins that fall outside [x0,x1] are excluded from
+   // the normalization exactly as in applyBeamCrystalConvolution_direct,
+   // which retains the original pairwise algorithm for accuracy checks.
+
+   if (nbins < 2)
+      return;
    double x0 = xvalues[0];
    double x1 = xvalues[nbins - 1];
    double var0 = pow(fTargetCrystal.mosaic_spread, 2) +
@@ -318,6 +359,75 @@ void CobremsGeneration::applyBeamCrystalConvolution(int nbins, double *xvalues,
    double a = fTargetCrystal.lattice_constant;
    double qabs = sqrt(8.0) * hbarc * 2*dpi / a;
    double xfact = 2 * fBeamEnergy * qabs / (me*me);
+
+   // tabulate the smearing function at (k-1)*dkern for k=0..nkern+2
+   double var = (varMS / var0 > 1e-4)? var0 + varMS : var0;
+   double alph_max = 10 * sqrt(var);
+   const int nkern = 4096;
+   double dkern = alph_max / nkern;
+   std::vector<double> kern(nkern + 3);
+   for (int k=0; k < nkern + 3; ++k) {
+      kern[k] = smearing_term((k - 1) * dkern, var0, varMS);
+   }
+
+   std::vector<double> norm(nbins, 0);
+   std::vector<double> result(nbins, 0);
+   std::vector<double> term;
+   for (int j=0; j < nbins; ++j) {
+      double x = x0 + (x1 - x0) * (j + 0.5) / nbins;
+      double alph_per_bin = (x1 - x0) / nbins / xfact / 
+                            pow(1 - x + 1e-99, 2);
+      int window = nbins;
+      if (alph_max / alph_per_bin < nbins)
+         window = (int)(alph_max / alph_per_bin) + 1;
+      int imin = (j - window > 0)? j - window : 0;
+      int imax = (j + window < nbins)? j + window : nbins - 1;
+      term.resize(imax - imin + 1);
+      for (int i=imin; i <= imax; ++i) {
+         double u = fabs(j - i) * alph_per_bin / dkern;
+         double t = 0;
+         if (u < nkern) {
+            int k = (int)u;
+            double f = u - k;
+            const double *p = &kern[k];
+            t = p[1] + 0.5 * f * (p[2] - p[0] +
+                             f * (2 * p[0] - 5 * p[1] + 4 * p[2] - p[3] +
+                             f * (3 * (p[1] - p[2]) + p[3] - p[0])));
+         }
+         term[i - imin] = t;
+         norm[j] += t;
+      }
+      for (int i=imin; i <= imax; ++i) {
+         result[i] += term[i - imin] * yvalues[j] / norm[j];
+      }
+   }
+
+   for (int i=0; i < nbins; ++i) {
+      if (fabs(result[i]) > 1e-35) {
+         yvalues[i] = result[i];
+      }
+      else {
+         yvalues[i] = 0;
+      }
+   }
+}
+
+void CobremsGeneration::applyBeamCrystalConvolution_direct(int nbins,
+                                                          double *xvalues,
+                                                          double *yvalues)
+{
+   // Same as applyBeamCrystalConvolution, but evaluates the smearing
+   // function directly for every pair of bins. This is O(nbins^2) and
+   // only intended as a reference for checking the fast method.
+
+   double x0 = xvalues[0];
+   double x1 = xvalues[nbins - 1];
+   double var0 = pow(fTargetCrystal.mosaic_spread, 2) +
+                 pow(fBeamEmittance / fCollimatorSpotrms, 2);
+   double varMS = Sigma2MS(fTargetThickness);
+   double a = fTargetCrystal.lattice_constant;
+   double qabs = sqrt(8.0) * hbarc * 2*dpi / a;
+   double xfact = 2 * fBeamEnergy * qabs / (me*me);
    double *norm = new double[nbins];
    double *result = new double[nbins];
    for (int j=0; j < nbins; ++j) {
@@ -327,20 +437,7 @@ void CobremsGeneration::applyBeamCrystalConvolution(int nbins, double *xvalues,
          double dx = (x1 - x0) * (j - i) / nbins;
          double x = x0 + (x1 - x0) * (j + 0.5) / nbins;
          double dalph = dx / xfact / pow(1 - x + 1e-99, 2);
-         double term;
-         if (varMS / var0 > 1e-4) {
-            term = dalph / varMS *
-                          (boost::math::erf(dalph / sqrt(2 * (var0 + varMS))) -
-                           boost::math::erf(dalph / sqrt(2 * var0))) +
-                   sqrt(2 / dpi) / varMS *
-                          (exp(-dalph*dalph / (2 * (var0 + varMS))) *
-                                               sqrt(var0 + varMS) -
-                           exp(-dalph*dalph / (2 * var0)) * sqrt(var0));
-         }
-         else {
-            term = exp(-dalph*dalph / (2 * var0)) / sqrt(2 * dpi * var0);
-         }
-         norm[j] += term;
+         norm[j] += smearing_term(dalph, var0, varMS);
       }
    }
 
@@ -349,20 +446,7 @@ void CobremsGeneration::applyBeamCrystalConvolution(int nbins, double *xvalues,
          double dx = (x1 - x0) * (j - i) / nbins;
          double x = x0 + (x1 - x0) * (j + 0.5) / nbins;
          double dalph = dx / xfact / pow(1 - x + 1e-99, 2);
-         double term;
-         if (varMS / var0 > 1e-4) {
-            term = dalph / varMS *
-                          (boost::math::erf(dalph / sqrt(2 * (var0 + varMS))) -
-                           boost::math::erf(dalph / sqrt(2 * var0))) +
-                   sqrt(2 / dpi) / varMS *
-                          (exp(-dalph*dalph / (2 * (var0 + varMS))) *
-                                                    sqrt(var0 + varMS) -
-                           exp(-dalph*dalph/ (2 * var0)) * sqrt(var0));
-         }
-         else {
-            term = exp(-dalph*dalph / (2 * var0)) / sqrt(2 * dpi * var0);
-         }
-         result[i] += term * yvalues[j] / norm[j];
+         result[i] += smearing_term(dalph, var0, varMS) * yvalues[j] / norm[j];
       }
    }
 
@@ -441,8 +525,13 @@ CobremsGeneration::CobremsGeneration(const CobremsGeneration &src)
    fCollimatorSpotrms = src.fCollimatorSpotrms;
    fCollimatorDistance = src.fCollimatorDistance;
    fCollimatorDiameter = src.fCollimatorDiameter;
+   fCollimatedFlag = src.fCollimatedFlag;
+   fPolarizedFlag = src.fPolarizedFlag;
+   fPhotonEnergyMin = src.fPhotonEnergyMin;
    fQ2theta2 = src.fQ2theta2;
    fQ2weight = src.fQ2weight;
+   fAcceptanceTables = src.fAcceptanceTables;
+   fSigma2MScoef = src.fSigma2MScoef;
 }
 
 CobremsGeneration &CobremsGeneration::operator=(const CobremsGeneration &src)
@@ -463,8 +552,13 @@ CobremsGeneration &CobremsGeneration::operator=(const CobremsGeneration &src)
    fCollimatorSpotrms = src.fCollimatorSpotrms;
    fCollimatorDistance = src.fCollimatorDistance;
    fCollimatorDiameter = src.fCollimatorDiameter;
+   fCollimatedFlag = src.fCollimatedFlag;
+   fPolarizedFlag = src.fPolarizedFlag;
+   fPhotonEnergyMin = src.fPhotonEnergyMin;
    fQ2theta2 = src.fQ2theta2;
    fQ2weight = src.fQ2weight;
+   fAcceptanceTables = src.fAcceptanceTables;
+   fSigma2MScoef = src.fSigma2MScoef;
    return *this;
 }
 
@@ -866,16 +960,115 @@ double CobremsGeneration::Acceptance(double theta2)
    // multiple-scattering in the target contribute to smearing of the
    // angular acceptance at the the collimator edge. The argument theta2
    // is the production polar angle theta^2 expressed in units of 
-   // (me/fBeamEnergy)^2.
+   // (me/fBeamEnergy)^2. The result is interpolated from a table of
+   // values computed by Acceptance_direct, with an absolute error less
+   // than fAcceptanceTolerance.
 
-   double acceptance = 0;
-   double niter = 50;
+   double thetaC = fCollimatorDiameter / (2 * fCollimatorDistance) *
+                                              fBeamEnergy / me;
+   double var0 = pow((fCollimatorSpotrms / fCollimatorDistance) *
+                                              fBeamEnergy / me, 2);
+   double varMS = Sigma2MS(fTargetThickness) * pow(fBeamEnergy / me, 2);
+   if (var0 <= 0) {
+      return Acceptance_direct(theta2, thetaC, var0, varMS);
+   }
+   const acceptance_table_t *table = getAcceptanceTable(thetaC, var0, varMS);
    double theta = sqrt(theta2);
+   if (theta >= table->theta_max) {
+      return 0;
+   }
+   double u = theta / table->dtheta;
+   int i = (int)u;
+   double t = u - i;
+   const double *p = &table->value[i];
+   return p[1] + 0.5 * t * (p[2] - p[0] +
+                      t * (2 * p[0] - 5 * p[1] + 4 * p[2] - p[3] +
+                      t * (3 * (p[1] - p[2]) + p[3] - p[0])));
+}
+
+const CobremsGeneration::acceptance_table_t *
+CobremsGeneration::getAcceptanceTable(double thetaC, double var0, double varMS)
+{
+   // Look up the acceptance table for the given collimator half-angle
+   // and beam angular spreads, or build a new one. The table covers
+   // theta from 0 up to 10 sigma beyond the collimator edge, where the
+   // acceptance has fallen to zero within machine precision. The grid
+   // is refined by factors of 2 until cubic interpolation reproduces
+   // the direct integral at all bin midpoints within the tolerance.
+
+   for (unsigned int n=0; n < fAcceptanceTables.size(); ++n) {
+      if (fAcceptanceTables[n].thetaC == thetaC &&
+          fAcceptanceTables[n].var0 == var0 &&
+          fAcceptanceTables[n].varMS == varMS)
+      {
+         return &fAcceptanceTables[n];
+      }
+   }
+
+   acceptance_table_t table;
+   table.thetaC = thetaC;
+   table.var0 = var0;
+   table.varMS = varMS;
+   table.theta_max = thetaC + 10 * sqrt(var0 + varMS);
+   for (int nbins = 64; nbins <= 16384; nbins *= 2) {
+      table.dtheta = table.theta_max / nbins;
+      table.value.resize(nbins + 3);
+      for (int i=0; i < nbins + 3; ++i) {
+         double theta = (i - 1) * table.dtheta;
+         table.value[i] = Acceptance_direct(theta*theta, thetaC, var0, varMS);
+      }
+      double maxerr = 0;
+      for (int i=0; i < nbins; ++i) {
+         const double *p = &table.value[i];
+         double interp = (9 * (p[1] + p[2]) - p[0] - p[3]) / 16;
+         double theta = (i + 0.5) * table.dtheta;
+         double exact = Acceptance_direct(theta*theta, thetaC, var0, varMS);
+         maxerr = (fabs(interp - exact) > maxerr)? fabs(interp - exact) :
+                                                   maxerr;
+      }
+      if (maxerr < fAcceptanceTolerance / 4)
+         break;
+   }
+
+#if COBREMS_GENERATOR_VERBOSITY > 0
+   std::cout << "CobremsGeneration::getAcceptanceTable - new table with "
+             << table.value.size() - 3 << " bins for thetaC=" << thetaC
+             << ", var0=" << var0 << ", varMS=" << varMS << std::endl;
+#endif
+
+   if (fAcceptanceTables.size() >= 4)
+      fAcceptanceTables.erase(fAcceptanceTables.begin());
+   fAcceptanceTables.push_back(table);
+   return &fAcceptanceTables.back();
+}
+
+double CobremsGeneration::Acceptance_direct(double theta2)
+{
+   // Computes the same collimator acceptance as Acceptance(theta2)
+   // above by direct numerical integration, without the lookup table.
+   // This is much slower than Acceptance, and only provided so that
+   // the accuracy of the tabulation can be checked.
+
    double thetaC = fCollimatorDiameter / (2 * fCollimatorDistance) *
                                               fBeamEnergy / me;
    double var0 = pow((fCollimatorSpotrms / fCollimatorDistance) *
                                               fBeamEnergy / me, 2);
    double varMS = Sigma2MS(fTargetThickness) * pow(fBeamEnergy / me, 2);
+   return Acceptance_direct(theta2, thetaC, var0, varMS);
+}
+
+double CobremsGeneration::Acceptance_direct(double theta2, double thetaC,
+                                           double var0, double varMS)
+{
+   // Numerical integration over the beam angular spread of the sharp
+   // collimator aperture with half-angle thetaC, all angles in units
+   // of me/fBeamEnergy. The beam spread is described by the variance
+   // var0 from the electron beam spot and varMS from multiple scattering
+   // in the radiator.
+
+   double acceptance = 0;
+   double niter = 50;
+   double theta = sqrt(theta2);
    if (theta < thetaC) {
       double u1 = thetaC - theta;
       if (u1*u1 / (var0 + varMS) > 20) {
@@ -966,8 +1159,36 @@ double CobremsGeneration::Sigma2MS(double thickness_m)
    // Some formulas, although valid for a reasonable range of target
    // thickness, can go negative for extremely small target thicknesses.
    // Here I protect against these unusual cases by taking the absolute value.
-
-   return fabs(Sigma2MS_Geant(thickness_m));
+   //
+   // This is called for every generated photon, so the Geant formula
+   // (see Sigma2MS_Geant) is evaluated here from thickness-independent
+   // coefficients that are only recomputed when the beam energy or the
+   // crystal changes.
+
+   if (fSigma2MScoef.Ebeam != fBeamEnergy ||
+       fSigma2MScoef.Z != fTargetCrystal.Z ||
+       fSigma2MScoef.density != fTargetCrystal.density)
+   {
+      double rBohr = 0.52917721e-10; // m
+      double F = 0.98; // probability cutoff in definition of sigma2MS
+      double Z = fTargetCrystal.Z;
+      double chi2cc = pow(0.39612e-2, 2) * Z * (Z + 1) *
+                      fTargetCrystal.density / 12; // GeV^2/m
+      double chi2alpha = 1.13 * pow(hbarc / (fBeamEnergy * rBohr * 0.885), 2) *
+                         pow(Z, 2/3.) * (1 + 3.34 * pow(alpha * Z, 2));
+      fSigma2MScoef.chi2c_per_m = chi2cc / pow(fBeamEnergy, 2);
+      fSigma2MScoef.gnu_per_m = fSigma2MScoef.chi2c_per_m /
+                                (1.167 * chi2alpha * 2 * (1 - F));
+      fSigma2MScoef.Ebeam = fBeamEnergy;
+      fSigma2MScoef.Z = fTargetCrystal.Z;
+      fSigma2MScoef.density = fTargetCrystal.density;
+   }
+   double F = 0.98;
+   double chi2c = fSigma2MScoef.chi2c_per_m * thickness_m;
+   double gnu = fSigma2MScoef.gnu_per_m * thickness_m;
+   if (gnu == 0)
+      return 0;
+   return fabs(chi2c / (1 + pow(F, 2)) * ((1 + gnu) / gnu * log1p(gnu) - 1));
 }
 
 double CobremsGeneration::Sigma2MS_Kaune(double thickness_m)
@@ -1071,26 +1292,218 @@ double CobremsGeneration::Sigma2MS_Hanson(double thickness_m)
    return theta2max * (B - 1.2) / 2;
 }
 
+void CobremsGeneration::EvaluateBatch(batch_function_t func, int n,
+                                      const double *x,
+                                      const double *arg1,
+                                      const double *arg2,
+                                      const double *thetax,
+                                      const double *thetay,
+                                      double *result,
+                                      int nthreads)
+{
+   // Evaluates one of the rate or polarization functions listed in
+   // batch_function_t for n points, writing the values into result[n].
+   // Arrays arg1 and arg2 hold the extra arguments of the selected
+   // function (see the enum declaration), and may be null if it does
+   // not take them. If thetax and thetay are not null then the radiator
+   // is set to orientation (thetax[i], thetay[i], fTargetThetaz) for
+   // point i, otherwise the present orientation is used for all points.
+   // Giving only one of thetax and thetay is an error.
+   // With nthreads > 1 the points are split into contiguous blocks that
+   // are evaluated in parallel, each by a private copy of this object
+   // that inherits the acceptance tables and other precomputed state
+   // built here beforehand. Setting nthreads = 0 selects the number of
+   // hardware threads. The orientation of this object is not changed.
+
+   if ((thetax == 0) != (thetay == 0)) {
+      std::cerr << "Error in CobremsGeneration::EvaluateBatch - "
+                << "thetax and thetay arrays must be given together, "
+                << "cannot continue." << std::endl;
+      exit(1);
+   }
+   if (fCollimatedFlag)
+      Acceptance(0);
+   Sigma2MS(fTargetThickness);
+
+   if (nthreads == 0)
+      nthreads = std::thread::hardware_concurrency();
+   if (nthreads > n / 16)
+      nthreads = n / 16;
+   if (nthreads < 2) {
+      double thetax0 = fTargetThetax;
+      double thetay0 = fTargetThetay;
+      evaluateBatchRange(func, 0, n, x, arg1, arg2, thetax, thetay, result);
+      if (thetax && thetay)
+         setTargetOrientation(thetax0, thetay0, fTargetThetaz);
+      return;
+   }
+   std::vector<std::thread> workers;
+   for (int t=0; t < nthreads; ++t) {
+      int begin = (long int)n * t / nthreads;
+      int end = (long int)n * (t + 1) / nthreads;
+      workers.push_back(std::thread([=]() {
+         CobremsGeneration gen(*this);
+         gen.evaluateBatchRange(func, begin, end, x, arg1, arg2,
+                                thetax, thetay, result);
+      }));
+   }
+   for (int t=0; t < nthreads; ++t) {
+      workers[t].join();
+   }
+}
+
+void CobremsGeneration::evaluateBatchRange(batch_function_t func,
+                                           int begin, int end,
+                                           const double *x,
+                                           const double *arg1,
+                                           const double *arg2,
+                                           const double *thetax,
+                                           const double *thetay,
+                                           double *result)
+{
+   // Evaluate points [begin,end) of a batch, see EvaluateBatch.
+
+   for (int i=begin; i < end; ++i) {
+      if (thetax && thetay)
+         setTargetOrientation(thetax[i], thetay[i], fTargetThetaz);
+      switch (func) {
+         case BATCH_RATE_DNTDX:
+            result[i] = Rate_dNtdx(x[i]);
+            break;
+         case BATCH_RATE_DNCDX:
+            result[i] = Rate_dNcdx(x[i]);
+            break;
+         case BATCH_RATE_DNIDX:
+            result[i] = Rate_dNidx(x[i]);
+            break;
+         case BATCH_RATE_DNCDXDP:
+            result[i] = Rate_dNcdxdp(x[i], arg1[i]);
+            break;
+         case BATCH_RATE_DNIDXDT2:
+            result[i] = Rate_dNidxdt2(x[i], arg1[i]);
+            break;
+         case BATCH_POLARIZATION:
+            result[i] = Polarization(x[i], arg1[i]);
+            break;
+         case BATCH_POLARIZATION_PHI:
+            result[i] = Polarization(x[i], arg1[i], arg2[i]);
+            break;
+         case BATCH_ABREMS_POLARIZATION:
+            result[i] = AbremsPolarization(x[i], arg1[i], arg2[i]);
+            break;
+      }
+   }
+}
+
 #ifdef BOOST_PYTHON_WRAPPING
 
-void CobremsGeneration::pyApplyBeamCrystalConvolution(int nbins, pyobject xarr,
-                                                                pyobject yarr)
+static double *pybuffer(boost::python::object arr, int n, const char *name)
 {
+   // Returns a pointer to the data buffer of a python array.array
+   // object, or null if the argument is None. The array must be of
+   // typecode 'd' and hold at least n elements, otherwise a python
+   // ValueError is raised, so that no C++ code ever reads or writes
+   // past the end of a python buffer of the wrong size or type.
+
    using boost::python::extract;
    typedef boost::python::tuple pytuple;
-   pytuple xtuple = extract<pytuple>(xarr.attr("buffer_info")());
-   pytuple ytuple = extract<pytuple>(yarr.attr("buffer_info")());
-   double *xbuf = reinterpret_cast<double*>((int)extract<int>(xtuple[0]));
-   double *ybuf = reinterpret_cast<double*>((int)extract<int>(ytuple[0]));
+   if (arr.is_none())
+      return 0;
+   std::string typecode = extract<std::string>(arr.attr("typecode"));
+   pytuple tuple = extract<pytuple>(arr.attr("buffer_info")());
+   long int length = extract<long int>(tuple[1]);
+   if (typecode != "d" || length < n) {
+      std::stringstream msg;
+      msg << "argument " << name << " must be an array('d') "
+          << "of at least " << n << " elements";
+      PyErr_SetString(PyExc_ValueError, msg.str().c_str());
+      boost::python::throw_error_already_set();
+   }
+   return reinterpret_cast<double*>((uintptr_t)extract<uintptr_t>(tuple[0]));
+}
+
+class pyReleaseGIL {
+   // Releases the python global interpreter lock for the lifetime
+   // of the object, so that other python threads can run while
+   // this one is busy inside a long C++ calculation.
+ public:
+   pyReleaseGIL() : fState(PyEval_SaveThread()) {}
+   ~pyReleaseGIL() { PyEval_RestoreThread(fState); }
+ private:
+   PyThreadState *fState;
+};
+
+void CobremsGeneration::pyApplyBeamCrystalConvolution(int nbins, pyobject xarr,
+                                                                pyobject yarr)
+{
+   double *xbuf = pybuffer(xarr, nbins, "xvalues");
+   double *ybuf = pybuffer(yarr, nbins, "yvalues");
+   if (xbuf == 0 || ybuf == 0) {
+      PyErr_SetString(PyExc_ValueError, "applyBeamCrystalConvolution - "
+                      "required argument array is missing");
+      boost::python::throw_error_already_set();
+   }
    applyBeamCrystalConvolution(nbins, xbuf, ybuf);
 }
 
+void CobremsGeneration::pyApplyBeamCrystalConvolution_direct(int nbins,
+                                                            pyobject xarr,
+                                                            pyobject yarr)
+{
+   double *xbuf = pybuffer(xarr, nbins, "xvalues");
+   double *ybuf = pybuffer(yarr, nbins, "yvalues");
+   if (xbuf == 0 || ybuf == 0) {
+      PyErr_SetString(PyExc_ValueError, "applyBeamCrystalConvolution_direct - "
+                      "required argument array is missing");
+      boost::python::throw_error_already_set();
+   }
+   applyBeamCrystalConvolution_direct(nbins, xbuf, ybuf);
+}
+
+void CobremsGeneration::pyEvaluateBatch(batch_function_t func, int n,
+                                        pyobject xarr, 
+                                        pyobject arg1arr,
+                                        pyobject arg2arr,
+                                        pyobject thetaxarr,
+                                        pyobject thetayarr,
+                                        pyobject resultarr,
+                                        int nthreads)
+{
+   if (n < 0) {
+      PyErr_SetString(PyExc_ValueError, "EvaluateBatch - "
+                      "number of points must not be negative");
+      boost::python::throw_error_already_set();
+   }
+   double *x = pybuffer(xarr, n, "x");
+   double *arg1 = pybuffer(arg1arr, n, "arg1");
+   double *arg2 = pybuffer(arg2arr, n, "arg2");
+   double *thetax = pybuffer(thetaxarr, n, "thetax");
+   double *thetay = pybuffer(thetayarr, n, "thetay");
+   double *result = pybuffer(resultarr, n, "result");
+   if (x == 0 || result == 0 ||
+       (arg1 == 0 && func >= BATCH_RATE_DNCDXDP) ||
+       (arg2 == 0 && func >= BATCH_POLARIZATION_PHI))
+   {
+      PyErr_SetString(PyExc_ValueError, "EvaluateBatch - "
+                      "required argument array is missing");
+      boost::python::throw_error_already_set();
+   }
+   if ((thetax == 0) != (thetay == 0)) {
+      PyErr_SetString(PyExc_ValueError, "EvaluateBatch - "
+                      "thetax and thetay must be given together");
+      boost::python::throw_error_already_set();
+   }
+   pyReleaseGIL nogil;
+   EvaluateBatch(func, n, x, arg1, arg2, thetax, thetay, result, nthreads);
+}
+
 double (CobremsGeneration::*Rate_dNtdx_1)(double) = &CobremsGeneration::Rate_dNtdx;
 double (CobremsGeneration::*Rate_dNtdx_3)(double, double, double) = &CobremsGeneration::Rate_dNtdx;
 double (CobremsGeneration::*Rate_dNcdx_1)(double) = &CobremsGeneration::Rate_dNcdx;
 double (CobremsGeneration::*Rate_dNcdx_3)(double, double, double) = &CobremsGeneration::Rate_dNcdx;
 double (CobremsGeneration::*Acceptance_1)(double) = &CobremsGeneration::Acceptance;
 double (CobremsGeneration::*Acceptance_4)(double, double, double, double) = &CobremsGeneration::Acceptance;
+double (CobremsGeneration::*Acceptance_direct_1)(double) = &CobremsGeneration::Acceptance_direct;
 double (CobremsGeneration::*Polarization_2)(double, double) = &CobremsGeneration::Polarization;
 double (CobremsGeneration::*Polarization_3)(double, double, double) = &CobremsGeneration::Polarization;
 
@@ -1100,6 +1513,18 @@ BOOST_PYTHON_MODULE(libcobrems)
    using boost::python::enum_;
    using boost::python::def;
 
+   enum_<CobremsGeneration::batch_function_t>("batch_function")
+      .value("BATCH_RATE_DNTDX", CobremsGeneration::BATCH_RATE_DNTDX)
+      .value("BATCH_RATE_DNCDX", CobremsGeneration::BATCH_RATE_DNCDX)
+      .value("BATCH_RATE_DNIDX", CobremsGeneration::BATCH_RATE_DNIDX)
+      .value("BATCH_RATE_DNCDXDP", CobremsGeneration::BATCH_RATE_DNCDXDP)
+      .value("BATCH_RATE_DNIDXDT2", CobremsGeneration::BATCH_RATE_DNIDXDT2)
+      .value("BATCH_POLARIZATION", CobremsGeneration::BATCH_POLARIZATION)
+      .value("BATCH_POLARIZATION_PHI", CobremsGeneration::BATCH_POLARIZATION_PHI)
+      .value("BATCH_ABREMS_POLARIZATION", CobremsGeneration::BATCH_ABREMS_POLARIZATION)
+      .export_values()
+   ;
+
    class_<CobremsGeneration, CobremsGeneration*>
          ("CobremsGeneration", 
           "coherent bremsstrahlung spectrum and polarization calculator, "
@@ -1147,6 +1572,7 @@ BOOST_PYTHON_MODULE(libcobrems)
       .def("getPolarizedFlag", &CobremsGeneration::getPolarizedFlag)
       .def("setPolarizedFlag", &CobremsGeneration::setPolarizedFlag)
       .def("applyBeamCrystalConvolution", &CobremsGeneration::pyApplyBeamCrystalConvolution)
+      .def("applyBeamCrystalConvolution_direct", &CobremsGeneration::pyApplyBeamCrystalConvolution_direct)
       .def("printBeamlineInfo", &CobremsGeneration::printBeamlineInfo)
       .def("printTargetCrystalInfo", &CobremsGeneration::printTargetCrystalInfo)
       .def("CoherentEnhancement", &CobremsGeneration::CoherentEnhancement)
@@ -1165,11 +1591,13 @@ BOOST_PYTHON_MODULE(libcobrems)
       .def("Polarization", Polarization_3)
       .def("Acceptance", Acceptance_1)
       .def("Acceptance", Acceptance_4)
+      .def("Acceptance_direct", Acceptance_direct_1)
       .def("Sigma2MS", &CobremsGeneration::Sigma2MS)
       .def("Sigma2MS_Kaune", &CobremsGeneration::Sigma2MS_Kaune)
       .def("Sigma2MS_PDG", &CobremsGeneration::Sigma2MS_PDG)
       .def("Sigma2MS_Geant", &CobremsGeneration::Sigma2MS_Geant)
       .def("Sigma2MS_Hanson", &CobremsGeneration::Sigma2MS_Hanson)
+      .def("EvaluateBatch", &CobremsGeneration::pyEvaluateBatch)
       .def_readonly("dpi", &CobremsGeneration::dpi)
       .def_readonly("me", &CobremsGeneration::me)
       .def_readonly("alpha", &CobremsGeneration::alpha)
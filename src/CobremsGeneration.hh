@@ -31,6 +31,20 @@
 
 class CobremsGeneration {
  public:
+
+   // functions that can be evaluated over arrays with EvaluateBatch
+   enum batch_function_t {
+      BATCH_RATE_DNTDX,              // Rate_dNtdx(x)
+      BATCH_RATE_DNCDX,              // Rate_dNcdx(x)
+      BATCH_RATE_DNIDX,              // Rate_dNidx(x)
+      BATCH_RATE_DNCDXDP,            // Rate_dNcdxdp(x, phi=arg1)
+      BATCH_RATE_DNIDXDT2,           // Rate_dNidxdt2(x, theta2=arg1)
+      BATCH_POLARIZATION,            // Polarization(x, theta2=arg1)
+      BATCH_POLARIZATION_PHI,        // Polarization(x, theta2=arg1, phi=arg2)
+      BATCH_ABREMS_POLARIZATION      // AbremsPolarization(x, theta2=arg1,
+                                     //                    phi=arg2)
+   };
+
    CobremsGeneration(double Emax_GeV, double Epeak_GeV);
    CobremsGeneration(const CobremsGeneration &src);
    CobremsGeneration &operator=(const CobremsGeneration &src);
@@ -129,9 +143,13 @@ class CobremsGeneration {
    double getTargetDebyeWallerConstant(double DebyeT_K, double T_K);
    void applyBeamCrystalConvolution(int nbins, double *xvalues, 
                                                double *yvalues);
+   void applyBeamCrystalConvolution_direct(int nbins, double *xvalues, 
+                                                      double *yvalues);
 #if BOOST_PYTHON_WRAPPING
    typedef boost::python::object pyobject;
    void pyApplyBeamCrystalConvolution(int nbins, pyobject xarr, pyobject yarr);
+   void pyApplyBeamCrystalConvolution_direct(int nbins, pyobject xarr,
+                                                        pyobject yarr);
 #endif
    void printBeamlineInfo();
    void printTargetCrystalInfo();
@@ -153,11 +171,22 @@ class CobremsGeneration {
    double Acceptance(double theta2, double phi, 
                      double xshift_m, double yshift_m);
    double Acceptance(double theta2);
+   double Acceptance_direct(double theta2);
    double Sigma2MS(double thickness_m);
    double Sigma2MS_Kaune(double thickness_m);
    double Sigma2MS_PDG(double thickness_m);
    double Sigma2MS_Geant(double thickness_m);
    double Sigma2MS_Hanson(double thickness_m);
+   void EvaluateBatch(batch_function_t func, int n, const double *x,
+                      const double *arg1, const double *arg2,
+                      const double *thetax, const double *thetay,
+                      double *result, int nthreads=1);
+#if BOOST_PYTHON_WRAPPING
+   void pyEvaluateBatch(batch_function_t func, int n, pyobject xarr,
+                        pyobject arg1arr, pyobject arg2arr,
+                        pyobject thetaxarr, pyobject thetayarr,
+                        pyobject resultarr, int nthreads);
+#endif
 
    // some math and physical constants
    static const double dpi;
@@ -169,9 +198,47 @@ class CobremsGeneration {
    std::vector<double> fQ2theta2;
    std::vector<double> fQ2weight;
 
+   // maximum absolute error allowed in the tabulated acceptance
+   static const double fAcceptanceTolerance;
+
  private:
    void resetTargetOrientation();
    void updateTargetOrientation();
+   void evaluateBatchRange(batch_function_t func, int begin, int end,
+                           const double *x, const double *arg1,
+                           const double *arg2, const double *thetax,
+                           const double *thetay, double *result);
+
+   // The collimator acceptance is a smooth function of the production
+   // angle theta that depends on the beam energy, collimator geometry,
+   // electron beam spot and radiator thickness. It is tabulated on a
+   // uniform grid in theta for each distinct set of these parameters,
+   // and rebuilt automatically whenever any of them changes. A few of
+   // the most recent tables are retained, so that methods that change
+   // the collimator settings temporarily do not force a rebuild.
+   struct acceptance_table_t {
+      double thetaC;                   // collimator half-angle (me/E)
+      double var0;                     // beam spot angular variance
+      double varMS;                    // multiple scattering variance
+      double dtheta;                   // grid spacing in theta
+      double theta_max;                // upper bound of the table
+      std::vector<double> value;       // A(|theta|) at (i-1)*dtheta
+   };
+   std::vector<acceptance_table_t> fAcceptanceTables;
+   const acceptance_table_t *getAcceptanceTable(double thetaC, double var0,
+                                                double varMS);
+   double Acceptance_direct(double theta2, double thetaC, double var0,
+                            double varMS);
+
+   // The theta-independent factors of the multiple-scattering formula
+   // are computed once for each beam energy and crystal, and reused.
+   struct sigma2MS_coefficients_t {
+      double Ebeam;
+      double Z;
+      double density;
+      double chi2c_per_m;
+      double gnu_per_m;
+   } fSigma2MScoef;
 
    // description of the radiator crystal lattice, here configured for diamond
    // but may be customized to describe any regular crystal
@@ -40,25 +40,12 @@
 #include "G4ParallelWorldProcess.hh"
 #include "G4PairProductionRelModel.hh"
 #include "G4NistManager.hh"
+#include "G4LogicalVolume.hh"
 
 #define VERBOSE_PAIRS_SPLITTING 1
 #define DO_PAIRCOH_IMPORTANCE_SAMPLE 1
 #define USE_ADAPTIVE_SAMPLER 1
 
-// If you set this flag to 1 then all beam photons that reach
-// the TPOL converter target will convert to e+e- pairs inside,
-// otherwise the standard pair conversion probabilities apply.
-#define FORCED_PTAR_PAIR_CONVERSION 0
-
-// If you set this flag to 1 then all beam photons that reach
-// the LIH2 target will undergo Bethe-Heitler conversion to e+e-
-// pairs inside, otherwise the standard pair conversion
-// probabilities apply.
-#define FORCED_LIH2_PAIR_CONVERSION 0
-#define FORCED_LIHE_PAIR_CONVERSION 0
-#define FORCED_BETG_PAIR_CONVERSION 0
-#define FORCED_TGT0_PAIR_CONVERSION 0
-
 // If the pair conversion target is a nucleus, the generator
 // needs to know what fraction of the events to throw as
 // elastic-nuclear vs quasi-elastic-nucleon, and in the case
@@ -91,7 +78,12 @@
 #include "G4TrackVector.hh"
 
 #include <stdio.h>
+#include <unistd.h>
 #include <iomanip>
+#include <sstream>
+#include <fstream>
+#include <cfloat>
+#include <CLHEP/Random/MTwistEngine.h>
 
 #ifdef USING_DIRACXX
 #include <TLorentzBoost.h>
@@ -107,7 +99,23 @@ void unif01(int n, double *u) {
 
 G4double GlueXBeamConversionProcess::fBHpair_mass_min = 0;
 
-std::vector<AdaptiveSampler*> GlueXBeamConversionProcess::fAdaptiveSamplerRegistry;
+AdaptiveSamplerTrainer *GlueXBeamConversionProcess::fAdaptiveSamplerTrainer = 0;
+AdaptiveSampler *GlueXBeamConversionProcess::fAdaptiveSamplerMaster = 0;
+int GlueXBeamConversionProcess::fAdaptiveSamplerCount = 0;
+long int GlueXBeamConversionProcess::fAdaptiveSamplerInterval = 0;
+double GlueXBeamConversionProcess::fFastXSTolerance = 0;
+int GlueXBeamConversionProcess::fInstanceCount = 0;
+std::string GlueXBeamConversionProcess::fXScacheDir;
+std::map<std::string, GlueXBeamConversionProcess::conversion_xs_entry_t*>
+            GlueXBeamConversionProcess::fXSregistry;
+std::vector<std::string> GlueXBeamConversionProcess::fForcedVolumes;
+int GlueXBeamConversionProcess::fForcedChannel = 0;
+double GlueXBeamConversionProcess::fForcedEnhancement = 0;
+
+// Each worker thread samples from its own shard of the shared
+// AdaptiveSampler tree, and reduces its statistics into the shared
+// tree after this many generated pairs.
+#define ADAPTIVE_SAMPLER_SYNC_INTERVAL 10000
 
 G4Mutex GlueXBeamConversionProcess::fMutex = G4MUTEX_INITIALIZER;
 int GlueXBeamConversionProcess::fStopBeamBeforeConverter = 0;
@@ -127,6 +135,9 @@ GlueXBeamConversionProcess::GlueXBeamConversionProcess(const G4String &name,
    fPaircohPDF(0),
    fTripletPDF(0),
    fAdaptiveSampler(0),
+   fAdaptiveSamplerPasses(0),
+   fForcedStep(0),
+   fForcedPairFraction(1),
    isInitialised(false),
    fTargetZ(0),
    fTargetA(0)
@@ -134,6 +145,7 @@ GlueXBeamConversionProcess::GlueXBeamConversionProcess(const G4String &name,
    verboseLevel = 0;
 
    G4AutoLock barrier(&fMutex);
+   ++fInstanceCount;
    if (fConfigured)
       return;
 
@@ -346,6 +358,57 @@ GlueXBeamConversionProcess::GlueXBeamConversionProcess(const G4String &name,
       }
    }
 
+   std::map<int,int> bhadaptpars;
+   if (user_opts->Find("BHADAPT", bhadaptpars)) {
+      fAdaptiveSamplerInterval = bhadaptpars[1];
+   }
+
+   std::map<int,double> bhfastxspars;
+   if (user_opts->Find("BHFASTXS", bhfastxspars)) {
+      fFastXSTolerance = bhfastxspars[1];
+      if (fFastXSTolerance <= 0)
+         fFastXSTolerance = 1e-7;
+   }
+
+   std::map<int,std::string> bhxscachepars;
+   if (user_opts->Find("BHXSCACHE", bhxscachepars)) {
+      fXScacheDir = bhxscachepars[1];
+   }
+
+   std::map<int,std::string> bhforcepars;
+   if (user_opts->Find("BHFORCE", bhforcepars)) {
+      std::string names = bhforcepars[1];
+      size_t p = 0;
+      while (p != names.npos) {
+         size_t pfin = names.find_first_of(",", p);
+         std::string name(names.substr(p, pfin - p));
+         if (name.size() > 0)
+            fForcedVolumes.push_back(name);
+         p = (pfin == names.npos)? pfin : pfin + 1;
+      }
+      std::map<int,double> bhbiaspars;
+      if (user_opts->Find("BHBIAS", bhbiaspars)) {
+         if (bhbiaspars.find(1) != bhbiaspars.end())
+            fForcedChannel = int(bhbiaspars[1]);
+         if (bhbiaspars.find(2) != bhbiaspars.end())
+            fForcedEnhancement = bhbiaspars[2];
+      }
+      if (fForcedChannel < 0 || fForcedChannel > 2) {
+         G4cerr << "Error in GlueXBeamConversionProcess constructor - "
+                << "BHBIAS channel " << fForcedChannel << " is not valid, "
+                << "must be 0 (pair+triplet), 1 (pair) or 2 (triplet), "
+                << "cannot continue." << G4endl;
+         exit(-1);
+      }
+      if (fForcedEnhancement != 0 && fForcedEnhancement < 1) {
+         G4cerr << "Error in GlueXBeamConversionProcess constructor - "
+                << "BHBIAS enhancement " << fForcedEnhancement
+                << " is not valid, must be 0 (forced) or at least 1, "
+                << "cannot continue." << G4endl;
+         exit(-1);
+      }
+   }
+
    fConfigured = 1;
 
    if (verboseLevel > 0) {
@@ -356,6 +419,11 @@ GlueXBeamConversionProcess::GlueXBeamConversionProcess(const G4String &name,
 	      << (fStopBeamAfterConverter? "yes" : "no") << G4endl
 	      << "    Stop beam after target? "
 	      << (fStopBeamAfterTarget? "yes" : "no") << G4endl;
+       for (unsigned int i=0; i < fForcedVolumes.size(); ++i) {
+          G4cout << "    Beam conversion in volume " << fForcedVolumes[i]
+                 << " is " << ((fForcedEnhancement > 0)? "enhanced" : "forced")
+                 << G4endl;
+       }
    }
 }
 
@@ -366,24 +434,44 @@ GlueXBeamConversionProcess::~GlueXBeamConversionProcess()
    if (fTripletPDF)
       delete fTripletPDF;
 #ifdef USING_DIRACXX
-   if (fPairsGeneration)
+   if (fPairsGeneration) {
+      if (fPairsGeneration->GetFastPath() && verboseLevel > 0) {
+         G4cout << "GlueXBeamConversionProcess - "
+                << fPairsGeneration->GetFastPathCount()
+                << " cross section evaluations in double precision, "
+                << fPairsGeneration->GetFallbackCount()
+                << " of them redone in long double." << G4endl;
+      }
       delete fPairsGeneration;
+   }
 #endif
+   if (fAdaptiveSampler) {
+      fAdaptiveSamplerTrainer->synchronize(fAdaptiveSampler);
+      delete fAdaptiveSampler;
+      G4AutoLock barrier(&fMutex);
+      if (--fAdaptiveSamplerCount == 0) {
+         if (fAdaptiveSamplerTrainer->getNdiscarded() > 0) {
+            G4cout << "GlueXBeamConversionProcess - "
+                   << fAdaptiveSamplerTrainer->getNdiscarded()
+                   << " samples collected on superseded AdaptiveSampler"
+                   << " trees were left out of the final statistics."
+                   << G4endl;
+         }
+         fAdaptiveSamplerTrainer->saveState("BHgen_stats.astate");
+         delete fAdaptiveSamplerTrainer;
+         delete fAdaptiveSamplerMaster;
+         fAdaptiveSamplerTrainer = 0;
+         fAdaptiveSamplerMaster = 0;
+      }
+   }
    G4AutoLock barrier(&fMutex);
-   int nsamplers = fAdaptiveSamplerRegistry.size();
-   if (nsamplers > 0) {
-      fAdaptiveSampler = fAdaptiveSamplerRegistry[0];
-      for (int i=nsamplers-1; i > 0; --i) {
-         std::stringstream astatefile;
-         astatefile << "BHgen_thread_" << i << ".astate";
-         fAdaptiveSamplerRegistry[i]->saveState(astatefile.str());
-         fAdaptiveSampler->mergeState(astatefile.str());
-         delete fAdaptiveSamplerRegistry[i];
-         fAdaptiveSamplerRegistry.erase(fAdaptiveSamplerRegistry.begin() + i);
-      }
-      fAdaptiveSamplerRegistry[0]->saveState("BHgen_stats.astate");
-      delete fAdaptiveSamplerRegistry[0];
-      fAdaptiveSamplerRegistry.clear();
+   if (--fInstanceCount == 0) {
+      std::map<std::string, conversion_xs_entry_t*>::iterator iter;
+      for (iter = fXSregistry.begin(); iter != fXSregistry.end(); ++iter) {
+         delete iter->second->table;
+         delete iter->second;
+      }
+      fXSregistry.clear();
    }
 }
 
@@ -416,6 +504,8 @@ void GlueXBeamConversionProcess::InitialiseProcess(const G4ParticleDefinition*)
       A.push_back(9.012);
       w.push_back(1);
       fPairsGeneration = new PairConversionGeneration(Z, A, w);
+      if (fFastXSTolerance > 0)
+         fPairsGeneration->SetFastPath(true, fFastXSTolerance);
 
 #if defined DO_TRIPLET_IMPORTANCE_SAMPLE || defined DO_PAIRCOH_IMPORTANCE_SAMPLE
       if (fTripletPDF == 0 || fPaircohPDF == 0) {
@@ -470,59 +560,68 @@ G4double GlueXBeamConversionProcess::PostStepGetPhysicalInteractionLength(
                                      G4double previousStepSize,
                                      G4ForceCondition *condition)
 {
+   fForcedStep = 0;
    const G4Step *step = G4ParallelWorldProcess::GetHyperStep();
    G4VPhysicalVolume *pvol = step->GetPostStepPoint()->GetPhysicalVolume();
    if (track.GetTrackID() == 1 && pvol && pvol->GetName() == "PTAR" &&
-       (FORCED_PTAR_PAIR_CONVERSION || 
-        fStopBeamBeforeConverter ||
-        fStopBeamAfterConverter ))
+       (fStopBeamBeforeConverter || fStopBeamAfterConverter))
    {
-      fPIL = G4VEmProcess::PostStepGetPhysicalInteractionLength(
-                             track, previousStepSize, condition);
+      fPIL = getConversionMeanFreePath(track, previousStepSize, condition);
       setConverterMaterial(4, 9);
       *condition = Forced;
       return 100*cm;
    }
    else if (track.GetTrackID() == 1 && pvol && pvol->GetName() == "LIH2" &&
-       (FORCED_LIH2_PAIR_CONVERSION || 
-        fStopBeamAfterTarget ))
+       fStopBeamAfterTarget)
    {
-      fPIL = G4VEmProcess::PostStepGetPhysicalInteractionLength(
-                             track, previousStepSize, condition);
+      fPIL = getConversionMeanFreePath(track, previousStepSize, condition);
       setConverterMaterial(1, 1);
       *condition = Forced;
       return 100*cm;
    }
    else if (track.GetTrackID() == 1 && pvol && pvol->GetName() == "TGT0" &&
-       (FORCED_TGT0_PAIR_CONVERSION || 
-        fStopBeamAfterTarget ))
+       fStopBeamAfterTarget)
    {
-      fPIL = G4VEmProcess::PostStepGetPhysicalInteractionLength(
-                             track, previousStepSize, condition);
+      fPIL = getConversionMeanFreePath(track, previousStepSize, condition);
       setConverterMaterial(82, 208);
       *condition = Forced;
       return 100*cm;
    }
    else if (track.GetTrackID() == 1 && pvol && pvol->GetName() == "BETG" &&
-       (FORCED_BETG_PAIR_CONVERSION || 
-        fStopBeamAfterTarget ))
+       fStopBeamAfterTarget)
    {
-      fPIL = G4VEmProcess::PostStepGetPhysicalInteractionLength(
-                             track, previousStepSize, condition);
+      fPIL = getConversionMeanFreePath(track, previousStepSize, condition);
       setConverterMaterial(4, 9);
       *condition = Forced;
       return 100*cm;
    }
    else if (track.GetTrackID() == 1 && pvol && pvol->GetName() == "LIHE" &&
-       (FORCED_LIHE_PAIR_CONVERSION || 
-        fStopBeamAfterTarget ))
+       fStopBeamAfterTarget)
    {
-      fPIL = G4VEmProcess::PostStepGetPhysicalInteractionLength(
-                             track, previousStepSize, condition);
+      fPIL = getConversionMeanFreePath(track, previousStepSize, condition);
       setConverterMaterial(2, 4);
       *condition = Forced;
       return 100*cm;
    }
+   else if (track.GetTrackID() == 1 && pvol &&
+            isForcedVolume(pvol->GetName()))
+   {
+      const G4Material *mat = pvol->GetLogicalVolume()->GetMaterial();
+      if (setConverterMaterial(mat) == 0) {
+         G4cerr << "Error in GlueXBeamConversionProcess - "
+                << "volume " << pvol->GetName() << " listed on the "
+                << "BHFORCE card is made of " << mat->GetName()
+                << ", whose main element Z=" << fTargetZ
+                << " A=" << fTargetA << " is not supported as a "
+                << "pair converter, cannot continue." << G4endl;
+         exit(-1);
+      }
+      fPIL = getConversionMeanFreePath(track, previousStepSize, condition,
+                                       &fForcedPairFraction);
+      fForcedStep = 1;
+      *condition = Forced;
+      return 100*cm;
+   }
    *condition = NotForced;
    return 1e99;
 }
@@ -604,6 +703,39 @@ G4VParticleChange *GlueXBeamConversionProcess::PostStepDoIt(
       hddm_s::ReactionList rea = event_info->getOutputRecord()->getReactions();
       rea(0).setWeight(rea(0).getWeight() * weight_factor);
    }
+   else if (fForcedStep) {
+
+      // The beam photon converts within this step with true probability
+      // pconv, but is made to convert with probability qconv instead,
+      // which is 1 for forced conversion and enhancement * pconv when
+      // enhanced. The ratio of the two probabilities is applied to the
+      // event weight whether the photon converts or not, so that the
+      // weighted sum over events reproduces the unbiased rates.
+
+      double pconv = 1 - exp(-step.GetStepLength() / fPIL);
+      if (fForcedChannel == 1)
+         pconv *= fForcedPairFraction;
+      else if (fForcedChannel == 2)
+         pconv *= 1 - fForcedPairFraction;
+      if (pconv <= 0)
+         return pParticleChange;
+      double qconv = 1;
+      if (fForcedEnhancement > 0 && fForcedEnhancement * pconv < 1)
+         qconv = fForcedEnhancement * pconv;
+      if (qconv < 1 && G4UniformRand() > qconv) {
+         scaleEventWeight((1 - pconv) / (1 - qconv));
+         return pParticleChange;
+      }
+      GenerateBeamPairConversion(step);
+      scaleEventWeight(pconv / qconv);
+
+      if (verboseLevel > 0) {
+         G4cout << "GlueXBeamConversionProcess: beam particle converted"
+                << " in volume " << step.GetPreStepPoint()
+                                       ->GetPhysicalVolume()->GetName()
+                << " with bias weight " << pconv / qconv << G4endl;
+      }
+   }
    else {
       GenerateBeamPairConversion(step);
 
@@ -651,6 +783,7 @@ void GlueXBeamConversionProcess::prepareImportanceSamplingPDFs()
    TThreeVectorReal p;
    g0.SetMom(p.SetPolar(kin,0,0));
    g0.SetPol(TThreeVector(0,0,0));
+   TThreeVectorReal pol0(0,0,0);
    p1.AllPol();
    e2.AllPol();
    e3.AllPol();
@@ -713,8 +846,10 @@ void GlueXBeamConversionProcess::prepareImportanceSamplingPDFs()
          p1.SetMom(q1);
          e2.SetMom(q2);
          e3.SetMom(q3);
-         LDouble_t tripXS = fPairsGeneration->DiffXS_triplet(g0,p1,e2,e3);
-         LDouble_t pairXS = fPairsGeneration->DiffXS_pair(g0,p1,e2);
+         LDouble_t tripXS = fPairsGeneration->DiffXS_triplet(g0, pol0, 0,
+                                                             p1, e2, e3);
+         LDouble_t pairXS = fPairsGeneration->DiffXS_pair(g0, pol0, 0,
+                                                          p1, e2);
          fTripletPDF->Psum += fTripletPDF->Pmax = tripXS * weight;
          fPaircohPDF->Psum += fPaircohPDF->Pmax = pairXS * weight;
          fTripletPDF->density.push_back(fTripletPDF->Pmax);
@@ -744,6 +879,430 @@ void GlueXBeamConversionProcess::prepareImportanceSamplingPDFs()
    fPaircohPDF->Psum = 0;
 }
 
+G4double GlueXBeamConversionProcess::getConversionMeanFreePath(
+                                     const G4Track &track,
+                                     G4double previousStepSize,
+                                     G4ForceCondition *condition,
+                                     G4double *pairFraction)
+{
+   // Return the mean free path for pair + triplet conversion of the
+   // photon in its present material, interpolated in log(E) from the
+   // tabulated total cross sections. If no table is available (built
+   // without Dirac++) fall back on the standard Geant4 model. If
+   // pairFraction is given, it is filled with the fraction of the
+   // total conversion cross section that is from pair production.
+
+   if (pairFraction)
+      *pairFraction = 1;
+   const conversion_xs_table_t *table = getConversionTable(track.GetMaterial());
+   if (table == 0) {
+      return G4VEmProcess::PostStepGetPhysicalInteractionLength(
+                           track, previousStepSize, condition);
+   }
+   int nbins = table->pair.size();
+   double u = (log(track.GetKineticEnergy()/GeV) - table->logEmin) /
+              table->dlogE;
+   if (u < 0)
+      return DBL_MAX;
+   u = (u > nbins - 1)? nbins - 1 : u;
+   int i = (u < nbins - 1)? (int)u : nbins - 2;
+   double f = u - i;
+   double pair = (1 - f) * table->pair[i] + f * table->pair[i+1];
+   double triplet = (1 - f) * table->triplet[i] + f * table->triplet[i+1];
+   if (pairFraction && pair + triplet > 0)
+      *pairFraction = pair / (pair + triplet);
+   return (pair + triplet > 0)? 1 / (pair + triplet) : DBL_MAX;
+}
+
+G4bool GlueXBeamConversionProcess::isForcedVolume(const G4String &name) const
+{
+   for (unsigned int i=0; i < fForcedVolumes.size(); ++i) {
+      if (name == fForcedVolumes[i])
+         return true;
+   }
+   return false;
+}
+
+int GlueXBeamConversionProcess::setConverterMaterial(const G4Material *mat)
+{
+   // Set the converter nucleus to the element that makes up the largest
+   // fraction by mass of material mat, with A rounded to the nearest
+   // nucleon number. Returns 1 on success, or 0 if the generator cannot
+   // handle that nucleus, either because there is no atomic form factor
+   // for it or no nuclear form factor (hydrogen is supported only as a
+   // bare proton).
+
+   const G4ElementVector *elements = mat->GetElementVector();
+   const G4double *fractions = mat->GetFractionVector();
+   int imax = 0;
+   for (unsigned int i=1; i < mat->GetNumberOfElements(); ++i) {
+      if (fractions[i] > fractions[imax])
+         imax = i;
+   }
+   const G4Element *elem = (*elements)[imax];
+   setConverterMaterial(elem->GetZasInt(), floor(elem->GetN() + 0.5));
+   if (fTargetZ == 1)
+      return (fTargetA == 1);
+   return (fTargetZ > 1 && fTargetZ < 93 && fTargetA >= fTargetZ);
+}
+
+void GlueXBeamConversionProcess::scaleEventWeight(double factor)
+{
+   // Multiply the weight of the current event in the output record by
+   // factor. Events from unweighted generators carry the hddm default
+   // weight of zero, which is taken to mean unit weight here.
+
+   const G4Event *event = G4RunManager::GetRunManager()->GetCurrentEvent();
+   GlueXUserEventInformation *event_info;
+   event_info = (GlueXUserEventInformation*)event->GetUserInformation();
+   if (event_info == 0 || event_info->getOutputRecord() == 0)
+      return;
+   hddm_s::PhysicsEventList pev = event_info->getOutputRecord()
+                                            ->getPhysicsEvents();
+   if (pev.size() == 0)
+      return;
+   hddm_s::ReactionList rea = pev(0).getReactions();
+   if (rea.size() == 0) {
+      rea = pev(0).addReactions();
+   }
+   double weight = rea(0).getWeight();
+   rea(0).setWeight(((weight == 0)? 1 : weight) * factor);
+}
+
+const GlueXBeamConversionProcess::conversion_xs_table_t *
+GlueXBeamConversionProcess::getConversionTable(const G4Material *mat)
+{
+   // Look up the conversion cross section table for this material, first
+   // in the thread-local map, then in the process-wide registry, and only
+   // build it if no other thread has done so already. The global mutex is
+   // only held to find the registry entry, the table itself is read or
+   // built under the lock of its own entry, so a thread building a table
+   // only holds up other threads that need the same one. If a cache
+   // directory is named by the BHXSCACHE card in control.in, tables are
+   // restored from there when available and saved there after being built.
+
+   std::map<const G4Material*, const conversion_xs_table_t*>::iterator it;
+   it = fXStables.find(mat);
+   if (it != fXStables.end())
+      return it->second;
+
+#ifndef USING_DIRACXX
+
+   fXStables[mat] = 0;
+   return 0;
+
+#else
+
+   std::string key = getConversionTableKey(mat);
+
+   conversion_xs_entry_t *entry;
+   {
+      G4AutoLock barrier(&fMutex);
+      std::map<std::string, conversion_xs_entry_t*>::iterator iter;
+      iter = fXSregistry.find(key);
+      if (iter == fXSregistry.end())
+         iter = fXSregistry.insert(std::make_pair(key,
+                                   new conversion_xs_entry_t)).first;
+      entry = iter->second;
+   }
+   G4AutoLock entry_barrier(&entry->mutex);
+   if (entry->table != 0) {
+      fXStables[mat] = entry->table;
+      return entry->table;
+   }
+
+   std::string fname;
+   if (fXScacheDir.size() > 0) {
+      unsigned long long int hash = 14695981039346656037ULL;
+      for (unsigned int i=0; i < key.size(); ++i) {
+         hash ^= (unsigned char)key[i];
+         hash *= 1099511628211ULL;
+      }
+      char hashname[40];
+      snprintf(hashname, 40, "/conversion_xs_%016llx.dat", hash);
+      fname = fXScacheDir + hashname;
+   }
+
+   conversion_xs_table_t *table = new conversion_xs_table_t;
+   if (fname.size() > 0 && readConversionTable(fname, key, table) == 0) {
+      G4cout << "GlueXBeamConversionProcess - conversion cross section "
+             << "table for " << mat->GetName() << " restored from "
+             << fname << G4endl;
+   }
+   else {
+      G4cout << "GlueXBeamConversionProcess - building conversion cross "
+             << "section table for " << mat->GetName() << ", please wait... "
+             << std::flush;
+      buildConversionTable(mat, table);
+      G4cout << "finished." << G4endl;
+      if (fname.size() > 0)
+         writeConversionTable(fname, key, table);
+   }
+   entry->table = table;
+   fXStables[mat] = table;
+   return table;
+
+#endif
+}
+
+std::string GlueXBeamConversionProcess::getConversionTableKey(
+                                        const G4Material *mat) const
+{
+   // Form a string that uniquely identifies the material composition on
+   // which the conversion cross section tables depend. The version tag
+   // must be bumped whenever the table construction in
+   // buildConversionTable changes, to invalidate old caches.
+
+   std::ostringstream key;
+   key << std::setprecision(17)
+       << "v1"
+       << ",lepton=" << ((fLeptonPairFamily == 1)? "mu" : "e");
+   const G4ElementVector *elements = mat->GetElementVector();
+   const G4double *natoms = mat->GetVecNbOfAtomsPerVolume();
+   for (unsigned int i=0; i < mat->GetNumberOfElements(); ++i) {
+      key << ",Z" << (*elements)[i]->GetZasInt()
+          << "=" << natoms[i]*cm3;
+   }
+   return key.str();
+}
+
+int GlueXBeamConversionProcess::readConversionTable(
+                                const std::string &fname,
+                                const std::string &key,
+                                conversion_xs_table_t *table)
+{
+   // Restore a conversion cross section table from a cache file written
+   // by writeConversionTable. Returns 0 on success, or non-zero if the
+   // file is missing, unreadable or was made for another key.
+
+   std::ifstream fin(fname.c_str());
+   if (!fin.good())
+      return 1;
+   std::string tag, fkey;
+   fin >> tag >> fkey;
+   if (tag != "key" || fkey != key)
+      return 2;
+   int nbins;
+   fin >> tag >> nbins >> table->logEmin >> table->dlogE;
+   if (tag != "table" || !fin.good() || nbins < 2)
+      return 3;
+   table->pair.resize(nbins);
+   table->triplet.resize(nbins);
+   for (int i=0; i < nbins; ++i) {
+      fin >> table->pair[i] >> table->triplet[i];
+      table->pair[i] /= mm;
+      table->triplet[i] /= mm;
+   }
+   if (fin.fail())
+      return 4;
+   return 0;
+}
+
+int GlueXBeamConversionProcess::writeConversionTable(
+                                const std::string &fname,
+                                const std::string &key,
+                                const conversion_xs_table_t *table)
+{
+   // Save a conversion cross section table to a cache file, going
+   // through a temporary file so that concurrent jobs sharing the
+   // same cache directory never see a partially written table.
+
+   std::ostringstream tmpname;
+   tmpname << fname << ".tmp" << getpid();
+   std::ofstream fout(tmpname.str().c_str());
+   if (!fout.good()) {
+      G4cerr << "Warning in GlueXBeamConversionProcess - "
+             << "unable to write conversion cross section table to "
+             << fname << ", continuing without the cache." << G4endl;
+      return 1;
+   }
+   int nbins = table->pair.size();
+   fout << std::setprecision(17)
+        << "key " << key << std::endl
+        << "table " << nbins << " " << table->logEmin << " "
+        << table->dlogE << std::endl;
+   for (int i=0; i < nbins; ++i) {
+      fout << table->pair[i] * mm << " "
+           << table->triplet[i] * mm << std::endl;
+   }
+   fout.close();
+   if (fout.fail() || rename(tmpname.str().c_str(), fname.c_str()) != 0) {
+      remove(tmpname.str().c_str());
+      return 2;
+   }
+   return 0;
+}
+
+void GlueXBeamConversionProcess::buildConversionTable(
+                                 const G4Material *mat,
+                                 conversion_xs_table_t *table)
+{
+   // Tabulate the total pair (nuclear + atomic coherent) and triplet
+   // conversion cross sections of this material from the pair threshold
+   // up to beyond the end of the GlueX photon spectrum. The atomic
+   // cross sections are integrated from the same polarized differential
+   // cross sections that are used to generate the conversions, and then
+   // weighted by the number of atoms of each element per unit volume.
+
+#ifdef USING_DIRACXX
+   double mLepton = (fLeptonPairFamily == 1)? mMuon : mElectron;
+   double Emin = 2 * mLepton;
+   double Emax = 20;
+   int nperdecade = 6;
+   int nbins = (int)ceil(log10(Emax / Emin) * nperdecade) + 1;
+   table->logEmin = log(Emin);
+   table->dlogE = log(Emax / Emin) / (nbins - 1);
+   table->pair.assign(nbins, 0);
+   table->triplet.assign(nbins, 0);
+
+   const G4ElementVector *elements = mat->GetElementVector();
+   const G4double *natoms = mat->GetVecNbOfAtomsPerVolume();
+   for (unsigned int n=0; n < mat->GetNumberOfElements(); ++n) {
+      std::vector<double> Z(1, (*elements)[n]->GetZasInt());
+      std::vector<double> A(1, (*elements)[n]->GetN());
+      std::vector<double> w(1, 1);
+      PairConversionGeneration gen(Z, A, w);
+      if (fFastXSTolerance > 0)
+         gen.SetFastPath(true, fFastXSTolerance);
+      for (int i=0; i < nbins; ++i) {
+         double kin = exp(table->logEmin + i * table->dlogE);
+         double pairXS, tripletXS;
+         integrateConversionXS(&gen, kin, pairXS, tripletXS);
+         table->pair[i] += natoms[n] * pairXS*barn;
+         table->triplet[i] += natoms[n] * tripletXS*barn;
+      }
+   }
+#endif
+}
+
+#ifdef USING_DIRACXX
+void GlueXBeamConversionProcess::integrateConversionXS(
+                                 PairConversionGeneration *gen,
+                                 double kin,
+                                 double &pairXS, double &tripletXS)
+{
+   // Monte Carlo integral of the unpolarized pair and triplet cross
+   // sections (barns) for a photon of energy kin (GeV), sampling the
+   // same variables as GenerateBeamPairConversion but without the
+   // importance-sampling tables. The sampler is private and restarted
+   // from the same seed at every energy, so that the statistical errors
+   // (about 1%) are strongly correlated between neighboring points and
+   // the table is smooth in E, and the event random number sequence is
+   // not disturbed.
+
+   const int npoints = 10000;
+   CLHEP::MTwistEngine engine(20161224);
+
+   LDouble_t mLepton = mElectron;
+   if (fLeptonPairFamily == 1)
+      mLepton = mMuon;
+   TPhoton gIn;
+   TLepton p1(mLepton);
+   TLepton e2(mLepton);
+   TLepton e3(mElectron);
+   gIn.SetMom(TThreeVectorReal(0, 0, kin));
+   gIn.SetPol(TThreeVector(0,0,0));
+   TThreeVectorReal pol0(0,0,0);
+
+   double pairsum = 0;
+   double tripletsum = 0;
+   for (int n=0; n < npoints; ++n) {
+      LDouble_t weight = 1;
+      LDouble_t Epos = mLepton + (kin - mLepton) * engine.flat();
+      weight *= kin - mLepton;
+      LDouble_t phi12 = 2*M_PI * engine.flat();
+      weight *= 2*M_PI;
+      LDouble_t phiR = 2*M_PI * engine.flat();
+      weight *= 2*M_PI;
+
+      // Generate Mpair as 1 / (M [M^2 + Mcut^2])
+      LDouble_t Mmin = 2 * mLepton;
+      LDouble_t Mcut = 10 * mLepton;
+      LDouble_t um0 = 1 + sqr(Mcut / Mmin);
+      LDouble_t um = pow(um0, engine.flat());
+      LDouble_t Mpair = Mcut / sqrt(um - 1 + 1e-99);
+      weight *= Mpair * (sqr(Mcut) + sqr(Mpair)) * log(um0) / (2 * sqr(Mcut));
+
+      // Generate qR^2 with weight 1 / [qR^2 sqrt(qRcut^2 + qR^2)]
+      LDouble_t qRmin = sqr(Mpair) /(2 * kin);
+      LDouble_t qRcut = 2 * mLepton;
+      LDouble_t uq0 = qRmin / (qRcut + sqrt(sqr(qRcut) + sqr(qRmin)));
+      LDouble_t uq = pow(uq0, engine.flat());
+      LDouble_t qR = 2 * qRcut * uq / (1 - sqr(uq));
+      LDouble_t qR2 = qR * qR;
+      weight *= qR2 * sqrt(1 + qR2 / sqr(qRcut)) * (-2 * log(uq0));
+      weight *= Mpair / (2 * kin);
+
+      LDouble_t k12star2 = sqr(Mpair / 2) - sqr(mLepton);
+      if (k12star2 < 0)
+         continue;
+      LDouble_t k12star = sqrt(k12star2);
+
+      // triplet kinematics, with a free recoil electron
+      LDouble_t E3 = sqrt(qR2 + sqr(mElectron));
+      LDouble_t E12 = kin + mElectron - E3;
+      LDouble_t costhetaR = (sqr(Mpair) / 2 + (kin + mElectron) *
+                             (E3 - mElectron)) / (kin * qR);
+      if (E12 > Mpair && Epos < E12 - mLepton && fabs(costhetaR) <= 1) {
+         LDouble_t q12mag = sqrt(sqr(E12) - sqr(Mpair));
+         LDouble_t costhetastar = (Epos - E12 / 2) * Mpair /
+                                  (k12star * q12mag);
+         if (fabs(costhetastar) <= 1) {
+            LDouble_t sinthetaR = sqrt(1 - sqr(costhetaR));
+            TFourVectorReal q3(E3, qR * sinthetaR * cos(phiR),
+                                   qR * sinthetaR * sin(phiR),
+                                   qR * costhetaR);
+            LDouble_t sinthetastar = sqrt(1 - sqr(costhetastar));
+            TThreeVectorReal k12(k12star * sinthetastar * cos(phi12),
+                                 k12star * sinthetastar * sin(phi12),
+                                 k12star * costhetastar);
+            TFourVectorReal q1(Mpair / 2, k12);
+            TFourVectorReal q2(Mpair / 2, -k12);
+            TLorentzBoost toLab(q3[1] / E12, q3[2] / E12,
+                                (q3[3] - kin) / E12);
+            q1.Boost(toLab);
+            q2.Boost(toLab);
+            p1.SetMom(q1);
+            e2.SetMom(q2);
+            e3.SetMom(q3);
+            tripletsum += gen->DiffXS_triplet(gIn, pol0, 0,
+                                              p1, e2, e3) * weight;
+         }
+      }
+
+      // pair kinematics, with the atom absorbing zero energy
+      LDouble_t Eneg = kin - Epos;
+      costhetaR = (sqr(Mpair) + qR2) / (2 * kin * qR);
+      if (kin > Mpair && Eneg > mLepton && fabs(costhetaR) <= 1) {
+         LDouble_t q12mag = sqrt(sqr(kin) - sqr(Mpair));
+         LDouble_t costhetastar = (Epos - kin / 2) * Mpair /
+                                  (k12star * q12mag);
+         if (fabs(costhetastar) <= 1) {
+            LDouble_t sinthetaR = sqrt(1 - sqr(costhetaR));
+            TThreeVectorReal q3(qR * sinthetaR * cos(phiR),
+                                qR * sinthetaR * sin(phiR),
+                                qR * costhetaR);
+            LDouble_t sinthetastar = sqrt(1 - sqr(costhetastar));
+            TThreeVectorReal k12(k12star * sinthetastar * cos(phi12),
+                                 k12star * sinthetastar * sin(phi12),
+                                 k12star * costhetastar);
+            TFourVectorReal q1(Mpair / 2, k12);
+            TFourVectorReal q2(Mpair / 2, -k12);
+            TLorentzBoost toLab(q3[1] / kin, q3[2] / kin,
+                                (q3[3] - kin) / kin);
+            q1.Boost(toLab);
+            q2.Boost(toLab);
+            p1.SetMom(q1);
+            e2.SetMom(q2);
+            pairsum += gen->DiffXS_pair(gIn, pol0, 0, p1, e2) * weight;
+         }
+      }
+   }
+   pairXS = pairsum / npoints;
+   tripletXS = tripletsum / npoints;
+}
+#endif
+
 void GlueXBeamConversionProcess::GenerateBeamPairConversion(const G4Step &step)
 {
    // Unlike the other GenerateXXX methods in this class, this method should
@@ -880,7 +1439,10 @@ void GlueXBeamConversionProcess::GenerateBeamPairConversion(const G4Step &step)
                         (fTripletPDF->Ntested / (fTripletPDF->Psum + 1e-99));
       LDouble_t Spaircoh = fPaircohPDF->Npassed *
                         (fPaircohPDF->Ntested / (fPaircohPDF->Psum + 1e-99));
-      if (Striplet < Spaircoh) {                     // try incoherent generation
+      bool tryTriplet = (Striplet < Spaircoh);
+      if (fForcedStep && fForcedChannel > 0)
+         tryTriplet = (fForcedChannel == 2);
+      if (tryTriplet) {                              // try incoherent generation
          ++fTripletPDF->Ntested;
    
          // Solve for the c.m. momentum of e+ in the pair 1,2 rest frame
@@ -960,7 +1522,8 @@ void GlueXBeamConversionProcess::GenerateBeamPairConversion(const G4Step &step)
 
          // Compute the differential cross section (barns/GeV^4)
          // returned as d(sigma)/(dE+ dphi+ d^3qR)
-         LDouble_t diffXS = fPairsGeneration->DiffXS_triplet(gIn, p1, e2, e3);
+         LDouble_t diffXS = fPairsGeneration->DiffXS_triplet(gIn,
+                            pol0, pol0.Length(), p1, e2, e3);
 
          // Use keep/discard algorithm
          LDouble_t Pfactor = diffXS * weight;
@@ -1041,7 +1604,8 @@ void GlueXBeamConversionProcess::GenerateBeamPairConversion(const G4Step &step)
          p1.SetMom(q1.Rotate(rockaxis, rockangle));
          e2.SetMom(q2.Rotate(rockaxis, rockangle));
          e3.SetMom(TThreeVectorReal(0,0,0));
-         LDouble_t diffXS = fPairsGeneration->DiffXS_pair(gIn, p1, e2);
+         LDouble_t diffXS = fPairsGeneration->DiffXS_pair(gIn,
+                            pol0, pol0.Length(), p1, e2);
    
          // Use keep/discard algorithm
          LDouble_t Pfactor = diffXS * weight;
@@ -1554,6 +2118,15 @@ void GlueXBeamConversionProcess::GenerateBetheHeitlerProcess(const G4Step &step)
    else {
       G4ParticleDefinition *ion = G4ParticleTable::GetParticleTable()
                            ->GetIonTable()->GetIon(fTargetZ, fTargetA);
+      if (ion == 0) {
+         G4cerr << "Error in GlueXBeamConversionProcess::"
+                << "GenerateBeamPairConversion - no recoil ion with "
+                << "Z=" << fTargetZ << " A=" << fTargetA
+                << " for the converter in volume "
+                << step.GetPreStepPoint()->GetPhysicalVolume()->GetName()
+                << ", cannot continue." << G4endl;
+         exit(-1);
+      }
       sec3 = new G4DynamicParticle(ion, psec3);
    }
    G4TrackVector secondaries;
@@ -1592,19 +2165,7 @@ void GlueXBeamConversionProcess::GenerateBetheHeitlerProcess(const G4Step &step)
    }
 
 #if USE_ADAPTIVE_SAMPLER
-   static int passes = 0;
-   ++passes; // thread safety not important here
-   int tens = 1000;
-   while (passes >= tens*10)
-      tens *= 10;
-   if (passes % tens == 0) {
-      std::cout << "AdaptiveSampler reports efficiency " 
-                << fAdaptiveSampler->getEfficiency()
-                << std::endl;
-      std::stringstream astatefile;
-      astatefile << "BHgen_thread_" << G4Threading::G4GetThreadId() << ".astate";
-      fAdaptiveSampler->saveState(astatefile.str());
-   }
+   synchronizeAdaptiveSampler();
 #endif
 
 #endif
@@ -1884,19 +2445,7 @@ void GlueXBeamConversionProcess::GenerateTripletProcess(const G4Step &step)
    }
 
 #if USE_ADAPTIVE_SAMPLER
-   static int passes = 0;
-   ++passes; // thread safety not important here
-   int tens = 1000;
-   while (passes >= tens*10)
-      tens *= 10;
-   if (passes % tens == 0) {
-      std::cout << "AdaptiveSampler reports efficiency " 
-                << fAdaptiveSampler->getEfficiency()
-                << std::endl;
-      std::stringstream astatefile;
-      astatefile << "BHgen_thread_" << G4Threading::G4GetThreadId() << ".astate";
-      fAdaptiveSampler->saveState(astatefile.str());
-   }
+   synchronizeAdaptiveSampler();
 #endif
 
 #endif
@@ -1904,13 +2453,48 @@ void GlueXBeamConversionProcess::GenerateTripletProcess(const G4Step &step)
 
 void GlueXBeamConversionProcess::prepareAdaptiveSampler()
 {
-   fAdaptiveSampler = new AdaptiveSampler(6, &unif01, 1);
-   fAdaptiveSampler->restoreState("BHgen.astate");
-   fAdaptiveSampler->setVerbosity(2);
-   fAdaptiveSampler->reset_stats();
+   // All threads train a single AdaptiveSampler tree in memory, each
+   // one sampling from its own private shard of the shared tree. If a
+   // BHADAPT interval is given in control.in, the shared tree is also
+   // adapted during the run each time that many new samples have been
+   // collected, otherwise it only accumulates statistics, which are
+   // saved at the end of the run for offline adaptation with adapt.
 
    G4AutoLock barrier(&fMutex);
-   fAdaptiveSamplerRegistry.push_back(fAdaptiveSampler);
+   if (fAdaptiveSamplerTrainer == 0) {
+      fAdaptiveSamplerMaster = new AdaptiveSampler(6, &unif01, 1);
+      fAdaptiveSamplerMaster->restoreState("BHgen.astate");
+      fAdaptiveSamplerMaster->setVerbosity(2);
+      fAdaptiveSamplerMaster->reset_stats();
+      fAdaptiveSamplerTrainer = new AdaptiveSamplerTrainer(
+                                    fAdaptiveSamplerMaster,
+                                    fAdaptiveSamplerInterval);
+   }
+   fAdaptiveSampler = fAdaptiveSamplerTrainer->newShard();
+   ++fAdaptiveSamplerCount;
+}
+
+void GlueXBeamConversionProcess::synchronizeAdaptiveSampler()
+{
+   // Reduce the statistics of this thread's shard into the shared
+   // tree at regular intervals, and report progress now and then.
+
+   if (++fAdaptiveSamplerPasses % ADAPTIVE_SAMPLER_SYNC_INTERVAL != 0)
+      return;
+   int newcells = fAdaptiveSamplerTrainer->synchronize(fAdaptiveSampler,
+                                                       false);
+   if (newcells > 0) {
+      G4cout << "AdaptiveSampler tree adapted, " << newcells
+             << " cells added" << G4endl;
+   }
+   long int tens = ADAPTIVE_SAMPLER_SYNC_INTERVAL;
+   while (fAdaptiveSamplerPasses >= tens*10)
+      tens *= 10;
+   if (fAdaptiveSamplerPasses % tens == 0) {
+      std::cout << "AdaptiveSampler reports efficiency " 
+                << fAdaptiveSamplerTrainer->getEfficiency()
+                << std::endl;
+   }
 }
 
 double GlueXBeamConversionProcess::nucleonFormFactor(double Q2_GeV,
@@ -21,6 +21,11 @@
 #include <AdaptiveSampler.hh>
 #include <G4AutoLock.hh>
 #include <G4Step.hh>
+#include <G4Material.hh>
+
+#include <map>
+#include <string>
+#include <vector>
 
 class GlueXBeamConversionProcess: public G4VEmProcess
 {
@@ -82,9 +87,58 @@ class GlueXBeamConversionProcess: public G4VEmProcess
    ImportanceSampler *fTripletPDF;
 
    AdaptiveSampler *fAdaptiveSampler;
+   long int fAdaptiveSamplerPasses;
    void prepareAdaptiveSampler();
+   void synchronizeAdaptiveSampler();
 
    void setConverterMaterial(double Z, double A);
+   int setConverterMaterial(const G4Material *mat);
+
+   // total pair and triplet conversion cross sections for one material,
+   // tabulated on a uniform grid in log(E) and shared by all threads
+   struct conversion_xs_table_t {
+      double logEmin;                // log of first photon energy (GeV)
+      double dlogE;                  // grid spacing in log(E)
+      std::vector<double> pair;      // macroscopic cross section (1/mm)
+      std::vector<double> triplet;   // macroscopic cross section (1/mm)
+   };
+   std::map<const G4Material*, const conversion_xs_table_t*> fXStables;
+
+   // entry in the process-wide table registry, with its own lock so
+   // that a table is built only once, without holding up the threads
+   // that are looking up or building the tables for other materials
+   struct conversion_xs_entry_t {
+      G4Mutex mutex;
+      conversion_xs_table_t *table;
+      conversion_xs_entry_t() : table(0) {}
+   };
+
+   G4double getConversionMeanFreePath(const G4Track &track,
+                                      G4double previousStepSize,
+                                      G4ForceCondition *condition,
+                                      G4double *pairFraction = 0);
+   const conversion_xs_table_t *getConversionTable(const G4Material *mat);
+   std::string getConversionTableKey(const G4Material *mat) const;
+   void buildConversionTable(const G4Material *mat,
+                             conversion_xs_table_t *table);
+   int readConversionTable(const std::string &fname,
+                           const std::string &key,
+                           conversion_xs_table_t *table);
+   int writeConversionTable(const std::string &fname,
+                            const std::string &key,
+                            const conversion_xs_table_t *table);
+   // runtime forced / enhanced conversion of beam photons in the
+   // volumes listed on the BHFORCE card, with the biasing weight
+   // folded into the event weight of the output record
+   int fForcedStep;
+   G4double fForcedPairFraction;
+   G4bool isForcedVolume(const G4String &name) const;
+   void scaleEventWeight(double factor);
+
+#ifdef USING_DIRACXX
+   void integrateConversionXS(PairConversionGeneration *gen, double kin,
+                              double &pairXS, double &tripletXS);
+#endif
 
  private:
    GlueXBeamConversionProcess() = delete;
@@ -95,7 +149,17 @@ class GlueXBeamConversionProcess: public G4VEmProcess
 
    static G4Mutex fMutex;
    static int fConfigured;
-   static std::vector<AdaptiveSampler*> fAdaptiveSamplerRegistry;
+   static AdaptiveSamplerTrainer *fAdaptiveSamplerTrainer;
+   static AdaptiveSampler *fAdaptiveSamplerMaster;
+   static int fAdaptiveSamplerCount;
+   static long int fAdaptiveSamplerInterval;
+   static double fFastXSTolerance;
+   static int fInstanceCount;
+   static std::string fXScacheDir;
+   static std::map<std::string, conversion_xs_entry_t*> fXSregistry;
+   static std::vector<std::string> fForcedVolumes;
+   static int fForcedChannel;         // 0=pair+triplet, 1=pair, 2=triplet
+   static double fForcedEnhancement;  // 0=always convert, >1 enhance
 
    static int fFormFactorChoice;
 
@@ -0,0 +1,529 @@
+//
+// GlueXCDCNavigation class implementation
+//
+// author: agent at local
+// version: october 18, 2026
+
+#include "GlueXCDCNavigation.hh"
+#include "GlueXUserOptions.hh"
+
+#include "G4Version.hh"
+#include "G4Tubs.hh"
+#include "G4VSolid.hh"
+#include "G4AffineTransform.hh"
+#include "G4AuxiliaryNavServices.hh"
+#include "G4LogicalVolumeStore.hh"
+#include "G4TransportationManager.hh"
+#include "G4Navigator.hh"
+#include "G4SystemOfUnits.hh"
+#include "G4PhysicalConstants.hh"
+#include "G4ios.hh"
+
+#include <algorithm>
+#include <math.h>
+
+G4Mutex GlueXCDCNavigation::fMutex = G4MUTEX_INITIALIZER;
+int GlueXCDCNavigation::fTablesBuilt = 0;
+std::vector<GlueXCDCNavigation::straw_mother_t> GlueXCDCNavigation::fMothers;
+std::vector<int> GlueXCDCNavigation::fMotherIndex;
+
+// Isotropic safety returned inside a straw mother volume is capped at
+// this distance, which is also how far beyond the track segment the
+// candidate straws are collected.
+double GlueXCDCNavigation::fSafetyMargin = 0.5*cm;
+
+// Minimum cosine between the direction and the normal of the surface
+// just exited, for that volume to be blocked from immediate re-entry.
+static const double kMinExitingCosine = 1e-3;
+
+GlueXCDCNavigation::GlueXCDCNavigation()
+{
+   G4AutoLock barrier(&fMutex);
+   if (! fTablesBuilt) {
+      BuildStrawTables();
+      fTablesBuilt = 1;
+   }
+}
+
+GlueXCDCNavigation::~GlueXCDCNavigation()
+{}
+
+int GlueXCDCNavigation::Install()
+{
+   // Replace the voxel navigation of the tracking navigator of the
+   // calling thread with an instance of this class, if requested by
+   // the CDCNAVIGATION card. Safe to call at the start of every run.
+
+   static G4ThreadLocal int installed = 0;
+   if (installed)
+      return 1;
+
+   GlueXUserOptions *user_opts = GlueXUserOptions::GetInstance();
+   if (user_opts == 0) {
+      G4cerr << "Error in GlueXCDCNavigation::Install - "
+             << "GlueXUserOptions::GetInstance() returns null, "
+             << "cannot continue." << G4endl;
+      exit(-1);
+   }
+   std::map<int,int> cdcnav;
+   if (! user_opts->Find("CDCNAVIGATION", cdcnav) || cdcnav[1] == 0)
+      return 0;
+
+#if G4VERSION_NUMBER >= 1040
+   G4TransportationManager *tmanager;
+   tmanager = G4TransportationManager::GetTransportationManager();
+   G4Navigator *navigator = tmanager->GetNavigatorForTracking();
+   navigator->SetVoxelNavigation(new GlueXCDCNavigation());
+   installed = 1;
+   return 1;
+#else
+   G4cerr << "GlueXCDCNavigation::Install warning - "
+          << "CDCNAVIGATION requires Geant4 10.4 or later, "
+          << "card ignored." << G4endl;
+   installed = 1;
+   return 0;
+#endif
+}
+
+void GlueXCDCNavigation::BuildStrawTables()
+{
+   // Build the straw ring tables for every logical volume that holds
+   // CDC straws as direct daughters. Called once with fMutex held.
+
+   G4LogicalVolumeStore *volumes = G4LogicalVolumeStore::GetInstance();
+   G4LogicalVolumeStore::iterator iter;
+   for (iter = volumes->begin(); iter != volumes->end(); ++iter) {
+      G4LogicalVolume *logvol = *iter;
+      int nstraws = 0;
+      for (int i=0; i < (int)logvol->GetNoDaughters(); ++i) {
+         G4String dname = logvol->GetDaughter(i)->GetLogicalVolume()
+                                                ->GetName();
+         if (dname == "STLA" || dname == "STRA")
+            ++nstraws;
+      }
+      if (nstraws == 0)
+         continue;
+      straw_mother_t mother;
+      if (BuildStrawMother(logvol, mother)) {
+         unsigned int id = logvol->GetInstanceID();
+         if (id >= fMotherIndex.size())
+            fMotherIndex.resize(id + 1, -1);
+         fMotherIndex[id] = fMothers.size();
+         fMothers.push_back(mother);
+         int nring = 0;
+         for (unsigned int r=0; r < mother.rings.size(); ++r)
+            nring += mother.rings[r].daughter.size();
+         G4cout << "GlueXCDCNavigation: navigating " << nring
+                << " straws in " << mother.rings.size()
+                << " rings of volume " << logvol->GetName()
+                << " analytically, " << mother.others.size()
+                << " other daughters" << G4endl;
+      }
+      else {
+         G4cerr << "GlueXCDCNavigation::BuildStrawTables warning - "
+                << "straws in volume " << logvol->GetName()
+                << " do not fit the straw ring model, "
+                << "keeping voxel navigation for it." << G4endl;
+      }
+   }
+}
+
+int GlueXCDCNavigation::BuildStrawMother(G4LogicalVolume *logvol,
+                                         straw_mother_t &mother)
+{
+   // Describe each full-phi tube daughter by the point where its axis
+   // comes closest to the z axis of the mother, then group them into
+   // rings of equal radius, stereo angle and z, and check that each
+   // ring is uniformly spaced in phi. Returns 0 if any ring is not.
+
+   struct straw_t {
+      int daughter;
+      double radius;
+      double tanstereo;
+      double z0;
+      double phi0;
+      double rstraw;
+      double zext;
+   };
+   std::vector<straw_t> straws;
+   mother.logvol = logvol;
+   mother.rings.clear();
+   mother.others.clear();
+   for (int i=0; i < (int)logvol->GetNoDaughters(); ++i) {
+      G4VPhysicalVolume *pvol = logvol->GetDaughter(i);
+      G4Tubs *tubs = dynamic_cast<G4Tubs*>(pvol->GetLogicalVolume()
+                                               ->GetSolid());
+      if (pvol->IsReplicated() || tubs == 0 ||
+          tubs->GetDeltaPhiAngle() < twopi - 1e-9)
+      {
+         mother.others.push_back(i);
+         continue;
+      }
+      G4ThreeVector axis = pvol->GetObjectRotationValue() *
+                           G4ThreeVector(0, 0, 1);
+      if (axis.z() < 0)
+         axis = -axis;
+      G4ThreeVector center = pvol->GetObjectTranslation();
+      double uxy2 = axis.perp2();
+      double s = 0;
+      if (uxy2 > 1e-12)
+         s = -(center.x() * axis.x() + center.y() * axis.y()) / uxy2;
+      G4ThreeVector p0 = center + s * axis;
+      straw_t straw;
+      straw.daughter = i;
+      straw.rstraw = tubs->GetOuterRadius();
+      straw.radius = p0.perp();
+      if (axis.z() < 0.5 || straw.radius < 10 * straw.rstraw) {
+         mother.others.push_back(i);
+         continue;
+      }
+      straw.phi0 = p0.phi();
+      G4ThreeVector tangent(-sin(straw.phi0), cos(straw.phi0), 0);
+      straw.tanstereo = (uxy2 > 1e-12)? axis.dot(tangent) / axis.z() : 0;
+      straw.z0 = (uxy2 > 1e-12)? p0.z() : 0;
+      double halfz = tubs->GetZHalfLength() * axis.z() +
+                     straw.rstraw * sqrt(uxy2);
+      straw.zext = std::max(fabs(center.z() + halfz - straw.z0),
+                            fabs(center.z() - halfz - straw.z0));
+      straws.push_back(straw);
+   }
+
+   std::vector<std::vector<straw_t> > members;
+   for (unsigned int i=0; i < straws.size(); ++i) {
+      unsigned int r;
+      for (r=0; r < members.size(); ++r) {
+         const straw_t &first = members[r][0];
+         if (fabs(straws[i].radius - first.radius) < 1e-3*mm &&
+             fabs(straws[i].tanstereo - first.tanstereo) < 1e-6 &&
+             fabs(straws[i].z0 - first.z0) < 1e-3*mm &&
+             fabs(straws[i].rstraw - first.rstraw) < 1e-6*mm)
+         {
+            break;
+         }
+      }
+      if (r == members.size())
+         members.push_back(std::vector<straw_t>());
+      members[r].push_back(straws[i]);
+   }
+
+   for (unsigned int r=0; r < members.size(); ++r) {
+      straw_ring_t ring;
+      int nstraws = members[r].size();
+      ring.radius = members[r][0].radius;
+      ring.tanstereo = members[r][0].tanstereo;
+      ring.z0 = members[r][0].z0;
+      ring.phi0 = members[r][0].phi0;
+      ring.dphi = twopi / nstraws;
+      ring.rstraw = members[r][0].rstraw;
+      ring.rmax = ring.radius;
+      ring.daughter.resize(nstraws, -1);
+      for (int n=0; n < nstraws; ++n) {
+         const straw_t &straw = members[r][n];
+         double phi = remainder(straw.phi0 - ring.phi0, twopi);
+         int k = (int)floor(phi / ring.dphi + 0.5);
+         if (fabs(phi - k * ring.dphi) > 1e-6)
+            return 0;
+         k = (k + nstraws) % nstraws;
+         if (ring.daughter[k] >= 0)
+            return 0;
+         ring.daughter[k] = straw.daughter;
+         double zt = straw.zext * ring.tanstereo;
+         ring.rmax = std::max(ring.rmax, sqrt(ring.radius * ring.radius +
+                                              zt * zt));
+      }
+      mother.rings.push_back(ring);
+   }
+   return (mother.rings.size() > 0);
+}
+
+void GlueXCDCNavigation::CollectCandidates(const straw_mother_t &mother,
+                                           const G4ThreeVector &point,
+                                           const G4ThreeVector &dir,
+                                           double length, double margin,
+                                           std::vector<int> &candidates)
+{
+   // Fill candidates with the daughter index of every straw whose
+   // volume comes within margin of the segment point + t*dir, for t
+   // in [0,length], plus some straws that do not. For each ring the
+   // segment is clipped to the annulus swept by the straw axes, and
+   // within each piece the azimuth of the segment and the stereo
+   // rotation of the straws are both monotonic in t, so their ends
+   // bound the range of straw phi0 that can be touched.
+
+   candidates = mother.others;
+   double A = dir.perp2();
+   double B = 2 * (point.x() * dir.x() + point.y() * dir.y());
+   double C = point.perp2();
+   bool duplicates = false;
+   for (unsigned int r=0; r < mother.rings.size(); ++r) {
+      const straw_ring_t &ring = mother.rings[r];
+      double sec = sqrt(1 + ring.tanstereo * ring.tanstereo);
+      double reach = (ring.rstraw + margin) * sec;
+      double rlo = std::max(ring.radius - reach, 0.);
+      double rhi = ring.rmax + reach;
+      double tspan[2][2];
+      int nspan = 0;
+      if (A < 1e-24) {
+         if (C >= rlo * rlo && C <= rhi * rhi) {
+            tspan[0][0] = 0;
+            tspan[0][1] = length;
+            nspan = 1;
+         }
+      }
+      else {
+         double disc = B * B - 4 * A * (C - rhi * rhi);
+         if (disc < 0)
+            continue;
+         double t0 = std::max((-B - sqrt(disc)) / (2 * A), 0.);
+         double t1 = std::min((-B + sqrt(disc)) / (2 * A), length);
+         if (t0 > t1)
+            continue;
+         disc = B * B - 4 * A * (C - rlo * rlo);
+         if (disc <= 0) {
+            tspan[0][0] = t0;
+            tspan[0][1] = t1;
+            nspan = 1;
+         }
+         else {
+            double tin = (-B - sqrt(disc)) / (2 * A);
+            double tout = (-B + sqrt(disc)) / (2 * A);
+            if (t0 <= std::min(t1, tin)) {
+               tspan[nspan][0] = t0;
+               tspan[nspan++][1] = std::min(t1, tin);
+            }
+            if (std::max(t0, tout) <= t1) {
+               tspan[nspan][0] = std::max(t0, tout);
+               tspan[nspan++][1] = t1;
+            }
+         }
+      }
+      int nstraws = ring.daughter.size();
+      for (int span=0; span < nspan; ++span) {
+         G4ThreeVector pa = point + tspan[span][0] * dir;
+         G4ThreeVector pb = point + tspan[span][1] * dir;
+         double rmin = std::max(std::min(pa.perp(), pb.perp()), rlo);
+         if (A > 1e-24) {
+            double tmin = -B / (2 * A);
+            if (tmin > tspan[span][0] && tmin < tspan[span][1])
+               rmin = std::max(sqrt(std::max(C - B * B / (4 * A), 0.)), rlo);
+         }
+         int kfirst = 0;
+         int klast = nstraws - 1;
+         if (reach < rmin) {
+            double phia = pa.phi();
+            double phib = phia + remainder(pb.phi() - phia, twopi);
+            double dza = atan((pa.z() - ring.z0) * ring.tanstereo /
+                              ring.radius);
+            double dzb = atan((pb.z() - ring.z0) * ring.tanstereo /
+                              ring.radius);
+            double width = asin(reach / rmin) + 1e-9;
+            double philo = std::min(phia, phib) - std::max(dza, dzb) - width;
+            double phihi = std::max(phia, phib) - std::min(dza, dzb) + width;
+            kfirst = (int)ceil((philo - ring.phi0) / ring.dphi);
+            klast = (int)floor((phihi - ring.phi0) / ring.dphi);
+            if (klast - kfirst >= nstraws) {
+               kfirst = 0;
+               klast = nstraws - 1;
+            }
+         }
+         for (int k=kfirst; k <= klast; ++k) {
+            int n = k % nstraws;
+            candidates.push_back(ring.daughter[(n < 0)? n + nstraws : n]);
+         }
+      }
+      duplicates |= (nspan > 1);
+   }
+   if (duplicates) {
+      std::sort(candidates.begin(), candidates.end());
+      candidates.erase(std::unique(candidates.begin(), candidates.end()),
+                       candidates.end());
+   }
+}
+
+G4bool GlueXCDCNavigation::LevelLocate(G4NavigationHistory &history,
+                                       const G4VPhysicalVolume *blockedVol,
+                                       const G4int blockedNum,
+                                       const G4ThreeVector &globalPoint,
+                                       const G4ThreeVector *globalDirection,
+                                       const G4bool pLocatedOnEdge,
+                                       G4ThreeVector &localPoint)
+{
+   // Search for the daughter volume containing localPoint among the
+   // straws whose section covers it, as G4VoxelNavigation does among
+   // the contents of the voxel node that contains it.
+
+   G4LogicalVolume *motherLogical = history.GetTopVolume()
+                                           ->GetLogicalVolume();
+   const straw_mother_t *mother = GetStrawMother(motherLogical);
+   if (mother == 0) {
+      return G4VoxelNavigation::LevelLocate(history, blockedVol, blockedNum,
+                                            globalPoint, globalDirection,
+                                            pLocatedOnEdge, localPoint);
+   }
+   CollectCandidates(*mother, localPoint, G4ThreeVector(0, 0, 1), 0, 0,
+                     fCandidates);
+   for (int i = fCandidates.size() - 1; i >= 0; --i) {
+      G4VPhysicalVolume *samplePhysical;
+      samplePhysical = motherLogical->GetDaughter(fCandidates[i]);
+      if (samplePhysical == blockedVol)
+         continue;
+      history.NewLevel(samplePhysical, kNormal, samplePhysical->GetCopyNo());
+      G4VSolid *sampleSolid = samplePhysical->GetLogicalVolume()->GetSolid();
+      G4ThreeVector samplePoint;
+      samplePoint = history.GetTopTransform().TransformPoint(globalPoint);
+      if (G4AuxiliaryNavServices::CheckPointOnSurface(sampleSolid,
+                                  samplePoint, globalDirection,
+                                  history.GetTopTransform(), pLocatedOnEdge))
+      {
+         localPoint = samplePoint;
+         return true;
+      }
+      history.BackLevel();
+   }
+   return false;
+}
+
+G4double GlueXCDCNavigation::ComputeStep(const G4ThreeVector &localPoint,
+                                         const G4ThreeVector &localDirection,
+                                         const G4double currentProposedStepLength,
+                                         G4double &newSafety,
+                                         G4NavigationHistory &history,
+                                         G4bool &validExitNormal,
+                                         G4ThreeVector &exitNormal,
+                                         G4bool &exiting,
+                                         G4bool &entering,
+                                         G4VPhysicalVolume *(*pBlockedPhysical),
+                                         G4int &blockedReplicaNo)
+{
+   // Same algorithm as G4NormalNavigation::ComputeStep, except that
+   // only the straws that can be reached before the track leaves the
+   // mother volume are intersected, and the isotropic safety is capped
+   // at fSafetyMargin, beyond which no straws have been considered.
+
+   G4VPhysicalVolume *motherPhysical = history.GetTopVolume();
+   G4LogicalVolume *motherLogical = motherPhysical->GetLogicalVolume();
+   const straw_mother_t *mother = GetStrawMother(motherLogical);
+   if (mother == 0) {
+      return G4VoxelNavigation::ComputeStep(localPoint, localDirection,
+                                            currentProposedStepLength,
+                                            newSafety, history,
+                                            validExitNormal, exitNormal,
+                                            exiting, entering,
+                                            pBlockedPhysical,
+                                            blockedReplicaNo);
+   }
+   G4VSolid *motherSolid = motherLogical->GetSolid();
+   G4double motherSafety = motherSolid->DistanceToOut(localPoint);
+   G4double ourSafety = std::min(motherSafety, fSafetyMargin);
+   G4double ourStep = currentProposedStepLength;
+
+   G4VPhysicalVolume *blockedExitedVol = 0;
+   if (exiting && validExitNormal) {
+      if (localDirection.dot(exitNormal) >= kMinExitingCosine) {
+         blockedExitedVol = *pBlockedPhysical;
+         ourSafety = 0;
+      }
+   }
+   exiting = false;
+   entering = false;
+
+   G4bool motherValidExitNormal = false;
+   G4ThreeVector motherExitNormal(0, 0, 0);
+   G4double motherStep = motherSolid->DistanceToOut(localPoint,
+                                                    localDirection, true,
+                                                    &motherValidExitNormal,
+                                                    &motherExitNormal);
+   G4double length = std::min(currentProposedStepLength, motherStep);
+   CollectCandidates(*mother, localPoint, localDirection, length,
+                     fSafetyMargin, fCandidates);
+   for (int i = fCandidates.size() - 1; i >= 0; --i) {
+      G4VPhysicalVolume *samplePhysical;
+      samplePhysical = motherLogical->GetDaughter(fCandidates[i]);
+      if (samplePhysical == blockedExitedVol)
+         continue;
+      G4AffineTransform sampleTf(samplePhysical->GetRotation(),
+                                 samplePhysical->GetTranslation());
+      sampleTf.Invert();
+      const G4ThreeVector samplePoint = sampleTf.TransformPoint(localPoint);
+      const G4VSolid *sampleSolid = samplePhysical->GetLogicalVolume()
+                                                  ->GetSolid();
+      const G4double sampleSafety = sampleSolid->DistanceToIn(samplePoint);
+      if (sampleSafety < ourSafety)
+         ourSafety = sampleSafety;
+      if (sampleSafety <= ourStep) {
+         G4ThreeVector sampleDirection = sampleTf.TransformAxis(localDirection);
+         const G4double sampleStep = sampleSolid->DistanceToIn(samplePoint,
+                                                               sampleDirection);
+         if (sampleStep <= ourStep) {
+            ourStep = sampleStep;
+            entering = true;
+            exiting = false;
+            *pBlockedPhysical = samplePhysical;
+            blockedReplicaNo = -1;
+         }
+      }
+   }
+
+   if (currentProposedStepLength < ourSafety) {
+      entering = false;
+      exiting = false;
+      *pBlockedPhysical = 0;
+      ourStep = kInfinity;
+   }
+   else if (motherSafety <= ourStep) {
+      if (motherStep <= ourStep) {
+         ourStep = motherStep;
+         exiting = true;
+         entering = false;
+         validExitNormal = motherValidExitNormal;
+         exitNormal = motherExitNormal;
+         if (motherValidExitNormal) {
+            const G4RotationMatrix *rot = motherPhysical->GetRotation();
+            if (rot)
+               exitNormal *= rot->inverse();
+         }
+      }
+      else {
+         validExitNormal = false;
+      }
+   }
+   newSafety = ourSafety;
+   return ourStep;
+}
+
+G4double GlueXCDCNavigation::ComputeSafety(const G4ThreeVector &localPoint,
+                                           const G4NavigationHistory &history,
+                                           const G4double pMaxLength)
+{
+   // Isotropic safety from localPoint to the mother surface and to the
+   // straws within fSafetyMargin of it, capped at fSafetyMargin.
+
+   G4LogicalVolume *motherLogical = history.GetTopVolume()
+                                           ->GetLogicalVolume();
+   const straw_mother_t *mother = GetStrawMother(motherLogical);
+   if (mother == 0) {
+      return G4VoxelNavigation::ComputeSafety(localPoint, history,
+                                              pMaxLength);
+   }
+   G4double motherSafety = motherLogical->GetSolid()
+                                        ->DistanceToOut(localPoint);
+   if (motherSafety == 0)
+      return 0;
+   G4double ourSafety = std::min(motherSafety, fSafetyMargin);
+   CollectCandidates(*mother, localPoint, G4ThreeVector(0, 0, 1), 0,
+                     fSafetyMargin, fCandidates);
+   for (unsigned int i=0; i < fCandidates.size(); ++i) {
+      G4VPhysicalVolume *samplePhysical;
+      samplePhysical = motherLogical->GetDaughter(fCandidates[i]);
+      G4AffineTransform sampleTf(samplePhysical->GetRotation(),
+                                 samplePhysical->GetTranslation());
+      sampleTf.Invert();
+      const G4ThreeVector samplePoint = sampleTf.TransformPoint(localPoint);
+      const G4VSolid *sampleSolid = samplePhysical->GetLogicalVolume()
+                                                  ->GetSolid();
+      const G4double sampleSafety = sampleSolid->DistanceToIn(samplePoint);
+      if (sampleSafety < ourSafety)
+         ourSafety = sampleSafety;
+   }
+   return ourSafety;
+}
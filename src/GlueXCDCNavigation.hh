@@ -0,0 +1,134 @@
+//
+// GlueXCDCNavigation class header
+//
+// author: agent at local
+// version: october 18, 2026
+//
+// This class replaces the generic smart voxel navigation of Geant4
+// inside the mother volumes of the CDC straws. The straws are built
+// by HddsG4Builder as individual G4PVPlacement daughters, many of
+// them stereo, so a track crossing the chamber visits a long list of
+// voxel slices whose contents are dominated by straws it never comes
+// near. Here each mother volume is described instead by a table of
+// straw rings, each ring having a radius of closest approach to the
+// beam axis, a stereo angle, and a uniform phi pitch. Given a point
+// or a straight segment in the mother frame, the few straws that it
+// can touch are computed directly from (ring, phi, z, stereo angle),
+// and only those are handed to the solids for exact intersections.
+//
+// The straw placements themselves are not changed, so the touchable
+// history, the copy numbers, and hence the ring/straw identifiers
+// seen by GlueXSensitiveDetectorCDC::GetIdent are exactly the same
+// as with voxel navigation. Any volume that is not described by the
+// ring model is navigated by the G4VoxelNavigation base class. The
+// src/utils/cdcnavcheck tool compares this navigation with the voxel
+// navigation, and the candidate straws with a brute force search, on
+// a CDC-like chamber with stereo layers.
+//
+// Enable it with the CDCNAVIGATION card in control.in. The straw ring
+// tables are "shared", and are built once from the closed geometry
+// the first time an instance is constructed. Instances of this class
+// are "thread-local", one per worker thread, and are owned by the
+// tracking navigator of that thread once Install() has been called.
+
+#ifndef GlueXCDCNavigation_h
+#define GlueXCDCNavigation_h 1
+
+#include "G4VoxelNavigation.hh"
+#include "G4LogicalVolume.hh"
+#include "G4VPhysicalVolume.hh"
+#include "G4NavigationHistory.hh"
+#include "G4ThreeVector.hh"
+#include "G4Threading.hh"
+#include "G4AutoLock.hh"
+
+#include <vector>
+
+class GlueXCDCNavigation : public G4VoxelNavigation
+{
+ public:
+   GlueXCDCNavigation();
+   virtual ~GlueXCDCNavigation();
+
+   static int Install();
+
+   virtual G4bool LevelLocate(G4NavigationHistory &history,
+                              const G4VPhysicalVolume *blockedVol,
+                              const G4int blockedNum,
+                              const G4ThreeVector &globalPoint,
+                              const G4ThreeVector *globalDirection,
+                              const G4bool pLocatedOnEdge,
+                              G4ThreeVector &localPoint);
+
+   virtual G4double ComputeStep(const G4ThreeVector &localPoint,
+                                const G4ThreeVector &localDirection,
+                                const G4double currentProposedStepLength,
+                                G4double &newSafety,
+                                G4NavigationHistory &history,
+                                G4bool &validExitNormal,
+                                G4ThreeVector &exitNormal,
+                                G4bool &exiting,
+                                G4bool &entering,
+                                G4VPhysicalVolume *(*pBlockedPhysical),
+                                G4int &blockedReplicaNo);
+
+   virtual G4double ComputeSafety(const G4ThreeVector &localPoint,
+                                  const G4NavigationHistory &history,
+                                  const G4double pMaxLength=DBL_MAX);
+
+   struct straw_ring_t {
+      double radius;      // distance of closest approach to the z axis
+      double tanstereo;   // signed tangent of the stereo angle
+      double z0;          // z of closest approach to the z axis
+      double phi0;        // azimuth of straw 0 at closest approach
+      double dphi;        // azimuthal pitch, 2 pi / nstraws
+      double rstraw;      // radius of the straw transverse section
+      double rmax;        // largest axis radius over the straw length
+      std::vector<int> daughter;  // daughter index of each straw
+   };
+
+   struct straw_mother_t {
+      G4LogicalVolume *logvol;
+      std::vector<straw_ring_t> rings;
+      std::vector<int> others;    // non-straw daughters, always checked
+   };
+
+   static void CollectCandidates(const straw_mother_t &mother,
+                                 const G4ThreeVector &point,
+                                 const G4ThreeVector &dir,
+                                 double length, double margin,
+                                 std::vector<int> &candidates);
+
+ protected:
+   std::vector<int> fCandidates;
+
+   static const straw_mother_t *GetStrawMother(const G4LogicalVolume *lvol);
+   static int BuildStrawMother(G4LogicalVolume *logvol,
+                               straw_mother_t &mother);
+   static void BuildStrawTables();
+
+   static double fSafetyMargin;
+
+ private:
+   GlueXCDCNavigation(const GlueXCDCNavigation &src);
+   GlueXCDCNavigation &operator=(const GlueXCDCNavigation &src);
+
+   static G4Mutex fMutex;
+   static int fTablesBuilt;
+   static std::vector<straw_mother_t> fMothers;
+   static std::vector<int> fMotherIndex;
+};
+
+inline const GlueXCDCNavigation::straw_mother_t *
+GlueXCDCNavigation::GetStrawMother(const G4LogicalVolume *logvol)
+{
+   // Look up the straw ring table for this mother volume by its
+   // logical volume instance ID, returns null if there is none.
+
+   unsigned int id = logvol->GetInstanceID();
+   if (id < fMotherIndex.size() && fMotherIndex[id] >= 0)
+      return &fMothers[fMotherIndex[id]];
+   return 0;
+}
+
+#endif
@@ -7,7 +7,9 @@
 #include "GlueXDetectorConstruction.hh"
 #include "GlueXDetectorMessenger.hh"
 #include "GlueXMagneticField.hh"
+#include "GlueXUserOptions.hh"
 #include "HddmOutput.hh"
+#include "HddsG4Cache.hh"
 
 #include "GlueXSensitiveDetectorCDC.hh"
 #include "GlueXSensitiveDetectorFDC.hh"
@@ -26,6 +28,7 @@
 #include "GlueXSensitiveDetectorPS.hh"
 #include "GlueXSensitiveDetectorTPOL.hh"
 #include "GlueXSensitiveDetectorCTOF.hh"
+#include "GlueXFastShowerBCAL.hh"
 
 
 #include "G4Version.hh"
@@ -75,6 +78,24 @@ using namespace xercesc;
 G4Mutex GlueXDetectorConstruction::fMutex = G4MUTEX_INITIALIZER;
 std::list<GlueXDetectorConstruction*> GlueXDetectorConstruction::fInstance;
 
+static std::string geometry_key(const std::string &mainfile,
+                                const std::string &cachekey)
+{
+   // Identify the geometry that was built, by the md5 checksum of the
+   // HDDS document if one is known, otherwise by the key computed from
+   // the contents of the HDDS xml files, see HddsG4Cache::ComputeKey.
+   // Returns an empty string if the geometry cannot be identified.
+
+   if (last_md5_checksum.size() > 0)
+      return std::string("md5:") + last_md5_checksum;
+   std::string key(cachekey);
+   if (key.size() == 0 && mainfile.size() > 0)
+      key = HddsG4Cache::ComputeKey(mainfile);
+   if (key.size() > 0)
+      return "hdds:" + key;
+   return "";
+}
+
 GlueXDetectorConstruction::GlueXDetectorConstruction(G4String hddsFile)
 : fMaxStep(0),
   fUniformField(0),
@@ -89,6 +110,53 @@ GlueXDetectorConstruction::GlueXDetectorConstruction(G4String hddsFile)
  
    fpDetectorMessenger = new GlueXDetectorMessenger(this);
 
+   // If a geometry cache directory is given in the GEOMCACHE card,
+   // look there for a translation of the same HDDS document, keyed
+   // by the contents of its source files, and if found build the
+   // Geant4 model from it without parsing any XML. Otherwise the
+   // translation below is recorded and saved there for next time.
+
+   std::string mainfile;
+   if (hddsFile.size() > 0)
+   {
+      mainfile = hddsFile;
+   }
+   else if (getenv("JANA_GEOMETRY_URL"))
+   {
+#ifndef FORCE_HDDS_FILES_PARSING
+      std::string url = getenv("JANA_GEOMETRY_URL");
+      if (url.substr(0,10) == "xmlfile://")
+         mainfile = url.substr(10);
+#else
+      if (getenv("HDDS_HOME"))
+         mainfile = std::string(getenv("HDDS_HOME")) + "/main_HDDS.xml";
+#endif
+   }
+   std::string cachefile;
+   std::string cachekey;
+   std::map<int, std::string> geomcache;
+   GlueXUserOptions *user_opts = GlueXUserOptions::GetInstance();
+   if (user_opts && user_opts->Find("GEOMCACHE", geomcache) &&
+       mainfile.size() > 0)
+   {
+      cachekey = HddsG4Cache::ComputeKey(mainfile);
+      if (cachekey.size() > 0)
+      {
+         cachefile = HddsG4Cache::CacheFileName(geomcache[1], cachekey);
+         std::string md5;
+         if (fHddsBuilder.readCache(cachefile, cachekey, md5))
+         {
+            if (md5.size() > 0)
+               last_md5_checksum = md5;
+            G4cout << APP_NAME << " - geometry loaded from cache "
+                   << cachefile << G4endl;
+            fGeometryKey = geometry_key(mainfile, cachekey);
+            return;
+         }
+         fHddsBuilder.recordTranslation();
+      }
+   }
+
    // Read the geometry description from a HDDS document
    // (Hall D Detector Specification) and build a Geant4
    // model of it in memory.
@@ -186,6 +254,15 @@ GlueXDetectorConstruction::GlueXDetectorConstruction(G4String hddsFile)
       exit(1);
    }
 
+   if (cachefile.size() > 0)
+   {
+      std::string md5(last_md5_checksum);
+      if (fHddsBuilder.writeCache(cachefile, cachekey, md5))
+         G4cout << APP_NAME << " - geometry cache written to "
+                << cachefile << G4endl;
+   }
+   fGeometryKey = geometry_key(mainfile, cachekey);
+
    XMLPlatformUtils::Terminate();
 }
 
@@ -199,6 +276,7 @@ GlueXDetectorConstruction(const GlueXDetectorConstruction &src)
    fUniformField = src.fUniformField;
    fpMagneticField = src.fpMagneticField; // shallow copy, sharing magfield
    fpDetectorMessenger = src.fpDetectorMessenger;  // shallow copy, sharing
+   fGeometryKey = src.fGeometryKey;
 }
 
 GlueXDetectorConstruction::~GlueXDetectorConstruction()
@@ -231,6 +309,18 @@ const HddsG4Builder *GlueXDetectorConstruction::GetBuilder()
    return 0;
 }
 
+std::string GlueXDetectorConstruction::GetGeometryKey()
+{
+   // Return a string that identifies the geometry built by the primary
+   // instance, for tagging files that are only valid for one geometry,
+   // or an empty string if it is not known.
+
+   G4AutoLock barrier(&fMutex);
+   if (fInstance.size() > 0)
+      return (*fInstance.begin())->fGeometryKey;
+   return "";
+}
+
 void GlueXDetectorConstruction::SetUniformField(G4double field_T)
 {
   // This method embeds the entire Hall D (spectrometer + beam line)
@@ -469,6 +559,12 @@ void GlueXDetectorConstruction::ConstructSDandField()
                 << G4endl;
       }
    }
+
+   // The fast shower model is thread-local, so each thread needs its own
+   if (GlueXFastShowerBCAL::IsActive()) {
+      new GlueXFastShowerBCAL("GlueXFastShowerBCAL",
+                              GlueXFastShowerBCAL::GetRegion());
+   }
 }
 
 void GlueXDetectorConstruction::CloneF()
@@ -61,6 +61,7 @@ class GlueXDetectorConstruction : public G4VUserDetectorConstruction
 
      static const GlueXDetectorConstruction* GetInstance();
      static const HddsG4Builder* GetBuilder();
+     static std::string GetGeometryKey();
 
   private:
      G4double fMaxStep;		// maximum step size for tracking
@@ -68,6 +69,7 @@ class GlueXDetectorConstruction : public G4VUserDetectorConstruction
      G4MagneticField* fpMagneticField; // pointer to the field manager
      GlueXDetectorMessenger* fpDetectorMessenger;  // pointer to the Messenger
      HddsG4Builder fHddsBuilder; // hdds translator object instance
+     std::string fGeometryKey;   // identifies the geometry that was built
 
      static G4Mutex fMutex;
      static std::list<GlueXDetectorConstruction*> fInstance;
@@ -0,0 +1,297 @@
+//
+// GlueXFastShowerBCAL class implementation
+//
+// author: agent at local
+// version: october 18, 2026
+
+#include "GlueXFastShowerBCAL.hh"
+#include "GlueXUserOptions.hh"
+
+#include "G4Gamma.hh"
+#include "G4Electron.hh"
+#include "G4Positron.hh"
+#include "G4FastTrack.hh"
+#include "G4FastStep.hh"
+#include "G4LogicalVolumeStore.hh"
+#include "G4TransportationManager.hh"
+#include "G4PhysicalConstants.hh"
+#include "G4SystemOfUnits.hh"
+#include "GFlashEnergySpot.hh"
+#include "Randomize.hh"
+#include "G4ios.hh"
+
+#include <stdlib.h>
+#include <math.h>
+#include <fstream>
+#include <sstream>
+#include <map>
+
+G4Region *GlueXFastShowerBCAL::fRegion = 0;
+std::string GlueXFastShowerBCAL::fVolumeName("BCAL");
+std::string GlueXFastShowerBCAL::fMatrixName("BM01");
+const G4Material *GlueXFastShowerBCAL::fMatrixMaterial = 0;
+double GlueXFastShowerBCAL::fEmin = 0;
+double GlueXFastShowerBCAL::fX0 = 0;
+double GlueXFastShowerBCAL::fRm = 0;
+double GlueXFastShowerBCAL::fEc = 0;
+double GlueXFastShowerBCAL::fMinDepth = 10.;
+double GlueXFastShowerBCAL::fEscale = 1.0;
+double GlueXFastShowerBCAL::fBeta = 0.5;
+double GlueXFastShowerBCAL::fTmaxOffset[2] = {-0.5, 0.5};
+double GlueXFastShowerBCAL::fRcore[2] = {0.10, 0.20};
+double GlueXFastShowerBCAL::fRtail[2] = {0.60, 0.60};
+double GlueXFastShowerBCAL::fPcore[2] = {0.90, 0.30};
+double GlueXFastShowerBCAL::fSpotsPerGeV = 200.;
+
+GlueXFastShowerBCAL::GlueXFastShowerBCAL(const G4String &name,
+                                         G4Region *envelope)
+ : G4VFastSimulationModel(name, envelope),
+   fStartDepth(0)
+{
+   fHitMaker = new GFlashHitMaker();
+   fNavigator = new G4Navigator();
+}
+
+GlueXFastShowerBCAL::~GlueXFastShowerBCAL()
+{
+   delete fHitMaker;
+   delete fNavigator;
+}
+
+int GlueXFastShowerBCAL::Configure()
+{
+   // Read the BCALFASTSIM card and the optional parameter table that
+   // it names, and set up the envelope region for the model. This must
+   // be called in the master thread after the geometry is constructed
+   // and before the physics processes are. Returns 1 if the model is
+   // enabled, otherwise 0.
+
+   GlueXUserOptions *user_opts = GlueXUserOptions::GetInstance();
+   if (user_opts == 0) {
+      G4cerr << "Error in GlueXFastShowerBCAL::Configure - "
+             << "GlueXUserOptions::GetInstance() returns null, "
+             << "cannot continue." << G4endl;
+      exit(-1);
+   }
+   std::map<int,std::string> fastsim;
+   if (! user_opts->Find("BCALFASTSIM", fastsim))
+      return 0;
+   fEmin = atof(fastsim[1].c_str()) * GeV;
+   if (fEmin <= 0) {
+      G4cerr << "GlueXFastShowerBCAL::Configure error - "
+             << "BCALFASTSIM card must start with a positive energy "
+             << "threshold in GeV, cannot continue." << G4endl;
+      exit(-1);
+   }
+
+   if (fastsim.find(2) != fastsim.end()) {
+      std::ifstream fin(fastsim[2].c_str());
+      if (! fin.good()) {
+         G4cerr << "GlueXFastShowerBCAL::Configure error - "
+                << "cannot open shower parameter table " << fastsim[2]
+                << " for input." << G4endl;
+         exit(-1);
+      }
+      std::string line;
+      while (std::getline(fin, line)) {
+         if (line.size() == 0 || line[0] == '#')
+            continue;
+         std::istringstream sline(line);
+         std::string keyword;
+         if (! (sline >> keyword))
+            continue;
+         int good;
+         if (keyword == "volume")
+            good = bool(sline >> fVolumeName);
+         else if (keyword == "matrix")
+            good = bool(sline >> fMatrixName);
+         else if (keyword == "mindepth")
+            good = bool(sline >> fMinDepth);
+         else if (keyword == "escale")
+            good = bool(sline >> fEscale);
+         else if (keyword == "beta")
+            good = (sline >> fBeta) && fBeta > 0;
+         else if (keyword == "tmax")
+            good = bool(sline >> fTmaxOffset[0] >> fTmaxOffset[1]);
+         else if (keyword == "rcore")
+            good = bool(sline >> fRcore[0] >> fRcore[1]);
+         else if (keyword == "rtail")
+            good = bool(sline >> fRtail[0] >> fRtail[1]);
+         else if (keyword == "pcore")
+            good = bool(sline >> fPcore[0] >> fPcore[1]);
+         else if (keyword == "spots")
+            good = (sline >> fSpotsPerGeV) && fSpotsPerGeV > 0;
+         else
+            good = 0;
+         if (! good) {
+            G4cerr << "GlueXFastShowerBCAL::Configure error - "
+                   << "bad line in " << fastsim[2] << ": " << line
+                   << G4endl;
+            exit(-1);
+         }
+      }
+   }
+
+   G4LogicalVolume *envelope = 0;
+   G4LogicalVolume *matrix = 0;
+   G4LogicalVolumeStore *volumes = G4LogicalVolumeStore::GetInstance();
+   for (unsigned int i=0; i < volumes->size(); ++i) {
+      if ((*volumes)[i]->GetName() == fVolumeName)
+         envelope = (*volumes)[i];
+      if ((*volumes)[i]->GetName() == fMatrixName)
+         matrix = (*volumes)[i];
+   }
+   if (envelope == 0 || matrix == 0) {
+      G4cerr << "GlueXFastShowerBCAL::Configure error - "
+             << "BCAL volume " << ((envelope)? fMatrixName : fVolumeName)
+             << " is not found in the geometry, cannot continue."
+             << G4endl;
+      exit(-1);
+   }
+
+   // Shower scales of the calorimeter matrix, using the effective Z
+   // for the critical energy of a mixture of lead and scintillator
+   fMatrixMaterial = matrix->GetMaterial();
+   fX0 = fMatrixMaterial->GetRadlen();
+   const G4ElementVector *elements = fMatrixMaterial->GetElementVector();
+   const G4double *atoms = fMatrixMaterial->GetVecNbOfAtomsPerVolume();
+   double zsum = 0;
+   double z2sum = 0;
+   for (unsigned int i=0; i < fMatrixMaterial->GetNumberOfElements(); ++i) {
+      double Z = (*elements)[i]->GetZ();
+      zsum += atoms[i] * Z;
+      z2sum += atoms[i] * Z * Z;
+   }
+   fEc = 610*MeV / (z2sum / zsum + 1.24);
+   fRm = 21.2052*MeV * fX0 / fEc;
+
+   // If the envelope already heads a region, eg. from the REGIONFILE
+   // table, the model is attached to that one.
+   if (envelope->IsRootRegion()) {
+      fRegion = envelope->GetRegion();
+   }
+   else {
+      fRegion = new G4Region("BCALfastShower");
+      fRegion->AddRootLogicalVolume(envelope);
+   }
+
+   G4cout << "GlueXFastShowerBCAL: fast showers above " << fEmin / GeV
+          << " GeV in " << fVolumeName << ", matrix "
+          << fMatrixMaterial->GetName() << " with X0 = " << fX0 / cm
+          << " cm, Rm = " << fRm / cm << " cm, Ec = " << fEc / MeV
+          << " MeV" << G4endl;
+   return 1;
+}
+
+G4bool GlueXFastShowerBCAL::IsApplicable(const G4ParticleDefinition &particle)
+{
+   return (&particle == G4Gamma::GammaDefinition() ||
+           &particle == G4Electron::ElectronDefinition() ||
+           &particle == G4Positron::PositronDefinition());
+}
+
+G4bool GlueXFastShowerBCAL::ModelTrigger(const G4FastTrack &fastTrack)
+{
+   // Trigger on particles above threshold that are just entering the
+   // envelope, provided the calorimeter matrix along their path is
+   // deep enough to contain most of the shower.
+
+   const G4Track *track = fastTrack.GetPrimaryTrack();
+   if (track->GetKineticEnergy() < fEmin)
+      return false;
+   const G4VSolid *solid = fastTrack.GetEnvelopeSolid();
+   G4ThreeVector lpos = fastTrack.GetPrimaryTrackLocalPosition();
+   G4ThreeVector ldir = fastTrack.GetPrimaryTrackLocalDirection();
+   if (solid->Inside(lpos) != kSurface ||
+       solid->SurfaceNormal(lpos).dot(ldir) >= 0)
+   {
+      return false;
+   }
+   G4double depth = solid->DistanceToOut(lpos, ldir);
+   fStartDepth = FindShowerStart(track->GetPosition(),
+                                 track->GetMomentumDirection(), depth);
+   return (fStartDepth >= 0 && depth - fStartDepth >= fMinDepth * fX0);
+}
+
+void GlueXFastShowerBCAL::DoIt(const G4FastTrack &fastTrack,
+                               G4FastStep &fastStep)
+{
+   // Stop the incident particle and deposit its energy as a set of
+   // spots distributed according to the parametrized profiles.
+
+   const G4Track *track = fastTrack.GetPrimaryTrack();
+   fastStep.KillPrimaryTrack();
+   fastStep.ProposePrimaryTrackPathLength(0.0);
+
+   G4double Eshower = track->GetKineticEnergy();
+   int kind = 0;
+   if (track->GetDefinition() == G4Positron::PositronDefinition())
+      Eshower += 2 * electron_mass_c2;
+   else if (track->GetDefinition() == G4Gamma::GammaDefinition())
+      kind = 1;
+
+   G4double Tmax = log(Eshower / fEc) + fTmaxOffset[kind];
+   if (Tmax < 0.5)
+      Tmax = 0.5;
+   G4double alpha = 1 + fBeta * Tmax;
+   int nspots = int(fSpotsPerGeV * Eshower / GeV);
+   nspots = (nspots < 20)? 20 : (nspots > 5000)? 5000 : nspots;
+
+   const G4ThreeVector &axis = track->GetMomentumDirection();
+   G4ThreeVector start = track->GetPosition() + fStartDepth * axis;
+   G4ThreeVector e1 = axis.orthogonal().unit();
+   G4ThreeVector e2 = axis.cross(e1);
+   const double rmax = 5.;
+   GFlashEnergySpot spot;
+   spot.SetEnergy(Eshower * fEscale / nspots);
+   for (int n=0; n < nspots; ++n) {
+      double t = CLHEP::RandGamma::shoot(alpha, fBeta);
+      double tau = t / Tmax;
+      double pcore = fPcore[0] - fPcore[1] * tau;
+      double R;
+      if (G4UniformRand() < pcore)
+         R = fRcore[0] + fRcore[1] * tau;
+      else
+         R = fRtail[0] + fRtail[1] * tau;
+      double umax = rmax * rmax / (rmax * rmax + R * R);
+      double u = umax * G4UniformRand();
+      double r = R * sqrt(u / (1 - u));
+      double phi = twopi * G4UniformRand();
+      spot.SetPosition(start + t * fX0 * axis +
+                       r * fRm * (cos(phi) * e1 + sin(phi) * e2));
+      fHitMaker->make(&spot, &fastTrack);
+   }
+}
+
+G4double GlueXFastShowerBCAL::FindShowerStart(const G4ThreeVector &pos,
+                                              const G4ThreeVector &dir,
+                                              G4double maxdist)
+{
+   // Returns the distance along the shower axis from pos to the point
+   // where it first enters the calorimeter matrix, or -1 if that does
+   // not happen within a distance maxdist.
+
+   if (fNavigator->GetWorldVolume() == 0) {
+      G4TransportationManager *tmanager;
+      tmanager = G4TransportationManager::GetTransportationManager();
+      G4Navigator *tracking = tmanager->GetNavigatorForTracking();
+      fNavigator->SetWorldVolume(tracking->GetWorldVolume());
+   }
+   G4double dist = 0;
+   G4VPhysicalVolume *pvol;
+   pvol = fNavigator->LocateGlobalPointAndSetup(pos, &dir, false, false);
+   for (int nsteps=0; pvol != 0 && nsteps < 100; ++nsteps) {
+      if (pvol->GetLogicalVolume()->GetMaterial() == fMatrixMaterial)
+         return dist;
+      G4double safety;
+      G4double step = fNavigator->ComputeStep(pos + dist * dir, dir,
+                                              maxdist - dist, safety);
+      if (step >= maxdist - dist)
+         break;
+      dist += step;
+      fNavigator->SetGeometricallyLimitedStep();
+      pvol = fNavigator->LocateGlobalPointAndSetup(pos + dist * dir,
+                                                   &dir, true);
+   }
+   return -1;
+}
@@ -0,0 +1,106 @@
+//
+// GlueXFastShowerBCAL class header
+//
+// author: agent at local
+// version: october 18, 2026
+//
+// This class is a Geant4 fast simulation model for electromagnetic
+// showers in the barrel calorimeter. It is enabled by the BCALFASTSIM
+// card in control.in, which gives the energy threshold above which
+// photons and electrons entering the BCAL envelope are replaced by a
+// parametrized shower, and optionally the name of a parameter table
+// that overrides the default shower profiles.
+//
+// The shower is laid down as a set of equal-energy spots. The depth of
+// each spot (in radiation lengths of the calorimeter matrix, measured
+// from the point where the shower axis enters the first sensitive
+// volume) is drawn from the gamma distribution
+//
+//    dE/dt = E b (b t)^(a-1) exp(-b t) / Gamma(a)
+//
+// with Tmax = (a-1)/b = ln(E/Ec) + C, C being different for photons and
+// electrons. The radius of each spot from the shower axis (in Moliere
+// radii) is drawn from a sum of a core and a tail component, each of
+// the form f(r) = 2 r R^2 / (r^2 + R^2)^2, with radii R and a core
+// fraction that vary linearly with t/Tmax. The spots are handed to the
+// GFlash hit maker, which locates them in the geometry and passes them
+// on to GlueXSensitiveDetectorBCAL as energy deposits in the cells.
+//
+// The lines of the parameter table are a keyword followed by values,
+//
+//   volume <logical volume>     envelope of the fast simulation (BCAL)
+//   matrix <logical volume>     volume whose material sets X0, Rm, Ec
+//   mindepth <X0>               minimum depth of matrix in the envelope
+//                               along the shower axis to trigger (10)
+//   escale <factor>             visible energy scale factor (1.0)
+//   beta <b>                    longitudinal profile slope b (0.5)
+//   tmax <C electron> <C gamma> shower maximum offsets (-0.5 0.5)
+//   rcore <R0> <R1>             core radius R0 + R1 t/Tmax (0.10 0.20)
+//   rtail <R0> <R1>             tail radius R0 + R1 t/Tmax (0.60 0.60)
+//   pcore <p0> <p1>             core fraction p0 - p1 t/Tmax (0.90 0.30)
+//   spots <n>                   number of spots per GeV (200)
+//
+// The defaults are generic, the values that reproduce full simulation
+// in the BCAL are found with the test/bcalfastshower.py tool.
+//
+// In the context of the Geant4 event-level multithreading model,
+// the static configuration is "shared", set up once by the master
+// thread through Configure(), and model instances are "thread-local",
+// one for each worker thread, created in ConstructSDandField.
+
+#ifndef GlueXFastShowerBCAL_h
+#define GlueXFastShowerBCAL_h 1
+
+#include "G4VFastSimulationModel.hh"
+#include "G4Region.hh"
+#include "G4Material.hh"
+#include "G4Navigator.hh"
+#include "GFlashHitMaker.hh"
+
+#include <string>
+
+class GlueXFastShowerBCAL : public G4VFastSimulationModel
+{
+ public:
+   GlueXFastShowerBCAL(const G4String &name, G4Region *envelope);
+   virtual ~GlueXFastShowerBCAL();
+
+   virtual G4bool IsApplicable(const G4ParticleDefinition &particle);
+   virtual G4bool ModelTrigger(const G4FastTrack &fastTrack);
+   virtual void DoIt(const G4FastTrack &fastTrack, G4FastStep &fastStep);
+
+   static int Configure();
+   static int IsActive() { return fRegion != 0; }
+   static G4Region *GetRegion() { return fRegion; }
+
+ protected:
+   G4double FindShowerStart(const G4ThreeVector &pos,
+                            const G4ThreeVector &dir, G4double maxdist);
+
+   GFlashHitMaker *fHitMaker;
+   G4Navigator *fNavigator;
+   G4double fStartDepth;
+
+ private:
+   GlueXFastShowerBCAL(const GlueXFastShowerBCAL &src);
+   GlueXFastShowerBCAL &operator=(const GlueXFastShowerBCAL &src);
+
+   static G4Region *fRegion;
+   static std::string fVolumeName;
+   static std::string fMatrixName;
+   static const G4Material *fMatrixMaterial;
+   static double fEmin;
+   static double fX0;
+   static double fRm;
+   static double fEc;
+   static double fMinDepth;
+   static double fEscale;
+   static double fBeta;
+   static double fTmaxOffset[2];
+   static double fRcore[2];
+   static double fRtail[2];
+   static double fPcore[2];
+   static double fSpotsPerGeV;
+};
+
+#endif
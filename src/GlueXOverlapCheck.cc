@@ -0,0 +1,373 @@
+//
+// GlueXOverlapCheck class implementation
+//
+// author: agent at local
+// version: october 18, 2026
+
+#include "GlueXOverlapCheck.hh"
+#include "GlueXUserOptions.hh"
+#include "G4LogicalVolumeStore.hh"
+#include "G4AffineTransform.hh"
+#include "G4VisExtent.hh"
+#include "G4VSolid.hh"
+#include "G4SystemOfUnits.hh"
+#include "G4ios.hh"
+#include "Randomize.hh"
+
+#include <stdio.h>
+#include <float.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <set>
+
+double GlueXOverlapCheck::fTolerance = 1e-3 * mm;
+int GlueXOverlapCheck::fMinPoints = 100;
+int GlueXOverlapCheck::fMaxPoints = 20000;
+double GlueXOverlapCheck::fRefineDistance = 1 * mm;
+double GlueXOverlapCheck::fRefineSpacing = 1 * mm;
+std::string GlueXOverlapCheck::fReportFile("overlaps.dat");
+std::vector<std::vector<GlueXOverlapCheck::box_t> >
+            GlueXOverlapCheck::fSisterBoxes;
+std::vector<int> GlueXOverlapCheck::fMotherIndex;
+
+static const char *overlap_kind[] = {"protrudes", "overlaps", "encloses"};
+
+int GlueXOverlapCheck::Requested()
+{
+   // Read the GEOMCHECK and GEOMCHECKFILE cards, returns 1 if the
+   // standalone overlap check was requested, otherwise 0.
+
+   GlueXUserOptions *user_opts = GlueXUserOptions::GetInstance();
+   if (user_opts == 0) {
+      G4cerr << "Error in GlueXOverlapCheck::Requested - "
+             << "GlueXUserOptions::GetInstance() returns null, "
+             << "cannot continue." << G4endl;
+      exit(-1);
+   }
+
+   std::map<int,double> geomcheck;
+   if (! user_opts->Find("GEOMCHECK", geomcheck))
+      return 0;
+   if (geomcheck.find(1) != geomcheck.end())
+      fTolerance = geomcheck[1] * mm;
+   if (geomcheck.find(2) != geomcheck.end() && geomcheck[2] > 0)
+      fMinPoints = geomcheck[2];
+   if (geomcheck.find(3) != geomcheck.end() && geomcheck[3] > 0)
+      fMaxPoints = geomcheck[3];
+   if (fMaxPoints < fMinPoints)
+      fMaxPoints = fMinPoints;
+   std::map<int,std::string> checkfile;
+   if (user_opts->Find("GEOMCHECKFILE", checkfile))
+      fReportFile = checkfile[1];
+   return 1;
+}
+
+int GlueXOverlapCheck::Run(int nthreads)
+{
+   // Check all placements in the geometry for overlaps using nthreads
+   // threads (0 selects the number of hardware threads), and write the
+   // overlap report. Returns the number of overlaps found.
+
+   std::chrono::steady_clock::time_point start;
+   start = std::chrono::steady_clock::now();
+
+   // Collect the placements and the bounding boxes of all daughters
+   // in the frame of their mother, which are shared by the threads.
+
+   G4LogicalVolumeStore *volumes = G4LogicalVolumeStore::GetInstance();
+   std::vector<placement_t> places;
+   std::set<G4VSolid*> solids;
+   fSisterBoxes.clear();
+   fMotherIndex.clear();
+   G4LogicalVolumeStore::iterator iter;
+   for (iter = volumes->begin(); iter != volumes->end(); ++iter) {
+      G4LogicalVolume *logvol = *iter;
+      int ndaughters = logvol->GetNoDaughters();
+      if (ndaughters == 0)
+         continue;
+      unsigned int id = logvol->GetInstanceID();
+      if (id >= fMotherIndex.size())
+         fMotherIndex.resize(id + 1, -1);
+      fMotherIndex[id] = fSisterBoxes.size();
+      fSisterBoxes.push_back(std::vector<box_t>(ndaughters));
+      for (int i=0; i < ndaughters; ++i) {
+         G4VPhysicalVolume *pvol = logvol->GetDaughter(i);
+         fSisterBoxes.back()[i] = MotherFrameBox(pvol);
+         if (pvol->IsReplicated())
+            continue;
+         placement_t place = {logvol, i};
+         places.push_back(place);
+         solids.insert(pvol->GetLogicalVolume()->GetSolid());
+      }
+   }
+
+   // Some solids set up their surface sampling tables on the first
+   // call to GetPointOnSurface, do that here before the threads start.
+
+   std::set<G4VSolid*>::iterator siter;
+   for (siter = solids.begin(); siter != solids.end(); ++siter)
+      (*siter)->GetPointOnSurface();
+
+   if (nthreads <= 0)
+      nthreads = std::thread::hardware_concurrency();
+   if (nthreads < 1)
+      nthreads = 1;
+#ifndef G4MULTITHREADED
+   // the random engine is only thread-local in multithreaded builds
+   nthreads = 1;
+#endif
+   G4cout << "GlueXOverlapCheck: checking " << places.size()
+          << " placements for overlaps larger than " << fTolerance / mm
+          << " mm using " << nthreads << " threads" << G4endl;
+
+   // Hand out the placements to the threads in small chunks, so that
+   // a few large mother volumes do not leave the other threads idle.
+
+   std::vector<result_t> results(places.size());
+   std::atomic<int> next_chunk(0);
+   const int chunk_size = 16;
+   auto worker = [&]() {
+      CLHEP::RanecuEngine engine;
+      G4Random::setTheEngine(&engine);
+      while (true) {
+         int begin = chunk_size * next_chunk++;
+         if (begin >= (int)places.size())
+            break;
+         int end = std::min(begin + chunk_size, (int)places.size());
+         for (int i=begin; i < end; ++i)
+            CheckPlacement(places[i], i + 1, results[i]);
+      }
+   };
+   std::vector<std::thread> threads;
+   for (int t=0; t < nthreads; ++t)
+      threads.push_back(std::thread(worker));
+   for (int t=0; t < nthreads; ++t)
+      threads[t].join();
+
+   int noverlaps = WriteReport(fReportFile, places, results);
+   std::chrono::duration<double> elapsed;
+   elapsed = std::chrono::steady_clock::now() - start;
+   G4cout << "GlueXOverlapCheck: found " << noverlaps << " overlaps in "
+          << elapsed.count() << " s, report written to " << fReportFile
+          << G4endl;
+   return noverlaps;
+}
+
+GlueXOverlapCheck::box_t
+GlueXOverlapCheck::MotherFrameBox(const G4VPhysicalVolume *pvol)
+{
+   // Return the axis-aligned box in the mother frame that contains
+   // the bounding box of the daughter solid placed as pvol.
+
+   G4VisExtent ext = pvol->GetLogicalVolume()->GetSolid()->GetExtent();
+   G4AffineTransform tf(pvol->GetRotation(), pvol->GetTranslation());
+   box_t box;
+   box.lo = G4ThreeVector(DBL_MAX, DBL_MAX, DBL_MAX);
+   box.hi = -box.lo;
+   for (int corner=0; corner < 8; ++corner) {
+      G4ThreeVector p((corner & 1)? ext.GetXmax() : ext.GetXmin(),
+                      (corner & 2)? ext.GetYmax() : ext.GetYmin(),
+                      (corner & 4)? ext.GetZmax() : ext.GetZmin());
+      p = tf.TransformPoint(p);
+      box.lo.set(std::min(box.lo.x(), p.x()), std::min(box.lo.y(), p.y()),
+                 std::min(box.lo.z(), p.z()));
+      box.hi.set(std::max(box.hi.x(), p.x()), std::max(box.hi.y(), p.y()),
+                 std::max(box.hi.z(), p.z()));
+   }
+   return box;
+}
+
+void GlueXOverlapCheck::CheckPlacement(const placement_t &place,
+                                       long int seed, result_t &result)
+{
+   // Sample points on the surface of the daughter and test them against
+   // the mother and the nearby sisters, adding one entry to the result
+   // for each neighbour that overlaps, with the largest depth found.
+
+   long int seeds[2] = {seed, 0x2545f491};
+   G4Random::setTheSeeds(seeds);
+
+   G4LogicalVolume *mother = place.mother;
+   G4VSolid *msolid = mother->GetSolid();
+   G4VPhysicalVolume *pvol = mother->GetDaughter(place.daughter);
+   G4VSolid *solid = pvol->GetLogicalVolume()->GetSolid();
+   G4AffineTransform tf(pvol->GetRotation(), pvol->GetTranslation());
+
+   int imother = fMotherIndex[mother->GetInstanceID()];
+   const std::vector<box_t> &boxes = fSisterBoxes[imother];
+   const box_t &mybox = boxes[place.daughter];
+   std::vector<int> sisters;
+   std::vector<G4AffineTransform> sister_tf;
+   for (int i=0; i < (int)boxes.size(); ++i) {
+      if (i == place.daughter ||
+          boxes[i].lo.x() > mybox.hi.x() + fTolerance ||
+          boxes[i].lo.y() > mybox.hi.y() + fTolerance ||
+          boxes[i].lo.z() > mybox.hi.z() + fTolerance ||
+          boxes[i].hi.x() < mybox.lo.x() - fTolerance ||
+          boxes[i].hi.y() < mybox.lo.y() - fTolerance ||
+          boxes[i].hi.z() < mybox.lo.z() - fTolerance)
+      {
+         continue;
+      }
+      G4VPhysicalVolume *sister = mother->GetDaughter(i);
+      if (sister->IsReplicated())
+         continue;
+      sisters.push_back(i);
+      G4AffineTransform stf(sister->GetRotation(), sister->GetTranslation());
+      sister_tf.push_back(stf.Inverse());
+   }
+
+   // The refined point count covers the daughter surface at a spacing
+   // of about fRefineSpacing, estimated from its bounding box.
+
+   G4ThreeVector size(mybox.hi - mybox.lo);
+   double area = 2 * (size.x() * size.y() + size.y() * size.z() +
+                      size.z() * size.x());
+   double nrefine = area / (fRefineSpacing * fRefineSpacing);
+   nrefine = std::max(nrefine, (double)fMinPoints);
+   nrefine = std::min(nrefine, (double)fMaxPoints);
+
+   std::map<int,overlap_t> found;
+   double clearance = DBL_MAX;
+   result.npoints = 0;
+   result.refined = 0;
+   for (int stage=0; stage < 2; ++stage) {
+      int npoints = (stage == 0)? fMinPoints : (int)nrefine - fMinPoints;
+      for (int n=0; n < npoints; ++n) {
+         G4ThreeVector mp = tf.TransformPoint(solid->GetPointOnSurface());
+         if (msolid->Inside(mp) == kOutside) {
+            double depth = msolid->DistanceToIn(mp);
+            if (depth > fTolerance) {
+               overlap_t &ov = found[-1];
+               if (ov.npoints++ == 0 || depth > ov.depth) {
+                  ov.depth = depth;
+                  ov.where = mp;
+               }
+            }
+            clearance = 0;
+         }
+         else {
+            clearance = std::min(clearance, msolid->DistanceToOut(mp));
+         }
+         for (unsigned int k=0; k < sisters.size(); ++k) {
+            G4VSolid *ssolid = mother->GetDaughter(sisters[k])->
+                                       GetLogicalVolume()->GetSolid();
+            G4ThreeVector sp = sister_tf[k].TransformPoint(mp);
+            EInside inside = ssolid->Inside(sp);
+            if (inside == kInside) {
+               double depth = ssolid->DistanceToOut(sp);
+               if (depth > fTolerance) {
+                  overlap_t &ov = found[sisters[k]];
+                  if (ov.npoints++ == 0 || depth > ov.depth) {
+                     ov.depth = depth;
+                     ov.where = mp;
+                  }
+               }
+               clearance = 0;
+            }
+            else if (inside == kSurface) {
+               clearance = 0;
+            }
+            else {
+               clearance = std::min(clearance, ssolid->DistanceToIn(sp));
+            }
+         }
+      }
+      result.npoints += npoints;
+      if (found.size() == 0 && clearance > fRefineDistance)
+         break;
+      result.refined = 1;
+   }
+   std::map<int,overlap_t>::iterator fiter;
+   for (fiter = found.begin(); fiter != found.end(); ++fiter) {
+      fiter->second.kind = (fiter->first < 0)? 0 : 1;
+      fiter->second.sister = fiter->first;
+      result.overlaps.push_back(fiter->second);
+   }
+
+   // A sister lying entirely inside the daughter has no surface points
+   // inside it, so also test one surface point of each sister that was
+   // not already found to overlap.
+
+   G4AffineTransform inverse(tf.Inverse());
+   for (unsigned int k=0; k < sisters.size(); ++k) {
+      if (found.find(sisters[k]) != found.end())
+         continue;
+      G4VPhysicalVolume *sister = mother->GetDaughter(sisters[k]);
+      G4AffineTransform stf(sister->GetRotation(), sister->GetTranslation());
+      G4VSolid *ssolid = sister->GetLogicalVolume()->GetSolid();
+      G4ThreeVector mp = stf.TransformPoint(ssolid->GetPointOnSurface());
+      G4ThreeVector dp = inverse.TransformPoint(mp);
+      if (solid->Inside(dp) == kInside) {
+         double depth = solid->DistanceToOut(dp);
+         if (depth > fTolerance) {
+            overlap_t ov = {2, sisters[k], depth, mp, 1};
+            result.overlaps.push_back(ov);
+         }
+      }
+   }
+}
+
+int GlueXOverlapCheck::WriteReport(const std::string &fname,
+                                   const std::vector<placement_t> &places,
+                                   const std::vector<result_t> &results)
+{
+   // Write one line per overlap found, with the names and copy numbers
+   // of the volumes, the largest depth and where it was found in the
+   // mother frame, and the number of sample points that overlapped.
+   // Returns the number of overlaps.
+
+   long int total_points = 0;
+   int total_refined = 0;
+   int noverlaps = 0;
+   for (unsigned int i=0; i < results.size(); ++i) {
+      total_points += results[i].npoints;
+      total_refined += results[i].refined;
+      noverlaps += results[i].overlaps.size();
+   }
+
+   std::string tmpname(fname + ".tmp");
+   std::ofstream fout(tmpname.c_str());
+   fout << "# HDGeant4 overlap report written by a GEOMCHECK run"
+        << " with tolerance " << fTolerance / mm << " mm" << std::endl
+        << "# " << places.size() << " placements checked, "
+        << total_refined << " resampled at high density, "
+        << total_points << " surface points, "
+        << noverlaps << " overlaps found" << std::endl
+        << "# kind      mother       volume         copy"
+        << " sister         copy   depth(mm)"
+        << "       x(mm)       y(mm)       z(mm)   points" << std::endl;
+   for (unsigned int i=0; i < results.size(); ++i) {
+      G4LogicalVolume *mother = places[i].mother;
+      G4VPhysicalVolume *pvol = mother->GetDaughter(places[i].daughter);
+      for (unsigned int j=0; j < results[i].overlaps.size(); ++j) {
+         const overlap_t &ov = results[i].overlaps[j];
+         std::string sister_name("-");
+         int sister_copy = -1;
+         if (ov.sister >= 0) {
+            G4VPhysicalVolume *sister = mother->GetDaughter(ov.sister);
+            sister_name = sister->GetLogicalVolume()->GetName();
+            sister_copy = sister->GetCopyNo();
+         }
+         char line[250];
+         snprintf(line, 250, "%-9s %-12s %-12s %6d %-12s %6d %11.4f"
+                             " %11.3f %11.3f %11.3f %8d",
+                  overlap_kind[ov.kind], mother->GetName().c_str(),
+                  pvol->GetLogicalVolume()->GetName().c_str(),
+                  pvol->GetCopyNo(), sister_name.c_str(), sister_copy,
+                  ov.depth / mm, ov.where.x() / mm, ov.where.y() / mm,
+                  ov.where.z() / mm, ov.npoints);
+         fout << line << std::endl;
+      }
+   }
+   fout.close();
+   if (! fout.good() || rename(tmpname.c_str(), fname.c_str()) != 0) {
+      G4cerr << "GlueXOverlapCheck::WriteReport error - "
+             << "unable to write " << fname << G4endl;
+   }
+   return noverlaps;
+}
@@ -0,0 +1,91 @@
+//
+// GlueXOverlapCheck class header
+//
+// author: agent at local
+// version: october 18, 2026
+//
+// This class implements the standalone geometry validation mode of
+// hdgeant4, selected by the GEOMCHECK card in control.in. After the
+// geometry is built, every placement of a daughter volume found in
+// the logical volume store is checked for overlaps, the job writes
+// an overlap report (GEOMCHECKFILE card, default overlaps.dat) and
+// exits without running any events. The exit status is nonzero if
+// any overlaps were found.
+//
+// Each placement is checked in the frame of its mother volume, using
+// the same test as G4PVPlacement::CheckOverlaps: random points on the
+// surface of the daughter must not lie outside the mother or inside
+// any of its sisters by more than the tolerance, and a point on the
+// surface of each sister must not lie inside the daughter. Only the
+// sisters whose bounding boxes intersect that of the daughter are
+// tested. The sampling density is adaptive: each placement is first
+// sampled with a small number of points, and only placements that are
+// found to overlap or come within fRefineDistance of a neighbour are
+// resampled at a density set by their size, up to a maximum count.
+//
+// The placements are distributed over a pool of threads that share
+// the geometry read-only. Each placement is sampled with its own
+// random seed, so the report does not depend on the number of threads.
+
+#ifndef GlueXOverlapCheck_h
+#define GlueXOverlapCheck_h 1
+
+#include "G4LogicalVolume.hh"
+#include "G4VPhysicalVolume.hh"
+#include "G4ThreeVector.hh"
+
+#include <vector>
+#include <string>
+
+class GlueXOverlapCheck
+{
+ public:
+   static int Requested();
+   static int Run(int nthreads=0);
+
+ protected:
+   struct placement_t {
+      G4LogicalVolume *mother;
+      int daughter;
+   };
+
+   struct overlap_t {
+      int kind;           // 0 = protrudes, 1 = overlaps, 2 = encloses
+      int sister;         // daughter index of the sister, -1 for mother
+      double depth;       // largest overlap depth found
+      G4ThreeVector where;  // where it was found, in the mother frame
+      int npoints;        // number of sample points that overlap
+   };
+
+   struct result_t {
+      int npoints;
+      int refined;
+      std::vector<overlap_t> overlaps;
+   };
+
+   struct box_t {
+      G4ThreeVector lo;
+      G4ThreeVector hi;
+   };
+
+   static void CheckPlacement(const placement_t &place, long int seed,
+                              result_t &result);
+   static box_t MotherFrameBox(const G4VPhysicalVolume *pvol);
+   static int WriteReport(const std::string &fname,
+                          const std::vector<placement_t> &places,
+                          const std::vector<result_t> &results);
+
+   static double fTolerance;
+   static int fMinPoints;
+   static int fMaxPoints;
+   static double fRefineDistance;
+   static double fRefineSpacing;
+   static std::string fReportFile;
+   static std::vector<std::vector<box_t> > fSisterBoxes;
+   static std::vector<int> fMotherIndex;
+
+ private:
+   GlueXOverlapCheck();
+};
+
+#endif
@@ -13,6 +13,15 @@
 #include <G4SystemOfUnits.hh>
 #include <Randomize.hh>
 
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
 #include <JANA/JApplication.h>
 #include <JANA/JCalibration.h>
 
@@ -39,6 +48,30 @@ int GlueXPhotonBeamGenerator::fForceFixedPolarization = false;
 double GlueXPhotonBeamGenerator::fFixedPolarization = 0;
 double GlueXPhotonBeamGenerator::fFixedPolarization_phi = 0;
 
+G4Mutex GlueXPhotonBeamGenerator::fMutex = G4MUTEX_INITIALIZER;
+int GlueXPhotonBeamGenerator::fInstanceCount = 0;
+std::string GlueXPhotonBeamGenerator::fPDFcacheDir;
+std::map<std::string, GlueXPhotonBeamGenerator::beam_pdf_tables_t*>
+            GlueXPhotonBeamGenerator::fPDFtables;
+
+int GlueXPhotonBeamGenerator::fPoolSize = 0;
+int GlueXPhotonBeamGenerator::fPoolMaxReuse = 0;
+long int GlueXPhotonBeamGenerator::fPoolSeed = 1;
+double GlueXPhotonBeamGenerator::fPoolEventsPerGeneration = 0;
+std::string GlueXPhotonBeamGenerator::fPoolFile;
+int GlueXPhotonBeamGenerator::fPoolFromFile = 0;
+std::map<int, std::shared_ptr<GlueXPhotonBeamGenerator::beam_photon_pool_t> >
+            GlueXPhotonBeamGenerator::fPools;
+int GlueXPhotonBeamGenerator::fPoolsProduced = 0;
+int GlueXPhotonBeamGenerator::fPoolsRequested = 0;
+std::atomic<int> GlueXPhotonBeamGenerator::fPoolShutdown(0);
+std::mutex GlueXPhotonBeamGenerator::fPoolMutex;
+std::condition_variable GlueXPhotonBeamGenerator::fPoolCondition;
+std::thread *GlueXPhotonBeamGenerator::fPoolThread = 0;
+GlueXPhotonBeamGenerator *GlueXPhotonBeamGenerator::fPoolProducer = 0;
+std::atomic<long int> GlueXPhotonBeamGenerator::fPoolPhotonsFilled(0);
+std::atomic<long int> GlueXPhotonBeamGenerator::fPoolPhotonsDrawn(0);
+
 // This utility function is useful in the debugger,
 // but do not use it for actual simulation operatons.
 
@@ -55,7 +88,11 @@ int g4random_seeds(CLHEP::HepRandomEngine *eng=0) {
 
 GlueXPhotonBeamGenerator::GlueXPhotonBeamGenerator(CobremsGeneration *gen)
  : fCobrems(gen),
-   fTagger(0)
+   fTagger(0),
+   fPDFs(0),
+   fPoolGeneration(-1),
+   fRandomEngine(0),
+   fIsPoolProducer(0)
 {
    GlueXUserOptions *user_opts = GlueXUserOptions::GetInstance();
    if (user_opts == 0) {
@@ -96,10 +133,56 @@ GlueXPhotonBeamGenerator::GlueXPhotonBeamGenerator(CobremsGeneration *gen)
       else {
          fBeamBackgroundTagOnly = 0;
       }
+      std::map<int, int> bgpoolpars;
+      std::map<int, std::string> bgpoolfilepars;
+      std::map<int, double> bgrate;
+      std::map<int, double> bggate;
+      if (user_opts->Find("BGPOOL", bgpoolpars)) {
+         G4AutoLock barrier(&fMutex);
+         fPoolSize = (bgpoolpars[1] > 0)? bgpoolpars[1] : 0;
+         fPoolMaxReuse = (bgpoolpars.find(2) != bgpoolpars.end())?
+                         bgpoolpars[2] : 10;
+         fPoolSeed = (bgpoolpars.find(3) != bgpoolpars.end())?
+                     bgpoolpars[3] : 1;
+         if (user_opts->Find("BGPOOLFILE", bgpoolfilepars))
+            fPoolFile = bgpoolfilepars[1];
+
+         // A new pool generation is swapped in after a fixed number of
+         // events, chosen so that each pool photon is drawn on average
+         // BGPOOL(2) times. Tying the swap to the event number rather
+         // than to the order in which photons are drawn keeps the
+         // background of every event independent of thread scheduling.
+         user_opts->Find("BGRATE", bgrate);
+         user_opts->Find("BGGATE", bggate);
+         double photons_per_event = bgrate[1] * (bggate[2] - bggate[1]);
+         if (photons_per_event > 0) {
+            fPoolEventsPerGeneration = fPoolSize * (double)fPoolMaxReuse /
+                                       photons_per_event;
+         }
+         if (fPoolEventsPerGeneration < 1)
+            fPoolEventsPerGeneration = 1;
+      }
+   }
+   std::map<int, std::string> beamcachepars;
+   if (user_opts->Find("BEAMCACHE", beamcachepars)) {
+      G4AutoLock barrier(&fMutex);
+      fPDFcacheDir = beamcachepars[1];
    }
 
    prepareImportanceSamplingPDFs();
 
+   // Start the background photon pool producer, once per process
+   if (fPoolSize > 0) {
+      G4AutoLock barrier(&fMutex);
+      if (fPoolThread == 0) {
+         fPoolProducer = new GlueXPhotonBeamGenerator(*this);
+         fPoolShutdown = 0;
+         fPoolsRequested = 1;
+         fPoolsProduced = 0;
+         fPoolThread = new std::thread(runBeamPhotonPoolProducer);
+      }
+   }
+
    // Create interface for interactive commands
 
    fMessenger = new G4GenericMessenger(this, "/PhotonBeam/",
@@ -117,16 +200,234 @@ GlueXPhotonBeamGenerator::GlueXPhotonBeamGenerator(CobremsGeneration *gen)
        " on beam photons created by the simulation.");
 }
 
+GlueXPhotonBeamGenerator::GlueXPhotonBeamGenerator(const
+                          GlueXPhotonBeamGenerator &src)
+ : fCobrems(new CobremsGeneration(*src.fCobrems)),
+   fTagger(0),
+   fPDFs(src.fPDFs),
+   fPoolGeneration(-1),
+   fRandomEngine(0),
+   fIsPoolProducer(1),
+   fMessenger(0)
+{
+   // The pool producer thread generates beam photons with a private
+   // copy of the coherent bremsstrahlung generator, because the one
+   // owned by the primary generator action keeps internal state that
+   // changes with every photon. The importance-sampling tables are
+   // shared read-only with the other instances.
+}
+
 GlueXPhotonBeamGenerator::~GlueXPhotonBeamGenerator()
 {
+   if (fIsPoolProducer) {
+      delete fCobrems;
+      return;
+   }
+
    delete fMessenger; 
+
+   G4AutoLock barrier(&fMutex);
+   fPool.reset();
+   if (--fInstanceCount == 0) {
+      // the producer shares the importance-sampling tables, so it
+      // must be stopped before they are deleted
+      if (fPoolThread) {
+         {
+            std::lock_guard<std::mutex> lock(fPoolMutex);
+            fPoolShutdown = 1;
+         }
+         fPoolCondition.notify_all();
+         fPoolThread->join();
+         delete fPoolThread;
+         fPoolThread = 0;
+         delete fPoolProducer;
+         fPoolProducer = 0;
+         fPools.clear();
+      }
+      std::map<std::string, beam_pdf_tables_t*>::iterator iter;
+      for (iter = fPDFtables.begin(); iter != fPDFtables.end(); ++iter)
+         delete iter->second;
+      fPDFtables.clear();
+      if (fPoolPhotonsDrawn > 0) {
+         G4cout << "GlueXPhotonBeamGenerator - background photon pool: "
+                << fPoolPhotonsDrawn << " photons drawn from a total of "
+                << fPoolPhotonsFilled << " generated, mean reuse factor "
+                << fPoolPhotonsDrawn / (fPoolPhotonsFilled + 1e-99)
+                << G4endl;
+      }
+   }
 }
 
 void GlueXPhotonBeamGenerator::prepareImportanceSamplingPDFs()
+{
+   // Look up the importance-sampling tables for the present beam
+   // configuration in the process-wide registry, and only build them
+   // if no other thread has done so already. If a cache directory is
+   // named by the BEAMCACHE card in control.in, tables are restored
+   // from there when available and saved there after being built.
+
+   std::string key = getImportanceSamplingKey();
+
+   G4AutoLock barrier(&fMutex);
+   ++fInstanceCount;
+   std::map<std::string, beam_pdf_tables_t*>::iterator iter;
+   iter = fPDFtables.find(key);
+   if (iter != fPDFtables.end()) {
+      fPDFs = iter->second;
+      return;
+   }
+
+   std::string fname;
+   if (fPDFcacheDir.size() > 0) {
+      unsigned long long int hash = 14695981039346656037ULL;
+      for (unsigned int i=0; i < key.size(); ++i) {
+         hash ^= (unsigned char)key[i];
+         hash *= 1099511628211ULL;
+      }
+      char hashname[40];
+      snprintf(hashname, 40, "/cobrems_pdfs_%016llx.dat", hash);
+      fname = fPDFcacheDir + hashname;
+   }
+
+   beam_pdf_tables_t *pdfs = new beam_pdf_tables_t;
+   if (fname.size() > 0 && readImportanceSamplingPDFs(fname, key, pdfs) == 0) {
+      G4cout << "GlueXPhotonBeamGenerator - beam importance sampling tables "
+             << "restored from " << fname << G4endl;
+   }
+   else {
+      // a failed read may leave the tables partly filled, start over
+      delete pdfs;
+      pdfs = new beam_pdf_tables_t;
+      buildImportanceSamplingPDFs(pdfs);
+      if (fname.size() > 0)
+         writeImportanceSamplingPDFs(fname, key, pdfs);
+   }
+   fPDFtables[key] = pdfs;
+   fPDFs = pdfs;
+}
+
+std::string GlueXPhotonBeamGenerator::getImportanceSamplingKey() const
+{
+   // Form a string that uniquely identifies the beam and radiator
+   // configuration on which the importance-sampling tables depend.
+   // The version tag must be bumped whenever the table construction
+   // in buildImportanceSamplingPDFs changes, to invalidate old caches.
+
+   std::ostringstream key;
+   key << std::setprecision(17)
+       << "v1"
+       << ",E0=" << fCobrems->getBeamEnergy()
+       << ",Emin=" << fCobrems->getPhotonEnergyMin()
+       << ",emit=" << fCobrems->getBeamEmittance()
+       << ",spot=" << fCobrems->getCollimatorSpotrms()
+       << ",cdist=" << fCobrems->getCollimatorDistance()
+       << ",cdiam=" << fCobrems->getCollimatorDiameter()
+       << ",thick=" << fCobrems->getTargetThickness()
+       << ",crystal=" << fCobrems->getTargetCrystal()
+       << ",mosaic=" << fCobrems->getTargetCrystalMosaicSpread()
+       << ",thx=" << fCobrems->getTargetThetax()
+       << ",thy=" << fCobrems->getTargetThetay()
+       << ",thz=" << fCobrems->getTargetThetaz()
+       << ",coll=" << fCobrems->getCollimatedFlag()
+       << ",pol=" << fCobrems->getPolarizedFlag();
+   return key.str();
+}
+
+int GlueXPhotonBeamGenerator::readImportanceSamplingPDFs(
+                              const std::string &fname,
+                              const std::string &key,
+                              beam_pdf_tables_t *pdfs)
+{
+   // Restore the importance-sampling tables from a cache file written
+   // by writeImportanceSamplingPDFs. Returns 0 on success, or non-zero
+   // if the file is missing, unreadable or was made for another key.
+   // On failure the contents of pdfs are undefined, and it must not be
+   // reused for buildImportanceSamplingPDFs.
+
+   std::ifstream fin(fname.c_str());
+   if (!fin.good())
+      return 1;
+   std::string tag, fkey;
+   fin >> tag >> fkey;
+   if (tag != "key" || fkey != key)
+      return 2;
+   ImportanceSampler *table[3] = {&pdfs->coherentPDFx,
+                                  &pdfs->incoherentPDFlogx,
+                                  &pdfs->incoherentPDFy};
+   for (int n=0; n < 3; ++n) {
+      int nbins;
+      fin >> tag >> nbins >> table[n]->Pcut;
+      if (tag != "table" || !fin.good() || nbins < 2)
+         return 3;
+      table[n]->randvar.resize(nbins);
+      table[n]->density.resize(nbins);
+      table[n]->integral.resize(nbins);
+      for (int i=0; i < nbins; ++i) {
+         fin >> table[n]->randvar[i]
+             >> table[n]->density[i]
+             >> table[n]->integral[i];
+      }
+      if (fin.fail())
+         return 3;
+   }
+   fin >> tag >> pdfs->incoherentPDFtheta02;
+   if (tag != "theta02" || fin.fail())
+      return 4;
+   return 0;
+}
+
+int GlueXPhotonBeamGenerator::writeImportanceSamplingPDFs(
+                              const std::string &fname,
+                              const std::string &key,
+                              const beam_pdf_tables_t *pdfs)
+{
+   // Save the importance-sampling tables to a cache file, going
+   // through a temporary file so that concurrent jobs sharing the
+   // same cache directory never see a partially written table.
+
+   std::ostringstream tmpname;
+   tmpname << fname << ".tmp" << getpid();
+   std::ofstream fout(tmpname.str().c_str());
+   if (!fout.good()) {
+      G4cerr << "Warning in GlueXPhotonBeamGenerator - "
+             << "unable to write beam importance sampling tables to "
+             << fname << ", continuing without the cache." << G4endl;
+      return 1;
+   }
+   fout << std::setprecision(17)
+        << "key " << key << std::endl;
+   const ImportanceSampler *table[3] = {&pdfs->coherentPDFx,
+                                        &pdfs->incoherentPDFlogx,
+                                        &pdfs->incoherentPDFy};
+   for (int n=0; n < 3; ++n) {
+      int nbins = table[n]->randvar.size();
+      fout << "table " << nbins << " " << table[n]->Pcut << std::endl;
+      for (int i=0; i < nbins; ++i) {
+         fout << table[n]->randvar[i] << " "
+              << table[n]->density[i] << " "
+              << table[n]->integral[i] << std::endl;
+      }
+   }
+   fout << "theta02 " << pdfs->incoherentPDFtheta02 << std::endl;
+   fout.close();
+   if (fout.fail() || rename(tmpname.str().c_str(), fname.c_str()) != 0) {
+      remove(tmpname.str().c_str());
+      return 2;
+   }
+   return 0;
+}
+
+void GlueXPhotonBeamGenerator::buildImportanceSamplingPDFs(
+                               beam_pdf_tables_t *pdfs)
 {
    // Construct lookup tables representing the PDFs used for
    // importance-sampling the coherent bremsstrahlung kinematics.
 
+   ImportanceSampler &coherentPDFx = pdfs->coherentPDFx;
+   ImportanceSampler &incoherentPDFlogx = pdfs->incoherentPDFlogx;
+   ImportanceSampler &incoherentPDFy = pdfs->incoherentPDFy;
+   double &incoherentPDFtheta02 = pdfs->incoherentPDFtheta02;
+
    const int Ndim = 500;
    double Emin = fCobrems->getPhotonEnergyMin() * GeV;
    double Emax = fCobrems->getBeamEnergy() * GeV;
@@ -148,15 +449,15 @@ void GlueXPhotonBeamGenerator::prepareImportanceSamplingPDFs()
    for (int i=0; i < Ndim; ++i) {
       double yplusbl = yarr[i] + ymax / pcut;
       psum += yplusbl;
-      fCoherentPDFx.randvar.push_back(xarr[i]);
-      fCoherentPDFx.density.push_back(yplusbl);
-      fCoherentPDFx.integral.push_back(psum);
+      coherentPDFx.randvar.push_back(xarr[i]);
+      coherentPDFx.density.push_back(yplusbl);
+      coherentPDFx.integral.push_back(psum);
    }
    for (int i=0; i < Ndim; ++i) {
-      fCoherentPDFx.density[i] /= psum * dx;
-      fCoherentPDFx.integral[i] /= psum;
+      coherentPDFx.density[i] /= psum * dx;
+      coherentPDFx.integral[i] /= psum;
    }
-   fCoherentPDFx.Pcut = 3 * psum / Ndim;
+   coherentPDFx.Pcut = 3 * psum / Ndim;
 
    // Compute approximate PDF for dNi/dlogx
    double logxmin = log(xmin);
@@ -169,47 +470,47 @@ void GlueXPhotonBeamGenerator::prepareImportanceSamplingPDFs()
       dNidlogx = fCobrems->Rate_dNidxdt2(x, 0) * x;
       dNidlogx = (dNidlogx > 0)? dNidlogx : 0;
       qsum += dNidlogx;
-      fIncoherentPDFlogx.randvar.push_back(logx);
-      fIncoherentPDFlogx.density.push_back(dNidlogx);
-      fIncoherentPDFlogx.integral.push_back(qsum);
+      incoherentPDFlogx.randvar.push_back(logx);
+      incoherentPDFlogx.density.push_back(dNidlogx);
+      incoherentPDFlogx.integral.push_back(qsum);
    }
    for (int i=0; i < Ndim; ++i) {
-      fIncoherentPDFlogx.density[i] /= qsum * dlogx;
-      fIncoherentPDFlogx.integral[i] /= qsum;
+      incoherentPDFlogx.density[i] /= qsum * dlogx;
+      incoherentPDFlogx.integral[i] /= qsum;
    }
-   fIncoherentPDFlogx.Pcut = qsum / Ndim;
+   incoherentPDFlogx.Pcut = qsum / Ndim;
  
    // Compute approximate PDF for dNi/dy
-   fIncoherentPDFtheta02 = 1.8;
+   incoherentPDFtheta02 = 1.8;
    double ymin = 1e-3;
    double dy = (1 - ymin) / Ndim;
    double dNidxdy;
    double tsum = 0;
    for (int i=0; i < Ndim; ++i) {
       double y = ymin + (i + 0.5) * dy;
-      double theta2 = fIncoherentPDFtheta02 * (1 / y - 1);
+      double theta2 = incoherentPDFtheta02 * (1 / y - 1);
       dNidxdy = fCobrems->Rate_dNidxdt2(0.5, theta2) *
-                fIncoherentPDFtheta02 / (y*y);
+                incoherentPDFtheta02 / (y*y);
       dNidxdy = (dNidxdy > 0)? dNidxdy : 0;
       tsum += dNidxdy;
-      fIncoherentPDFy.randvar.push_back(y);
-      fIncoherentPDFy.density.push_back(dNidxdy);
-      fIncoherentPDFy.integral.push_back(tsum);
+      incoherentPDFy.randvar.push_back(y);
+      incoherentPDFy.density.push_back(dNidxdy);
+      incoherentPDFy.integral.push_back(tsum);
    }
    for (int i=0; i < Ndim; ++i) {
-      fIncoherentPDFy.density[i] /= tsum * dy;
-      fIncoherentPDFy.integral[i] /= tsum;
+      incoherentPDFy.density[i] /= tsum * dy;
+      incoherentPDFy.integral[i] /= tsum;
    }
-   fIncoherentPDFy.Pcut = 1.5 * tsum / Ndim;
-   fCoherentPDFx.Pmax = 0;
-   fCoherentPDFx.Psum = 0;
-   fIncoherentPDFlogx.Pmax = 0;
-   fIncoherentPDFlogx.Psum = 0;
-   fIncoherentPDFy.Pmax = 0;
-   fIncoherentPDFy.Psum = 0;
+   incoherentPDFy.Pcut = 1.5 * tsum / Ndim;
+   coherentPDFx.Pmax = 0;
+   coherentPDFx.Psum = 0;
+   incoherentPDFlogx.Pmax = 0;
+   incoherentPDFlogx.Psum = 0;
+   incoherentPDFy.Pmax = 0;
+   incoherentPDFy.Psum = 0;
 
    // apply a correction based on endpoint energy
-   fIncoherentPDFy.Pcut *= 12*GeV / Emax;
+   incoherentPDFy.Pcut *= 12*GeV / Emax;
 }
 
 void GlueXPhotonBeamGenerator::GeneratePrimaryVertex(G4Event* anEvent)
@@ -284,8 +585,6 @@ void GlueXPhotonBeamGenerator::GenerateBeamPhoton(G4Event* anEvent, double t0)
    // with that applied to dNi/(dx dy) and then replace the fake variable y'
    // with the true y that was sampled as described above.
 
-   assert (fCoherentPDFx.integral.size() != 0);
-
    // The GlueXUserEventInformation constructor can set the random number
    // seeds for this event, so this must happen at here at the top.
    GlueXUserEventInformation *event_info;
@@ -298,8 +597,139 @@ void GlueXPhotonBeamGenerator::GenerateBeamPhoton(G4Event* anEvent, double t0)
    }
    assert (event_info != 0);
 
-   double phiMosaic = 2*M_PI * G4UniformRand();
-   double rhoMosaic = sqrt(-2 * log(G4UniformRand()));
+   // Background photons may be drawn from the shared pool, if enabled
+   beam_photon_t kin;
+   if (t0 != 0 && fPoolSize > 0)
+      DrawBeamKinematicsFromPool(kin, anEvent->GetEventID());
+   else
+      GenerateBeamKinematics(kin);
+   double x = kin.x;
+   double alphax = kin.alphax;
+   double alphay = kin.alphay;
+   double thxBeam = kin.thxBeam;
+   double thyBeam = kin.thyBeam;
+   double polarization = kin.polarization;
+   double polarization_phi = kin.polarization_phi;
+
+   // Define the particle kinematics and polarization in lab coordinates
+   G4ParticleDefinition *part = GlueXPrimaryGeneratorAction::GetParticle("gamma");
+   double Emax = fCobrems->getBeamEnergy() * GeV;
+   double Erms = fCobrems->getBeamErms() * GeV;
+   double Ebeam = Emax + Erms * G4RandGauss::shoot();
+   double pabs = Ebeam * x;
+   double px = pabs * alphax;
+   double py = pabs * alphay;
+   double pz = sqrt(pabs*pabs - px*px - py*py);
+   double colphi = 2*M_PI * G4UniformRand();
+   double vspotrms = fCobrems->getCollimatorSpotrms() * m;
+   double colrho = vspotrms * sqrt(-2 * log(G4UniformRand()));
+   double colDist = fCobrems->getCollimatorDistance() * m;
+   double radx = colrho * cos(colphi) - colDist * thxBeam;
+   double rady = colrho * sin(colphi) - colDist * thyBeam;
+   double colx = radx + colDist * alphax;
+   double coly = rady + colDist * alphay;
+#if defined BEAM_BOX_SIZE
+   colx += BEAM_BOX_SIZE * (G4UniformRand() - 0.5);
+   coly += BEAM_BOX_SIZE * (G4UniformRand() - 0.5);
+#endif
+   colx += fBeamOffset[0];
+   coly += fBeamOffset[1];
+   G4ThreeVector vtx(colx, coly, fBeamStartZ);
+   if (fForceFixedPolarization) {
+      polarization = fFixedPolarization;
+      polarization_phi = fFixedPolarization_phi;
+   }
+   G4ThreeVector pol(polarization * cos(polarization_phi),
+                     polarization * sin(polarization_phi),
+                     -(px * polarization * cos(polarization_phi) +
+                       py * polarization * sin(polarization_phi)) / pz);
+   // use upper half-space to define the polarization plane
+   if (pol[2] < 0)
+      pol = -pol;
+   G4ThreeVector mom(px, py, pz);
+
+   // If beam photon is primary particle, use it to initialize event info
+   double targetCenterZ = GlueXPrimaryGeneratorAction::getTargetCenterZ();
+   int bg = 1;
+   double tvtx;
+   if (t0 == 0) {
+      tvtx = (vtx[2] - targetCenterZ) / fBeamVelocity;
+      tvtx -= GenerateTriggerTime(anEvent);
+      if (fGenerateNotSimulate == 0) {
+         event_info->AddBeamParticle(1, tvtx, vtx, mom, pol);
+      }
+      bg = 0;
+   }
+   else {
+      tvtx = fBeamBucketPeriod * floor(t0 / fBeamBucketPeriod + 0.5);
+      tvtx += (vtx[2] - targetCenterZ) / fBeamVelocity;
+      if (fBeamBackgroundTagOnly) {
+         double ttag = tvtx + (targetCenterZ - vtx[2]) / fBeamVelocity;
+         GenerateTaggerHit(anEvent, pabs, ttag, bg);
+         return;
+      }
+   }
+
+   // Generate new primary for the beam photon
+   G4PrimaryVertex* vertex = new G4PrimaryVertex(vtx, tvtx);
+   G4PrimaryParticle* photon = new G4PrimaryParticle(part, px, py, pz);
+   photon->SetPolarization(pol);
+   vertex->SetPrimary(photon);
+   if (fGenerateNotSimulate < 1) {
+      anEvent->AddPrimaryVertex(vertex);
+   }
+
+   // Include information about the radiating electron, but do not track it
+   G4ParticleDefinition *ve = GlueXPrimaryGeneratorAction::GetParticle("e-");
+   double vpx = Ebeam * thxBeam;
+   double vpy = Ebeam * thyBeam;
+   double vpz = sqrt(Ebeam*Ebeam - vpx*vpx - vpy*vpy);
+   G4PrimaryParticle *velectron = new G4PrimaryParticle(ve, vpx, vpy, vpz);
+   double colvx = radx + colDist * thxBeam;
+   double colvy = rady + colDist * thyBeam;
+   colvx += fBeamOffset[0];
+   colvy += fBeamOffset[1];
+   G4ThreeVector vvtx(colvx, colvy, fBeamStartZ);
+   G4PrimaryVertex *vvertex = new G4PrimaryVertex(vvtx, tvtx);
+   vvertex->SetPrimary(velectron);
+   event_info->AddPrimaryVertex(*vvertex);
+   delete vvertex;
+
+   // If running in event generation only mode, default is not to
+   // save the event to the output file. This will be set back to
+   // true if the beam particle makes it to the reference plane.
+   if (fGenerateNotSimulate == -1) {
+      event_info->SetKeepEvent(0);
+   }
+
+   // If bg beam particle, append to MC record
+   if (bg || fGenerateNotSimulate == 1) {
+      event_info->AddPrimaryVertex(*vertex);
+   }
+
+   if (fGenerateNotSimulate == 0) {
+
+      // Register a tagger hit for each beam photon
+
+      double ttag = tvtx + (targetCenterZ - vtx[2]) / fBeamVelocity;
+      GenerateTaggerHit(anEvent, pabs, ttag, bg);
+   }
+}
+
+void GlueXPhotonBeamGenerator::GenerateBeamKinematics(beam_photon_t &photon)
+{
+   // Generate the kinematics of a single beam photon by importance
+   // sampling, as described in the comments at the head of method
+   // GenerateBeamPhoton above.
+
+   assert (fPDFs != 0 && fPDFs->coherentPDFx.integral.size() != 0);
+   const ImportanceSampler &coherentPDFx = fPDFs->coherentPDFx;
+   const ImportanceSampler &incoherentPDFlogx = fPDFs->incoherentPDFlogx;
+   const ImportanceSampler &incoherentPDFy = fPDFs->incoherentPDFy;
+   const double incoherentPDFtheta02 = fPDFs->incoherentPDFtheta02;
+
+   double phiMosaic = 2*M_PI * UniformRand();
+   double rhoMosaic = sqrt(-2 * log(UniformRand()));
    rhoMosaic *= fCobrems->getTargetCrystalMosaicSpread() * radian;
    double thxMosaic = rhoMosaic * cos(phiMosaic);
    double thyMosaic = rhoMosaic * sin(phiMosaic);
@@ -308,15 +738,15 @@ void GlueXPhotonBeamGenerator::GenerateBeamPhoton(G4Event* anEvent, double t0)
    double yemittance = xemittance / 2.5; // nominal, should be checked
    double xspotsize = fCobrems->getCollimatorSpotrms() * m;
    double yspotsize = xspotsize; // nominal, should be checked
-   double phiBeam = 2*M_PI * G4UniformRand();
-   double rhoBeam = sqrt(-2 * log(G4UniformRand()));
+   double phiBeam = 2*M_PI * UniformRand();
+   double rhoBeam = sqrt(-2 * log(UniformRand()));
    double thxBeam = (xemittance / xspotsize) * rhoBeam * cos(phiBeam);
    double thyBeam = (yemittance / yspotsize) * rhoBeam * sin(phiBeam);
 
    double raddz = fCobrems->getTargetThickness() * m;
-   double varMS = fCobrems->Sigma2MS(raddz/m * G4UniformRand());
-   double rhoMS = sqrt(-2 * varMS * log(G4UniformRand()));
-   double phiMS = 2*M_PI * G4UniformRand();
+   double varMS = fCobrems->Sigma2MS(raddz/m * UniformRand());
+   double rhoMS = sqrt(-2 * varMS * log(UniformRand()));
+   double phiMS = 2*M_PI * UniformRand();
    double thxMS = rhoMS * cos(phiMS);
    double thyMS = rhoMS * sin(phiMS);
 
@@ -334,55 +764,55 @@ void GlueXPhotonBeamGenerator::GenerateBeamPhoton(G4Event* anEvent, double t0)
    double theta2 = 0;
    double polarization = 0;
    double polarization_phi = 0;
-   double coherent_fraction = fCoherentPDFx.Pcut;
-   coherent_fraction /= fCoherentPDFx.Pcut + fIncoherentPDFy.Pcut;
+   double coherent_fraction = coherentPDFx.Pcut;
+   coherent_fraction /= coherentPDFx.Pcut + incoherentPDFy.Pcut;
    while (true) {
-      double splitrand = G4UniformRand();
+      double splitrand = UniformRand();
       if (splitrand < coherent_fraction) { // try coherent generation
-         ++fCoherentPDFx.Ntested;
-
-         double u = G4UniformRand();
-         int i = fCoherentPDFx.search(u);
-         double ui = fCoherentPDFx.integral[i];
-         double u_i = (i > 0)? fCoherentPDFx.integral[i-1] : 0;
-         double xi = fCoherentPDFx.randvar[i];
-         double dx = (i > 0)? xi - fCoherentPDFx.randvar[i-1]:
-                              fCoherentPDFx.randvar[i+1] - xi;
+         ++fCoherentStats.Ntested;
+
+         double u = UniformRand();
+         int i = coherentPDFx.search(u);
+         double ui = coherentPDFx.integral[i];
+         double u_i = (i > 0)? coherentPDFx.integral[i-1] : 0;
+         double xi = coherentPDFx.randvar[i];
+         double dx = (i > 0)? xi - coherentPDFx.randvar[i-1]:
+                              coherentPDFx.randvar[i+1] - xi;
          x = xi + dx * (0.5 - (ui - u) / (ui - u_i));
          assert (x > 0);
          double dNcdxPDF = (ui - u_i) / dx;
          double dNcdx = fCobrems->Rate_dNcdx(x);
          double Pfactor = dNcdx / dNcdxPDF;
-         if (Pfactor > fCoherentPDFx.Pmax)
-            fCoherentPDFx.Pmax = Pfactor;
-         if (Pfactor > fCoherentPDFx.Pcut) {
+         if (Pfactor > fCoherentStats.Pmax)
+            fCoherentStats.Pmax = Pfactor;
+         if (Pfactor > coherentPDFx.Pcut) {
             G4cout << "Warning in GenerateBeamPhoton - Pfactor " << Pfactor
-                   << " exceeds fCoherentPDFx.Pcut = " << fCoherentPDFx.Pcut
+                   << " exceeds fCoherentPDFx.Pcut = " << coherentPDFx.Pcut
                    << G4endl
                    << "  present x = " << x << G4endl
                    << "  present maximum Pfactor = "
-                   << fCoherentPDFx.Pmax << G4endl
+                   << fCoherentStats.Pmax << G4endl
                    << "  current generator efficiency = "
-                   << fCoherentPDFx.Npassed /
-                      (fCoherentPDFx.Ntested + 1e-99)
+                   << fCoherentStats.Npassed /
+                      (fCoherentStats.Ntested + 1e-99)
                    << G4endl;
          }
-         ++fCoherentPDFx.Psum += Pfactor;
-         if (G4UniformRand() * fCoherentPDFx.Pcut > Pfactor) {
+         ++fCoherentStats.Psum += Pfactor;
+         if (UniformRand() * coherentPDFx.Pcut > Pfactor) {
             continue;
          }
-         ++fCoherentPDFx.Npassed;
+         ++fCoherentStats.Npassed;
 
          double freq;
          double fmax = dNcdx / M_PI;
          while (true) {
-            phi = 2*M_PI * G4UniformRand();
+            phi = 2*M_PI * UniformRand();
             freq = fCobrems->Rate_dNcdxdp(x, phi);
             assert (freq < fmax);
-            if (G4UniformRand() * fmax < freq)
+            if (UniformRand() * fmax < freq)
                break;
          }
-         double uq = freq * G4UniformRand();
+         double uq = freq * UniformRand();
          int j = ImportanceSampler::search(uq, fCobrems->fQ2weight);
          theta2 = fCobrems->fQ2theta2[j];
          polarization = fCobrems->Polarization(x, theta2, phi);
@@ -390,56 +820,56 @@ void GlueXPhotonBeamGenerator::GenerateBeamPhoton(G4Event* anEvent, double t0)
          break;
       }
       else {                                     // try incoherent generation
-         ++fIncoherentPDFlogx.Ntested;
-
-         double ux = G4UniformRand();
-         int i = fIncoherentPDFlogx.search(ux);
-         double ui = fIncoherentPDFlogx.integral[i];
-         double u_i = (i > 0)? fIncoherentPDFlogx.integral[i-1] : 0;
-         double logxi = fIncoherentPDFlogx.randvar[i];
-         double dlogx = (i > 0)? logxi - fIncoherentPDFlogx.randvar[i-1]:
-                                 fIncoherentPDFlogx.randvar[i+1] - logxi;
+         ++fIncoherentStats.Ntested;
+
+         double ux = UniformRand();
+         int i = incoherentPDFlogx.search(ux);
+         double ui = incoherentPDFlogx.integral[i];
+         double u_i = (i > 0)? incoherentPDFlogx.integral[i-1] : 0;
+         double logxi = incoherentPDFlogx.randvar[i];
+         double dlogx = (i > 0)? logxi - incoherentPDFlogx.randvar[i-1]:
+                                 incoherentPDFlogx.randvar[i+1] - logxi;
          double logx = logxi + dlogx * (0.5 - (ui - ux) / (ui - u_i));
          assert (logx < 0);
          x = exp(logx);
          double dNidxdyPDF = (ui - u_i) / x / dlogx;
-         double uy = G4UniformRand();
-         int j = fIncoherentPDFy.search(uy);
-         double uj = fIncoherentPDFy.integral[j];
-         double u_j = (j > 0)? fIncoherentPDFy.integral[j-1] : 0;
-         double yj = fIncoherentPDFy.randvar[j];
-         double dy = (j > 0)? yj - fIncoherentPDFy.randvar[j-1]:
-                             fIncoherentPDFy.randvar[j+1] - yj;
+         double uy = UniformRand();
+         int j = incoherentPDFy.search(uy);
+         double uj = incoherentPDFy.integral[j];
+         double u_j = (j > 0)? incoherentPDFy.integral[j-1] : 0;
+         double yj = incoherentPDFy.randvar[j];
+         double dy = (j > 0)? yj - incoherentPDFy.randvar[j-1]:
+                             incoherentPDFy.randvar[j+1] - yj;
          double y = yj + dy * (0.5 - (uj - uy) / (uj - u_j));
          assert (y > 0);
          dNidxdyPDF *= (uj - u_j) / dy;
-         theta2 = fIncoherentPDFtheta02 * (1 / (y + 1e-99) - 1);
+         theta2 = incoherentPDFtheta02 * (1 / (y + 1e-99) - 1);
          double dNidxdy = fCobrems->Rate_dNidxdt2(x, theta2) *
-                          fIncoherentPDFtheta02 / (y*y + 1e-99);
+                          incoherentPDFtheta02 / (y*y + 1e-99);
          double Pfactor = dNidxdy / dNidxdyPDF;
-         if (Pfactor > fIncoherentPDFlogx.Pmax)
-            fIncoherentPDFlogx.Pmax = Pfactor;
-         if (Pfactor > fIncoherentPDFy.Pcut) {
+         if (Pfactor > fIncoherentStats.Pmax)
+            fIncoherentStats.Pmax = Pfactor;
+         if (Pfactor > incoherentPDFy.Pcut) {
             G4cout << "Warning in GenerateBeamPhoton - Pfactor " << Pfactor
                    << " exceeds fIncoherentPDFy.Pcut = " 
-                   << fIncoherentPDFy.Pcut
+                   << incoherentPDFy.Pcut
                    << G4endl
                    << "  present x = " << x << G4endl
                    << "  present y = " << y << G4endl
                    << "  present maximum Pfactor = "
-                   << fIncoherentPDFlogx.Pmax << G4endl
+                   << fIncoherentStats.Pmax << G4endl
                    << "  current generator efficiency = "
-                   << fIncoherentPDFlogx.Npassed /
-                      (fIncoherentPDFlogx.Ntested + 1e-99)
+                   << fIncoherentStats.Npassed /
+                      (fIncoherentStats.Ntested + 1e-99)
                    << G4endl;
          }
-         fIncoherentPDFlogx.Psum += Pfactor;
-         if (G4UniformRand() * fIncoherentPDFy.Pcut > Pfactor) {
+         fIncoherentStats.Psum += Pfactor;
+         if (UniformRand() * incoherentPDFy.Pcut > Pfactor) {
             continue;
          }
-         ++fIncoherentPDFlogx.Npassed;
+         ++fIncoherentStats.Npassed;
 
-         phi = 2*M_PI * G4UniformRand();
+         phi = 2*M_PI * UniformRand();
          polarization = fCobrems->AbremsPolarization(x, theta2, phi);
          polarization_phi = phi - M_PI / 2;
          break;
@@ -447,21 +877,21 @@ void GlueXPhotonBeamGenerator::GenerateBeamPhoton(G4Event* anEvent, double t0)
    }
 
 #if VERBOSE_COBREMS_SPLITTING
-   if (fIncoherentPDFlogx.Npassed / 100 * 100 == fIncoherentPDFlogx.Npassed) {
+   if (fIncoherentStats.Npassed / 100 * 100 == fIncoherentStats.Npassed) {
       G4cout << "coherent rate is "
-             << fCoherentPDFx.Psum / (fCoherentPDFx.Ntested + 1e-99)
+             << fCoherentStats.Psum / (fCoherentStats.Ntested + 1e-99)
              << ", efficiency is "
-             << fCoherentPDFx.Npassed / (fCoherentPDFx.Ntested + 1e-99)
+             << fCoherentStats.Npassed / (fCoherentStats.Ntested + 1e-99)
              << G4endl
              << "incoherent rate is "
-             << fIncoherentPDFlogx.Psum / (fIncoherentPDFlogx.Ntested + 1e-99)
+             << fIncoherentStats.Psum / (fIncoherentStats.Ntested + 1e-99)
              << ", efficiency is "
-             << fIncoherentPDFlogx.Npassed / (fIncoherentPDFlogx.Ntested + 1e-99)
+             << fIncoherentStats.Npassed / (fIncoherentStats.Ntested + 1e-99)
              << G4endl
              << "counts are "
-             << fCoherentPDFx.Npassed << " / " << fIncoherentPDFlogx.Npassed
+             << fCoherentStats.Npassed << " / " << fIncoherentStats.Npassed
              << " = "
-             << fCoherentPDFx.Npassed / (fIncoherentPDFlogx.Npassed + 1e-99)
+             << fCoherentStats.Npassed / (fIncoherentStats.Npassed + 1e-99)
              << G4endl;
    }
 #endif
@@ -471,112 +901,284 @@ void GlueXPhotonBeamGenerator::GenerateBeamPhoton(G4Event* anEvent, double t0)
                                   targetThetay/radian,
                                   targetThetaz/radian);
 
-   // Define the particle kinematics and polarization in lab coordinates
-   G4ParticleDefinition *part = GlueXPrimaryGeneratorAction::GetParticle("gamma");
    double Emax = fCobrems->getBeamEnergy() * GeV;
-   double Erms = fCobrems->getBeamErms() * GeV;
-   double Ebeam = Emax + Erms * G4RandGauss::shoot();
    double theta = sqrt(theta2) * electron_mass_c2 / Emax;
-   double alphax = thxBeam + thxMS + theta * cos(phi);
-   double alphay = thyBeam + thyMS + theta * sin(phi);
-   double pabs = Ebeam * x;
-   double px = pabs * alphax;
-   double py = pabs * alphay;
-   double pz = sqrt(pabs*pabs - px*px - py*py);
-   double colphi = 2*M_PI * G4UniformRand();
-   double vspotrms = fCobrems->getCollimatorSpotrms() * m;
-   double colrho = vspotrms * sqrt(-2 * log(G4UniformRand()));
-   double colDist = fCobrems->getCollimatorDistance() * m;
-   double radx = colrho * cos(colphi) - colDist * thxBeam;
-   double rady = colrho * sin(colphi) - colDist * thyBeam;
-   double colx = radx + colDist * alphax;
-   double coly = rady + colDist * alphay;
-#if defined BEAM_BOX_SIZE
-   colx += BEAM_BOX_SIZE * (G4UniformRand() - 0.5);
-   coly += BEAM_BOX_SIZE * (G4UniformRand() - 0.5);
-#endif
-   colx += fBeamOffset[0];
-   coly += fBeamOffset[1];
-   G4ThreeVector vtx(colx, coly, fBeamStartZ);
-   if (fForceFixedPolarization) {
-      polarization = fFixedPolarization;
-      polarization_phi = fFixedPolarization_phi;
+   photon.x = x;
+   photon.alphax = thxBeam + thxMS + theta * cos(phi);
+   photon.alphay = thyBeam + thyMS + theta * sin(phi);
+   photon.thxBeam = thxBeam;
+   photon.thyBeam = thyBeam;
+   photon.polarization = polarization;
+   photon.polarization_phi = polarization_phi;
+
+}
+
+void GlueXPhotonBeamGenerator::DrawBeamKinematicsFromPool(
+                               beam_photon_t &photon, int eventID)
+{
+   // Draw the kinematics of a background beam photon at random from
+   // the pool of pre-generated photons shared by all threads. Pools are
+   // filled by the producer thread, see runBeamPhotonPoolProducer, and
+   // a new pool generation is used for every fPoolEventsPerGeneration
+   // events, so that each pool photon is drawn on average BGPOOL(2)
+   // times. Photons are drawn with replacement, using the random number
+   // stream of the event. The electron beam energy spread, the position
+   // of the spot on the radiator and the beam bucket time are sampled by
+   // the caller independently for every photon drawn, so repeated draws
+   // of one pool entry are never exact copies.
+
+   int generation = 1;
+   if (fPoolMaxReuse > 0)
+      generation += (int)(eventID / fPoolEventsPerGeneration);
+   if (generation != fPoolGeneration || !fPool) {
+      fPool = getBeamPhotonPool(generation);
+      fPoolGeneration = generation;
    }
-   G4ThreeVector pol(polarization * cos(polarization_phi),
-                     polarization * sin(polarization_phi),
-                     -(px * polarization * cos(polarization_phi) +
-                       py * polarization * sin(polarization_phi)) / pz);
-   // use upper half-space to define the polarization plane
-   if (pol[2] < 0)
-      pol = -pol;
-   G4ThreeVector mom(px, py, pz);
 
-   // If beam photon is primary particle, use it to initialize event info
-   double targetCenterZ = GlueXPrimaryGeneratorAction::getTargetCenterZ();
-   int bg = 1;
-   double tvtx;
-   if (t0 == 0) {
-      tvtx = (vtx[2] - targetCenterZ) / fBeamVelocity;
-      tvtx -= GenerateTriggerTime(anEvent);
-      if (fGenerateNotSimulate == 0) {
-         event_info->AddBeamParticle(1, tvtx, vtx, mom, pol);
-      }
-      bg = 0;
+   long int nphotons = fPool->photons.size();
+   long int i = (long int)(G4UniformRand() * nphotons);
+   const pool_photon_t &rec = fPool->photons[(i < nphotons)? i : nphotons-1];
+   photon.x = rec.x;
+   photon.alphax = rec.alphax;
+   photon.alphay = rec.alphay;
+   photon.thxBeam = rec.thxBeam;
+   photon.thyBeam = rec.thyBeam;
+   photon.polarization = rec.polarization;
+   photon.polarization_phi = rec.polarization_phi;
+   ++fPoolPhotonsDrawn;
+}
+
+std::shared_ptr<GlueXPhotonBeamGenerator::beam_photon_pool_t>
+GlueXPhotonBeamGenerator::getBeamPhotonPool(int generation)
+{
+   // Return the requested pool generation, waiting for the producer
+   // thread only if it has fallen behind. The producer keeps just the
+   // last few generations, so a thread that is working on events far
+   // behind the others may find its generation gone, in which case it
+   // regenerates the pool itself from the same seeds.
+
+   std::unique_lock<std::mutex> lock(fPoolMutex);
+   if (generation > fPoolsRequested) {
+      fPoolsRequested = generation;
+      fPoolCondition.notify_all();
    }
-   else {
-      tvtx = fBeamBucketPeriod * floor(t0 / fBeamBucketPeriod + 0.5);
-      tvtx += (vtx[2] - targetCenterZ) / fBeamVelocity;
-      if (fBeamBackgroundTagOnly) {
-         double ttag = tvtx + (targetCenterZ - vtx[2]) / fBeamVelocity;
-         GenerateTaggerHit(anEvent, pabs, ttag, bg);
-         return;
+   while (generation > fPoolsProduced && fPoolShutdown == 0)
+      fPoolCondition.wait(lock);
+   std::map<int, std::shared_ptr<beam_photon_pool_t> >::iterator iter;
+   iter = fPools.find(generation);
+   if (iter != fPools.end())
+      return iter->second;
+   lock.unlock();
+
+   std::shared_ptr<beam_photon_pool_t> pool(new beam_photon_pool_t);
+   fillBeamPhotonPool(pool.get(), fPoolSize, generation);
+   fPoolPhotonsFilled += pool->photons.size();
+   return pool;
+}
+
+void GlueXPhotonBeamGenerator::runBeamPhotonPoolProducer()
+{
+   // Body of the producer thread that fills the background photon pools,
+   // staying one generation ahead of the highest generation requested by
+   // the worker threads. Generation 1 is read from the BGPOOLFILE, if it
+   // exists and matches the present beam configuration, otherwise it is
+   // generated and saved there for use by subsequent jobs.
+
+   GlueXPhotonBeamGenerator *producer = fPoolProducer;
+   std::string key = producer->getImportanceSamplingKey();
+   for (int gen=1; ; ++gen) {
+      {
+         std::unique_lock<std::mutex> lock(fPoolMutex);
+         while (fPoolShutdown == 0 && (gen > fPoolsRequested + 1 ||
+                                      (gen > 1 && fPoolMaxReuse == 0)))
+         {
+            fPoolCondition.wait(lock);
+         }
+         if (fPoolShutdown)
+            return;
+         // skip generations that the workers have already left behind
+         if (gen > 1 && gen < fPoolsRequested - 2)
+            gen = fPoolsRequested - 2;
       }
+      std::shared_ptr<beam_photon_pool_t> pool(new beam_photon_pool_t);
+      if (gen == 1 && fPoolFile.size() > 0 &&
+          producer->readBeamPhotonPool(fPoolFile, key, pool.get()) == 0)
+      {
+         G4cout << "GlueXPhotonBeamGenerator - " << pool->photons.size()
+                << " background beam photons restored from "
+                << fPoolFile << G4endl;
+         fPoolFromFile = 1;
+      }
+      else {
+         producer->fillBeamPhotonPool(pool.get(), fPoolSize, gen);
+         if (pool->photons.size() == 0)
+            return;
+         if (gen == 1 && fPoolFile.size() > 0)
+            producer->writeBeamPhotonPool(fPoolFile, key, pool.get());
+      }
+      fPoolPhotonsFilled += pool->photons.size();
+
+      std::lock_guard<std::mutex> lock(fPoolMutex);
+      fPools[gen] = pool;
+      fPoolsProduced = gen;
+      std::map<int, std::shared_ptr<beam_photon_pool_t> >::iterator iter;
+      for (iter = fPools.begin(); iter != fPools.end();) {
+         if (iter->first < fPoolsRequested - 2 &&
+             !(iter->first == 1 && fPoolFromFile))
+         {
+            fPools.erase(iter++);
+         }
+         else {
+            ++iter;
+         }
+      }
+      fPoolCondition.notify_all();
    }
+}
 
-   // Generate new primary for the beam photon
-   G4PrimaryVertex* vertex = new G4PrimaryVertex(vtx, tvtx);
-   G4PrimaryParticle* photon = new G4PrimaryParticle(part, px, py, pz);
-   photon->SetPolarization(pol);
-   vertex->SetPrimary(photon);
-   if (fGenerateNotSimulate < 1) {
-      anEvent->AddPrimaryVertex(vertex);
+void GlueXPhotonBeamGenerator::fillBeamPhotonPool(beam_photon_pool_t *pool,
+                                                  int npool, int generation)
+{
+   // Generate npool beam photons into the pool, using a private random
+   // number engine seeded from BGPOOL(3) and the pool generation, so
+   // that the contents of every pool are reproducible regardless of
+   // which thread fills it. Filling stops early, leaving the pool empty,
+   // if the producer thread is shut down meanwhile.
+
+   G4cout << "GlueXPhotonBeamGenerator - generating pool " << generation
+          << " of " << npool << " background beam photons" << G4endl;
+   long int seeds[2];
+   seeds[0] = 1 + labs(fPoolSeed * 69069 + 12345) % 2147483562;
+   seeds[1] = 1 + (generation * 40014L + 1013904223) % 2147483398;
+   CLHEP::RanecuEngine engine;
+   engine.setSeeds(seeds);
+   fRandomEngine = &engine;
+   pool->photons.resize(npool);
+   for (int n=0; n < npool; ++n) {
+      if (fIsPoolProducer && fPoolShutdown) {
+         pool->photons.clear();
+         break;
+      }
+      beam_photon_t photon;
+      GenerateBeamKinematics(photon);
+      pool_photon_t &rec = pool->photons[n];
+      rec.x = photon.x;
+      rec.alphax = photon.alphax;
+      rec.alphay = photon.alphay;
+      rec.thxBeam = photon.thxBeam;
+      rec.thyBeam = photon.thyBeam;
+      rec.polarization = photon.polarization;
+      rec.polarization_phi = photon.polarization_phi;
    }
+   fRandomEngine = 0;
+}
 
-   // Include information about the radiating electron, but do not track it
-   G4ParticleDefinition *ve = GlueXPrimaryGeneratorAction::GetParticle("e-");
-   double vpx = Ebeam * thxBeam;
-   double vpy = Ebeam * thyBeam;
-   double vpz = sqrt(Ebeam*Ebeam - vpx*vpx - vpy*vpy);
-   G4PrimaryParticle *velectron = new G4PrimaryParticle(ve, vpx, vpy, vpz);
-   double colvx = radx + colDist * thxBeam;
-   double colvy = rady + colDist * thyBeam;
-   colvx += fBeamOffset[0];
-   colvy += fBeamOffset[1];
-   G4ThreeVector vvtx(colvx, colvy, fBeamStartZ);
-   G4PrimaryVertex *vvertex = new G4PrimaryVertex(vvtx, tvtx);
-   vvertex->SetPrimary(velectron);
-   event_info->AddPrimaryVertex(*vvertex);
-   delete vvertex;
+// Pool files are written with an explicit little-endian byte order,
+// each record being the 7 members of pool_photon_t as IEEE floats.
 
-   // If running in event generation only mode, default is not to
-   // save the event to the output file. This will be set back to
-   // true if the beam particle makes it to the reference plane.
-   if (fGenerateNotSimulate == -1) {
-      event_info->SetKeepEvent(0);
+static const int pool_record_size = 7 * 4;
+
+static void pack_pool_record(const float *vals, unsigned char *buf)
+{
+   for (int k=0; k < 7; ++k) {
+      uint32_t bits;
+      memcpy(&bits, &vals[k], 4);
+      for (int b=0; b < 4; ++b)
+         buf[k*4 + b] = (bits >> (8*b)) & 0xff;
    }
+}
 
-   // If bg beam particle, append to MC record
-   if (bg || fGenerateNotSimulate == 1) {
-      event_info->AddPrimaryVertex(*vertex);
+static void unpack_pool_record(const unsigned char *buf, float *vals)
+{
+   for (int k=0; k < 7; ++k) {
+      uint32_t bits = 0;
+      for (int b=0; b < 4; ++b)
+         bits |= (uint32_t)buf[k*4 + b] << (8*b);
+      memcpy(&vals[k], &bits, 4);
    }
+}
 
-   if (fGenerateNotSimulate == 0) {
+int GlueXPhotonBeamGenerator::readBeamPhotonPool(const std::string &fname,
+                                                 const std::string &key,
+                                                 beam_photon_pool_t *pool)
+{
+   // Restore a pool of background beam photons from a file written by
+   // writeBeamPhotonPool. Returns 0 on success, or non-zero if the file
+   // is missing, unreadable, or was made for another beam configuration.
 
-      // Register a tagger hit for each beam photon
+   std::ifstream fin(fname.c_str(), std::ios::binary);
+   if (!fin.good())
+      return 1;
+   std::string header, keyline, tag, order;
+   std::getline(fin, header);
+   std::getline(fin, keyline);
+   if (header != "hdgeant4 beam photon pool v2" || keyline != "key " + key)
+      return 2;
+   long int nphotons;
+   int recsize;
+   fin >> tag >> nphotons >> recsize >> order;
+   if (tag != "photons" || !fin.good() || nphotons < 1 ||
+       recsize != pool_record_size || order != "little-endian")
+   {
+      return 3;
+   }
+   fin.get();
+   std::vector<unsigned char> buf(nphotons * pool_record_size);
+   fin.read((char*)&buf[0], buf.size());
+   if (fin.gcount() != (std::streamsize)buf.size())
+      return 4;
+   pool->photons.resize(nphotons);
+   for (long int n=0; n < nphotons; ++n) {
+      float vals[7];
+      unpack_pool_record(&buf[n * pool_record_size], vals);
+      pool_photon_t &rec = pool->photons[n];
+      rec.x = vals[0];
+      rec.alphax = vals[1];
+      rec.alphay = vals[2];
+      rec.thxBeam = vals[3];
+      rec.thyBeam = vals[4];
+      rec.polarization = vals[5];
+      rec.polarization_phi = vals[6];
+   }
+   return 0;
+}
 
-      double ttag = tvtx + (targetCenterZ - vtx[2]) / fBeamVelocity;
-      GenerateTaggerHit(anEvent, pabs, ttag, bg);
+int GlueXPhotonBeamGenerator::writeBeamPhotonPool(const std::string &fname,
+                                                  const std::string &key,
+                                                  const beam_photon_pool_t *pool)
+{
+   // Save a pool of background beam photons to a file, going through a
+   // temporary file so that concurrent jobs sharing the same pool file
+   // never see a partially written pool.
+
+   std::ostringstream tmpname;
+   tmpname << fname << ".tmp" << getpid();
+   std::ofstream fout(tmpname.str().c_str(), std::ios::binary);
+   if (!fout.good()) {
+      G4cerr << "Warning in GlueXPhotonBeamGenerator - "
+             << "unable to write background beam photon pool to "
+             << fname << ", continuing without it." << G4endl;
+      return 1;
+   }
+   long int nphotons = pool->photons.size();
+   std::vector<unsigned char> buf(nphotons * pool_record_size);
+   for (long int n=0; n < nphotons; ++n) {
+      const pool_photon_t &rec = pool->photons[n];
+      float vals[7] = {rec.x, rec.alphax, rec.alphay, rec.thxBeam,
+                       rec.thyBeam, rec.polarization, rec.polarization_phi};
+      pack_pool_record(vals, &buf[n * pool_record_size]);
    }
+   fout << "hdgeant4 beam photon pool v2" << std::endl
+        << "key " << key << std::endl
+        << "photons " << nphotons << " " << pool_record_size
+        << " little-endian" << std::endl;
+   fout.write((const char*)&buf[0], buf.size());
+   fout.close();
+   if (fout.fail() || rename(tmpname.str().c_str(), fname.c_str()) != 0) {
+      remove(tmpname.str().c_str());
+      return 2;
+   }
+   return 0;
 }
 
 double GlueXPhotonBeamGenerator::GenerateTriggerTime(const G4Event *event)
@@ -8,7 +8,14 @@
 // this class is "thread-local", ie. has thread-local state.
 // Separate object instances are created for each worker thread.
 // Resources are created once when the first object is instantiated,
-// and destroyed once when the last object is destroyed.
+// and destroyed once when the last object is destroyed. The tables
+// used for importance sampling depend only on the beam and radiator
+// configuration, so they are built once per process (or read back
+// from a disk cache) and shared read-only by all worker threads.
+// Likewise the optional pools of pre-generated background photons
+// (see BGPOOL in control.in) are shared by all worker threads. They
+// are filled by a dedicated producer thread with its own random number
+// engine, which keeps one pool generation ahead of the worker threads.
 
 #ifndef GlueXPhotonBeamGenerator_H
 #define GlueXPhotonBeamGenerator_H
@@ -19,6 +26,17 @@
 #include <ImportanceSampler.hh>
 #include <GlueXPseudoDetectorTAG.hh>
 #include <G4Event.hh>
+#include <G4AutoLock.hh>
+#include <Randomize.hh>
+
+#include <map>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
 
 class GlueXPhotonBeamGenerator: public G4VPrimaryGenerator
 {
@@ -47,12 +65,106 @@ class GlueXPhotonBeamGenerator: public G4VPrimaryGenerator
    static double fBeamVelocity;
    static double fBeamOffset[2];
 
-   ImportanceSampler fCoherentPDFx; 
-   ImportanceSampler fIncoherentPDFlogx;
-   ImportanceSampler fIncoherentPDFy;
-   double fIncoherentPDFtheta02;
+   struct beam_pdf_tables_t {
+      ImportanceSampler coherentPDFx; 
+      ImportanceSampler incoherentPDFlogx;
+      ImportanceSampler incoherentPDFy;
+      double incoherentPDFtheta02;
+   };
+   const beam_pdf_tables_t *fPDFs;
+
+   // generation statistics are kept per thread, the tables are shared
+   struct sampler_stats_t {
+      double Psum;
+      double Pmax;
+      long int Ntested;
+      long int Npassed;
+      sampler_stats_t() : Psum(0), Pmax(0), Ntested(0), Npassed(0) {}
+   };
+   sampler_stats_t fCoherentStats;
+   sampler_stats_t fIncoherentStats;
+
+   // kinematics of a single beam photon, everything that depends
+   // on the radiator and the rejection sampling, but not on the
+   // electron beam energy spread, spot position or photon time
+   struct beam_photon_t {
+      double x;
+      double alphax;
+      double alphay;
+      double thxBeam;
+      double thyBeam;
+      double polarization;
+      double polarization_phi;
+   };
+   void GenerateBeamKinematics(beam_photon_t &photon);
+
+   // compact form of beam_photon_t for the background photon pool
+   struct pool_photon_t {
+      float x;
+      float alphax;
+      float alphay;
+      float thxBeam;
+      float thyBeam;
+      float polarization;
+      float polarization_phi;
+   };
+   struct beam_photon_pool_t {
+      std::vector<pool_photon_t> photons;
+   };
+   std::shared_ptr<beam_photon_pool_t> fPool;
+   int fPoolGeneration;
+
+   void DrawBeamKinematicsFromPool(beam_photon_t &photon, int eventID);
+   void fillBeamPhotonPool(beam_photon_pool_t *pool, int npool,
+                           int generation);
+   std::shared_ptr<beam_photon_pool_t> getBeamPhotonPool(int generation);
+   int readBeamPhotonPool(const std::string &fname,
+                          const std::string &key,
+                          beam_photon_pool_t *pool);
+   int writeBeamPhotonPool(const std::string &fname,
+                           const std::string &key,
+                           const beam_photon_pool_t *pool);
+   static void runBeamPhotonPoolProducer();
+
+   // random numbers for GenerateBeamKinematics come from the event
+   // random stream, except while filling a pool, see fillBeamPhotonPool
+   CLHEP::HepRandomEngine *fRandomEngine;
+   double UniformRand() {
+      return (fRandomEngine)? fRandomEngine->flat() : G4UniformRand();
+   }
+   int fIsPoolProducer;
+
+   static int fPoolSize;
+   static int fPoolMaxReuse;
+   static long int fPoolSeed;
+   static double fPoolEventsPerGeneration;
+   static std::string fPoolFile;
+   static int fPoolFromFile;
+   static std::map<int, std::shared_ptr<beam_photon_pool_t> > fPools;
+   static int fPoolsProduced;
+   static int fPoolsRequested;
+   static std::atomic<int> fPoolShutdown;
+   static std::mutex fPoolMutex;
+   static std::condition_variable fPoolCondition;
+   static std::thread *fPoolThread;
+   static GlueXPhotonBeamGenerator *fPoolProducer;
+   static std::atomic<long int> fPoolPhotonsFilled;
+   static std::atomic<long int> fPoolPhotonsDrawn;
 
    void prepareImportanceSamplingPDFs();
+   void buildImportanceSamplingPDFs(beam_pdf_tables_t *pdfs);
+   std::string getImportanceSamplingKey() const;
+   int readImportanceSamplingPDFs(const std::string &fname,
+                                  const std::string &key,
+                                  beam_pdf_tables_t *pdfs);
+   int writeImportanceSamplingPDFs(const std::string &fname,
+                                   const std::string &key,
+                                   const beam_pdf_tables_t *pdfs);
+
+   static G4Mutex fMutex;
+   static int fInstanceCount;
+   static std::string fPDFcacheDir;
+   static std::map<std::string, beam_pdf_tables_t*> fPDFtables;
 
    static int fForceFixedPolarization;
    static double fFixedPolarization;
@@ -99,7 +211,8 @@ class GlueXPhotonBeamGenerator: public G4VPrimaryGenerator
 
  private:
    GlueXPhotonBeamGenerator();
-   GlueXPhotonBeamGenerator(const GlueXPhotonBeamGenerator &src) {}
+   // makes the private instance used by the pool producer thread
+   GlueXPhotonBeamGenerator(const GlueXPhotonBeamGenerator &src);
    GlueXPhotonBeamGenerator &operator=(const GlueXPhotonBeamGenerator &src) {
       return *this;
    }
@@ -9,6 +9,11 @@
 #include <G4ParallelWorldPhysics.hh>
 
 #include <iomanip>   
+#include <sstream>
+#include <stdio.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
 
 #include "globals.hh"
 #include "G4ios.hh"
@@ -19,6 +24,12 @@
 
 #include "G4Material.hh"
 #include "G4MaterialTable.hh"
+#include "G4Element.hh"
+#include "G4LogicalVolumeStore.hh"
+#include "G4RegionStore.hh"
+#include "G4ProductionCuts.hh"
+#include "G4Threading.hh"
+#include "G4FastSimulationManagerProcess.hh"
 
 #include "G4DecayPhysics.hh"
 #include "G4EmStandardPhysics_option1.hh"
@@ -40,6 +51,8 @@
 //#include "G4OpticalProcessIndex.hh"
 
 #include <GlueXBeamConversionProcess.hh>
+#include <GlueXRegionCuts.hh>
+#include <GlueXFastShowerBCAL.hh>
 #include <GlueXBernardConversionProcess.hh>
 
 GlueXPhysicsList::GlueXPhysicsList(const GlueXDetectorConstruction *geometry,
@@ -47,7 +60,8 @@ GlueXPhysicsList::GlueXPhysicsList(const GlueXDetectorConstruction *geometry,
  : G4VModularPhysicsList(),
    fBeamConversion(0),
    fBernardConversion(0),
-   fOpticalPhysics(0)
+   fOpticalPhysics(0),
+   fPhysicsTableCacheStore(0)
 {
    if (geometry == 0) {
       geometry = GlueXDetectorConstruction::GetInstance();
@@ -79,6 +93,12 @@ GlueXPhysicsList::GlueXPhysicsList(const GlueXDetectorConstruction *geometry,
    SetVerboseLevel(verbosity);
    DumpCutValuesTable(verbosity);
 
+   // Regions with their own production cuts and tracking limits
+   GlueXRegionCuts::Configure();
+
+   // Region for the parametrized showers in the BCAL
+   GlueXFastShowerBCAL::Configure();
+
    // Parallel world transportation
    for (int para=1; para <= geometry->GetParallelWorldCount(); ++para) {
       G4String name = geometry->GetParallelWorldName(para);
@@ -253,39 +273,51 @@ void GlueXPhysicsList::ConstructProcess()
             exit(1);
 #endif
          }
-         if (KEcut_gamma > 0) {
-            G4UserLimits *glimits = new G4UserLimits();
-            glimits->SetUserMaxTime(tcut);
-            glimits->SetUserMinEkine(KEcut_gamma);
+         if (KEcut_gamma > 0 ||
+             GlueXRegionCuts::HasLimits(GlueXRegionCuts::kGamma))
+         {
             GlueXSpecialCuts *gcuts;
             gcuts = new GlueXSpecialCuts("GlueX tracking limits for gammas");
-            gcuts->SetUserLimits(glimits);
+            if (KEcut_gamma > 0) {
+               G4UserLimits *glimits = new G4UserLimits();
+               glimits->SetUserMaxTime(tcut);
+               glimits->SetUserMinEkine(KEcut_gamma);
+               gcuts->SetUserLimits(glimits);
+            }
             mgr->AddProcess(gcuts, -1, -1, 1);
          }
          else
             continue;
       }
       else if (particleName == "e-" || particleName == "e+") {
-         if (KEcut_electron > 0) {
-            G4UserLimits *elimits = new G4UserLimits();
-            elimits->SetUserMaxTime(tcut);
-            elimits->SetUserMinEkine(KEcut_electron);
+         if (KEcut_electron > 0 ||
+             GlueXRegionCuts::HasLimits(GlueXRegionCuts::kElectron))
+         {
             GlueXSpecialCuts *ecuts;
             ecuts = new GlueXSpecialCuts("GlueX tracking limits for electrons");
-            ecuts->SetUserLimits(elimits);
+            if (KEcut_electron > 0) {
+               G4UserLimits *elimits = new G4UserLimits();
+               elimits->SetUserMaxTime(tcut);
+               elimits->SetUserMinEkine(KEcut_electron);
+               ecuts->SetUserLimits(elimits);
+            }
             mgr->AddProcess(ecuts, -1, -1, 1);
          }
          else
             continue;
       }
       else if (particleName == "neutron") {
-         if (KEcut_neutron > 0) {
-            G4UserLimits *nlimits = new G4UserLimits();
-            nlimits->SetUserMaxTime(tcut);
-            nlimits->SetUserMinEkine(KEcut_neutron);
+         if (KEcut_neutron > 0 ||
+             GlueXRegionCuts::HasLimits(GlueXRegionCuts::kNeutron))
+         {
             GlueXSpecialCuts *ncuts;
             ncuts = new GlueXSpecialCuts("GlueX tracking limits for neutrons");
-            ncuts->SetUserLimits(nlimits);
+            if (KEcut_neutron > 0) {
+               G4UserLimits *nlimits = new G4UserLimits();
+               nlimits->SetUserMaxTime(tcut);
+               nlimits->SetUserMinEkine(KEcut_neutron);
+               ncuts->SetUserLimits(nlimits);
+            }
             mgr->AddProcess(ncuts, -1, -1, 1);
          }
          else
@@ -295,26 +327,34 @@ void GlueXPhysicsList::ConstructProcess()
                particleName == "pi+" || particleName == "pi-" ||
                particleName == "kaon+" || particleName == "kaon-")
       {
-         if (KEcut_proton > 0) {
-            G4UserLimits *hlimits = new G4UserLimits();
-            hlimits->SetUserMaxTime(tcut);
-            hlimits->SetUserMinEkine(KEcut_proton);
+         if (KEcut_proton > 0 ||
+             GlueXRegionCuts::HasLimits(GlueXRegionCuts::kHadron))
+         {
             GlueXSpecialCuts *hcuts;
             hcuts = new GlueXSpecialCuts("GlueX tracking limits for protons");
-            hcuts->SetUserLimits(hlimits);
+            if (KEcut_proton > 0) {
+               G4UserLimits *hlimits = new G4UserLimits();
+               hlimits->SetUserMaxTime(tcut);
+               hlimits->SetUserMinEkine(KEcut_proton);
+               hcuts->SetUserLimits(hlimits);
+            }
             mgr->AddProcess(hcuts, -1, -1, 1);
          }
          else
             continue;
       }
       else if (particleName == "mu-" || particleName == "mu+") {
-         if (KEcut_muon > 0) {
-            G4UserLimits *mlimits = new G4UserLimits();
-            mlimits->SetUserMaxTime(tcut);
-            mlimits->SetUserMinEkine(KEcut_muon);
+         if (KEcut_muon > 0 ||
+             GlueXRegionCuts::HasLimits(GlueXRegionCuts::kMuon))
+         {
             GlueXSpecialCuts *mcuts;
             mcuts = new GlueXSpecialCuts("GlueX tracking limits for muons");
-            mcuts->SetUserLimits(mlimits);
+            if (KEcut_muon > 0) {
+               G4UserLimits *mlimits = new G4UserLimits();
+               mlimits->SetUserMaxTime(tcut);
+               mlimits->SetUserMinEkine(KEcut_muon);
+               mcuts->SetUserLimits(mlimits);
+            }
             mgr->AddProcess(mcuts, -1, -1, 1);
          }
          else
@@ -331,6 +371,18 @@ void GlueXPhysicsList::ConstructProcess()
       }
    }
 
+   // Register the fast simulation process for parametrized showers
+   if (GlueXFastShowerBCAL::IsActive()) {
+      const char *showering[3] = {"gamma", "e-", "e+"};
+      G4ParticleTable *ptable = G4ParticleTable::GetParticleTable();
+      for (int i=0; i < 3; ++i) {
+         G4ProcessManager *mgr = ptable->FindParticle(showering[i])
+                                       ->GetProcessManager();
+         mgr->AddDiscreteProcess(new
+              G4FastSimulationManagerProcess("BCAL fast showers"));
+      }
+   }
+
    // Try to limit the number of secondaries generated by physics processes
    // that will end up falling below the particle thresholds set above. In
    // no case will I ever set this to lower than 1 MeV.
@@ -392,8 +444,177 @@ void GlueXPhysicsList::SetCuts()
       }
    }
 
+   // Production cuts for the regions in the REGIONFILE table
+   if (G4Threading::IsMasterThread()) {
+      G4ProductionCutsTable *cuts_table;
+      cuts_table = G4ProductionCutsTable::GetProductionCutsTable();
+      GlueXRegionCuts::SetDefaultCuts(cuts_table->GetDefaultProductionCuts());
+   }
+
    if (verboseLevel > 0)
       G4VUserPhysicsList::DumpCutValuesTable();  
+
+   // Retrieve the physics tables from the cache if possible
+   if (G4Threading::IsMasterThread())
+      ConfigurePhysicsTableCache();
+}
+
+void GlueXPhysicsList::ConfigurePhysicsTableCache()
+{
+   // If a physics table cache directory is given in the PHYSCACHE card,
+   // look there for the tables built by an earlier job with the same
+   // physics configuration, as identified by PhysicsTableKey(). If they
+   // are found then Geant4 is told to retrieve its physics tables from
+   // there instead of building them, otherwise the tables built by this
+   // job are stored there by StorePhysicsTableCache at start of run.
+
+   std::map<int,std::string> physcache;
+   if (! fOptions->Find("PHYSCACHE", physcache))
+      return;
+   fPhysicsTableCacheDir = physcache[1] + "/physics-" + PhysicsTableKey();
+   struct stat info;
+   if (stat(fPhysicsTableCacheDir.c_str(), &info) == 0 &&
+       S_ISDIR(info.st_mode))
+   {
+      SetPhysicsTableRetrieved(fPhysicsTableCacheDir);
+      fPhysicsTableCacheStore = 0;
+      G4cout << "GlueXPhysicsList: physics tables will be retrieved from "
+             << fPhysicsTableCacheDir << G4endl;
+   }
+   else {
+      fPhysicsTableCacheStore = 1;
+   }
+}
+
+static void remove_table_dir(const std::string &dirname)
+{
+   DIR *dir = opendir(dirname.c_str());
+   if (dir) {
+      struct dirent *entry;
+      while ((entry = readdir(dir)) != 0) {
+         std::string name(entry->d_name);
+         if (name != "." && name != "..")
+            unlink((dirname + "/" + name).c_str());
+      }
+      closedir(dir);
+   }
+   rmdir(dirname.c_str());
+}
+
+void GlueXPhysicsList::StorePhysicsTableCache()
+{
+   // Store the physics tables in the cache directory, if requested by
+   // ConfigurePhysicsTableCache. This must be called in the master
+   // thread after the tables are built, ie. at the start of the first
+   // run. The tables are written into a private directory that is then
+   // renamed into place, so that concurrent jobs sharing the cache
+   // never see a partial set of tables.
+
+   if (! fPhysicsTableCacheStore)
+      return;
+   fPhysicsTableCacheStore = 0;
+   std::stringstream tmpdir;
+   tmpdir << fPhysicsTableCacheDir << ".tmp" << getpid();
+   if (mkdir(tmpdir.str().c_str(), 0755) != 0) {
+      G4cerr << "GlueXPhysicsList::StorePhysicsTableCache warning - "
+             << "cannot create directory " << tmpdir.str()
+             << ", physics tables not cached." << G4endl;
+      return;
+   }
+   if (! StorePhysicsTable(tmpdir.str()) ||
+       rename(tmpdir.str().c_str(), fPhysicsTableCacheDir.c_str()) != 0)
+   {
+      remove_table_dir(tmpdir.str());
+      G4cerr << "GlueXPhysicsList::StorePhysicsTableCache warning - "
+             << "unable to store physics tables in "
+             << fPhysicsTableCacheDir << G4endl;
+      return;
+   }
+   G4cout << "GlueXPhysicsList: physics tables stored in "
+          << fPhysicsTableCacheDir << G4endl;
+}
+
+std::string GlueXPhysicsList::PhysicsTableKey() const
+{
+   // Compute a key for the physics tables from everything that goes
+   // into building them: the Geant4 version, the physics options in
+   // control.in, the production cuts of each region, the materials,
+   // and the logical volume tree that assigns materials to regions.
+   // Any change to these gives a new key, so the tables are rebuilt.
+
+   std::stringstream desc;
+   desc << std::setprecision(17);
+   desc << "geant4 " << G4VERSION_NUMBER << std::endl;
+#if USING_DIRACXX
+   desc << "USING_DIRACXX" << std::endl;
+#endif
+#if USING_BERNARD
+   desc << "USING_BERNARD" << std::endl;
+#endif
+   const char *cards[] = {"RANGECUTS", "CUTS", "MULS", "BREM", "COMP",
+                          "LOSS", "PAIR", "DCAY", "DRAY", "HADR",
+                          "CKOV", "LABS", 0};
+   for (int i=0; cards[i] != 0; ++i) {
+      std::map<int,double> values;
+      if (fOptions->Find(cards[i], values)) {
+         desc << cards[i];
+         std::map<int,double>::iterator iter;
+         for (iter = values.begin(); iter != values.end(); ++iter)
+            desc << " " << iter->first << "=" << iter->second;
+         desc << std::endl;
+      }
+   }
+
+   G4RegionStore *regions = G4RegionStore::GetInstance();
+   for (unsigned int i=0; i < regions->size(); ++i) {
+      G4Region *region = (*regions)[i];
+      desc << "region " << region->GetName();
+      G4ProductionCuts *pcuts = region->GetProductionCuts();
+      if (pcuts) {
+         for (int index=0; index < NumberOfG4CutIndex; ++index)
+            desc << " " << pcuts->GetProductionCut(index);
+      }
+      std::vector<G4LogicalVolume*>::iterator root;
+      root = region->GetRootLogicalVolumeIterator();
+      for (size_t n=0; n < region->GetNumberOfRootVolumes(); ++n, ++root)
+         desc << " " << (*root)->GetName();
+      desc << std::endl;
+   }
+
+   const G4MaterialTable *materials = G4Material::GetMaterialTable();
+   for (unsigned int i=0; i < materials->size(); ++i) {
+      G4Material *mat = (*materials)[i];
+      desc << "material " << mat->GetName() << " " << mat->GetDensity();
+      const double *fractions = mat->GetFractionVector();
+      for (unsigned int e=0; e < mat->GetNumberOfElements(); ++e) {
+         const G4Element *elem = mat->GetElement(e);
+         desc << " " << elem->GetName() << " " << elem->GetZ()
+              << " " << elem->GetA() << " " << fractions[e];
+      }
+      desc << std::endl;
+   }
+
+   G4LogicalVolumeStore *volumes = G4LogicalVolumeStore::GetInstance();
+   for (unsigned int i=0; i < volumes->size(); ++i) {
+      G4LogicalVolume *logvol = (*volumes)[i];
+      desc << "volume " << logvol->GetName() << " "
+           << ((logvol->GetMaterial())? logvol->GetMaterial()->GetName()
+                                      : G4String("none"));
+      for (int d=0; d < (int)logvol->GetNoDaughters(); ++d)
+         desc << " " << logvol->GetDaughter(d)->GetLogicalVolume()->GetName();
+      desc << std::endl;
+   }
+
+   // 64-bit FNV-1a hash of the description
+   std::string dstr(desc.str());
+   unsigned long long hash = 0xcbf29ce484222325ULL;
+   for (size_t i=0; i < dstr.size(); ++i) {
+      hash ^= (unsigned char)dstr[i];
+      hash *= 0x100000001b3ULL;
+   }
+   char key[20];
+   snprintf(key, 20, "%016llx", hash);
+   return key;
 }
 
 void GlueXPhysicsList::ListActiveProcesses()
@@ -53,9 +53,17 @@ class GlueXPhysicsList: public G4VModularPhysicsList
    virtual void DoProcessReordering();
    virtual void CheckProcessOrdering();
 
+   virtual void StorePhysicsTableCache();
+
  protected:
    GlueXUserOptions *fOptions;
 
+   // Physics table cache, see ConfigurePhysicsTableCache
+   virtual void ConfigurePhysicsTableCache();
+   std::string PhysicsTableKey() const;
+   std::string fPhysicsTableCacheDir;
+   int fPhysicsTableCacheStore;
+
    G4VEmProcess *fBeamConversion;
    G4VEmProcess *fBernardConversion;
    G4OpticalPhysics *fOpticalPhysics;
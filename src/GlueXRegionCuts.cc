@@ -0,0 +1,297 @@
+//
+// GlueXRegionCuts class implementation
+//
+// author: agent at local
+// version: october 18, 2026
+
+#include "GlueXRegionCuts.hh"
+#include "GlueXUserOptions.hh"
+#include "G4LogicalVolumeStore.hh"
+#include "G4RegionStore.hh"
+#include "G4SystemOfUnits.hh"
+#include "G4ios.hh"
+
+#include <stdio.h>
+#include <fstream>
+#include <sstream>
+#include <map>
+
+G4Mutex GlueXRegionCuts::fMutex = G4MUTEX_INITIALIZER;
+int GlueXRegionCuts::fInstanceCount = 0;
+std::vector<GlueXRegionCuts::region_cuts_t> GlueXRegionCuts::fRegions;
+std::vector<GlueXRegionCuts::region_stats_t> GlueXRegionCuts::fTotals;
+
+GlueXRegionCuts::GlueXRegionCuts()
+{
+   G4AutoLock barrier(&fMutex);
+   ++fInstanceCount;
+}
+
+GlueXRegionCuts::~GlueXRegionCuts()
+{
+   G4AutoLock barrier(&fMutex);
+   if (fStats.size() > fTotals.size()) {
+      region_stats_t zero = {0, 0};
+      fTotals.resize(fStats.size(), zero);
+   }
+   for (unsigned int i=0; i < fStats.size(); ++i) {
+      fTotals[i].steps += fStats[i].steps;
+      fTotals[i].secondaries += fStats[i].secondaries;
+   }
+   if (--fInstanceCount == 0) {
+      PrintSummary();
+      fTotals.clear();
+   }
+}
+
+int GlueXRegionCuts::Configure()
+{
+   // Read the region table named in the REGIONFILE card, create the
+   // regions and attach their root volumes. This must be called in
+   // the master thread after the geometry is constructed and before
+   // the physics processes are. Returns the number of regions.
+
+   GlueXUserOptions *user_opts = GlueXUserOptions::GetInstance();
+   if (user_opts == 0) {
+      G4cerr << "Error in GlueXRegionCuts::Configure - "
+             << "GlueXUserOptions::GetInstance() returns null, "
+             << "cannot continue." << G4endl;
+      exit(-1);
+   }
+   std::map<int,std::string> regionfile;
+   if (! user_opts->Find("REGIONFILE", regionfile))
+      return 0;
+
+   // Zero region thresholds fall back on the global CUTS and TOFMAX
+   double KEglobal[kParticleClasses] = {0};
+   std::map<int,double> cuts;
+   if (user_opts->Find("CUTS", cuts)) {
+      for (int i=0; i < kParticleClasses; ++i) {
+         if (cuts.find(i + 1) != cuts.end() && cuts[i + 1] > 0)
+            KEglobal[i] = cuts[i + 1] * GeV;
+      }
+   }
+   double tglobal = 1.0e-5 * s;
+   std::map<int,double> tof;
+   if (user_opts->Find("TOFMAX", tof) && tof.find(1) != tof.end())
+      tglobal = tof[1] * s;
+
+   std::ifstream fin(regionfile[1].c_str());
+   if (! fin.good()) {
+      G4cerr << "GlueXRegionCuts::Configure error - "
+             << "cannot open region table " << regionfile[1]
+             << " for input." << G4endl;
+      exit(-1);
+   }
+   std::vector<std::string> names;
+   std::map<std::string,region_cuts_t> table;
+   std::map<std::string,std::vector<G4LogicalVolume*> > roots;
+   std::string line;
+   while (std::getline(fin, line)) {
+      if (line.size() == 0 || line[0] == '#')
+         continue;
+      std::istringstream sline(line);
+      std::string keyword;
+      std::string name;
+      if (! (sline >> keyword))
+         continue;
+      sline >> name;
+      if (table.find(name) == table.end()) {
+         region_cuts_t zero = {0, {0}, {0}, 0, {0}};
+         table[name] = zero;
+         names.push_back(name);
+      }
+      region_cuts_t &entry = table[name];
+      int good = (name.size() > 0);
+      if (keyword == "region") {
+         for (int i=0; i < 3; ++i) {
+            good = good && (sline >> entry.rangecut[i]);
+            entry.rangecut[i] *= cm;
+         }
+      }
+      else if (keyword == "volumes") {
+         std::string volname;
+         G4LogicalVolumeStore *volumes = G4LogicalVolumeStore::GetInstance();
+         while (good && sline >> volname) {
+            int found = 0;
+            for (unsigned int i=0; i < volumes->size(); ++i) {
+               G4LogicalVolume *logvol = (*volumes)[i];
+               if (logvol->GetName() == volname) {
+                  if (logvol->IsRootRegion()) {
+                     G4cerr << "GlueXRegionCuts::Configure error - "
+                            << "volume " << volname << " listed in "
+                            << regionfile[1] << " is already the root "
+                            << "of a region, cannot continue." << G4endl;
+                     exit(-1);
+                  }
+                  roots[name].push_back(logvol);
+                  ++found;
+               }
+            }
+            if (found == 0) {
+               G4cerr << "GlueXRegionCuts::Configure error - "
+                      << "volume " << volname << " listed in "
+                      << regionfile[1] << " is not found in the "
+                      << "geometry, cannot continue." << G4endl;
+               exit(-1);
+            }
+         }
+      }
+      else if (keyword == "limits") {
+         for (int i=0; i < kParticleClasses; ++i) {
+            good = good && (sline >> entry.KEcut[i]);
+            entry.KEcut[i] *= GeV;
+         }
+         if (good && sline >> entry.tcut)
+            entry.tcut *= s;
+      }
+      else {
+         good = 0;
+      }
+      if (! good) {
+         G4cerr << "GlueXRegionCuts::Configure error - "
+                << "bad line in " << regionfile[1] << ": " << line
+                << G4endl;
+         exit(-1);
+      }
+   }
+
+   for (unsigned int n=0; n < names.size(); ++n) {
+      region_cuts_t entry = table[names[n]];
+      if (roots[names[n]].size() == 0) {
+         G4cerr << "GlueXRegionCuts::Configure error - "
+                << "region " << names[n] << " in " << regionfile[1]
+                << " has no volumes, cannot continue." << G4endl;
+         exit(-1);
+      }
+      entry.region = new G4Region(names[n]);
+      for (unsigned int i=0; i < roots[names[n]].size(); ++i)
+         entry.region->AddRootLogicalVolume(roots[names[n]][i]);
+      entry.region->SetProductionCuts(new G4ProductionCuts());
+      int limited = (entry.tcut > 0);
+      for (int i=0; i < kParticleClasses; ++i) {
+         if (entry.KEcut[i] > 0 || limited) {
+            entry.limits[i] = new G4UserLimits();
+            entry.limits[i]->SetUserMaxTime((entry.tcut > 0)? entry.tcut
+                                                            : tglobal);
+            entry.limits[i]->SetUserMinEkine((entry.KEcut[i] > 0)?
+                                             entry.KEcut[i] : KEglobal[i]);
+         }
+      }
+      fRegions.push_back(entry);
+   }
+   G4cout << "GlueXRegionCuts: " << fRegions.size() << " regions defined"
+          << " in " << regionfile[1] << G4endl;
+   return fRegions.size();
+}
+
+void GlueXRegionCuts::SetDefaultCuts(const G4ProductionCuts *defaults)
+{
+   // Set the production cuts of each region, taking the values that
+   // are not given in the region table from the default cuts.
+
+   const char *particles[4] = {"gamma", "e-", "e+", "proton"};
+   const int column[4] = {0, 1, 1, 2};
+   for (unsigned int n=0; n < fRegions.size(); ++n) {
+      G4ProductionCuts *pcuts = fRegions[n].region->GetProductionCuts();
+      for (int i=0; i < 4; ++i) {
+         double cut = fRegions[n].rangecut[column[i]];
+         if (cut <= 0)
+            cut = defaults->GetProductionCut(particles[i]);
+         pcuts->SetProductionCut(cut, particles[i]);
+      }
+   }
+}
+
+int GlueXRegionCuts::HasLimits(int pclass)
+{
+   // Returns 1 if any region has tracking limits for particle class
+   // pclass, otherwise 0.
+
+   if (pclass < 0)
+      return 0;
+   for (unsigned int i=0; i < fRegions.size(); ++i) {
+      if (fRegions[i].limits[pclass])
+         return 1;
+   }
+   return 0;
+}
+
+int GlueXRegionCuts::ParticleClass(const G4ParticleDefinition *particle)
+{
+   // Returns the class of this particle type for the purpose of the
+   // CUTS and region limits, or -1 if it is not subject to them.
+
+   const G4String &name = particle->GetParticleName();
+   if (name == "gamma")
+      return kGamma;
+   else if (name == "e-" || name == "e+")
+      return kElectron;
+   else if (name == "neutron")
+      return kNeutron;
+   else if (name == "proton" || name == "pi+" || name == "pi-" ||
+            name == "kaon+" || name == "kaon-")
+      return kHadron;
+   else if (name == "mu-" || name == "mu+")
+      return kMuon;
+   return -1;
+}
+
+int GlueXRegionCuts::LookupRegion(const G4LogicalVolume *logvol)
+{
+   // Returns the index in the region store of the region that this
+   // volume belongs to, or the size of the store if it has none.
+
+   G4RegionStore *regions = G4RegionStore::GetInstance();
+   unsigned int index;
+   for (index=0; index < regions->size(); ++index) {
+      if ((*regions)[index] == logvol->GetRegion())
+         break;
+   }
+   if (fStats.size() < regions->size() + 1) {
+      region_stats_t zero = {0, 0};
+      fStats.resize(regions->size() + 1, zero);
+   }
+   return index;
+}
+
+void GlueXRegionCuts::PrintSummary()
+{
+   long int total_steps = 0;
+   long int total_secondaries = 0;
+   for (unsigned int i=0; i < fTotals.size(); ++i) {
+      total_steps += fTotals[i].steps;
+      total_secondaries += fTotals[i].secondaries;
+   }
+   if (total_steps == 0)
+      return;
+
+   G4RegionStore *regions = G4RegionStore::GetInstance();
+   G4cout << "GlueXRegionCuts: steps and secondaries by region" << G4endl
+          << "   region                       gamma cut     e cut"
+          << "         steps      %   secondaries      %" << G4endl;
+   for (unsigned int i=0; i < fTotals.size(); ++i) {
+      if (fTotals[i].steps == 0)
+         continue;
+      std::string name("(none)");
+      double gcut = 0;
+      double ecut = 0;
+      if (i < regions->size()) {
+         G4Region *region = (*regions)[i];
+         name = region->GetName();
+         G4ProductionCuts *pcuts = region->GetProductionCuts();
+         if (pcuts) {
+            gcut = pcuts->GetProductionCut("gamma");
+            ecut = pcuts->GetProductionCut("e-");
+         }
+      }
+      char line[200];
+      snprintf(line, 200, "   %-28s %7.3g mm %7.3g mm"
+                          " %13ld %6.2f %13ld %6.2f",
+               name.c_str(), gcut / mm, ecut / mm, fTotals[i].steps,
+               100. * fTotals[i].steps / total_steps, fTotals[i].secondaries,
+               100. * fTotals[i].secondaries /
+               ((total_secondaries > 0)? total_secondaries : 1));
+      G4cout << line << G4endl;
+   }
+}
@@ -0,0 +1,134 @@
+//
+// GlueXRegionCuts class header
+//
+// author: agent at local
+// version: october 18, 2026
+//
+// This class sets up named Geant4 regions with their own production
+// cuts and tracking thresholds, as listed in the region table file
+// named in the REGIONFILE card of control.in. Each line of the table
+// starts with a keyword followed by the region name,
+//
+//   region <name> <gamma cut> <e+/e- cut> <proton cut>
+//   volumes <name> <logical volume> [<logical volume> ...]
+//   limits <name> <KEgamma> <KEe> <KEn> <KEp> <KEmu> [<tmax>]
+//
+// where the range cuts are in cm as in the RANGECUTS card, and the
+// kinetic energy thresholds (GeV) and time limit (s) are applied to
+// the same particle classes as the CUTS and TOFMAX cards. A value of
+// zero means the global setting applies. The listed volumes become
+// root volumes of the region, which extends down through all of their
+// daughters that are not root volumes of some other region.
+//
+// When a region table is in use, the number of steps taken and the
+// number of secondaries produced in each region are counted, and a
+// summary is printed at the end of the job.
+//
+// In the context of the Geant4 event-level multithreading model,
+// the static methods are "shared", and instances of this class are
+// "thread-local", ie. have thread-local state. The step counter
+// instance for each worker thread is owned by its GlueXSteppingAction.
+
+#ifndef GlueXRegionCuts_h
+#define GlueXRegionCuts_h 1
+
+#include "G4Step.hh"
+#include "G4Region.hh"
+#include "G4LogicalVolume.hh"
+#include "G4ProductionCuts.hh"
+#include "G4ParticleDefinition.hh"
+#include "G4UserLimits.hh"
+#include "G4Threading.hh"
+#include "G4AutoLock.hh"
+
+#include <vector>
+#include <string>
+
+class GlueXRegionCuts
+{
+ public:
+   GlueXRegionCuts();
+   ~GlueXRegionCuts();
+
+   void RecordStep(const G4Step *step);
+
+   enum particle_class_t {
+      kGamma = 0,
+      kElectron = 1,
+      kNeutron = 2,
+      kHadron = 3,
+      kMuon = 4,
+      kParticleClasses = 5
+   };
+
+   static int Configure();
+   static void SetDefaultCuts(const G4ProductionCuts *defaults);
+   static int IsActive() { return fRegions.size() > 0; }
+   static int HasLimits(int pclass);
+   static int ParticleClass(const G4ParticleDefinition *particle);
+   static G4UserLimits *GetUserLimits(const G4Region *region, int pclass);
+
+ protected:
+   struct region_cuts_t {
+      G4Region *region;
+      double rangecut[3];       // gamma, e+/e-, proton (0 = default)
+      double KEcut[kParticleClasses];
+      double tcut;
+      G4UserLimits *limits[kParticleClasses];
+   };
+
+   struct region_stats_t {
+      long int steps;
+      long int secondaries;
+   };
+   std::vector<region_stats_t> fStats;
+   std::vector<int> fRegionOfVolume;
+
+   int LookupRegion(const G4LogicalVolume *logvol);
+   static void PrintSummary();
+
+ private:
+   GlueXRegionCuts(const GlueXRegionCuts &src);
+   GlueXRegionCuts &operator=(const GlueXRegionCuts &src);
+
+   static G4Mutex fMutex;
+   static int fInstanceCount;
+   static std::vector<region_cuts_t> fRegions;
+   static std::vector<region_stats_t> fTotals;
+};
+
+inline void GlueXRegionCuts::RecordStep(const G4Step *step)
+{
+   // Charge this step and its secondaries to the region of the
+   // volume in which it was taken.
+
+   const G4LogicalVolume *logvol = step->GetPreStepPoint()->
+                                   GetPhysicalVolume()->GetLogicalVolume();
+   unsigned int id = logvol->GetInstanceID();
+   if (id >= fRegionOfVolume.size())
+      fRegionOfVolume.resize(id + 1, -1);
+   int index = fRegionOfVolume[id];
+   if (index < 0) {
+      index = LookupRegion(logvol);
+      fRegionOfVolume[id] = index;
+   }
+   fStats[index].steps += 1;
+   fStats[index].secondaries += step->GetSecondaryInCurrentStep()->size();
+}
+
+inline G4UserLimits *GlueXRegionCuts::GetUserLimits(const G4Region *region,
+                                                    int pclass)
+{
+   // Return the tracking limits for particles of class pclass in
+   // this region, or null if the global limits apply there.
+
+   if (pclass < 0)
+      return 0;
+   for (unsigned int i=0; i < fRegions.size(); ++i) {
+      if (fRegions[i].region == region)
+         return fRegions[i].limits[pclass];
+   }
+   return 0;
+}
+
+#endif
@@ -7,10 +7,12 @@
 #include "GlueXRunAction.hh"
 #include "GlueXPhysicsList.hh"
 #include "GlueXUserEventInformation.hh"
+#include "GlueXCDCNavigation.hh"
 
 #include "G4VisManager.hh"
 #include "G4ViewParameters.hh"
 #include "G4VViewer.hh"
+#include "G4Threading.hh"
 #include "G4ios.hh"
 
 GlueXRunAction::GlueXRunAction(GlueXPhysicsList *plist)
@@ -44,6 +46,14 @@ void GlueXRunAction::BeginOfRunAction(const G4Run*)
          GlueXUserEventInformation::setWriteNoHitEvents(1);
    }
 
+   // Analytic straw navigation in the CDC (CDCNAVIGATION card)
+   GlueXCDCNavigation::Install();
+
+   // The physics tables are built by now, save them in the
+   // cache if the PHYSCACHE card asks for it
+   if (G4Threading::IsMasterThread())
+      fPhysicsList->StorePhysicsTableCache();
+
    fPhysicsList->SelectActiveProcesses();
    //fPhysicsList->ListActiveProcesses();
 
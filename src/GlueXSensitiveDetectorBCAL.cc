@@ -17,6 +17,8 @@
 #include "G4HCofThisEvent.hh"
 #include "G4Step.hh"
 #include "G4SDManager.hh"
+#include "G4FastTrack.hh"
+#include "G4GFlashSpot.hh"
 #include "G4ios.hh"
 
 #include <JANA/JApplication.h>
@@ -95,6 +97,7 @@ GlueXSensitiveDetectorBCAL::GlueXSensitiveDetectorBCAL(const G4String& name)
 GlueXSensitiveDetectorBCAL::GlueXSensitiveDetectorBCAL(
                      const GlueXSensitiveDetectorBCAL &src)
  : G4VSensitiveDetector(src),
+   G4VGFlashSensitiveDetector(src),
    fCellsMap(src.fCellsMap), fPointsMap(src.fPointsMap)
 {
    G4AutoLock barrier(&fMutex);
@@ -159,12 +162,8 @@ G4bool GlueXSensitiveDetectorBCAL::ProcessHits(G4Step* step,
    // order of appearance in the event simulation.
 
    G4Track *track = step->GetTrack();
-   G4int trackID = track->GetTrackID();
-   int pdgtype = track->GetDynamicParticle()->GetPDGcode();
-   int g3type = GlueXPrimaryGeneratorAction::ConvertPdgToGeant3(pdgtype);
    GlueXUserTrackInformation *trackinfo = (GlueXUserTrackInformation*)
                                           track->GetUserInformation();
-   int itrack = trackinfo->GetGlueXTrackID();
    if (touch->GetVolume()->GetName() == "BCL0") {
       if (track->GetCurrentStepNumber() == 1)
          trackinfo->SetGlueXHistory(1);
@@ -172,25 +171,7 @@ G4bool GlueXSensitiveDetectorBCAL::ProcessHits(G4Step* step,
           xin[0] * pin[0] + xin[1] * pin[1] > 0 &&
           Ein > THRESH_MEV*MeV)
       {
-         G4int key = fPointsMap->entries();
-         GlueXHitBCALpoint* lastPoint = (*fPointsMap)[key - 1];
-         // Limit bcal truthPoints to one per track
-         if (lastPoint == 0 || lastPoint->track_ != trackID) {
-            GlueXHitBCALpoint newPoint;
-            newPoint.ptype_G3 = g3type;
-            newPoint.track_ = trackID;
-            newPoint.trackID_ = itrack;
-            newPoint.primary_ = (track->GetParentID() == 0);
-            newPoint.t_ns = t/ns;
-            newPoint.z_cm = xin[2]/cm;
-            newPoint.r_cm = xin.perp()/cm;
-            newPoint.phi_rad = xin.phi();
-            newPoint.px_GeV = pin[0]/GeV;
-            newPoint.py_GeV = pin[1]/GeV;
-            newPoint.pz_GeV = pin[2]/GeV;
-            newPoint.E_GeV = Ein/GeV;
-            fPointsMap->add(key, newPoint);
-         }
+         AddTruthPoint(track, xin, pin, Ein, t);
  
          // The original HDGeant hits code for the BCal had a heavy-weight
          // recording system implemented to assign every hit to a particular
@@ -234,149 +215,236 @@ G4bool GlueXSensitiveDetectorBCAL::ProcessHits(G4Step* step,
    // Post the hit to the hits map, ordered by sector index
 
    if (dEsum > 0) {
-      int module = GetIdent("module", touch);
-      int layer = GetIdent("layer", touch);
-      int sector = GetIdent("sector", touch);
-      int key = GlueXHitBCALcell::GetKey(module, layer, sector);
-      GlueXHitBCALcell *cell = (*fCellsMap)[key];
-      if (cell == 0) {
-         GlueXHitBCALcell newcell(module, layer, sector);
-         fCellsMap->add(key, newcell);
-         cell = (*fCellsMap)[key];
-      }
+      AddCellHit(touch, dEsum, t, xlocal, trackinfo->GetBCALincidentID());
+   }
+   return true;
+}
 
-      // Add the hit to the bcal truth hits list, maintaining strict time ordering
+G4bool GlueXSensitiveDetectorBCAL::ProcessHits(G4GFlashSpot* spot,
+                                               G4TouchableHistory* ROhist)
+{
+   // Energy spots from the fast shower model, see GlueXFastShowerBCAL,
+   // are recorded like the steps of a fully simulated shower, with the
+   // time taken from the incident particle plus the time of flight
+   // from its entry point at the speed of light.
+
+   double dEsum = spot->GetEnergySpot()->GetEnergy();
+   const G4ThreeVector &x = spot->GetEnergySpot()->GetPosition();
+   const G4Track *track = spot->GetOriginatorTrack()->GetPrimaryTrack();
+   const G4ThreeVector &xin = track->GetPosition();
+   const G4ThreeVector &pin = track->GetMomentum();
+   double Ein = track->GetTotalEnergy();
+   double tin = track->GetGlobalTime();
+   double t = tin + (x - xin).mag() / c_light;
+
+   const G4VTouchable* touch = spot->GetTouchableHandle()();
+   const G4AffineTransform &local_from_global = touch->GetHistory()
+                                                     ->GetTopTransform();
+   G4ThreeVector xlocal = local_from_global.TransformPoint(x);
+   if (touch->GetVolume()->GetName() == "BCL0")
+      return false;
 
-      int merge_hit = 0;
-      std::vector<GlueXHitBCALcell::hitinfo_t>::iterator hiter;
-      for (hiter = cell->hits.begin(); hiter != cell->hits.end(); ++hiter) {
-         if (fabs(hiter->t_ns*ns - t) < TWO_HIT_TIME_RESOL) {
-            merge_hit = 1;
-            break;
-         }
-         else if (hiter->t_ns*ns > t) {
-            break;
-         }
+   // The incident particle has not necessarily passed through BCL0,
+   // in which case the truth shower is recorded here instead, under
+   // the same conditions as for the steps of a full simulation. All
+   // of the spots of one shower come from the same intercepted track,
+   // so the incident ID is only assigned on the first of them.
+
+   GlueXUserTrackInformation *trackinfo = (GlueXUserTrackInformation*)
+                                          track->GetUserInformation();
+   if (trackinfo->GetGlueXHistory() == 0 &&
+       trackinfo->GetBCALincidentID() == 0 &&
+       xin[0] * pin[0] + xin[1] * pin[1] > 0 &&
+       Ein > THRESH_MEV*MeV)
+   {
+      AddTruthPoint(track, xin, pin, Ein, tin);
+      trackinfo->AssignBCALincidentID(track);
+   }
+
+   if (dEsum > 0) {
+      AddCellHit(touch, dEsum, t, xlocal, trackinfo->GetBCALincidentID());
+   }
+   return true;
+}
+
+void GlueXSensitiveDetectorBCAL::AddTruthPoint(const G4Track *track,
+                                               const G4ThreeVector &xin,
+                                               const G4ThreeVector &pin,
+                                               double Ein, double t)
+{
+   int trackID = track->GetTrackID();
+   int pdgtype = track->GetDynamicParticle()->GetPDGcode();
+   int g3type = GlueXPrimaryGeneratorAction::ConvertPdgToGeant3(pdgtype);
+   GlueXUserTrackInformation *trackinfo = (GlueXUserTrackInformation*)
+                                          track->GetUserInformation();
+   int itrack = trackinfo->GetGlueXTrackID();
+   G4int key = fPointsMap->entries();
+   GlueXHitBCALpoint* lastPoint = (*fPointsMap)[key - 1];
+   // Limit bcal truthPoints to one per track
+   if (lastPoint == 0 || lastPoint->track_ != trackID) {
+      GlueXHitBCALpoint newPoint;
+      newPoint.ptype_G3 = g3type;
+      newPoint.track_ = trackID;
+      newPoint.trackID_ = itrack;
+      newPoint.primary_ = (track->GetParentID() == 0);
+      newPoint.t_ns = t/ns;
+      newPoint.z_cm = xin[2]/cm;
+      newPoint.r_cm = xin.perp()/cm;
+      newPoint.phi_rad = xin.phi();
+      newPoint.px_GeV = pin[0]/GeV;
+      newPoint.py_GeV = pin[1]/GeV;
+      newPoint.pz_GeV = pin[2]/GeV;
+      newPoint.E_GeV = Ein/GeV;
+      fPointsMap->add(key, newPoint);
+   }
+}
+
+void GlueXSensitiveDetectorBCAL::AddCellHit(const G4VTouchable *touch,
+                                            double dEsum, double t,
+                                            const G4ThreeVector &xlocal,
+                                            int incidentId)
+{
+   int module = GetIdent("module", touch);
+   int layer = GetIdent("layer", touch);
+   int sector = GetIdent("sector", touch);
+   int key = GlueXHitBCALcell::GetKey(module, layer, sector);
+   GlueXHitBCALcell *cell = (*fCellsMap)[key];
+   if (cell == 0) {
+      GlueXHitBCALcell newcell(module, layer, sector);
+      fCellsMap->add(key, newcell);
+      cell = (*fCellsMap)[key];
+   }
+
+   // Add the hit to the bcal truth hits list, maintaining strict time ordering
+
+   int merge_hit = 0;
+   std::vector<GlueXHitBCALcell::hitinfo_t>::iterator hiter;
+   for (hiter = cell->hits.begin(); hiter != cell->hits.end(); ++hiter) {
+      if (fabs(hiter->t_ns*ns - t) < TWO_HIT_TIME_RESOL) {
+         merge_hit = 1;
+         break;
       }
-      if (merge_hit) {
-         // Use the time from the earlier hit but add the energy deposition
+      else if (hiter->t_ns*ns > t) {
+         break;
+      }
+   }
+   if (merge_hit) {
+      // Use the time from the earlier hit but add the energy deposition
 #if USE_ENERGY_WEIGHTED_TIMES
-         hiter->t_ns = (hiter->t_ns * hiter->E_GeV + 
-                               t/ns * dEsum/GeV) /
-                       (hiter->E_GeV + dEsum/GeV);
-         hiter->zlocal_cm = (hiter->zlocal_cm * hiter->E_GeV +
-                                    xlocal[2]/cm * dEsum/GeV) /
-                            (hiter->E_GeV + dEsum/GeV);
+      hiter->t_ns = (hiter->t_ns * hiter->E_GeV + 
+                            t/ns * dEsum/GeV) /
+                    (hiter->E_GeV + dEsum/GeV);
+      hiter->zlocal_cm = (hiter->zlocal_cm * hiter->E_GeV +
+                                 xlocal[2]/cm * dEsum/GeV) /
+                         (hiter->E_GeV + dEsum/GeV);
 #else
-         if (hiter->t_ns*ns > t) {
-            hiter->t_ns = t/ns;
-            hiter->zlocal_cm = xlocal[2]/cm;
-            hiter->incidentId_ = trackinfo->GetBCALincidentID();
-         }
-#endif
-         // correction factor makes shower yields match hdgeant
-         hiter->E_GeV += dEsum/GeV * SHOWER_ENERGY_SCALE_FACTOR;
-      }
-      else if ((int)cell->hits.size() < MAX_HITS) {
-         // create new hit 
-         hiter = cell->hits.insert(hiter, GlueXHitBCALcell::hitinfo_t());
-         // correction factor makes shower yields match hdgeant
-         hiter->E_GeV = dEsum/GeV * SHOWER_ENERGY_SCALE_FACTOR;
+      if (hiter->t_ns*ns > t) {
          hiter->t_ns = t/ns;
          hiter->zlocal_cm = xlocal[2]/cm;
-         hiter->incidentId_ = trackinfo->GetBCALincidentID();
-      }
-      else {
-         G4cerr << "GlueXSensitiveDetectorBCAL::ProcessHits error: "
-             << "max hit count " << MAX_HITS << " exceeded, truncating!"
-             << G4endl;
+         hiter->incidentId_ = incidentId;
       }
+#endif
+      // correction factor makes shower yields match hdgeant
+      hiter->E_GeV += dEsum/GeV * SHOWER_ENERGY_SCALE_FACTOR;
+   }
+   else if ((int)cell->hits.size() < MAX_HITS) {
+      // create new hit 
+      hiter = cell->hits.insert(hiter, GlueXHitBCALcell::hitinfo_t());
+      // correction factor makes shower yields match hdgeant
+      hiter->E_GeV = dEsum/GeV * SHOWER_ENERGY_SCALE_FACTOR;
+      hiter->t_ns = t/ns;
+      hiter->zlocal_cm = xlocal[2]/cm;
+      hiter->incidentId_ = incidentId;
+   }
+   else {
+      G4cerr << "GlueXSensitiveDetectorBCAL::ProcessHits error: "
+          << "max hit count " << MAX_HITS << " exceeded, truncating!"
+          << G4endl;
+   }
 
-      // Add the hit to the upstream sipm hits list, with strict time ordering
+   // Add the hit to the upstream sipm hits list, with strict time ordering
 
-      double udist = MODULE_FULL_LENGTH/2 + xlocal[2];
-      double dEup = dEsum * exp(-udist/ATTENUATION_LENGTH);
-      double tup = t + udist / C_EFFECTIVE;
-      merge_hit = 0;
-      for (hiter = cell->hits.begin(); hiter != cell->hits.end(); ++hiter) {
-         if (fabs(hiter->tup_ns*ns - tup) < TWO_HIT_TIME_RESOL) {
-            merge_hit = 1;
-            break;
-         }
-         else if (hiter->tup_ns*ns > tup) {
-            break;
-         }
+   double udist = MODULE_FULL_LENGTH/2 + xlocal[2];
+   double dEup = dEsum * exp(-udist/ATTENUATION_LENGTH);
+   double tup = t + udist / C_EFFECTIVE;
+   merge_hit = 0;
+   for (hiter = cell->hits.begin(); hiter != cell->hits.end(); ++hiter) {
+      if (fabs(hiter->tup_ns*ns - tup) < TWO_HIT_TIME_RESOL) {
+         merge_hit = 1;
+         break;
       }
-      if (merge_hit) {
-         // Use the time from the earlier hit but add the energy deposition
+      else if (hiter->tup_ns*ns > tup) {
+         break;
+      }
+   }
+   if (merge_hit) {
+      // Use the time from the earlier hit but add the energy deposition
 #if USE_ENERGY_WEIGHTED_TIMES
-         hiter->tup_ns = (hiter->tup_ns * hiter->Eup_GeV + 
-                                 tup/ns * dEup/GeV) /
-                       (hiter->Eup_GeV + dEup/GeV);
+      hiter->tup_ns = (hiter->tup_ns * hiter->Eup_GeV + 
+                              tup/ns * dEup/GeV) /
+                    (hiter->Eup_GeV + dEup/GeV);
 #else
-         if (hiter->tup_ns*ns > tup) {
-            hiter->tup_ns = tup/ns;
-         }
-#endif
-         // correction factor makes shower yields match hdgeant
-         hiter->Eup_GeV += dEup/GeV * SHOWER_ENERGY_SCALE_FACTOR;
-      }
-      else if ((int)cell->hits.size() < MAX_HITS) {
-         // create new hit 
-         hiter = cell->hits.insert(hiter, GlueXHitBCALcell::hitinfo_t());
-         // correction factor makes shower yields match hdgeant
-         hiter->Eup_GeV = dEup/GeV * SHOWER_ENERGY_SCALE_FACTOR;
+      if (hiter->tup_ns*ns > tup) {
          hiter->tup_ns = tup/ns;
       }
-      else {
-         G4cerr << "GlueXSensitiveDetectorBCAL::ProcessHits error: "
-             << "max hit count " << MAX_HITS << " exceeded, truncating!"
-             << G4endl;
-      }
+#endif
+      // correction factor makes shower yields match hdgeant
+      hiter->Eup_GeV += dEup/GeV * SHOWER_ENERGY_SCALE_FACTOR;
+   }
+   else if ((int)cell->hits.size() < MAX_HITS) {
+      // create new hit 
+      hiter = cell->hits.insert(hiter, GlueXHitBCALcell::hitinfo_t());
+      // correction factor makes shower yields match hdgeant
+      hiter->Eup_GeV = dEup/GeV * SHOWER_ENERGY_SCALE_FACTOR;
+      hiter->tup_ns = tup/ns;
+   }
+   else {
+      G4cerr << "GlueXSensitiveDetectorBCAL::ProcessHits error: "
+          << "max hit count " << MAX_HITS << " exceeded, truncating!"
+          << G4endl;
+   }
 
-      // Add the hit to the downstream sipm hits list, with strict time ordering
+   // Add the hit to the downstream sipm hits list, with strict time ordering
 
-      double ddist = MODULE_FULL_LENGTH/2 - xlocal[2];
-      double dEdown = dEsum * exp(-ddist/ATTENUATION_LENGTH);
-      double tdown = t + ddist / C_EFFECTIVE;
-      merge_hit = 0;
-      for (hiter = cell->hits.begin(); hiter != cell->hits.end(); ++hiter) {
-         if (fabs(hiter->tdown_ns*ns - tdown) < TWO_HIT_TIME_RESOL) {
-            merge_hit = 1;
-            break;
-         }
-         else if (hiter->tdown_ns*ns > tdown) {
-            break;
-         }
+   double ddist = MODULE_FULL_LENGTH/2 - xlocal[2];
+   double dEdown = dEsum * exp(-ddist/ATTENUATION_LENGTH);
+   double tdown = t + ddist / C_EFFECTIVE;
+   merge_hit = 0;
+   for (hiter = cell->hits.begin(); hiter != cell->hits.end(); ++hiter) {
+      if (fabs(hiter->tdown_ns*ns - tdown) < TWO_HIT_TIME_RESOL) {
+         merge_hit = 1;
+         break;
       }
-      if (merge_hit) {
-         // Use the time from the earlier hit but add the energy deposition
+      else if (hiter->tdown_ns*ns > tdown) {
+         break;
+      }
+   }
+   if (merge_hit) {
+      // Use the time from the earlier hit but add the energy deposition
 #if USE_ENERGY_WEIGHTED_TIMES
-         hiter->tdown_ns = (hiter->tdown_ns * hiter->Edown_GeV + 
-                                   tdown/ns * dEdown/GeV) /
-                       (hiter->Edown_GeV + dEdown/GeV);
+      hiter->tdown_ns = (hiter->tdown_ns * hiter->Edown_GeV + 
+                                tdown/ns * dEdown/GeV) /
+                    (hiter->Edown_GeV + dEdown/GeV);
 #else
-         if (hiter->tdown_ns*ns > tdown) {
-            hiter->tdown_ns = tdown/ns;
-         }
-#endif
-         // correction factor makes shower yields match hdgeant
-         hiter->Edown_GeV += dEdown/GeV * SHOWER_ENERGY_SCALE_FACTOR;
-      }
-      else if ((int)cell->hits.size() < MAX_HITS) {
-         // create new hit 
-         hiter = cell->hits.insert(hiter, GlueXHitBCALcell::hitinfo_t());
-         // correction factor makes shower yields match hdgeant
-         hiter->Edown_GeV = dEdown/GeV * SHOWER_ENERGY_SCALE_FACTOR;
+      if (hiter->tdown_ns*ns > tdown) {
          hiter->tdown_ns = tdown/ns;
       }
-      else {
-         G4cerr << "GlueXSensitiveDetectorBCAL::ProcessHits error: "
-             << "max hit count " << MAX_HITS << " exceeded, truncating!"
-             << G4endl;
-      }
+#endif
+      // correction factor makes shower yields match hdgeant
+      hiter->Edown_GeV += dEdown/GeV * SHOWER_ENERGY_SCALE_FACTOR;
+   }
+   else if ((int)cell->hits.size() < MAX_HITS) {
+      // create new hit 
+      hiter = cell->hits.insert(hiter, GlueXHitBCALcell::hitinfo_t());
+      // correction factor makes shower yields match hdgeant
+      hiter->Edown_GeV = dEdown/GeV * SHOWER_ENERGY_SCALE_FACTOR;
+      hiter->tdown_ns = tdown/ns;
+   }
+   else {
+      G4cerr << "GlueXSensitiveDetectorBCAL::ProcessHits error: "
+          << "max hit count " << MAX_HITS << " exceeded, truncating!"
+          << G4endl;
    }
-   return true;
 }
 
 void GlueXSensitiveDetectorBCAL::EndOfEvent(G4HCofThisEvent*)
@@ -12,15 +12,19 @@
 #define GlueXSensitiveDetectorBCAL_h 1
 
 #include "G4VSensitiveDetector.hh"
+#include "G4VGFlashSensitiveDetector.hh"
 #include "G4AutoLock.hh"
 
 #include "GlueXHitBCALcell.hh"
 #include "GlueXHitBCALpoint.hh"
 
 class G4Step;
+class G4Track;
+class G4GFlashSpot;
 class G4HCofThisEvent;
 
-class GlueXSensitiveDetectorBCAL : public G4VSensitiveDetector
+class GlueXSensitiveDetectorBCAL : public G4VSensitiveDetector,
+                                   public G4VGFlashSensitiveDetector
 {
  public:
    GlueXSensitiveDetectorBCAL(const G4String& name);
@@ -30,11 +34,17 @@ class GlueXSensitiveDetectorBCAL : public G4VSensitiveDetector
   
    virtual void Initialize(G4HCofThisEvent* hitCollection);
    virtual G4bool ProcessHits(G4Step* step, G4TouchableHistory* ROhist);
+   virtual G4bool ProcessHits(G4GFlashSpot* spot, G4TouchableHistory* ROhist);
    virtual void EndOfEvent(G4HCofThisEvent* hitCollection);
 
    int GetIdent(std::string div, const G4VTouchable *touch);
 
  private:
+   void AddTruthPoint(const G4Track *track, const G4ThreeVector &xin,
+                      const G4ThreeVector &pin, double Ein, double t);
+   void AddCellHit(const G4VTouchable *touch, double dEsum, double t,
+                   const G4ThreeVector &xlocal, int incidentId);
+
    GlueXHitsMapBCALcell* fCellsMap;
    GlueXHitsMapBCALpoint* fPointsMap;
 
@@ -5,6 +5,7 @@
 // version: january 22, 2017
 
 #include "GlueXSpecialCuts.hh"
+#include "GlueXRegionCuts.hh"
 #include "G4TransportationProcessType.hh"
 
 #include "G4PhysicalConstants.hh"
@@ -13,11 +14,10 @@
 #include "G4VParticleChange.hh"
 #include "G4LossTableManager.hh"
 
-G4UserLimits *GlueXSpecialCuts::fUserLimits = 0;
-G4Mutex GlueXSpecialCuts::fMutex = G4MUTEX_INITIALIZER;
-
 GlueXSpecialCuts::GlueXSpecialCuts(const G4String& aName)
-  : G4VProcess(aName, fUserDefined)
+  : G4VProcess(aName, fUserDefined),
+    fUserLimits(0),
+    fParticleClass(-2)
 {
    // set Process Sub Type
    SetProcessSubType(static_cast<int>(USER_SPECIAL_CUTS));
@@ -28,11 +28,19 @@ GlueXSpecialCuts::GlueXSpecialCuts(const G4String& aName)
 }
 
 GlueXSpecialCuts::~GlueXSpecialCuts()
-{}
+{
+   if (fUserLimits)
+      delete fUserLimits;
+}
 
 GlueXSpecialCuts::GlueXSpecialCuts(GlueXSpecialCuts& right)
-  : G4VProcess(right)
-{}
+  : G4VProcess(right),
+    fUserLimits(0),
+    fParticleClass(-2)
+{
+   if (right.fUserLimits)
+      fUserLimits = new G4UserLimits(*right.fUserLimits);
+}
 
 G4double GlueXSpecialCuts::
 PostStepGetPhysicalInteractionLength( const G4Track& aTrack,
@@ -42,22 +50,38 @@ PostStepGetPhysicalInteractionLength( const G4Track& aTrack,
    // condition is set to "Not Forced"
    *condition = NotForced;
 
+   // limits set for this particle in the current region, if any,
+   // take the place of the global ones, see GlueXRegionCuts
+   G4UserLimits *limits = fUserLimits;
+   if (GlueXRegionCuts::IsActive()) {
+      if (fParticleClass == -2) {
+         const G4ParticleDefinition *particle = aTrack.GetDefinition();
+         fParticleClass = GlueXRegionCuts::ParticleClass(particle);
+      }
+      const G4Region *region = aTrack.GetVolume()->GetLogicalVolume()
+                                                 ->GetRegion();
+      G4UserLimits *rlimits = GlueXRegionCuts::GetUserLimits(region,
+                                                             fParticleClass);
+      if (rlimits)
+         limits = rlimits;
+   }
+
    G4double ProposedStep = DBL_MAX;
-   if (fUserLimits) {
+   if (limits) {
 
       // check max kinetic energy first
       G4double Ekine = aTrack.GetKineticEnergy();
-      if (Ekine <= fUserLimits->GetUserMinEkine(aTrack))
+      if (Ekine <= limits->GetUserMinEkine(aTrack))
          return 0.;
 
       // max track length
-      ProposedStep = fUserLimits->GetUserMaxTrackLength(aTrack) -
+      ProposedStep = limits->GetUserMaxTrackLength(aTrack) -
                      aTrack.GetTrackLength();
       if (ProposedStep < 0.)
          return 0.;
 
       // max time limit
-      G4double tlimit = fUserLimits->GetUserMaxTime(aTrack);
+      G4double tlimit = limits->GetUserMaxTime(aTrack);
       if (tlimit < DBL_MAX) {
          G4double beta = aTrack.GetDynamicParticle()->GetTotalMomentum() /
 	                     aTrack.GetTotalEnergy();
@@ -71,7 +95,7 @@ PostStepGetPhysicalInteractionLength( const G4Track& aTrack,
 
       // min remaining range 
       // (only for charged particle except for chargedGeantino)
-      G4double Rmin = fUserLimits->GetUserMinRange(aTrack);
+      G4double Rmin = limits->GetUserMinRange(aTrack);
       if (Rmin > DBL_MIN) {
          G4ParticleDefinition* Particle = aTrack.GetDefinition();
          if (Particle->GetPDGCharge() != 0 && Particle->GetPDGMass() > 0.0) {
@@ -119,7 +143,6 @@ const G4UserLimits *GlueXSpecialCuts::GetUserLimits() const
 
 void GlueXSpecialCuts::SetUserLimits(const G4UserLimits *userlimits)
 {
-   G4AutoLock barrier(&fMutex);
    if (fUserLimits)
       delete fUserLimits;
    fUserLimits = new G4UserLimits(*userlimits);
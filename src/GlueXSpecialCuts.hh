@@ -73,8 +73,8 @@ class GlueXSpecialCuts : public G4VProcess
    GlueXSpecialCuts& operator=(const GlueXSpecialCuts& right);
 
    G4LossTableManager* theLossTableManager;
-   static G4UserLimits *fUserLimits;
-   static G4Mutex fMutex;
+   G4UserLimits *fUserLimits;
+   int fParticleClass;
 };
 
 #endif
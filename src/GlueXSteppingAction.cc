@@ -15,22 +15,67 @@
 #include "G4Threading.hh"
 #include "G4Event.hh"
 #include "G4Decay.hh"
+#include "G4PhysicalVolumeStore.hh"
 
 #include <stdio.h>
 #include <exception>
+#include <sstream>
 #include <map>
 
-//#define BACKGROUND_PROFILING 1
-#if BACKGROUND_PROFILING
 #include <TFile.h>
 #include <TTree.h>
-TFile *bgprofiles_file = 0;
-std::map<int, TTree*> bgprofiles;
-#endif
+#include <TH2D.h>
+
+// Number of crossings buffered by each thread before they are
+// written to the shared background profile trees.
+#define BGPROFILE_BUFFER_ROWS 65536
 
 G4Mutex GlueXSteppingAction::fMutex = G4MUTEX_INITIALIZER;
 int GlueXSteppingAction::fStopTracksInCollimator = 0;
 int GlueXSteppingAction::fSaveTrajectories = 0;
+std::vector<std::string> GlueXSteppingAction::fKillVolumes;
+std::vector<std::string> GlueXSteppingAction::fScoreVolumes;
+int GlueXSteppingAction::fProfileMode = 0;
+double GlueXSteppingAction::fProfileXYrange = 100;
+double GlueXSteppingAction::fProfileEmin = 1e-9;
+int GlueXSteppingAction::fInstanceCount = 0;
+TFile *GlueXSteppingAction::fProfileFile = 0;
+std::map<int, TTree*> GlueXSteppingAction::fProfileTrees;
+std::map<int, TH2D*> GlueXSteppingAction::fProfileSumsXY;
+std::map<int, TH2D*> GlueXSteppingAction::fProfileSumsE;
+
+//  The background profile trees det<n> contain information on particle 
+//  type, energy, position, polarization, and at what virtual detector the 
+//  particle passes through. These virtual detectors are filled with air
+//  and are listed in the SCOREVOLUMES card, by default "DETx" where x is
+//  an index currently between 1 and 8, stored in the tree as integer
+//  element "det". The xint[i][3] array records the vertices of the
+//  interaction sequence leading to the detected particle.
+
+static const int bgprofile_mint_max = 9;
+static struct bgprofile_row_t {
+   float totE;
+   float x[7];
+   float ppol;
+   float xspot[2];
+   int ptype;
+   int det;
+   int mint;
+   float xint[bgprofile_mint_max][3];
+} bgprofile_row;
+
+static void split_volume_list(const std::string &names,
+                              std::vector<std::string> &list)
+{
+   size_t p = 0;
+   while (p != names.npos) {
+      size_t pfin = names.find_first_of(",", p);
+      std::string name(names.substr(p, pfin - p));
+      if (name.size() > 0)
+         list.push_back(name);
+      p = (pfin == names.npos)? pfin : pfin + 1;
+   }
+}
 
 GlueXSteppingAction::GlueXSteppingAction()
 {
@@ -57,32 +102,168 @@ GlueXSteppingAction::GlueXSteppingAction()
    }
    else {
       fSaveTrajectories = 0;
-  }
+   }
+
+   if (fKillVolumes.size() == 0) {
+      std::map<int,std::string> killvolumes;
+      if (user_opts->Find("KILLVOLUMES", killvolumes))
+         split_volume_list(killvolumes[1], fKillVolumes);
+      else
+         fKillVolumes.push_back("World");
+      if (fStopTracksInCollimator) {
+         fKillVolumes.push_back("INSU");
+         fKillVolumes.push_back("PCTT");
+         fKillVolumes.push_back("PCPB");
+      }
+      std::map<int,std::string> scorevolumes;
+      if (user_opts->Find("SCOREVOLUMES", scorevolumes)) {
+         split_volume_list(scorevolumes[1], fScoreVolumes);
+      }
+      else {
+         for (int det=1; det <= 8; ++det) {
+            std::stringstream name;
+            name << "DET" << det;
+            fScoreVolumes.push_back(name.str());
+         }
+      }
+      if (fScoreVolumes.size() > 255) {
+         G4cerr << "Error in GlueXSteppingAction constructor - "
+                << "too many volumes listed on the SCOREVOLUMES card, "
+                << "maximum is 255, cannot continue." << G4endl;
+         exit(-1);
+      }
 
-#if BACKGROUND_PROFILING
-   if (bgprofiles_file == 0) {
-      bgprofiles_file = new TFile("bgprofiles.root", "recreate");
+      std::map<int,double> bgprofiles;
+      if (user_opts->Find("BGPROFILES", bgprofiles)) {
+         fProfileMode = int(bgprofiles[1]);
+         if (bgprofiles.find(2) != bgprofiles.end())
+            fProfileXYrange = bgprofiles[2];
+         if (bgprofiles.find(3) != bgprofiles.end())
+            fProfileEmin = bgprofiles[3];
+         if (fProfileMode < 0 || fProfileMode > 3 ||
+             fProfileXYrange <= 0 || fProfileEmin <= 0)
+         {
+            G4cerr << "Error in GlueXSteppingAction constructor - "
+                   << "invalid BGPROFILES card, "
+                   << "cannot continue." << G4endl;
+            exit(-1);
+         }
+      }
    }
-#endif
 
+   if (fProfileMode && fProfileFile == 0) {
+      fProfileFile = new TFile("bgprofiles.root", "recreate");
+   }
+   fProfileSpot[0] = fProfileSpot[1] = 0;
+   fProfileMint = 0;
+   ++fInstanceCount;
+
+   fVoxelTuning = 0;
+   if (GlueXVoxelTuning::IsProfiling())
+      fVoxelTuning = new GlueXVoxelTuning();
+   fRegionCuts = 0;
+   if (GlueXRegionCuts::IsActive())
+      fRegionCuts = new GlueXRegionCuts();
 }
 
 GlueXSteppingAction::GlueXSteppingAction(const GlueXSteppingAction &src)
+ : GlueXSteppingAction()
 {}
 
 GlueXSteppingAction::~GlueXSteppingAction()
 {
-#if BACKGROUND_PROFILING
+   if (fVoxelTuning)
+      delete fVoxelTuning;
+   if (fRegionCuts)
+      delete fRegionCuts;
    G4AutoLock barrier(&fMutex);
-   if (bgprofiles_file) {
-      std::map<int, TTree*>::iterator iter;
-      for (iter = bgprofiles.begin(); iter != bgprofiles.end(); ++iter) {
-         iter->second->Write();
+   if (fProfileMode) {
+      FlushBackgroundProfile();
+      MergeBackgroundProfile();
+   }
+   if (--fInstanceCount == 0 && fProfileFile) {
+      fProfileFile->cd();
+      std::map<int, TTree*>::iterator titer;
+      for (titer = fProfileTrees.begin(); titer != fProfileTrees.end();
+           ++titer)
+      {
+         titer->second->Write();
+      }
+      std::map<int, TH2D*>::iterator hiter;
+      for (hiter = fProfileSumsXY.begin(); hiter != fProfileSumsXY.end();
+           ++hiter)
+      {
+         hiter->second->Write();
+         delete hiter->second;
+      }
+      for (hiter = fProfileSumsE.begin(); hiter != fProfileSumsE.end();
+           ++hiter)
+      {
+         hiter->second->Write();
+         delete hiter->second;
+      }
+      delete fProfileFile;
+      fProfileFile = 0;
+      fProfileTrees.clear();
+      fProfileSumsXY.clear();
+      fProfileSumsE.clear();
+   }
+}
+
+GlueXSteppingAction::volume_role_t
+GlueXSteppingAction::ClassifyVolume(const G4String &name) const
+{
+   volume_role_t vrole = {kRoleNone, 0};
+   for (unsigned int i=0; i < fKillVolumes.size(); ++i) {
+      if (name == fKillVolumes[i])
+         vrole.role |= kRoleKill;
+   }
+   for (unsigned int i=0; i < fScoreVolumes.size(); ++i) {
+      if (name == fScoreVolumes[i]) {
+         vrole.role |= kRoleScore;
+         vrole.det = i + 1;
+         break;
       }
-      delete bgprofiles_file;
-      bgprofiles_file = 0;
    }
-#endif
+   return vrole;
+}
+
+void GlueXSteppingAction::BuildVolumeRoleTable()
+{
+   // Fill the volume role table for all physical volumes known at
+   // this time. This is done separately by each worker thread, so
+   // the table needs no locking. Volumes created later, eg. if the
+   // geometry is rebuilt, are picked up by LookupVolumeRole.
+
+   G4PhysicalVolumeStore *store = G4PhysicalVolumeStore::GetInstance();
+   unsigned int nids = fVolumeRoles.size();
+   G4PhysicalVolumeStore::iterator iter;
+   for (iter = store->begin(); iter != store->end(); ++iter) {
+      unsigned int id = (*iter)->GetInstanceID();
+      nids = (id < nids)? nids : id + 1;
+   }
+   volume_role_t none = {kRoleNone, 0};
+   fVolumeRoles.assign(nids, none);
+   for (iter = store->begin(); iter != store->end(); ++iter) {
+      unsigned int id = (*iter)->GetInstanceID();
+      fVolumeRoles[id] = ClassifyVolume((*iter)->GetName());
+   }
+}
+
+GlueXSteppingAction::volume_role_t
+GlueXSteppingAction::LookupVolumeRole(const G4VPhysicalVolume *pvol)
+{
+   // Slow path of GetVolumeRole, taken on the first step and when
+   // a track enters a volume that is newer than the role table.
+
+   BuildVolumeRoleTable();
+   unsigned int id = pvol->GetInstanceID();
+   if (id >= fVolumeRoles.size()) {
+      volume_role_t none = {kRoleNone, 0};
+      fVolumeRoles.resize(id + 1, none);
+      fVolumeRoles[id] = ClassifyVolume(pvol->GetName());
+   }
+   return fVolumeRoles[id];
 }
 
 void GlueXSteppingAction::UserSteppingAction(const G4Step* step)
@@ -96,21 +277,14 @@ void GlueXSteppingAction::UserSteppingAction(const G4Step* step)
    trackinfo = (GlueXUserTrackInformation*)track->GetUserInformation();
    const G4Step *hyperstep = G4ParallelWorldProcess::GetHyperStep();
    G4VPhysicalVolume *pvol = hyperstep->GetPostStepPoint()->GetPhysicalVolume();
-
-   // Kill tracks at entry to primary collimator or active collimator
-   // if this was asked for in the control file.
-   if (fStopTracksInCollimator) {
-      if (pvol && (pvol->GetName() == "INSU" ||
-                   pvol->GetName() == "PCTT" ||
-                   pvol->GetName() == "PCPB") )
-      {
-         track->SetTrackStatus(fStopAndKill);
-      }
-   }
+   volume_role_t vrole = GetVolumeRole(pvol);
 
    // Kill tracks when they enter the walls / ceiling / floor,
-   // otherwise a lot of time is spent showering in the walls.
-   if (pvol && (pvol->GetName() == "World")) {
+   // otherwise a lot of time is spent showering in the walls,
+   // or any other volume listed in the KILLVOLUMES card. This
+   // includes the primary and active collimator if this was
+   // asked for in the control file.
+   if (vrole.role & kRoleKill) {
       track->SetTrackStatus(fStopAndKill);
    }
 
@@ -142,129 +316,214 @@ void GlueXSteppingAction::UserSteppingAction(const G4Step* step)
       }
    }
  
+   // Profile the time spent in each volume if requested
+   if (fVoxelTuning) {
+      fVoxelTuning->RecordStep(step, event->GetEventID());
+   }
+
+   // Count steps and secondaries by region if regions are defined
+   if (fRegionCuts) {
+      fRegionCuts->RecordStep(step);
+   }
+
    // Save mc trajectory information if requested
    if (fSaveTrajectories) {
       eventinfo->AddMCtrajectoryPoint(*step, fSaveTrajectories);
    }
 
-#if BACKGROUND_PROFILING
+   // Record the flux through the virtual detectors listed in the
+   // SCOREVOLUMES card, if this was asked for in the control file.
+   if (fProfileMode) {
+      if (track->GetCurrentStepNumber() == 1)
+         TrackBackgroundProfile(step);
+      if (vrole.role & kRoleScore)
+         ScoreBackgroundProfile(step, vrole.det);
+   }
 
-//  The following defines a ROOT tree containing information on particle 
-//  type, energy, position, polarization, and at what virtual detector the 
-//  particle passes through. These virtual detectors are filled with air
-//  and are called "DETx" where x is an index currently between 1 and 8,
-//  stored in the tree as integer element "det".  The xint[i][3] array
-//  records the records the vertices of the interaction sequence leading
-//  to the detected particle.
-
-   struct profiler_row_t {
-      float totE;
-      float x[7];
-      float ppol;
-      float xspot[2];
-      int ptype;
-      int det;
-      int mint;
-      float xint[9][3];
-   };
-   const int mint_max = 9;
-   static struct profiler_row_t prow[256];
-   int id = G4Threading::G4GetThreadId() + 1;
-   assert(id < 256);
-
-   if (track->GetCurrentStepNumber() == 1) {
-      if (track->GetParentID() == 0) {
-         G4StepPoint *point = step->GetPostStepPoint();
-         const G4ThreeVector &pos = point->GetPosition();
-         prow[id].xspot[0] = pos[0]/cm;
-         prow[id].xspot[1] = pos[1]/cm;
-         prow[id].mint = 0;
+}
+
+void GlueXSteppingAction::TrackBackgroundProfile(const G4Step *step)
+{
+   // Remember the beam spot and the sequence of interaction vertices
+   // leading up to the particles that reach the virtual detectors.
+
+   const G4Track *track = step->GetTrack();
+   if (track->GetParentID() == 0) {
+      const G4ThreeVector &pos = step->GetPostStepPoint()->GetPosition();
+      fProfileSpot[0] = pos[0]/cm;
+      fProfileSpot[1] = pos[1]/cm;
+      fProfileMint = 0;
+   }
+   else {
+      const G4ThreeVector &pos = step->GetPreStepPoint()->GetPosition();
+      fProfileXint[fProfileMint][0] = pos[0]/cm;
+      fProfileXint[fProfileMint][1] = pos[1]/cm;
+      fProfileXint[fProfileMint][2] = pos[2]/cm;
+      if (fProfileMint < bgprofile_mint_max - 1)
+         ++fProfileMint;
+   }
+}
+
+void GlueXSteppingAction::ScoreBackgroundProfile(const G4Step *step, int det)
+{
+   const G4Track *track = step->GetTrack();
+   G4StepPoint *point = step->GetPostStepPoint();
+   const G4ThreeVector &pos = point->GetPosition();
+   const G4ThreeVector &mom = point->GetMomentum();
+   const G4ThreeVector &pol = point->GetPolarization();
+   double pmag = mom.mag();
+   double Etot = point->GetTotalEnergy();
+   int pdgcode = track->GetDynamicParticle()->GetPDGcode();
+   int g3type = GlueXPrimaryGeneratorAction::ConvertPdgToGeant3(pdgcode);
+
+   if (fProfileMode & 1) {
+      bgprofile_buffer_t &buf = fProfileBuffer;
+      buf.totE.push_back(Etot/GeV);
+      buf.x[0].push_back(pos[0]/cm);
+      buf.x[1].push_back(pos[1]/cm);
+      buf.x[2].push_back(pos[2]/cm);
+      buf.x[3].push_back(mom[0]/pmag);
+      buf.x[4].push_back(mom[1]/pmag);
+      buf.x[5].push_back(mom[2]/pmag);
+      buf.x[6].push_back(pmag/GeV);
+      buf.ppol.push_back(pol.mag());
+      buf.xspot[0].push_back(fProfileSpot[0]);
+      buf.xspot[1].push_back(fProfileSpot[1]);
+      buf.ptype.push_back(g3type);
+      buf.det.push_back(det);
+      buf.mint.push_back(fProfileMint);
+      for (int i=0; i < fProfileMint; ++i) {
+         buf.xint.push_back(fProfileXint[i][0]);
+         buf.xint.push_back(fProfileXint[i][1]);
+         buf.xint.push_back(fProfileXint[i][2]);
       }
-      else {
-         G4StepPoint *point = step->GetPreStepPoint();
-         const G4ThreeVector &pos = point->GetPosition();
-         prow[id].xint[prow[id].mint][0] = pos[0]/cm;
-         prow[id].xint[prow[id].mint][1] = pos[1]/cm;
-         prow[id].xint[prow[id].mint][2] = pos[2]/cm;
-         if (prow[id].mint < mint_max - 1)
-            ++prow[id].mint;
+      if (buf.totE.size() >= BGPROFILE_BUFFER_ROWS) {
+         G4AutoLock barrier(&fMutex);
+         FlushBackgroundProfile();
       }
    }
 
-   int det=0;
-   if (pvol == 0)
-      det = 0;
-   else if (pvol->GetName() == "DET1")
-      det = 1;
-   else if (pvol->GetName() == "DET2")
-      det = 2;
-   else if (pvol->GetName() == "DET3")
-      det = 3;
-   else if (pvol->GetName() == "DET4")
-      det = 4;
-   else if (pvol->GetName() == "DET5")
-      det = 5;
-   else if (pvol->GetName() == "DET6")
-      det = 6;
-   else if (pvol->GetName() == "DET7")
-      det = 7;
-   else if (pvol->GetName() == "DET8")
-      det = 8;
-   else
-      det = 0;
-
-   TTree *proftree;
-   if (det > 0) {
-      G4AutoLock barrier(&fMutex);
-      try {
-         proftree = bgprofiles.at(det);
+   if (fProfileMode & 2) {
+      if (fProfileHistsXY.find(det) == fProfileHistsXY.end()) {
+         G4AutoLock barrier(&fMutex);
+         std::stringstream names;
+         names << "det" << det;
+         std::stringstream titles;
+         titles << "flux through virtual detector " << det;
+         double xymax = fProfileXYrange;
+         TH2D *hxy = new TH2D((names.str() + "_xy").c_str(),
+                              (titles.str() + ";x (cm);y (cm)").c_str(),
+                              200, -xymax, xymax, 200, -xymax, xymax);
+         hxy->SetDirectory(0);
+         fProfileHistsXY[det] = hxy;
+         TH2D *hE = new TH2D((names.str() + "_logE").c_str(),
+                             (titles.str() + ";log10(E/GeV)").c_str(),
+                             120, log10(fProfileEmin), log10(12.),
+                             5, 0, 5);
+         hE->GetYaxis()->SetBinLabel(1, "gamma");
+         hE->GetYaxis()->SetBinLabel(2, "e-");
+         hE->GetYaxis()->SetBinLabel(3, "e+");
+         hE->GetYaxis()->SetBinLabel(4, "n");
+         hE->GetYaxis()->SetBinLabel(5, "other");
+         hE->SetDirectory(0);
+         fProfileHistsE[det] = hE;
       }
-      catch(std::out_of_range &err) {
+      int pclass = (g3type == 1)? 0 : (g3type == 3)? 1 :
+                   (g3type == 2)? 2 : (g3type == 13)? 3 : 4;
+      fProfileHistsXY[det]->Fill(pos[0]/cm, pos[1]/cm);
+      fProfileHistsE[det]->Fill(log10(Etot/GeV), pclass);
+   }
+}
+
+void GlueXSteppingAction::FlushBackgroundProfile()
+{
+   // Move the buffered crossings of this thread into the shared
+   // output trees, called with fMutex held.
+
+   bgprofile_buffer_t &buf = fProfileBuffer;
+   if (fProfileFile == 0 || buf.totE.size() == 0)
+      return;
+   TDirectory *saved = gDirectory;
+   fProfileFile->cd();
+   int xint_index = 0;
+   for (unsigned int row=0; row < buf.totE.size(); ++row) {
+      int det = buf.det[row];
+      TTree *proftree;
+      if (fProfileTrees.find(det) != fProfileTrees.end()) {
+         proftree = fProfileTrees[det];
+      }
+      else {
          std::stringstream names;
          names << "det" << det;
          std::stringstream titles;
          titles << "hits in virtual detector " << det;
          proftree = new TTree(names.str().c_str(), titles.str().c_str());
-         proftree->Branch("totE", &prow[0].totE, "totE/F");
-         proftree->Branch("x", &prow[0].x[0], "x[7]/F");
-         proftree->Branch("ppol", &prow[0].ppol, "ppol/F");
-         proftree->Branch("xspot", &prow[0].xspot[0], "xspot[2]/F");
-         proftree->Branch("ptype", &prow[0].ptype, "ptype/I");
-         proftree->Branch("det", &prow[0].det, "det/I");
-         proftree->Branch("mint", &prow[0].mint, "mint/I");
-         proftree->Branch("xint", &prow[0].xint[0][0], "xint[mint][3]/F");
-         bgprofiles[det] = proftree;
+         bgprofile_row_t &prow = bgprofile_row;
+         proftree->Branch("totE", &prow.totE, "totE/F");
+         proftree->Branch("x", &prow.x[0], "x[7]/F");
+         proftree->Branch("ppol", &prow.ppol, "ppol/F");
+         proftree->Branch("xspot", &prow.xspot[0], "xspot[2]/F");
+         proftree->Branch("ptype", &prow.ptype, "ptype/I");
+         proftree->Branch("det", &prow.det, "det/I");
+         proftree->Branch("mint", &prow.mint, "mint/I");
+         proftree->Branch("xint", &prow.xint[0][0], "xint[mint][3]/F");
+         fProfileTrees[det] = proftree;
       }
-      G4StepPoint *point = step->GetPostStepPoint();
-      const G4ThreeVector &pos = point->GetPosition();
-      const G4ThreeVector &mom = point->GetMomentum();
-      const G4ThreeVector &pol = point->GetPolarization();
-      double pmag = mom.mag();
-      double Etot = point->GetTotalEnergy();
-      int pdgcode = track->GetDynamicParticle()->GetPDGcode();
-      int g3type = GlueXPrimaryGeneratorAction::ConvertPdgToGeant3(pdgcode);
-      prow[0].totE = Etot/GeV;
-      prow[0].x[0] = pos[0]/cm;
-      prow[0].x[1] = pos[1]/cm;
-      prow[0].x[2] = pos[2]/cm;
-      prow[0].x[3] = mom[0]/pmag;
-      prow[0].x[4] = mom[1]/pmag;
-      prow[0].x[5] = mom[2]/pmag;
-      prow[0].x[6] = pmag/GeV;
-      prow[0].ppol= pol.mag();
-      prow[0].xspot[0] = prow[id].xspot[0];
-      prow[0].xspot[1] = prow[id].xspot[1];
-      prow[0].ptype = g3type;
-      prow[0].det = det;
-      prow[0].mint = prow[id].mint;
-      for (int i=0; i < prow[0].mint; ++i) {
-         prow[0].xint[i][0] = prow[id].xint[i][0];
-         prow[0].xint[i][1] = prow[id].xint[i][1];
-         prow[0].xint[i][2] = prow[id].xint[i][2];
+      bgprofile_row.totE = buf.totE[row];
+      for (int i=0; i < 7; ++i)
+         bgprofile_row.x[i] = buf.x[i][row];
+      bgprofile_row.ppol = buf.ppol[row];
+      bgprofile_row.xspot[0] = buf.xspot[0][row];
+      bgprofile_row.xspot[1] = buf.xspot[1][row];
+      bgprofile_row.ptype = buf.ptype[row];
+      bgprofile_row.det = det;
+      bgprofile_row.mint = buf.mint[row];
+      for (int i=0; i < bgprofile_row.mint; ++i) {
+         bgprofile_row.xint[i][0] = buf.xint[xint_index++];
+         bgprofile_row.xint[i][1] = buf.xint[xint_index++];
+         bgprofile_row.xint[i][2] = buf.xint[xint_index++];
       }
       proftree->Fill();
    }
+   saved->cd();
+   buf.totE.clear();
+   for (int i=0; i < 7; ++i)
+      buf.x[i].clear();
+   buf.ppol.clear();
+   buf.xspot[0].clear();
+   buf.xspot[1].clear();
+   buf.ptype.clear();
+   buf.det.clear();
+   buf.mint.clear();
+   buf.xint.clear();
+}
 
-#endif
+void GlueXSteppingAction::MergeBackgroundProfile()
+{
+   // Add the histograms of this thread into the shared sums,
+   // called with fMutex held.
 
+   std::map<int, TH2D*>::iterator iter;
+   for (iter = fProfileHistsXY.begin(); iter != fProfileHistsXY.end();
+        ++iter)
+   {
+      if (fProfileSumsXY.find(iter->first) == fProfileSumsXY.end())
+         fProfileSumsXY[iter->first] = iter->second;
+      else {
+         fProfileSumsXY[iter->first]->Add(iter->second);
+         delete iter->second;
+      }
+   }
+   for (iter = fProfileHistsE.begin(); iter != fProfileHistsE.end();
+        ++iter)
+   {
+      if (fProfileSumsE.find(iter->first) == fProfileSumsE.end())
+         fProfileSumsE[iter->first] = iter->second;
+      else {
+         fProfileSumsE[iter->first]->Add(iter->second);
+         delete iter->second;
+      }
+   }
+   fProfileHistsXY.clear();
+   fProfileHistsE.clear();
 }
@@ -14,6 +14,17 @@
 #include "G4UserSteppingAction.hh"
 #include "G4Threading.hh"
 #include "G4AutoLock.hh"
+#include "G4VPhysicalVolume.hh"
+#include "GlueXVoxelTuning.hh"
+#include "GlueXRegionCuts.hh"
+
+#include <vector>
+#include <string>
+#include <map>
+
+class TFile;
+class TTree;
+class TH2D;
 
 class GlueXSteppingAction : public G4UserSteppingAction
 {
@@ -30,6 +41,79 @@ class GlueXSteppingAction : public G4UserSteppingAction
    static int fStopTracksInCollimator;
    static int fSaveTrajectories;
    static G4Mutex fMutex;
+
+   // What happens to a track entering a given physical volume is looked
+   // up in a table indexed by the volume instance id, filled from the
+   // volume names on the first step after the geometry is built.
+   enum VolumeRole {
+      kRoleNone = 0,
+      kRoleKill = 1,        // stop tracks on entry
+      kRoleScore = 2        // virtual detector number det
+   };
+   struct volume_role_t {
+      unsigned char role;
+      unsigned char det;
+   };
+   std::vector<volume_role_t> fVolumeRoles;
+   volume_role_t GetVolumeRole(const G4VPhysicalVolume *pvol);
+   volume_role_t LookupVolumeRole(const G4VPhysicalVolume *pvol);
+   volume_role_t ClassifyVolume(const G4String &name) const;
+   void BuildVolumeRoleTable();
+
+   static std::vector<std::string> fKillVolumes;
+   static std::vector<std::string> fScoreVolumes;
+
+   // per-volume navigation profile, see GlueXVoxelTuning
+   GlueXVoxelTuning *fVoxelTuning;
+
+   // per-region step and secondary counts, see GlueXRegionCuts
+   GlueXRegionCuts *fRegionCuts;
+
+   // Background flux profiling in the SCOREVOLUMES virtual detectors,
+   // enabled at run time by the BGPROFILES card. Each thread buffers
+   // its crossings column by column and only takes the lock to move
+   // a full buffer into the shared output trees. Histograms are kept
+   // per thread and summed when the last instance is destroyed.
+   struct bgprofile_buffer_t {
+      std::vector<float> totE;
+      std::vector<float> x[7];
+      std::vector<float> ppol;
+      std::vector<float> xspot[2];
+      std::vector<int> ptype;
+      std::vector<int> det;
+      std::vector<int> mint;
+      std::vector<float> xint;      // 3*mint values for each row
+   };
+   bgprofile_buffer_t fProfileBuffer;
+   float fProfileSpot[2];
+   int fProfileMint;
+   float fProfileXint[9][3];
+   std::map<int, TH2D*> fProfileHistsXY;
+   std::map<int, TH2D*> fProfileHistsE;
+   void TrackBackgroundProfile(const G4Step *step);
+   void ScoreBackgroundProfile(const G4Step *step, int det);
+   void FlushBackgroundProfile();
+   void MergeBackgroundProfile();
+
+   static int fProfileMode;         // 0=off, 1=trees, 2=histograms, 3=both
+   static double fProfileXYrange;   // cm
+   static double fProfileEmin;      // GeV
+   static int fInstanceCount;
+   static TFile *fProfileFile;
+   static std::map<int, TTree*> fProfileTrees;
+   static std::map<int, TH2D*> fProfileSumsXY;
+   static std::map<int, TH2D*> fProfileSumsE;
 };
 
+inline GlueXSteppingAction::volume_role_t
+GlueXSteppingAction::GetVolumeRole(const G4VPhysicalVolume *pvol)
+{
+   if (pvol == 0)
+      return volume_role_t{kRoleNone, 0};
+   unsigned int id = pvol->GetInstanceID();
+   if (id < fVolumeRoles.size())
+      return fVolumeRoles[id];
+   return LookupVolumeRole(pvol);
+}
+
 #endif
@@ -43,7 +43,7 @@ class GlueXUserTrackInformation: public G4VUserTrackInformation
    void SetGlueXHistory(int history) {
       fGlueXHistory = history;
    }
-   void AssignBCALincidentID(G4Track *track) {
+   void AssignBCALincidentID(const G4Track *track) {
       const G4Event *event = G4RunManager::GetRunManager()->GetCurrentEvent();
       GlueXUserEventInformation *eventinfo = (GlueXUserEventInformation*)
                                              event->GetUserInformation();
@@ -0,0 +1,287 @@
+//
+// GlueXVoxelTuning class implementation
+//
+// author: agent at local
+// version: october 18, 2026
+
+#include "GlueXVoxelTuning.hh"
+#include "GlueXUserOptions.hh"
+#include "GlueXDetectorConstruction.hh"
+#include "G4LogicalVolumeStore.hh"
+#include "G4SmartVoxelProxy.hh"
+#include "G4SmartVoxelNode.hh"
+#include "G4ios.hh"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <map>
+
+G4Mutex GlueXVoxelTuning::fMutex = G4MUTEX_INITIALIZER;
+int GlueXVoxelTuning::fInstanceCount = 0;
+int GlueXVoxelTuning::fProfileEvents = 0;
+std::string GlueXVoxelTuning::fTuningFile("geomtune.dat");
+std::vector<GlueXVoxelTuning::volume_stats_t> GlueXVoxelTuning::fTotals;
+
+GlueXVoxelTuning::GlueXVoxelTuning()
+{
+   G4AutoLock barrier(&fMutex);
+   ++fInstanceCount;
+   fLastStep = std::chrono::steady_clock::now();
+}
+
+GlueXVoxelTuning::~GlueXVoxelTuning()
+{
+   G4AutoLock barrier(&fMutex);
+   if (fStats.size() > fTotals.size()) {
+      volume_stats_t zero = {0, 0};
+      fTotals.resize(fStats.size(), zero);
+   }
+   for (unsigned int id=0; id < fStats.size(); ++id) {
+      fTotals[id].steps += fStats[id].steps;
+      fTotals[id].seconds += fStats[id].seconds;
+   }
+   if (--fInstanceCount == 0 && IsProfiling()) {
+      WriteTuningFile(fTuningFile);
+      fTotals.clear();
+   }
+}
+
+void GlueXVoxelTuning::Configure()
+{
+   // Read the GEOMPROFILE and GEOMTUNEFILE cards, and apply the tuning
+   // file if one exists and this is not a profiling run. This must be
+   // called after the geometry is constructed and before it is closed.
+
+   GlueXUserOptions *user_opts = GlueXUserOptions::GetInstance();
+   if (user_opts == 0) {
+      G4cerr << "Error in GlueXVoxelTuning::Configure - "
+             << "GlueXUserOptions::GetInstance() returns null, "
+             << "cannot continue." << G4endl;
+      exit(-1);
+   }
+
+   std::map<int,std::string> tunefile;
+   if (user_opts->Find("GEOMTUNEFILE", tunefile)) {
+      fTuningFile = tunefile[1];
+   }
+   std::map<int,int> geomprofile;
+   if (user_opts->Find("GEOMPROFILE", geomprofile) && geomprofile[1] > 0) {
+      fProfileEvents = geomprofile[1];
+      G4cout << "GlueXVoxelTuning: profiling navigation over the first "
+             << fProfileEvents << " events, tuning will be written to "
+             << fTuningFile << G4endl;
+   }
+   else if (access(fTuningFile.c_str(), R_OK) == 0) {
+      ApplyTuningFile(fTuningFile);
+   }
+}
+
+int GlueXVoxelTuning::ApplyTuningFile(const std::string &fname)
+{
+   // Apply the smartless settings in a tuning file, provided that it
+   // was profiled on the same geometry as the one built for this run,
+   // as recorded in its "# geometry" header line. A file from another
+   // geometry is skipped with a warning, without applying anything.
+
+   std::ifstream fin(fname.c_str());
+   if (! fin.good()) {
+      G4cerr << "GlueXVoxelTuning::ApplyTuningFile error - "
+             << "cannot open " << fname << " for input." << G4endl;
+      return 0;
+   }
+   std::string filekey;
+   std::vector<std::pair<std::string, double> > settings;
+   std::string line;
+   while (std::getline(fin, line)) {
+      if (line.substr(0, 11) == "# geometry ") {
+         std::istringstream sline(line.substr(11));
+         sline >> filekey;
+         continue;
+      }
+      else if (line.size() == 0 || line[0] == '#') {
+         continue;
+      }
+      std::istringstream sline(line);
+      std::string name;
+      double smartless;
+      if (! (sline >> name >> smartless) || smartless <= 0) {
+         G4cerr << "GlueXVoxelTuning::ApplyTuningFile error - "
+                << "bad line in " << fname << ": " << line << G4endl;
+         return 0;
+      }
+      settings.push_back(std::pair<std::string, double>(name, smartless));
+   }
+   std::string geomkey = GlueXDetectorConstruction::GetGeometryKey();
+   if (geomkey.size() == 0 || filekey != geomkey) {
+      G4cerr << "GlueXVoxelTuning::ApplyTuningFile warning - "
+             << fname << " was profiled on geometry "
+             << ((filekey.size() > 0)? filekey : "(unknown)")
+             << " but this run has geometry "
+             << ((geomkey.size() > 0)? geomkey : "(unknown)")
+             << ", tuning file ignored." << G4endl;
+      return 0;
+   }
+
+   G4LogicalVolumeStore *volumes = G4LogicalVolumeStore::GetInstance();
+   int applied = 0;
+   int missing = 0;
+   for (unsigned int i=0; i < settings.size(); ++i) {
+      G4LogicalVolume *logvol = volumes->GetVolume(settings[i].first, false);
+      if (logvol) {
+         logvol->SetSmartless(settings[i].second);
+         ++applied;
+      }
+      else {
+         ++missing;
+      }
+   }
+   G4cout << "GlueXVoxelTuning: applied smartless settings from "
+          << fname << " to " << applied << " logical volumes";
+   if (missing > 0)
+      G4cout << ", " << missing << " volumes not found in this geometry";
+   G4cout << G4endl;
+   return applied;
+}
+
+double GlueXVoxelTuning::ChooseSmartless(double time_fraction, long int steps,
+                                         int ndaughters)
+{
+   // Smartless is the mean number of voxel slices per daughter volume,
+   // so the voxel memory of a volume grows in proportion to it, while
+   // the number of candidate daughters checked at each step falls.
+   // Spend the memory where the steps are, and give it back from
+   // volumes that are rarely or never entered. The Geant4 default is 2.
+
+   if (steps == 0)
+      return 0.5;
+   else if (time_fraction >= 0.10 && ndaughters >= 100)
+      return 8;
+   else if (time_fraction >= 0.02)
+      return 4;
+   else if (time_fraction >= 0.001)
+      return 2;
+   return 1;
+}
+
+double GlueXVoxelTuning::VoxelMemory(const G4SmartVoxelHeader *vox)
+{
+   // Estimate the memory in bytes held by a voxel header and all of
+   // its slices. Runs of equivalent slices share a single proxy.
+
+   if (vox == 0)
+      return 0;
+   double bytes = sizeof(G4SmartVoxelHeader);
+   const G4SmartVoxelProxy *last = 0;
+   int nslices = vox->GetNoSlices();
+   for (int s=0; s < nslices; ++s) {
+      const G4SmartVoxelProxy *prox = vox->GetSlice(s);
+      bytes += sizeof(G4SmartVoxelProxy*);
+      if (prox == last)
+         continue;
+      last = prox;
+      bytes += sizeof(G4SmartVoxelProxy);
+      if (prox->IsHeader()) {
+         bytes += VoxelMemory(prox->GetHeader());
+      }
+      else {
+         bytes += sizeof(G4SmartVoxelNode) +
+                  prox->GetNode()->GetNoContained() * sizeof(G4int);
+      }
+   }
+   return bytes;
+}
+
+int GlueXVoxelTuning::WriteTuningFile(const std::string &fname)
+{
+   // Write the tuning file from the accumulated profile, and print
+   // a summary of the expected memory / speed tradeoff. Called with
+   // fMutex held, after all of the profiling threads have finished.
+
+   G4LogicalVolumeStore *volumes = G4LogicalVolumeStore::GetInstance();
+   double total_seconds = 0;
+   long int total_steps = 0;
+   for (unsigned int id=0; id < fTotals.size(); ++id) {
+      total_seconds += fTotals[id].seconds;
+      total_steps += fTotals[id].steps;
+   }
+   if (total_steps == 0) {
+      G4cerr << "GlueXVoxelTuning::WriteTuningFile warning - "
+             << "no steps were profiled, " << fname
+             << " not written." << G4endl;
+      return 0;
+   }
+
+   struct tuning_row_t {
+      double seconds;
+      std::string line;
+   };
+   std::vector<tuning_row_t> rows;
+   double memory_now = 0;
+   double memory_tuned = 0;
+   double seconds_tuned_up = 0;
+   double seconds_tuned_down = 0;
+   G4LogicalVolumeStore::iterator iter;
+   for (iter = volumes->begin(); iter != volumes->end(); ++iter) {
+      G4LogicalVolume *logvol = *iter;
+      int ndaughters = logvol->GetNoDaughters();
+      const G4SmartVoxelHeader *vox = logvol->GetVoxelHeader();
+      if (vox == 0 && ndaughters < 2)
+         continue;
+      unsigned int id = logvol->GetInstanceID();
+      volume_stats_t stats = {0, 0};
+      if (id < fTotals.size())
+         stats = fTotals[id];
+      double fraction = stats.seconds / (total_seconds + 1e-30);
+      double smartless = logvol->GetSmartless();
+      double tuned = ChooseSmartless(fraction, stats.steps, ndaughters);
+      double mem = VoxelMemory(vox);
+      double mem_tuned = mem * tuned / smartless;
+      memory_now += mem;
+      memory_tuned += mem_tuned;
+      if (tuned > smartless)
+         seconds_tuned_up += stats.seconds;
+      else if (tuned < smartless)
+         seconds_tuned_down += stats.seconds;
+      char line[200];
+      snprintf(line, 200, "%-12s %6.2f %8d %12ld %10.6f %12.1f %12.1f",
+               logvol->GetName().c_str(), tuned, ndaughters, stats.steps,
+               fraction, mem / 1024, mem_tuned / 1024);
+      tuning_row_t row = {stats.seconds, line};
+      rows.push_back(row);
+   }
+   std::sort(rows.begin(), rows.end(),
+             [](const tuning_row_t &a, const tuning_row_t &b) {
+                return a.seconds > b.seconds;
+             });
+
+   std::string tmpname(fname + ".tmp");
+   std::ofstream fout(tmpname.c_str());
+   fout << "# HDGeant4 voxel tuning file written by a GEOMPROFILE run"
+        << " over " << fProfileEvents << " events, " << total_steps
+        << " steps" << std::endl
+        << "# geometry " << GlueXDetectorConstruction::GetGeometryKey()
+        << std::endl
+        << "# volume    smartless daughters      steps   time frac"
+        << "  voxel kB now voxel kB new" << std::endl;
+   for (unsigned int i=0; i < rows.size(); ++i)
+      fout << rows[i].line << std::endl;
+   fout.close();
+   if (! fout.good() || rename(tmpname.c_str(), fname.c_str()) != 0) {
+      G4cerr << "GlueXVoxelTuning::WriteTuningFile error - "
+             << "unable to write " << fname << G4endl;
+      return 0;
+   }
+
+   G4cout << "GlueXVoxelTuning: wrote smartless settings for "
+          << rows.size() << " voxelized volumes to " << fname << G4endl
+          << "   voxel memory " << memory_now / 1048576 << " MB now, "
+          << memory_tuned / 1048576 << " MB after tuning" << G4endl
+          << "   " << 100 * seconds_tuned_up / total_seconds
+          << "% of the profiled time is in volumes with finer voxels, "
+          << 100 * seconds_tuned_down / total_seconds
+          << "% in volumes with coarser voxels" << G4endl;
+   return rows.size();
+}
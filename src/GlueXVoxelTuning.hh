@@ -0,0 +1,107 @@
+//
+// GlueXVoxelTuning class header
+//
+// author: agent at local
+// version: october 18, 2026
+//
+// This class tunes the smart voxel optimization that Geant4 uses to
+// speed up navigation inside logical volumes with many daughters.
+// It works in two stages, selected in the control.in file.
+//
+//  1) Profiling, enabled by the GEOMPROFILE card: for the first N
+//     events of the run, count the steps taken inside each logical
+//     volume and the time they consumed. At the end of the job,
+//     write a tuning file that assigns a smartless value to every
+//     voxelized volume according to its share of the time, together
+//     with a report of the voxel memory before and after tuning.
+//
+//  2) Tuning, in any later run where GEOMPROFILE is not set: if the
+//     tuning file (GEOMTUNEFILE card, default geomtune.dat) exists in
+//     the working directory, its settings are applied to the logical
+//     volumes before the geometry is closed. The file records the key
+//     of the geometry it was profiled on (see GlueXDetectorConstruction
+//     ::GetGeometryKey), and it is ignored with a warning in a run that
+//     builds any other geometry.
+//
+// In the context of the Geant4 event-level multithreading model,
+// the static methods are "shared", and instances of this class are
+// "thread-local", ie. have thread-local state. The profiler instance
+// for each worker thread is owned by its GlueXSteppingAction.
+
+#ifndef GlueXVoxelTuning_h
+#define GlueXVoxelTuning_h 1
+
+#include "G4Step.hh"
+#include "G4Track.hh"
+#include "G4VPhysicalVolume.hh"
+#include "G4LogicalVolume.hh"
+#include "G4SmartVoxelHeader.hh"
+#include "G4Threading.hh"
+#include "G4AutoLock.hh"
+
+#include <chrono>
+#include <vector>
+#include <string>
+
+class GlueXVoxelTuning
+{
+ public:
+   GlueXVoxelTuning();
+   ~GlueXVoxelTuning();
+
+   void RecordStep(const G4Step *step, int eventID);
+
+   static void Configure();
+   static int IsProfiling() { return fProfileEvents > 0; }
+   static int ApplyTuningFile(const std::string &fname);
+   static int WriteTuningFile(const std::string &fname);
+
+ protected:
+   struct volume_stats_t {
+      long int steps;
+      double seconds;
+   };
+   std::vector<volume_stats_t> fStats;
+   std::chrono::steady_clock::time_point fLastStep;
+
+   static double VoxelMemory(const G4SmartVoxelHeader *vox);
+   static double ChooseSmartless(double time_fraction, long int steps,
+                                 int ndaughters);
+
+ private:
+   GlueXVoxelTuning(const GlueXVoxelTuning &src);
+   GlueXVoxelTuning &operator=(const GlueXVoxelTuning &src);
+
+   static G4Mutex fMutex;
+   static int fInstanceCount;
+   static int fProfileEvents;
+   static std::string fTuningFile;
+   static std::vector<volume_stats_t> fTotals;
+};
+
+inline void GlueXVoxelTuning::RecordStep(const G4Step *step, int eventID)
+{
+   // Charge the time since the previous step of this track to the
+   // logical volume in which this step was taken.
+
+   if (eventID >= fProfileEvents)
+      return;
+   std::chrono::steady_clock::time_point now;
+   now = std::chrono::steady_clock::now();
+   G4VPhysicalVolume *pvol = step->GetPreStepPoint()->GetPhysicalVolume();
+   if (pvol) {
+      unsigned int id = pvol->GetLogicalVolume()->GetInstanceID();
+      if (id >= fStats.size()) {
+         volume_stats_t zero = {0, 0};
+         fStats.resize(id + 1, zero);
+      }
+      fStats[id].steps += 1;
+      if (step->GetTrack()->GetCurrentStepNumber() > 1) {
+         std::chrono::duration<double> dt = now - fLastStep;
+         fStats[id].seconds += dt.count();
+      }
+   }
+   fLastStep = now;
+}
+
+#endif
@@ -68,9 +68,10 @@ using namespace xercesc;
 extern CPUtimer timer;
 #endif
 
-HddsG4Builder::HddsG4Builder() : fWorldVolume(0) { }
+HddsG4Builder::HddsG4Builder() : fWorldVolume(0), fJournal(0) { }
 
 HddsG4Builder::HddsG4Builder(const HddsG4Builder &src)
+ : fJournal(0)
 {
    fWorldVolume = src.fWorldVolume;
    fElements = src.fElements;
@@ -86,7 +87,10 @@ HddsG4Builder::HddsG4Builder(const HddsG4Builder &src)
    fCurrentPhiCenter = src.fCurrentPhiCenter;
 }
 
-HddsG4Builder::~HddsG4Builder() { }
+HddsG4Builder::~HddsG4Builder()
+{
+   delete fJournal;
+}
 
 int HddsG4Builder::createMaterial(DOMElement* el)
 {
@@ -98,44 +102,41 @@ int HddsG4Builder::createMaterial(DOMElement* el)
 #endif
    int imate = CodeWriter::createMaterial(el);
 
+   HddsG4Cache rec;
+   rec.putInt(kMaterialRecord);
+   rec.putInt(imate);
    if (fSubst.fBrewList.size() == 0)
    {
       XString matS = fSubst.getName();
       XString symS = fSubst.getSymbol();
-      double A = fSubst.getAtomicWeight();
-      double Z = fSubst.getAtomicNumber();
-      double dens = fSubst.getDensity();
-      fElements[imate] = new G4Element(matS,symS,Z,A*g/mole);
-      fMaterials[imate] = new G4Material(matS,Z,A*g/mole,dens*g/cm3);
+      rec.putString(matS);
+      rec.putString(symS);
+      rec.putDouble(fSubst.getAtomicWeight());
+      rec.putDouble(fSubst.getAtomicNumber());
+      rec.putDouble(fSubst.getDensity());
+      rec.putInt(0);
    }
    else
    {
       XString matS = fSubst.getName();
-      double dens = fSubst.getDensity();
-      int ncomp = fSubst.fBrewList.size();
-      fMaterials[imate] = new G4Material(matS,dens*g/cm3,ncomp);
+      rec.putString(matS);
+      rec.putString("");
+      rec.putDouble(0);
+      rec.putDouble(0);
+      rec.putDouble(fSubst.getDensity());
+      rec.putInt(fSubst.fBrewList.size());
       std::list<Substance::Brew>::iterator iter;
       for (iter = fSubst.fBrewList.begin();
            iter != fSubst.fBrewList.end(); iter++)
       {
-         int subimate = iter->sub->fUniqueID;
-         std::map<int,G4Element*>::iterator elemit = fElements.find(subimate);
-         if (iter->natoms)
-         {
-            fMaterials[imate]->AddElement(elemit->second,iter->natoms);
-         }
-         else if (elemit != fElements.end())
-         {
-            fMaterials[imate]->AddElement(elemit->second,iter->wfact);
-         }
-         else
-         {
-            fMaterials[imate]->AddMaterial(fMaterials[subimate],iter->wfact);
-         }
+         rec.putInt(iter->sub->fUniqueID);
+         rec.putInt(iter->natoms);
+         rec.putDouble(iter->wfact);
       }
    }
 
    DOMNodeList* propList = el->getElementsByTagName(X("optical_properties"));
+   rec.putInt(propList->getLength() > 0);
    if (propList->getLength() > 0)
    {
       DOMElement* propEl = (DOMElement*)propList->item(0);
@@ -164,6 +165,72 @@ int HddsG4Builder::createMaterial(DOMElement* el)
          valS = specEl->getAttribute(X("effic"));
          effic.push_back(atof(S(valS)));
       }
+      rec.putDoubles(Ephot);
+      rec.putDoubles(rindex);
+      rec.putDoubles(abslen);
+      rec.putDoubles(smooth);
+      rec.putDoubles(reflect);
+      rec.putDoubles(effic);
+   }
+   replay(rec);
+   if (fJournal)
+   {
+      fJournal->append(rec);
+   }
+#ifdef LINUX_CPUTIME_PROFILING
+   timestr << " ( " << timer.getUserDelta() << " ) ";
+   G4cerr << timestr.str() << G4endl;
+#endif
+   return imate;
+}
+
+void HddsG4Builder::buildMaterial(HddsG4Cache& rec)
+{
+   int imate = rec.getInt();
+   std::string matS = rec.getString();
+   std::string symS = rec.getString();
+   double A = rec.getDouble();
+   double Z = rec.getDouble();
+   double dens = rec.getDouble();
+   int ncomp = rec.getInt();
+   if (ncomp == 0)
+   {
+      fElements[imate] = new G4Element(matS,symS,Z,A*g/mole);
+      fMaterials[imate] = new G4Material(matS,Z,A*g/mole,dens*g/cm3);
+   }
+   else
+   {
+      fMaterials[imate] = new G4Material(matS,dens*g/cm3,ncomp);
+      for (int icomp = 0; icomp < ncomp; ++icomp)
+      {
+         int subimate = rec.getInt();
+         int natoms = rec.getInt();
+         double wfact = rec.getDouble();
+         std::map<int,G4Element*>::iterator elemit = fElements.find(subimate);
+         if (natoms)
+         {
+            fMaterials[imate]->AddElement(elemit->second,natoms);
+         }
+         else if (elemit != fElements.end())
+         {
+            fMaterials[imate]->AddElement(elemit->second,wfact);
+         }
+         else
+         {
+            fMaterials[imate]->AddMaterial(fMaterials[subimate],wfact);
+         }
+      }
+   }
+
+   if (rec.getInt())
+   {
+      std::vector<double> Ephot = rec.getDoubles();
+      std::vector<double> rindex = rec.getDoubles();
+      std::vector<double> abslen = rec.getDoubles();
+      std::vector<double> smooth = rec.getDoubles();
+      std::vector<double> reflect = rec.getDoubles();
+      std::vector<double> effic = rec.getDoubles();
+      int len = Ephot.size();
       G4MaterialPropertiesTable *mpt = new G4MaterialPropertiesTable();
       if (rindex[0] > 0)
       {
@@ -187,11 +254,6 @@ int HddsG4Builder::createMaterial(DOMElement* el)
       }
       fMaterials[imate]->SetMaterialPropertiesTable(mpt);
    }
-#ifdef LINUX_CPUTIME_PROFILING
-   timestr << " ( " << timer.getUserDelta() << " ) ";
-   G4cerr << timestr.str() << G4endl;
-#endif
-   return imate;
 }
 
 int HddsG4Builder::createSolid(DOMElement* el, Refsys& ref)
@@ -210,7 +272,11 @@ int HddsG4Builder::createSolid(DOMElement* el, Refsys& ref)
    Units unit;
    unit.getConversions(el);
 
-   G4VSolid *solid;
+   // Solid parameters are recorded in Geant4 units, in the order
+   // of the arguments to the constructor of the matching G4 solid,
+   // with the polyplane arrays of pcon/pgon stored end-to-end.
+
+   std::vector<double> par;
    XString shapeS(el->getTagName());
    if (shapeS == "box")
    {
@@ -218,11 +284,9 @@ int HddsG4Builder::createSolid(DOMElement* el, Refsys& ref)
       XString xyzS(el->getAttribute(X("X_Y_Z")));
       std::stringstream listr(xyzS);
       listr >> xl >> yl >> zl;
-      solid = new G4Box(S(nameS),
-                        xl/2 *cm/unit.cm,
-                        yl/2 *cm/unit.cm,
-                        zl/2 *cm/unit.cm
-                       );
+      par.push_back(xl/2 *cm/unit.cm);
+      par.push_back(yl/2 *cm/unit.cm);
+      par.push_back(zl/2 *cm/unit.cm);
    }
    else if (shapeS == "tubs")
    {
@@ -233,13 +297,11 @@ int HddsG4Builder::createSolid(DOMElement* el, Refsys& ref)
       XString profS(el->getAttribute(X("profile")));
       listr.clear(), listr.str(profS);
       listr >> phi0 >> dphi;
-      solid = new G4Tubs(S(nameS),
-                         ri * cm/unit.cm,
-                         ro * cm/unit.cm,
-                         zl/2 * cm/unit.cm,
-                         phi0 * deg/unit.deg,
-                         dphi * deg/unit.deg
-                        );
+      par.push_back(ri * cm/unit.cm);
+      par.push_back(ro * cm/unit.cm);
+      par.push_back(zl/2 * cm/unit.cm);
+      par.push_back(phi0 * deg/unit.deg);
+      par.push_back(dphi * deg/unit.deg);
    }
    else if (shapeS == "eltu")
    {
@@ -248,11 +310,9 @@ int HddsG4Builder::createSolid(DOMElement* el, Refsys& ref)
       XString rxyzS(el->getAttribute(X("Rxy_Z")));
       std::stringstream listr(rxyzS);
       listr >> rx >> ry >> zl;
-      solid = new G4EllipticalTube(S(nameS),
-                                   rx * cm/unit.cm,
-                                   ry * cm/unit.cm,
-                                   zl/2 * cm/unit.cm
-                                  );
+      par.push_back(rx * cm/unit.cm);
+      par.push_back(ry * cm/unit.cm);
+      par.push_back(zl/2 * cm/unit.cm);
    }
    else if (shapeS == "trd")
    {
@@ -272,75 +332,32 @@ int HddsG4Builder::createSolid(DOMElement* el, Refsys& ref)
       double x = tan(alph_xz/unit.rad);
       double y = tan(alph_yz/unit.rad);
       double r = sqrt(x*x + y*y);
-      solid = new G4Trap(S(nameS),
-                         zl/2 * cm/unit.cm,
-                         atan2(r,1) * rad,
-                         atan2(y,x) * rad,
-                         ym/2 * cm/unit.cm,
-                         xm/2 * cm/unit.cm,
-                         xm/2 * cm/unit.cm,
-                         0,
-                         yp/2 * cm/unit.cm,
-                         xp/2 * cm/unit.cm,
-                         xp/2 * cm/unit.cm,
-                         0
-                        );
-   }
-   else if (shapeS == "pcon")
+      par.push_back(zl/2 * cm/unit.cm);
+      par.push_back(atan2(r,1) * rad);
+      par.push_back(atan2(y,x) * rad);
+      par.push_back(ym/2 * cm/unit.cm);
+      par.push_back(xm/2 * cm/unit.cm);
+      par.push_back(xm/2 * cm/unit.cm);
+      par.push_back(0);
+      par.push_back(yp/2 * cm/unit.cm);
+      par.push_back(xp/2 * cm/unit.cm);
+      par.push_back(xp/2 * cm/unit.cm);
+      par.push_back(0);
+   }
+   else if (shapeS == "pcon" || shapeS == "pgon")
    {
       double phi0, dphi;
       XString profS(el->getAttribute(X("profile")));
       std::stringstream listr(profS);
       listr >> phi0 >> dphi;
-      DOMNodeList* planeList = el->getElementsByTagName(X("polyplane"));
-      int nplanes = planeList->getLength();
-      std::vector<double> zPlane;
-      std::vector<double> rInner;
-      std::vector<double> rOuter;
-      double zlast = -1e30;
-      double zeps = 0;
-      for (unsigned int p = 0; p < planeList->getLength(); p++)
+      par.push_back(phi0 * deg/unit.deg);
+      par.push_back(dphi * deg/unit.deg);
+      if (shapeS == "pgon")
       {
-         double ri, ro, zl;
-         DOMNode* node = planeList->item(p);
-         DOMElement* elem = (DOMElement*) node;
-         XString riozS(elem->getAttribute(X("Rio_Z")));
-         std::stringstream listr1(riozS);
-         listr1 >> ri >> ro >> zl;
-         if (zl < zlast)
-         {
-            G4cerr << APP_NAME << " error: Please re-order the polyplanes"
-                 << " of volume " << S(nameS) << " so that the z-values"
-                 << " are non-decreasing"
-                 << G4endl;
-            exit(1);
-         }
-         zl = (zl < zlast + zeps)? zlast + zeps : zl;
-         zlast = zl;
-         zPlane.push_back(zl * cm/unit.cm);
-         rInner.push_back(ri * cm/unit.cm);
-         rOuter.push_back(ro * cm/unit.cm);
+         XString segS(el->getAttribute(X("segments")));
+         par.push_back(atoi(S(segS)));
       }
-      solid = new G4Polycone(S(nameS),
-                             phi0 * deg/unit.deg,
-                             dphi * deg/unit.deg,
-                             nplanes,
-                             &zPlane[0],
-                             &rInner[0],
-                             &rOuter[0]
-                            );
-   }
-   else if (shapeS == "pgon")
-   {
-      int segments;
-      XString segS(el->getAttribute(X("segments")));
-      segments = atoi(S(segS));
-      double phi0, dphi;
-      XString profS(el->getAttribute(X("profile")));
-      std::stringstream listr(profS);
-      listr >> phi0 >> dphi;
       DOMNodeList* planeList = el->getElementsByTagName(X("polyplane"));
-      int nplanes = planeList->getLength();
       std::vector<double> zPlane;
       std::vector<double> rInner;
       std::vector<double> rOuter;
@@ -368,15 +385,9 @@ int HddsG4Builder::createSolid(DOMElement* el, Refsys& ref)
          rInner.push_back(ri * cm/unit.cm);
          rOuter.push_back(ro * cm/unit.cm);
       }
-      solid = new G4Polyhedra(S(nameS),
-                              phi0 * deg/unit.deg,
-                              dphi * deg/unit.deg,
-                              segments,
-                              nplanes,
-                              &zPlane[0],
-                              &rInner[0],
-                              &rOuter[0]
-                             );
+      par.insert(par.end(), zPlane.begin(), zPlane.end());
+      par.insert(par.end(), rInner.begin(), rInner.end());
+      par.insert(par.end(), rOuter.begin(), rOuter.end());
    }
    else if (shapeS == "cons")
    {
@@ -388,15 +399,13 @@ int HddsG4Builder::createSolid(DOMElement* el, Refsys& ref)
       XString profS(el->getAttribute(X("profile")));
       listr.clear(), listr.str(profS);
       listr >> phi0 >> dphi;
-      solid = new G4Cons(S(nameS),
-                         zl/2 * cm/unit.cm,
-                         rim * cm/unit.cm,
-                         rom * cm/unit.cm,
-                         rip * cm/unit.cm,
-                         rop * cm/unit.cm,
-                         phi0 * deg/unit.deg,
-                         dphi * deg/unit.deg
-                        );
+      par.push_back(zl/2 * cm/unit.cm);
+      par.push_back(rim * cm/unit.cm);
+      par.push_back(rom * cm/unit.cm);
+      par.push_back(rip * cm/unit.cm);
+      par.push_back(rop * cm/unit.cm);
+      par.push_back(phi0 * deg/unit.deg);
+      par.push_back(dphi * deg/unit.deg);
    }
    else if (shapeS == "sphere")
    {
@@ -412,14 +421,12 @@ int HddsG4Builder::createSolid(DOMElement* el, Refsys& ref)
       XString profS(el->getAttribute(X("profile")));
       listr.clear(), listr.str(profS);
       listr >> phi0 >> dphi;
-      solid = new G4Sphere(S(nameS),
-                           ri * cm/unit.cm,
-                           ro * cm/unit.cm,
-                           phi0 * deg/unit.deg,
-                           dphi * deg/unit.deg,
-                           theta0 * deg/unit.deg,
-                           theta1 * deg/unit.deg
-                          );
+      par.push_back(ri * cm/unit.cm);
+      par.push_back(ro * cm/unit.cm);
+      par.push_back(phi0 * deg/unit.deg);
+      par.push_back(dphi * deg/unit.deg);
+      par.push_back(theta0 * deg/unit.deg);
+      par.push_back(theta1 * deg/unit.deg);
    }
    else
    {
@@ -429,10 +436,90 @@ int HddsG4Builder::createSolid(DOMElement* el, Refsys& ref)
       exit(1);
    }
 
+   HddsG4Cache rec;
+   rec.putInt(kSolidRecord);
+   rec.putInt(ivolu);
+   rec.putString(nameS);
+   rec.putString(shapeS);
+   rec.putDoubles(par);
+   rec.putInt(imate);
+   rec.putInt(ref.fRegionID);
+   XString sensiS(el->getAttribute(X("sensitive")));
+   rec.putInt(sensiS == "true");
+   replay(rec);
+   if (fJournal)
+   {
+      fJournal->append(rec);
+   }
+
+#ifdef LINUX_CPUTIME_PROFILING
+   timestr << " ( " << timer.getUserDelta() << " ) ";
+   G4cerr << timestr.str() << G4endl;
+#endif
+   return ivolu;
+}
+
+void HddsG4Builder::buildSolid(HddsG4Cache& rec)
+{
+   int ivolu = rec.getInt();
+   std::string nameS = rec.getString();
+   std::string shapeS = rec.getString();
+   std::vector<double> par = rec.getDoubles();
+   int imate = rec.getInt();
+   int iregion = rec.getInt();
+   int sensitive = rec.getInt();
+
+   G4VSolid *solid;
+   if (shapeS == "box" && par.size() == 3)
+   {
+      solid = new G4Box(nameS, par[0], par[1], par[2]);
+   }
+   else if (shapeS == "tubs" && par.size() == 5)
+   {
+      solid = new G4Tubs(nameS, par[0], par[1], par[2], par[3], par[4]);
+   }
+   else if (shapeS == "eltu" && par.size() == 3)
+   {
+      solid = new G4EllipticalTube(nameS, par[0], par[1], par[2]);
+   }
+   else if (shapeS == "trd" && par.size() == 11)
+   {
+      solid = new G4Trap(nameS, par[0], par[1], par[2], par[3], par[4],
+                         par[5], par[6], par[7], par[8], par[9], par[10]);
+   }
+   else if (shapeS == "pcon" && par.size() > 2)
+   {
+      int nplanes = (par.size() - 2) / 3;
+      solid = new G4Polycone(nameS, par[0], par[1], nplanes,
+                             &par[2], &par[2 + nplanes], &par[2 + 2*nplanes]);
+   }
+   else if (shapeS == "pgon" && par.size() > 3)
+   {
+      int nplanes = (par.size() - 3) / 3;
+      solid = new G4Polyhedra(nameS, par[0], par[1], (int)par[2], nplanes,
+                              &par[3], &par[3 + nplanes], &par[3 + 2*nplanes]);
+   }
+   else if (shapeS == "cons" && par.size() == 7)
+   {
+      solid = new G4Cons(nameS, par[0], par[1], par[2], par[3], par[4],
+                         par[5], par[6]);
+   }
+   else if (shapeS == "sphere" && par.size() == 6)
+   {
+      solid = new G4Sphere(nameS, par[0], par[1], par[2], par[3], par[4],
+                           par[5]);
+   }
+   else
+   {
+      G4cerr << APP_NAME << " error: invalid record for solid "
+             << nameS << " of shape " << shapeS << G4endl;
+      exit(1);
+   }
+
    vpair_t newvol(ivolu,0);
-   G4FieldManager* fieldmgr = fFieldManagers[ref.fRegionID];
+   G4FieldManager* fieldmgr = fFieldManagers[iregion];
    fLogicalVolumes[newvol] = new G4LogicalVolume(solid,fMaterials[imate],
-                                                 S(nameS),fieldmgr);
+                                                 nameS,fieldmgr);
    G4Material* mate = fMaterials[imate];
    double dens = mate->GetDensity();
    double dmod = (int)(dens*97.345/(g/cm3)) % 20;
@@ -442,8 +529,7 @@ int HddsG4Builder::createSolid(DOMElement* el, Refsys& ref)
    G4VisAttributes* attr = new G4VisAttributes(G4Colour(red,green,blue));
    fLogicalVolumes[newvol]->SetVisAttributes(attr);
 
-   XString sensiS(el->getAttribute(X("sensitive")));
-   if (sensiS == "true")
+   if (sensitive)
    {
       fSensitiveVolumes[ivolu] = fLogicalVolumes[newvol];
    }
@@ -472,7 +558,7 @@ int HddsG4Builder::createSolid(DOMElement* el, Refsys& ref)
             exit(1);
          }
          if (poli_vector != 0 || effi_vector != 0) {
-            G4OpticalSurface *surface = new G4OpticalSurface(S(nameS));
+            G4OpticalSurface *surface = new G4OpticalSurface(nameS);
             surface->SetType(dielectric_metal);
             surface->SetModel(glisur);
             surface->SetMaterialPropertiesTable(mpt);
@@ -484,12 +570,12 @@ int HddsG4Builder::createSolid(DOMElement* el, Refsys& ref)
             else {
                surface->SetFinish(polished);
             }
-            new G4LogicalSkinSurface(S(nameS),fLogicalVolumes[newvol],surface);
+            new G4LogicalSkinSurface(nameS,fLogicalVolumes[newvol],surface);
          }
       }
       else if (refl_vector == 0) {
          if (poli_vector != 0) {
-            G4OpticalSurface *surface = new G4OpticalSurface(S(nameS));
+            G4OpticalSurface *surface = new G4OpticalSurface(nameS);
             surface->SetType(dielectric_dielectric);
             surface->SetModel(glisur);
             surface->SetMaterialPropertiesTable(mpt);
@@ -501,7 +587,7 @@ int HddsG4Builder::createSolid(DOMElement* el, Refsys& ref)
             else {
                surface->SetFinish(polished);
             }
-            new G4LogicalSkinSurface(S(nameS),fLogicalVolumes[newvol],surface);
+            new G4LogicalSkinSurface(nameS,fLogicalVolumes[newvol],surface);
          }
       }
       else {
@@ -512,12 +598,6 @@ int HddsG4Builder::createSolid(DOMElement* el, Refsys& ref)
          exit(1);
       }
    }
-
-#ifdef LINUX_CPUTIME_PROFILING
-   timestr << " ( " << timer.getUserDelta() << " ) ";
-   G4cerr << timestr.str() << G4endl;
-#endif
-   return ivolu;
 }
 
 int HddsG4Builder::createRotation(Refsys& ref)
@@ -530,9 +610,32 @@ int HddsG4Builder::createRotation(Refsys& ref)
 #endif
    int irot = CodeWriter::createRotation(ref);
 
+   HddsG4Cache rec;
+   rec.putInt(kRotationRecord);
+   rec.putInt(irot);
+   if (irot > 0)
+   {
+      rec.putDoubles(ref.getRotation());
+   }
+   replay(rec);
+   if (fJournal)
+   {
+      fJournal->append(rec);
+   }
+
+#ifdef LINUX_CPUTIME_PROFILING
+   timestr << " ( " << timer.getUserDelta() << " ) ";
+   G4cerr << timestr.str() << G4endl;
+#endif
+   return irot;
+}
+
+void HddsG4Builder::buildRotation(HddsG4Cache& rec)
+{
+   int irot = rec.getInt();
    if (irot > 0)
    {
-      std::vector<double> omega = ref.getRotation();
+      std::vector<double> omega = rec.getDoubles();
       fRotations[irot] = new G4RotationMatrix();
       fRotations[irot]->rotateX(omega[0]);
       fRotations[irot]->rotateY(omega[1]);
@@ -543,12 +646,6 @@ int HddsG4Builder::createRotation(Refsys& ref)
    {
       fRotations[0] = new G4RotationMatrix();
    }
-
-#ifdef LINUX_CPUTIME_PROFILING
-   timestr << " ( " << timer.getUserDelta() << " ) ";
-   G4cerr << timestr.str() << G4endl;
-#endif
-   return irot;
 }
 
 int HddsG4Builder::createVolume(DOMElement* el, Refsys& ref)
@@ -565,60 +662,21 @@ int HddsG4Builder::createVolume(DOMElement* el, Refsys& ref)
    {
       XString myvoluS(el->getAttribute(X("HDDSvolu")));
       XString motherS(fRef.fMother->getAttribute(X("HDDSvolu")));
-      int myvoluI = atoi(S(myvoluS));
-      int motherI = atoi(S(motherS));
-      G4ThreeVector origin(fRef.fOrigin[0]*cm,
-                           fRef.fOrigin[1]*cm,
-                           fRef.fOrigin[2]*cm);
-      int irot = fRef.fRotation;
-
-      // Apply fix-up in case we are placing the volume inside a phi division
-      // because of a flaw in the way geant4 handles this special case.
-
-      G4RotationMatrix *rot = fRotations[irot];
-      if (fCurrentPhiCenter[motherI] != 0)
+      HddsG4Cache rec;
+      rec.putInt(kPlacementRecord);
+      rec.putInt(icopy);
+      rec.putInt(atoi(S(myvoluS)));
+      rec.putInt(atoi(S(motherS)));
+      rec.putDouble(fRef.fOrigin[0]*cm);
+      rec.putDouble(fRef.fOrigin[1]*cm);
+      rec.putDouble(fRef.fOrigin[2]*cm);
+      rec.putInt(fRef.fRotation);
+      rec.putInt(fRef.fRelativeLayer);
+      replay(rec);
+      if (fJournal)
       {
-         rot = new G4RotationMatrix(*rot);
-         rot->rotateZ(-fCurrentPhiCenter[motherI]);
-         origin.rotateZ(fCurrentPhiCenter[motherI]);
+         fJournal->append(rec);
       }
-
-      std::map<vpair_t,G4LogicalVolume*>::iterator mine;
-      for (mine = fLogicalVolumes.find(vpair_t(myvoluI,0));
-           mine != fLogicalVolumes.end() && mine->first.first == myvoluI;
-           ++mine)
-      {
-         int ilayer = mine->first.second;
-         std::map<vpair_t,G4LogicalVolume*>::iterator moms;
-         moms = addNewLayer(motherI,fRef.fRelativeLayer + ilayer);
-         G4PVPlacement *pvol = new G4PVPlacement(rot, origin,
-                                                 mine->second,
-                                                 mine->second->GetName(),
-                                                 moms->second,0,icopy);
-#ifdef CHECK_OVERLAPS_MM
-         pvol->CheckOverlaps(1000,CHECK_OVERLAPS_MM);
-#endif
-#ifdef DEBUG_PLACEMENT
-         XString nameS(el->getAttribute(X("name")));
-         G4cout << "volume " << nameS 
-                << "->" << mine->second->GetName()
-                << "->" << mine->second->GetSolid()->GetName()
-                << " being placed in mother " << moms->second->GetName()
-                << "->" << moms->second->GetSolid()->GetName() << " at "
-                << fRef.fOrigin[0]*cm << ","
-                << fRef.fOrigin[1]*cm << "," 
-                << fRef.fOrigin[2]*cm
-                << G4endl;
-#endif
-
-         if (ilayer == 0) {
-            vpair_t mycopy(myvoluI,icopy);
-            fPhysicalVolumes[mycopy] = pvol;
-            fCurrentPlacement[myvoluI] = fPhysicalVolumes.find(mycopy);
-            fCurrentMother[myvoluI] = moms;
-         }
-      }
-
       fPending = false;
    }
 
@@ -629,6 +687,62 @@ int HddsG4Builder::createVolume(DOMElement* el, Refsys& ref)
    return icopy;
 }
 
+void HddsG4Builder::buildPlacement(HddsG4Cache& rec)
+{
+   int icopy = rec.getInt();
+   int myvoluI = rec.getInt();
+   int motherI = rec.getInt();
+   double x = rec.getDouble();
+   double y = rec.getDouble();
+   double z = rec.getDouble();
+   G4ThreeVector origin(x, y, z);
+   int irot = rec.getInt();
+   int relativeLayer = rec.getInt();
+
+   // Apply fix-up in case we are placing the volume inside a phi division
+   // because of a flaw in the way geant4 handles this special case.
+
+   G4RotationMatrix *rot = fRotations[irot];
+   if (fCurrentPhiCenter[motherI] != 0)
+   {
+      rot = new G4RotationMatrix(*rot);
+      rot->rotateZ(-fCurrentPhiCenter[motherI]);
+      origin.rotateZ(fCurrentPhiCenter[motherI]);
+   }
+
+   std::map<vpair_t,G4LogicalVolume*>::iterator mine;
+   for (mine = fLogicalVolumes.find(vpair_t(myvoluI,0));
+        mine != fLogicalVolumes.end() && mine->first.first == myvoluI;
+        ++mine)
+   {
+      int ilayer = mine->first.second;
+      std::map<vpair_t,G4LogicalVolume*>::iterator moms;
+      moms = addNewLayer(motherI,relativeLayer + ilayer);
+      G4PVPlacement *pvol = new G4PVPlacement(rot, origin,
+                                              mine->second,
+                                              mine->second->GetName(),
+                                              moms->second,0,icopy);
+#ifdef CHECK_OVERLAPS_MM
+      pvol->CheckOverlaps(1000,CHECK_OVERLAPS_MM);
+#endif
+#ifdef DEBUG_PLACEMENT
+      G4cout << "volume " << mine->second->GetName()
+             << "->" << mine->second->GetSolid()->GetName()
+             << " being placed in mother " << moms->second->GetName()
+             << "->" << moms->second->GetSolid()->GetName() << " at "
+             << x << "," << y << "," << z
+             << G4endl;
+#endif
+
+      if (ilayer == 0) {
+         vpair_t mycopy(myvoluI,icopy);
+         fPhysicalVolumes[mycopy] = pvol;
+         fCurrentPlacement[myvoluI] = fPhysicalVolumes.find(mycopy);
+         fCurrentMother[myvoluI] = moms;
+      }
+   }
+}
+
 std::map<HddsG4Builder::vpair_t,G4LogicalVolume*>::iterator
 HddsG4Builder::addNewLayer(int volume_id, int layer)
 {
@@ -802,12 +916,6 @@ int HddsG4Builder::createDivision(XString& divStr, Refsys& ref)
 
    XString motherS(ref.fMother->getAttribute(X("HDDSvolu")));
    XString myvoluS(ref.fPartition.divEl->getAttribute(X("HDDSvolu")));
-   int motherI = atoi(S(motherS));
-   int myvoluI = atoi(S(myvoluS));
-   std::map<vpair_t,G4LogicalVolume*>::iterator moms;
-   moms = fLogicalVolumes.find(vpair_t(motherI,0));
-   G4VSolid* solid = moms->second->GetSolid()->Clone();
-   solid->SetName(divStr);
    EAxis axis;
    double width,offset;
 
@@ -852,15 +960,54 @@ int HddsG4Builder::createDivision(XString& divStr, Refsys& ref)
       exit(1);
    }
 
+   HddsG4Cache rec;
+   rec.putInt(kDivisionRecord);
+   rec.putString(divStr);
+   rec.putInt(atoi(S(motherS)));
+   rec.putInt(atoi(S(myvoluS)));
+   rec.putInt(ndiv);
+   rec.putInt(axis);
+   rec.putDouble(width);
+   rec.putDouble(offset);
+   rec.putInt(ref.fRegionID);
+   replay(rec);
+   if (fJournal)
+   {
+      fJournal->append(rec);
+   }
+
+#ifdef LINUX_CPUTIME_PROFILING
+   timestr << " ( " << timer.getUserDelta() << " ) ";
+   G4cerr << timestr.str() << G4endl;
+#endif
+   return ndiv;
+}
+
+void HddsG4Builder::buildDivision(HddsG4Cache& rec)
+{
+   std::string divStr = rec.getString();
+   int motherI = rec.getInt();
+   int myvoluI = rec.getInt();
+   int ndiv = rec.getInt();
+   EAxis axis = (EAxis)rec.getInt();
+   double width = rec.getDouble();
+   double offset = rec.getDouble();
+   int iregion = rec.getInt();
+
+   std::map<vpair_t,G4LogicalVolume*>::iterator moms;
+   moms = fLogicalVolumes.find(vpair_t(motherI,0));
+   G4VSolid* solid = moms->second->GetSolid()->Clone();
+   solid->SetName(divStr);
+
    vpair_t mothvol(moms->first);
    vpair_t myvol(myvoluI,moms->first.second);
    G4Material* material = moms->second->GetMaterial();
-   G4FieldManager* fieldmgr = fFieldManagers[ref.fRegionID];
+   G4FieldManager* fieldmgr = fFieldManagers[iregion];
    fLogicalVolumes[myvol] = new G4LogicalVolume(solid,material,
-                                                S(divStr),fieldmgr);
+                                                divStr,fieldmgr);
    fLogicalVolumes[myvol]->SetVisAttributes(new G4VisAttributes(false));
    vpair_t mydiv(myvoluI,0);
-   fPhysicalVolumes[mydiv] = new G4PVDivision(S(divStr),
+   fPhysicalVolumes[mydiv] = new G4PVDivision(divStr,
                                               fLogicalVolumes[myvol],
                                               fLogicalVolumes[mothvol],
                                               axis,ndiv,width,offset);
@@ -959,12 +1106,6 @@ int HddsG4Builder::createDivision(XString& divStr, Refsys& ref)
           << " and repeating every " << width
           << G4endl;
 #endif
-
-#ifdef LINUX_CPUTIME_PROFILING
-   timestr << " ( " << timer.getUserDelta() << " ) ";
-   G4cerr << timestr.str() << G4endl;
-#endif
-   return ndiv;
 }
 
 int HddsG4Builder::createRegion(DOMElement* el, Refsys& ref)
@@ -977,16 +1118,15 @@ int HddsG4Builder::createRegion(DOMElement* el, Refsys& ref)
 #endif
    int iregion = CodeWriter::createRegion(el,ref);
 
-   XString motherS(ref.fMother->getAttribute(X("HDDSvolu")));
-   int motherI = atoi(S(motherS));
-   std::map<vpair_t,G4LogicalVolume*>::iterator moms;
-   moms = fLogicalVolumes.find(vpair_t(motherI,0));
-
-   G4double *R = (G4double*)ref.fMRmatrix;
-   G4double *O = ref.fMOrigin;
-   G4AffineTransform xform(CLHEP::HepRotation(CLHEP::HepRep3x3(R)),
-                           CLHEP::Hep3Vector(O[0],O[1],O[2]));
+   // Field types in region records: 0 = no region, 1 = noBfield,
+   // 2 = uniformBfield, 3 = mappedBfield, 4 = computedBfield
 
+   int ftype = 0;
+   std::vector<double> B(3,0);
+   double u = 0;
+   double maxArcStep = 0;
+   XString methodS("helix");
+   XString functionS;
    if (ref.fRegion)
    {
       DOMNodeList* noBfieldL;
@@ -999,8 +1139,6 @@ int HddsG4Builder::createRegion(DOMElement* el, Refsys& ref)
       mapBfieldL = ref.fRegion->getElementsByTagName(X("mappedBfield"));
       compBfieldL = ref.fRegion->getElementsByTagName(X("computedBfield"));
       swimL = ref.fRegion->getElementsByTagName(X("swim"));
-      double maxArcStep = 0;
-      XString methodS("helix");
       if (swimL->getLength() > 0)
       {
          DOMElement* swimEl = (DOMElement*)swimL->item(0);
@@ -1012,91 +1150,63 @@ int HddsG4Builder::createRegion(DOMElement* el, Refsys& ref)
       }
       if (noBfieldL->getLength() > 0)
       {
-         fMagneticRegions[iregion] = 0;
-         G4ThreeVector Bvec(0,0,1e-99);
-         G4UniformMagField *fld = new G4UniformMagField(Bvec);
-         G4Mag_EqRhs *eqn = new G4Mag_UsualEqRhs(fld);
-         G4MagIntegratorStepper *stepper = new G4ExactHelixStepper(eqn);
-         G4ChordFinder *cfinder = new G4ChordFinder(fld, 1e+99, stepper);
-         fFieldManagers[iregion] = new G4FieldManager(fld, cfinder);
+         ftype = 1;
       }
       else if (uniBfieldL->getLength() > 0)
       {
+         ftype = 2;
          Units funit;
          DOMElement* uniBfieldEl = (DOMElement*)uniBfieldL->item(0);
          funit.getConversions(uniBfieldEl);
          XString bvecS(uniBfieldEl->getAttribute(X("Bx_By_Bz")));
          std::stringstream str(S(bvecS));
-         double B[3];
          str >> B[0] >> B[1] >> B[2];
-         double u = kilogauss/funit.kG;
-         G4ThreeVector Bvec(B[0],B[1],B[2]);
-         GlueXUniformMagField *fld = new GlueXUniformMagField(Bvec,u,xform);
-         fMagneticRegions[iregion] = fld;
-         G4Mag_EqRhs *eqn = new G4Mag_UsualEqRhs(fld);
-         G4MagIntegratorStepper *stepper = new G4ExactHelixStepper(eqn);
-         G4ChordFinder *cfinder = new G4ChordFinder(fld, 0.01, stepper);
-         fFieldManagers[iregion] = new G4FieldManager(fld, cfinder);
+         u = kilogauss/funit.kG;
       }
       else if (mapBfieldL->getLength() > 0)
       {
+         ftype = 3;
          Units funit;
          DOMElement* mapBfieldEl = (DOMElement*)mapBfieldL->item(0);
          funit.getConversions(mapBfieldEl);
          XString bvecS(mapBfieldEl->getAttribute(X("maxBfield")));
          std::stringstream str(S(bvecS));
-         double Bmax;
-         str >> Bmax;
-         double u = kilogauss/funit.kG;
-         GlueXMappedMagField *fld = new GlueXMappedMagField(Bmax,u,xform);
-         fMagneticRegions[iregion] = fld;
-         G4Mag_EqRhs *eqn = new G4Mag_UsualEqRhs(fld);
-         G4MagIntegratorStepper *stepper;
-         if (methodS == "RungeKutta") {
-            stepper = new G4ClassicalRK4(eqn);
-         }
-         else {
-            stepper = new G4HelixMixedStepper(eqn);
-         }
-         G4ChordFinder *cfinder = new G4ChordFinder(fld, 0.01, stepper);
-         if (maxArcStep > 0) {
-            double rmin = 0.1 / (0.03 * Bmax * u) * meter;
-            double max_miss = rmin * (1 - cos(maxArcStep / 2));
-            cfinder->SetDeltaChord(max_miss);
-         }
-         fFieldManagers[iregion] = new G4FieldManager(fld, cfinder);
+         str >> B[0];
+         u = kilogauss/funit.kG;
       }
       else if (compBfieldL->getLength() > 0)
       {
+         ftype = 4;
          Units funit;
          DOMElement* compBfieldEl = (DOMElement*)compBfieldL->item(0);
          funit.getConversions(compBfieldEl);
          XString bvecS(compBfieldEl->getAttribute(X("maxBfield")));
          std::stringstream str(S(bvecS));
-         double Bmax;
-         str >> Bmax;
-         double u = kilogauss/funit.kG;
-         GlueXComputedMagField *fld = new GlueXComputedMagField(Bmax,u,xform);
-         fld->SetFunction(XString(compBfieldEl->getAttribute(X("function"))));
-         fMagneticRegions[iregion] = fld;
-         G4Mag_EqRhs *eqn = new G4Mag_UsualEqRhs(fld);
-         G4MagIntegratorStepper *stepper;
-         if (methodS == "RungeKutta") {
-            stepper = new G4ClassicalRK4(eqn);
-         }
-         else {
-            stepper = new G4HelixMixedStepper(eqn);
-         }
-         G4ChordFinder *cfinder = new G4ChordFinder(fld, 0.01, stepper);
-         if (maxArcStep > 0) {
-            double rmin = 0.1 / (0.03 * Bmax * u) * meter;
-            double max_miss = rmin * (1 - cos(maxArcStep / 2));
-            cfinder->SetDeltaChord(max_miss);
-         }
-         fFieldManagers[iregion] = new G4FieldManager(fld, cfinder);
+         str >> B[0];
+         u = kilogauss/funit.kG;
+         functionS = compBfieldEl->getAttribute(X("function"));
       }
    }
 
+   HddsG4Cache rec;
+   rec.putInt(kRegionRecord);
+   rec.putInt(iregion);
+   rec.putInt(ftype);
+   G4double *R = (G4double*)ref.fMRmatrix;
+   G4double *O = ref.fMOrigin;
+   rec.putDoubles(std::vector<double>(R, R + 9));
+   rec.putDoubles(std::vector<double>(O, O + 3));
+   rec.putDoubles(B);
+   rec.putDouble(u);
+   rec.putDouble(maxArcStep);
+   rec.putString(methodS);
+   rec.putString(functionS);
+   replay(rec);
+   if (fJournal)
+   {
+      fJournal->append(rec);
+   }
+
 #ifdef LINUX_CPUTIME_PROFILING
    timestr << " ( " << timer.getUserDelta() << " ) ";
    G4cerr << timestr.str() << G4endl;
@@ -1104,6 +1214,91 @@ int HddsG4Builder::createRegion(DOMElement* el, Refsys& ref)
    return iregion;
 }
 
+void HddsG4Builder::buildRegion(HddsG4Cache& rec)
+{
+   int iregion = rec.getInt();
+   int ftype = rec.getInt();
+   std::vector<double> R = rec.getDoubles();
+   std::vector<double> O = rec.getDoubles();
+   std::vector<double> B = rec.getDoubles();
+   double u = rec.getDouble();
+   double maxArcStep = rec.getDouble();
+   std::string methodS = rec.getString();
+   std::string functionS = rec.getString();
+   if (R.size() != 9 || O.size() != 3 || B.size() != 3)
+   {
+      G4cerr << APP_NAME << " error: invalid record for region "
+             << iregion << G4endl;
+      exit(1);
+   }
+   G4AffineTransform xform(CLHEP::HepRotation(CLHEP::HepRep3x3(&R[0])),
+                           CLHEP::Hep3Vector(O[0],O[1],O[2]));
+
+   if (ftype == 1)
+   {
+      fMagneticRegions[iregion] = 0;
+      G4ThreeVector Bvec(0,0,1e-99);
+      G4UniformMagField *fld = new G4UniformMagField(Bvec);
+      G4Mag_EqRhs *eqn = new G4Mag_UsualEqRhs(fld);
+      G4MagIntegratorStepper *stepper = new G4ExactHelixStepper(eqn);
+      G4ChordFinder *cfinder = new G4ChordFinder(fld, 1e+99, stepper);
+      fFieldManagers[iregion] = new G4FieldManager(fld, cfinder);
+   }
+   else if (ftype == 2)
+   {
+      G4ThreeVector Bvec(B[0],B[1],B[2]);
+      GlueXUniformMagField *fld = new GlueXUniformMagField(Bvec,u,xform);
+      fMagneticRegions[iregion] = fld;
+      G4Mag_EqRhs *eqn = new G4Mag_UsualEqRhs(fld);
+      G4MagIntegratorStepper *stepper = new G4ExactHelixStepper(eqn);
+      G4ChordFinder *cfinder = new G4ChordFinder(fld, 0.01, stepper);
+      fFieldManagers[iregion] = new G4FieldManager(fld, cfinder);
+   }
+   else if (ftype == 3)
+   {
+      double Bmax = B[0];
+      GlueXMappedMagField *fld = new GlueXMappedMagField(Bmax,u,xform);
+      fMagneticRegions[iregion] = fld;
+      G4Mag_EqRhs *eqn = new G4Mag_UsualEqRhs(fld);
+      G4MagIntegratorStepper *stepper;
+      if (methodS == "RungeKutta") {
+         stepper = new G4ClassicalRK4(eqn);
+      }
+      else {
+         stepper = new G4HelixMixedStepper(eqn);
+      }
+      G4ChordFinder *cfinder = new G4ChordFinder(fld, 0.01, stepper);
+      if (maxArcStep > 0) {
+         double rmin = 0.1 / (0.03 * Bmax * u) * meter;
+         double max_miss = rmin * (1 - cos(maxArcStep / 2));
+         cfinder->SetDeltaChord(max_miss);
+      }
+      fFieldManagers[iregion] = new G4FieldManager(fld, cfinder);
+   }
+   else if (ftype == 4)
+   {
+      double Bmax = B[0];
+      GlueXComputedMagField *fld = new GlueXComputedMagField(Bmax,u,xform);
+      fld->SetFunction(functionS);
+      fMagneticRegions[iregion] = fld;
+      G4Mag_EqRhs *eqn = new G4Mag_UsualEqRhs(fld);
+      G4MagIntegratorStepper *stepper;
+      if (methodS == "RungeKutta") {
+         stepper = new G4ClassicalRK4(eqn);
+      }
+      else {
+         stepper = new G4HelixMixedStepper(eqn);
+      }
+      G4ChordFinder *cfinder = new G4ChordFinder(fld, 0.01, stepper);
+      if (maxArcStep > 0) {
+         double rmin = 0.1 / (0.03 * Bmax * u) * meter;
+         double max_miss = rmin * (1 - cos(maxArcStep / 2));
+         cfinder->SetDeltaChord(max_miss);
+      }
+      fFieldManagers[iregion] = new G4FieldManager(fld, cfinder);
+   }
+}
+
 void HddsG4Builder::createSetFunctions(DOMElement* el, const XString& ident)
 {
 #ifdef LINUX_CPUTIME_PROFILING
@@ -1212,18 +1407,21 @@ void HddsG4Builder::createMapFunctions(DOMElement* el, const XString& ident)
       if (iregionS.size() == 0)
          continue;
       int iregion = atoi(S(iregionS));
-      GlueXMappedMagField *magfield = (GlueXMappedMagField*)
-                                      fMagneticRegions[iregion];
+      HddsG4Cache rec;
+      rec.putInt(kFieldMapRecord);
+      rec.putInt(iregion);
       int axorder[] = {0,0,0,0};
       int axsamples[] = {0,0,0,0};
 
       XString gridtype;
       DOMNodeList* gridL = mapfEl->getElementsByTagName(X("grid"));
+      rec.putInt(gridL->getLength());
       int ngrid;
       for (ngrid = 0; ngrid < (int)gridL->getLength(); ++ngrid)
       {
          int axsense[] = {1,1,1,1};
-         double axlower[4], axupper[4];
+         double axlower[] = {0,0,0,0};
+         double axupper[] = {0,0,0,0};
          DOMElement* gridEl = (DOMElement*)gridL->item(ngrid);
          XString typeS(gridEl->getAttribute(X("type")));
          if (gridtype.size() > 0 && typeS != gridtype)
@@ -1342,22 +1540,18 @@ void HddsG4Builder::createMapFunctions(DOMElement* el, const XString& ident)
             }
          }
 
-         if (gridtype == "cartesian")
-         {
-            magfield->AddCartesianGrid(axsamples, axorder, axsense,
-                                       axlower, axupper);
-         }
-         else if (gridtype == "cylindrical")
-         {
-            magfield->AddCylindricalGrid(axsamples, axorder, axsense,
-                                         axlower, axupper);
-         }
-         else
+         if (gridtype != "cartesian" && gridtype != "cylindrical")
          {
             G4cerr << APP_NAME << " error: unrecognized grid type " 
                    << S(gridtype) << G4endl;
             exit(1);
          }
+         rec.putString(gridtype);
+         rec.putInts(std::vector<int>(axsamples, axsamples + 4));
+         rec.putInts(std::vector<int>(axorder, axorder + 4));
+         rec.putInts(std::vector<int>(axsense, axsense + 4));
+         rec.putDoubles(std::vector<double>(axlower, axlower + 4));
+         rec.putDoubles(std::vector<double>(axupper, axupper + 4));
       }
 
       XString mapS(mapfEl->getAttribute(X("map")));
@@ -1375,13 +1569,24 @@ void HddsG4Builder::createMapFunctions(DOMElement* el, const XString& ident)
          exit(1);
       }
       mapS.erase(0,7);
-      magfield->ReadMapFile(S(mapS));
+      rec.putString(mapS);
+      replay(rec);
+      if (fJournal)
+      {
+         fJournal->append(rec);
+      }
    }
 
    // Apply a post-build fix to ensure that every point in the geometry
    // has a consistent magnetic field on all layers, using recursion.
 
-   addReflections(1);
+   HddsG4Cache rec;
+   rec.putInt(kReflectionRecord);
+   replay(rec);
+   if (fJournal)
+   {
+      fJournal->append(rec);
+   }
 
 #ifdef LINUX_CPUTIME_PROFILING
    timestr << " ( " << timer.getUserDelta() << " ) ";
@@ -1413,12 +1618,194 @@ void HddsG4Builder::translate(DOMElement* topel)
    }
    fWorldVolume = atoi(S(ivoluS));
 
+   // Record the world volume and the identifier tables, which are
+   // the last pieces of state needed to reproduce this translation.
+
+   if (fJournal)
+   {
+      fJournal->putInt(kWorldRecord);
+      fJournal->putInt(fWorldVolume);
+      fJournal->putInt(kIdentifierRecord);
+      fJournal->putInt(Refsys::fVolumes);
+      fJournal->putInt(Refsys::fIdentifierTable.size());
+      std::map<int,std::map<std::string,std::vector<int> > >::iterator iter;
+      for (iter = Refsys::fIdentifierTable.begin();
+           iter != Refsys::fIdentifierTable.end(); ++iter)
+      {
+         fJournal->putInt(iter->first);
+         fJournal->putInt(iter->second.size());
+         std::map<std::string,std::vector<int> >::iterator idlist;
+         for (idlist = iter->second.begin();
+              idlist != iter->second.end(); ++idlist)
+         {
+            fJournal->putString(idlist->first);
+            fJournal->putInts(idlist->second);
+         }
+      }
+   }
+
 #ifdef LINUX_CPUTIME_PROFILING
    timestr << " ( " << timer.getUserDelta() << " ) ";
    G4cerr << timestr.str() << G4endl;
 #endif
 }
 
+void HddsG4Builder::buildFieldMap(HddsG4Cache& rec)
+{
+   int iregion = rec.getInt();
+   GlueXMappedMagField *magfield = (GlueXMappedMagField*)
+                                   fMagneticRegions[iregion];
+   int ngrid = rec.getInt();
+   for (int igrid = 0; igrid < ngrid; ++igrid)
+   {
+      std::string gridtype = rec.getString();
+      std::vector<int> axsamples = rec.getInts();
+      std::vector<int> axorder = rec.getInts();
+      std::vector<int> axsense = rec.getInts();
+      std::vector<double> axlower = rec.getDoubles();
+      std::vector<double> axupper = rec.getDoubles();
+      if (axsamples.size() != 4 || axorder.size() != 4 ||
+          axsense.size() != 4 || axlower.size() != 4 ||
+          axupper.size() != 4)
+      {
+         G4cerr << APP_NAME << " error: invalid record for field map "
+                << "in region " << iregion << G4endl;
+         exit(1);
+      }
+      if (gridtype == "cartesian")
+      {
+         magfield->AddCartesianGrid(&axsamples[0], &axorder[0], &axsense[0],
+                                    &axlower[0], &axupper[0]);
+      }
+      else
+      {
+         magfield->AddCylindricalGrid(&axsamples[0], &axorder[0], &axsense[0],
+                                      &axlower[0], &axupper[0]);
+      }
+   }
+   std::string mapS = rec.getString();
+   magfield->ReadMapFile(mapS.c_str());
+}
+
+void HddsG4Builder::buildIdentifiers(HddsG4Cache& rec)
+{
+   Refsys::fVolumes = rec.getInt();
+   Refsys::fIdentifierTable.clear();
+   int nvolumes = rec.getInt();
+   for (int n = 0; n < nvolumes && rec.good(); ++n)
+   {
+      int ivolu = rec.getInt();
+      int nidents = rec.getInt();
+      for (int i = 0; i < nidents && rec.good(); ++i)
+      {
+         std::string ident = rec.getString();
+         Refsys::fIdentifierTable[ivolu][ident] = rec.getInts();
+      }
+   }
+}
+
+void HddsG4Builder::replay(HddsG4Cache& rec)
+{
+   // Construct the Geant4 objects described by the next record in rec,
+   // which was either just parsed from the HDDS document by one of the
+   // create* methods, or else read back from a geometry cache file.
+
+   int tag = rec.getInt();
+   switch (tag)
+   {
+      case kMaterialRecord:
+         buildMaterial(rec);
+         break;
+      case kSolidRecord:
+         buildSolid(rec);
+         break;
+      case kRotationRecord:
+         buildRotation(rec);
+         break;
+      case kRegionRecord:
+         buildRegion(rec);
+         break;
+      case kPlacementRecord:
+         buildPlacement(rec);
+         break;
+      case kDivisionRecord:
+         buildDivision(rec);
+         break;
+      case kFieldMapRecord:
+         buildFieldMap(rec);
+         break;
+      case kReflectionRecord:
+         addReflections(1);
+         break;
+      case kWorldRecord:
+         fWorldVolume = rec.getInt();
+         break;
+      case kIdentifierRecord:
+         buildIdentifiers(rec);
+         break;
+      default:
+         G4cerr << APP_NAME << " error: unknown geometry record type "
+                << tag << ", cannot continue." << G4endl;
+         exit(1);
+   }
+   if (! rec.good())
+   {
+      G4cerr << APP_NAME << " error: truncated geometry record of type "
+             << tag << ", cannot continue." << G4endl;
+      exit(1);
+   }
+}
+
+void HddsG4Builder::recordTranslation()
+{
+   delete fJournal;
+   fJournal = new HddsG4Cache();
+}
+
+int HddsG4Builder::writeCache(const std::string &fname,
+                              const std::string &key,
+                              const std::string &md5)
+{
+   // Write the records journaled since recordTranslation() was called
+   // to the geometry cache file fname. Returns 1 on success.
+
+   if (fJournal == 0)
+   {
+      return 0;
+   }
+   int written = fJournal->write(fname, key, md5);
+   delete fJournal;
+   fJournal = 0;
+   return written;
+}
+
+int HddsG4Builder::readCache(const std::string &fname,
+                             const std::string &key,
+                             std::string &md5)
+{
+   // Construct the geometry by replaying the records in the geometry
+   // cache file fname, in place of translate(). Returns 0 without any
+   // side effects if the file is missing, or does not match key.
+
+   HddsG4Cache cache;
+   if (! cache.read(fname, key, md5))
+   {
+      return 0;
+   }
+   while (! cache.atEnd())
+   {
+      replay(cache);
+   }
+   if (fWorldVolume == 0 || getWorldVolume() == 0)
+   {
+      G4cerr << APP_NAME << " error: geometry cache " << fname
+             << " does not contain a world volume, please delete it"
+             << " and try again." << G4endl;
+      exit(1);
+   }
+   return 1;
+}
+
 G4LogicalVolume* HddsG4Builder::getWorldVolume(int parallel) const
 {
    int worlds = 0;
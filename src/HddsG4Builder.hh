@@ -13,6 +13,7 @@
 #include "XString.hpp"
 #include "XParsers.hpp"
 #include "hddsCommon.hpp"
+#include "HddsG4Cache.hh"
 
 #include <G4Element.hh>
 #include <G4Material.hh>
@@ -61,6 +62,15 @@ class HddsG4Builder : public CodeWriter
 
    void translate(DOMElement* topel);	 // invokes the main translator
 
+   void recordTranslation();             // journal records for the cache
+   int writeCache(const std::string &fname,
+                  const std::string &key,
+                  const std::string &md5);
+                                         // write journal to a cache file
+   int readCache(const std::string &fname,
+                 const std::string &key,
+                 std::string &md5);      // build geometry from a cache file
+
  private:
    typedef std::pair<int,int> vpair_t;
 
@@ -68,6 +78,32 @@ class HddsG4Builder : public CodeWriter
    addNewLayer(int volume_id, int layer); // generate code for geometry layers
    void addReflections(int volume_id);    // propagate volume to other layers
 
+   // Each create* method above parses its element into a record and
+   // then calls replay() to construct the Geant4 objects from it, so
+   // that a geometry cache replays through exactly the same code.
+
+   enum {
+      kMaterialRecord = 1,
+      kSolidRecord,
+      kRotationRecord,
+      kRegionRecord,
+      kPlacementRecord,
+      kDivisionRecord,
+      kFieldMapRecord,
+      kReflectionRecord,
+      kWorldRecord,
+      kIdentifierRecord
+   };
+   void replay(HddsG4Cache& rec);         // construct from the next record
+   void buildMaterial(HddsG4Cache& rec);
+   void buildSolid(HddsG4Cache& rec);
+   void buildRotation(HddsG4Cache& rec);
+   void buildRegion(HddsG4Cache& rec);
+   void buildPlacement(HddsG4Cache& rec);
+   void buildDivision(HddsG4Cache& rec);
+   void buildFieldMap(HddsG4Cache& rec);
+   void buildIdentifiers(HddsG4Cache& rec);
+
    int fWorldVolume;
 
    // many-to-one maps from volume id to attribute pointer
@@ -100,6 +136,9 @@ class HddsG4Builder : public CodeWriter
    PhysicalVolume_map_iter fCurrentPlacement;
    PhysicalVolume_map_iter fCurrentDivision;
    std::map<int,double> fCurrentPhiCenter;
+
+   // records of the translation, kept only while writing a cache
+   HddsG4Cache *fJournal;
 };
 
 #endif
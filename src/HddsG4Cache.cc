@@ -0,0 +1,288 @@
+//
+// HddsG4Cache - class implementation
+//
+// author: agent at local
+// version: october 18, 2026
+//
+
+#include <HddsG4Cache.hh>
+#include <G4Version.hh>
+#include <G4ios.hh>
+
+#include <unistd.h>
+#include <dirent.h>
+#include <string.h>
+#include <stdio.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+// Increment this whenever the layout of any HddsG4Builder record
+// changes, so that caches written by older builds are ignored.
+const int HddsG4Cache::fFormatVersion = 1;
+
+static const char cache_magic[8] = {'H','D','D','S','G','4','C','\n'};
+
+HddsG4Cache::HddsG4Cache()
+ : fCursor(0),
+   fGood(true)
+{}
+
+HddsG4Cache::~HddsG4Cache()
+{}
+
+void HddsG4Cache::clear()
+{
+   fBuffer.clear();
+   fCursor = 0;
+   fGood = true;
+}
+
+void HddsG4Cache::putInt(int value)
+{
+   fBuffer.append((const char*)&value, sizeof(value));
+}
+
+void HddsG4Cache::putDouble(double value)
+{
+   fBuffer.append((const char*)&value, sizeof(value));
+}
+
+void HddsG4Cache::putString(const std::string &value)
+{
+   putInt(value.size());
+   fBuffer.append(value);
+}
+
+void HddsG4Cache::putDoubles(const std::vector<double> &values)
+{
+   putInt(values.size());
+   if (values.size() > 0)
+      fBuffer.append((const char*)&values[0], values.size() * sizeof(double));
+}
+
+void HddsG4Cache::putInts(const std::vector<int> &values)
+{
+   putInt(values.size());
+   if (values.size() > 0)
+      fBuffer.append((const char*)&values[0], values.size() * sizeof(int));
+}
+
+void HddsG4Cache::append(const HddsG4Cache &records)
+{
+   fBuffer.append(records.fBuffer);
+}
+
+void HddsG4Cache::get(void *data, size_t size)
+{
+   if (fCursor + size > fBuffer.size()) {
+      memset(data, 0, size);
+      fCursor = fBuffer.size();
+      fGood = false;
+      return;
+   }
+   memcpy(data, fBuffer.data() + fCursor, size);
+   fCursor += size;
+}
+
+int HddsG4Cache::getInt()
+{
+   int value;
+   get(&value, sizeof(value));
+   return value;
+}
+
+double HddsG4Cache::getDouble()
+{
+   double value;
+   get(&value, sizeof(value));
+   return value;
+}
+
+std::string HddsG4Cache::getString()
+{
+   int size = getInt();
+   if (size < 0 || fCursor + size > fBuffer.size()) {
+      fGood = false;
+      return std::string();
+   }
+   std::string value(fBuffer, fCursor, size);
+   fCursor += size;
+   return value;
+}
+
+std::vector<double> HddsG4Cache::getDoubles()
+{
+   int size = getInt();
+   if (size < 0 || fCursor + size * sizeof(double) > fBuffer.size()) {
+      fGood = false;
+      return std::vector<double>();
+   }
+   std::vector<double> values(size);
+   if (size > 0)
+      get(&values[0], size * sizeof(double));
+   return values;
+}
+
+std::vector<int> HddsG4Cache::getInts()
+{
+   int size = getInt();
+   if (size < 0 || fCursor + size * sizeof(int) > fBuffer.size()) {
+      fGood = false;
+      return std::vector<int>();
+   }
+   std::vector<int> values(size);
+   if (size > 0)
+      get(&values[0], size * sizeof(int));
+   return values;
+}
+
+unsigned long long HddsG4Cache::Hash(const char *data, size_t size,
+                                     unsigned long long seed)
+{
+   // 64-bit FNV-1a hash, chained through seed
+
+   unsigned long long hash = seed;
+   for (size_t i=0; i < size; ++i) {
+      hash ^= (unsigned char)data[i];
+      hash *= 0x100000001b3ULL;
+   }
+   return hash;
+}
+
+std::string HddsG4Cache::ComputeKey(const std::string &mainfile)
+{
+   // Compute the cache key for the HDDS document rooted at mainfile
+   // from the raw contents of all of the xml files in its directory,
+   // which is where HDDS keeps the files included by the main one,
+   // together with the cache format and Geant4 versions. No parsing
+   // is involved. Returns an empty string if mainfile is unreadable.
+
+   if (access(mainfile.c_str(), R_OK) != 0)
+      return "";
+   std::string dirname(".");
+   std::string basename(mainfile);
+   size_t slash = mainfile.rfind('/');
+   if (slash != std::string::npos) {
+      dirname = (slash > 0)? mainfile.substr(0, slash) : "/";
+      basename = mainfile.substr(slash + 1);
+   }
+   std::vector<std::string> files;
+   DIR *dir = opendir(dirname.c_str());
+   if (dir == 0)
+      return "";
+   struct dirent *entry;
+   while ((entry = readdir(dir)) != 0) {
+      std::string name(entry->d_name);
+      if (name.size() > 4 && name.substr(name.size() - 4) == ".xml")
+         files.push_back(name);
+   }
+   closedir(dir);
+   std::sort(files.begin(), files.end());
+
+   std::stringstream versions;
+   versions << fFormatVersion << " " << G4VERSION_NUMBER << " " << basename;
+   std::string vstr(versions.str());
+   unsigned long long hash = Hash(vstr.c_str(), vstr.size() + 1,
+                                  0xcbf29ce484222325ULL);
+   for (unsigned int i=0; i < files.size(); ++i) {
+      std::ifstream fin((dirname + "/" + files[i]).c_str());
+      if (! fin.good())
+         return "";
+      std::stringstream contents;
+      contents << fin.rdbuf();
+      std::string cstr(contents.str());
+      hash = Hash(files[i].c_str(), files[i].size() + 1, hash);
+      hash = Hash(cstr.c_str(), cstr.size(), hash);
+   }
+   char key[20];
+   snprintf(key, 20, "%016llx", hash);
+   return key;
+}
+
+std::string HddsG4Cache::CacheFileName(const std::string &cachedir,
+                                       const std::string &key)
+{
+   return cachedir + "/hdds-" + key + ".g4cache";
+}
+
+int HddsG4Cache::write(const std::string &fname, const std::string &key,
+                       const std::string &md5) const
+{
+   // Write the records to fname behind the cache header. The file is
+   // written under a temporary name and renamed into place, so that
+   // concurrent jobs sharing a cache directory never see a partial
+   // cache file. Returns 1 on success, 0 on failure.
+
+   HddsG4Cache header;
+   header.fBuffer.append(cache_magic, sizeof(cache_magic));
+   header.putInt(fFormatVersion);
+   header.putString(key);
+   header.putString(md5);
+   header.putDouble(fBuffer.size());
+   unsigned long long hash = Hash(fBuffer.data(), fBuffer.size(),
+                                  0xcbf29ce484222325ULL);
+   header.fBuffer.append((const char*)&hash, sizeof(hash));
+
+   std::stringstream tmpname;
+   tmpname << fname << ".tmp" << getpid();
+   std::ofstream fout(tmpname.str().c_str(), std::ios::binary);
+   fout.write(header.fBuffer.data(), header.fBuffer.size());
+   fout.write(fBuffer.data(), fBuffer.size());
+   fout.close();
+   if (! fout.good() || rename(tmpname.str().c_str(), fname.c_str()) != 0) {
+      G4cerr << "HddsG4Cache::write warning - "
+             << "unable to write geometry cache " << fname << G4endl;
+      unlink(tmpname.str().c_str());
+      return 0;
+   }
+   return 1;
+}
+
+int HddsG4Cache::read(const std::string &fname, const std::string &key,
+                      std::string &md5)
+{
+   // Load the records from cache file fname, if it exists and its
+   // header matches the format version and key, and the records are
+   // intact. Returns 1 on success, 0 if the cache cannot be used.
+
+   clear();
+   std::ifstream fin(fname.c_str(), std::ios::binary);
+   if (! fin.good())
+      return 0;
+   std::stringstream contents;
+   contents << fin.rdbuf();
+   fBuffer = contents.str();
+   if (fBuffer.size() < sizeof(cache_magic) ||
+       memcmp(fBuffer.data(), cache_magic, sizeof(cache_magic)) != 0)
+   {
+      G4cerr << "HddsG4Cache::read warning - "
+             << fname << " is not a geometry cache file, ignored." << G4endl;
+      clear();
+      return 0;
+   }
+   fCursor = sizeof(cache_magic);
+   int version = getInt();
+   std::string cachekey = getString();
+   std::string cachemd5 = getString();
+   double size = getDouble();
+   unsigned long long hash;
+   get(&hash, sizeof(hash));
+   if (! fGood || version != fFormatVersion || cachekey != key) {
+      clear();
+      return 0;
+   }
+   fBuffer.erase(0, fCursor);
+   fCursor = 0;
+   if (size != fBuffer.size() ||
+       hash != Hash(fBuffer.data(), fBuffer.size(), 0xcbf29ce484222325ULL))
+   {
+      G4cerr << "HddsG4Cache::read warning - "
+             << "geometry cache " << fname << " is corrupt, ignored."
+             << G4endl;
+      clear();
+      return 0;
+   }
+   md5 = cachemd5;
+   return 1;
+}
@@ -0,0 +1,76 @@
+//
+// HddsG4Cache - class header
+//
+// author: agent at local
+// version: october 18, 2026
+//
+// This class holds the binary record stream that HddsG4Builder uses
+// to cache the translation of a HDDS geometry. Each of the builder
+// create* methods parses its XML element into one flat record, and
+// then constructs the Geant4 objects from that record. Recorded in
+// order, these records are all that is needed to construct the same
+// geometry again without parsing any XML. The cache file stores the
+// records behind a header that carries the cache format version,
+// a key computed from the HDDS source files and the Geant4 version,
+// the md5 checksum of the geometry reported by JANA, and a checksum
+// of the records themselves. A file whose header or checksum does
+// not match is rejected as a whole, before any record is replayed.
+//
+// In the context of the Geant4 event-level multithreading model,
+// this class is "shared", ie. has no thread-local state.
+
+#ifndef _HDDSG4CACHE_
+#define _HDDSG4CACHE_
+
+#include <string>
+#include <vector>
+
+class HddsG4Cache
+{
+ public:
+   HddsG4Cache();
+   ~HddsG4Cache();
+
+   void putInt(int value);
+   void putDouble(double value);
+   void putString(const std::string &value);
+   void putDoubles(const std::vector<double> &values);
+   void putInts(const std::vector<int> &values);
+   void append(const HddsG4Cache &records);
+
+   int getInt();
+   double getDouble();
+   std::string getString();
+   std::vector<double> getDoubles();
+   std::vector<int> getInts();
+
+   bool atEnd() const { return fCursor >= fBuffer.size(); }
+   bool good() const { return fGood; }
+   void clear();
+
+   int write(const std::string &fname, const std::string &key,
+             const std::string &md5) const;
+   int read(const std::string &fname, const std::string &key,
+            std::string &md5);
+
+   static std::string ComputeKey(const std::string &mainfile);
+   static std::string CacheFileName(const std::string &cachedir,
+                                    const std::string &key);
+
+ protected:
+   void get(void *data, size_t size);
+
+   std::string fBuffer;
+   size_t fCursor;
+   bool fGood;
+
+   static unsigned long long Hash(const char *data, size_t size,
+                                  unsigned long long seed);
+   static const int fFormatVersion;
+
+ private:
+   HddsG4Cache(const HddsG4Cache &src);
+   HddsG4Cache &operator=(const HddsG4Cache &src);
+};
+
+#endif
@@ -0,0 +1,578 @@
+//
+// PairConversionAmplitudes class header
+//
+// author: agent at local
+// version: october 18, 2026
+//
+// notes:
+//
+// This class template evaluates the spin-summed squared Feynman
+// amplitudes for lepton pair production by a plane-polarized photon,
+// either in the static field of an atom (2 graphs) or on a free atomic
+// electron (8 graphs, including the exchange of the two final-state
+// electrons). It is the fast path used by PairConversionGeneration
+// in place of the general Dirac++ spinor algebra when it is enabled.
+//
+// The amplitudes are built from explicit Dirac spinors in the Dirac
+// representation, with the arithmetic carried out in the template type
+// Real. Rounding errors in the sum over Feynman graphs come from two
+// sources. The first is the subtraction of nearly-equal four-momenta and
+// invariants for nearly collinear final states. These quantities are
+// formed once from the long double inputs in a numerically stable way
+// before anything is converted to Real, so they cost no precision. The
+// second is cancellation between the graphs themselves. It is measured
+// by the condition number returned with each result, defined as
+//
+//    condition = (k0 / m) sqrt[ sum (|A_1| + |A_2| + ...)^2
+//                               / sum |A_1 + A_2 + ...|^2 ]
+//
+// where the A_i are the individual graphs and the sums run over spins
+// and photon polarization states. The leading factor of photon energy
+// over lepton mass accounts for the cancellations inside each graph
+// between spinor components that grow like sqrt(E/m). The relative
+// rounding error of the result is bounded by about condition times the
+// unit roundoff of Real, which lets the caller decide whether a double
+// result can be trusted, or whether it should be evaluated again in
+// long double. This form of the estimate was calibrated against long
+// double over the full phase space of the beam conversion generator,
+// where it overestimates the largest error by a factor of 1.5 - 2.
+//
+// units:
+// All momenta and masses are in GeV (c=1). The squared amplitudes are
+// returned in natural units, including the factor e^6 = (4 pi alpha)^3
+// for unit charges, and the 1/|q|^4 of the static Coulomb field.
+
+#ifndef PairConversionAmplitudes_h
+#define PairConversionAmplitudes_h 1
+
+#include <complex>
+#include <cmath>
+
+template <typename Real>
+class PairConversionAmplitudes {
+ public:
+   // Spin-summed |M|^2 for gamma(k) + atom -> l+(p1) l-(p2) + atom
+   // in the static Coulomb field of a unit point charge, with the
+   // photon plane polarized along pol with degree poldeg.
+   static Real PairMsqr(const long double k[4],
+                        const long double pol[3], long double poldeg,
+                        const long double p1[4], const long double p2[4],
+                        long double mLepton, Real *condition=0);
+
+   // Spin-summed |M|^2 for gamma(k) + e-(p0) -> l+(p1) l-(p2) e-(p3)
+   // with the target electron at rest, averaged over its spin, and the
+   // photon plane polarized along pol with degree poldeg. If exchange
+   // is true, the pair leptons are electrons and the graphs with p2 and
+   // p3 interchanged are included with the Fermi minus sign.
+   static Real TripletMsqr(const long double k[4],
+                           const long double pol[3], long double poldeg,
+                           const long double p1[4], const long double p2[4],
+                           const long double p3[4],
+                           long double mLepton, long double mTarget,
+                           bool exchange, Real *condition=0);
+
+ protected:
+   typedef std::complex<Real> complex_t;
+   struct spinor_t {
+      complex_t c[4];
+   };
+   struct current_t {
+      complex_t c[4];
+   };
+
+   static long double kdot(const long double k[4], const long double p[4],
+                           long double m);
+   static long double pdot(const long double p1[4], long double m1,
+                           const long double p2[4], long double m2);
+   static void polarizations(const long double k[4],
+                             const long double pol[3], long double poldeg,
+                             Real eps[2][4], Real weight[2]);
+
+   static void u_spinor(const Real p[4], Real m, int s, spinor_t &u);
+   static void v_spinor(const Real p[4], Real m, int s, spinor_t &v);
+   static void slash(const Real a[4], const spinor_t &in, spinor_t &out);
+   static void slash(const current_t &a, const spinor_t &in, spinor_t &out);
+   static void gamma(int mu, const spinor_t &in, spinor_t &out);
+   static void propagate(const Real p[4], Real m, Real denom,
+                         const spinor_t &in, spinor_t &out);
+   static complex_t bar(const spinor_t &a, const spinor_t &b);
+   static complex_t dot(const current_t &a, const current_t &b);
+   static void sandwich(const spinor_t &bra, const Real eps[4],
+                        const Real p[4], Real m, Real denom, bool eps_first,
+                        const spinor_t &ket, current_t &out);
+   static void vector_current(const spinor_t &bra, const spinor_t &ket,
+                              current_t &out);
+};
+
+template <typename Real>
+long double PairConversionAmplitudes<Real>::kdot(const long double k[4],
+                                                 const long double p[4],
+                                                 long double m)
+{
+   // Return k.p for massless k and on-shell p with mass m, avoiding
+   // the cancellation in E - p_par when p is nearly parallel to k.
+
+   long double kmag = sqrt(k[1]*k[1] + k[2]*k[2] + k[3]*k[3]);
+   long double ppar = (k[1]*p[1] + k[2]*p[2] + k[3]*p[3]) / kmag;
+   if (ppar <= 0)
+      return k[0] * (p[0] - ppar);
+   long double cx = (k[2]*p[3] - k[3]*p[2]) / kmag;
+   long double cy = (k[3]*p[1] - k[1]*p[3]) / kmag;
+   long double cz = (k[1]*p[2] - k[2]*p[1]) / kmag;
+   long double pperp2 = cx*cx + cy*cy + cz*cz;
+   return k[0] * (m*m + pperp2) / (p[0] + ppar);
+}
+
+template <typename Real>
+long double PairConversionAmplitudes<Real>::pdot(const long double p1[4],
+                                                 long double m1,
+                                                 const long double p2[4],
+                                                 long double m2)
+{
+   // Return p1.p2 for two on-shell momenta, written as a sum of
+   // non-negative terms so that it keeps full relative precision
+   // when the two momenta are nearly parallel.
+
+   long double a2 = p1[1]*p1[1] + p1[2]*p1[2] + p1[3]*p1[3];
+   long double b2 = p2[1]*p2[1] + p2[2]*p2[2] + p2[3]*p2[3];
+   long double ab = sqrt(a2 * b2);
+   long double e12 = p1[0] * p2[0];
+   long double near = (m1*m1*b2 + m2*m2*a2 + m1*m1*m2*m2) / (e12 + ab);
+   if (ab == 0)
+      return e12;
+   long double c = (p1[1]*p2[1] + p1[2]*p2[2] + p1[3]*p2[3]) / ab;
+   if (c <= 0)
+      return near + ab * (1 - c);
+   long double cx = p1[2]*p2[3] - p1[3]*p2[2];
+   long double cy = p1[3]*p2[1] - p1[1]*p2[3];
+   long double cz = p1[1]*p2[2] - p1[2]*p2[1];
+   return near + (cx*cx + cy*cy + cz*cz) / (ab * (1 + c));
+}
+
+template <typename Real>
+void PairConversionAmplitudes<Real>::polarizations(const long double k[4],
+                                                   const long double pol[3],
+                                                   long double poldeg,
+                                                   Real eps[2][4],
+                                                   Real weight[2])
+{
+   // Construct the two transverse linear polarization vectors, parallel
+   // and perpendicular to the plane of polarization, and the weights
+   // of the corresponding states in the photon spin density matrix.
+
+   long double kmag = sqrt(k[1]*k[1] + k[2]*k[2] + k[3]*k[3]);
+   long double khat[3] = {k[1] / kmag, k[2] / kmag, k[3] / kmag};
+   long double e[3] = {pol[0], pol[1], pol[2]};
+   long double epar = e[0]*khat[0] + e[1]*khat[1] + e[2]*khat[2];
+   for (int i=0; i < 3; ++i)
+      e[i] -= epar * khat[i];
+   long double emag = sqrt(e[0]*e[0] + e[1]*e[1] + e[2]*e[2]);
+   if (emag < 1e-12) {
+      // no plane of polarization given, any transverse axis will do
+      int i = (fabs(khat[0]) < 0.6)? 0 : (fabs(khat[1]) < 0.6)? 1 : 2;
+      long double axis[3] = {0, 0, 0};
+      axis[i] = 1;
+      e[0] = khat[1]*axis[2] - khat[2]*axis[1];
+      e[1] = khat[2]*axis[0] - khat[0]*axis[2];
+      e[2] = khat[0]*axis[1] - khat[1]*axis[0];
+      emag = sqrt(e[0]*e[0] + e[1]*e[1] + e[2]*e[2]);
+      poldeg = 0;
+   }
+   for (int i=0; i < 3; ++i)
+      e[i] /= emag;
+   eps[0][0] = 0;
+   eps[0][1] = e[0];
+   eps[0][2] = e[1];
+   eps[0][3] = e[2];
+   eps[1][0] = 0;
+   eps[1][1] = khat[1]*e[2] - khat[2]*e[1];
+   eps[1][2] = khat[2]*e[0] - khat[0]*e[2];
+   eps[1][3] = khat[0]*e[1] - khat[1]*e[0];
+   poldeg = (poldeg < 0)? 0 : (poldeg > 1)? 1 : poldeg;
+   weight[0] = (1 + poldeg) / 2;
+   weight[1] = (1 - poldeg) / 2;
+}
+
+template <typename Real>
+void PairConversionAmplitudes<Real>::u_spinor(const Real p[4], Real m,
+                                              int s, spinor_t &u)
+{
+   // Positive-energy spinor normalized to ubar u = 2m, with the spin
+   // quantized along z in the rest frame.
+
+   Real n = sqrt(p[0] + m);
+   complex_t up(s == 0, 0);
+   complex_t dn(s == 1, 0);
+   complex_t pplus(p[1], p[2]);
+   complex_t pminus(p[1], -p[2]);
+   u.c[0] = n * up;
+   u.c[1] = n * dn;
+   u.c[2] = (p[3] * up + pminus * dn) / n;
+   u.c[3] = (pplus * up - p[3] * dn) / n;
+}
+
+template <typename Real>
+void PairConversionAmplitudes<Real>::v_spinor(const Real p[4], Real m,
+                                              int s, spinor_t &v)
+{
+   // Negative-energy spinor normalized to vbar v = -2m. Only sums over
+   // spin states are needed, so any orthonormal basis can be used.
+
+   Real n = sqrt(p[0] + m);
+   complex_t up(s == 0, 0);
+   complex_t dn(s == 1, 0);
+   complex_t pplus(p[1], p[2]);
+   complex_t pminus(p[1], -p[2]);
+   v.c[0] = (p[3] * up + pminus * dn) / n;
+   v.c[1] = (pplus * up - p[3] * dn) / n;
+   v.c[2] = n * up;
+   v.c[3] = n * dn;
+}
+
+template <typename Real>
+void PairConversionAmplitudes<Real>::slash(const Real a[4],
+                                           const spinor_t &in,
+                                           spinor_t &out)
+{
+   // out = (a^0 gamma^0 - a.gamma) in, in the Dirac representation
+
+   complex_t aplus(a[1], a[2]);
+   complex_t aminus(a[1], -a[2]);
+   complex_t sl0 = a[3] * in.c[2] + aminus * in.c[3];
+   complex_t sl1 = aplus * in.c[2] - a[3] * in.c[3];
+   complex_t su0 = a[3] * in.c[0] + aminus * in.c[1];
+   complex_t su1 = aplus * in.c[0] - a[3] * in.c[1];
+   out.c[0] = a[0] * in.c[0] - sl0;
+   out.c[1] = a[0] * in.c[1] - sl1;
+   out.c[2] = su0 - a[0] * in.c[2];
+   out.c[3] = su1 - a[0] * in.c[3];
+}
+
+template <typename Real>
+void PairConversionAmplitudes<Real>::slash(const current_t &a,
+                                           const spinor_t &in,
+                                           spinor_t &out)
+{
+   // same as above for a complex four-vector a
+
+   complex_t i(0, 1);
+   complex_t aplus = a.c[1] + i * a.c[2];
+   complex_t aminus = a.c[1] - i * a.c[2];
+   complex_t sl0 = a.c[3] * in.c[2] + aminus * in.c[3];
+   complex_t sl1 = aplus * in.c[2] - a.c[3] * in.c[3];
+   complex_t su0 = a.c[3] * in.c[0] + aminus * in.c[1];
+   complex_t su1 = aplus * in.c[0] - a.c[3] * in.c[1];
+   out.c[0] = a.c[0] * in.c[0] - sl0;
+   out.c[1] = a.c[0] * in.c[1] - sl1;
+   out.c[2] = su0 - a.c[0] * in.c[2];
+   out.c[3] = su1 - a.c[0] * in.c[3];
+}
+
+template <typename Real>
+void PairConversionAmplitudes<Real>::gamma(int mu, const spinor_t &in,
+                                           spinor_t &out)
+{
+   // out = gamma^mu in, with the upper Lorentz index
+
+   complex_t i(0, 1);
+   switch (mu) {
+    case 0:
+      out.c[0] = in.c[0];
+      out.c[1] = in.c[1];
+      out.c[2] = -in.c[2];
+      out.c[3] = -in.c[3];
+      break;
+    case 1:
+      out.c[0] = in.c[3];
+      out.c[1] = in.c[2];
+      out.c[2] = -in.c[1];
+      out.c[3] = -in.c[0];
+      break;
+    case 2:
+      out.c[0] = -i * in.c[3];
+      out.c[1] = i * in.c[2];
+      out.c[2] = i * in.c[1];
+      out.c[3] = -i * in.c[0];
+      break;
+    default:
+      out.c[0] = in.c[2];
+      out.c[1] = -in.c[3];
+      out.c[2] = -in.c[0];
+      out.c[3] = in.c[1];
+   }
+}
+
+template <typename Real>
+void PairConversionAmplitudes<Real>::propagate(const Real p[4], Real m,
+                                               Real denom,
+                                               const spinor_t &in,
+                                               spinor_t &out)
+{
+   // out = (pslash + m) in / denom, where denom = p^2 - m^2 is supplied
+   // by the caller in a form free of cancellations
+
+   slash(p, in, out);
+   for (int i=0; i < 4; ++i)
+      out.c[i] = (out.c[i] + m * in.c[i]) / denom;
+}
+
+template <typename Real>
+typename PairConversionAmplitudes<Real>::complex_t
+PairConversionAmplitudes<Real>::bar(const spinor_t &a, const spinor_t &b)
+{
+   // return abar b = a^dagger gamma^0 b
+
+   return conj(a.c[0]) * b.c[0] + conj(a.c[1]) * b.c[1]
+        - conj(a.c[2]) * b.c[2] - conj(a.c[3]) * b.c[3];
+}
+
+template <typename Real>
+typename PairConversionAmplitudes<Real>::complex_t
+PairConversionAmplitudes<Real>::dot(const current_t &a, const current_t &b)
+{
+   // Minkowski product of two currents with upper indices
+
+   return a.c[0] * b.c[0] - a.c[1] * b.c[1]
+        - a.c[2] * b.c[2] - a.c[3] * b.c[3];
+}
+
+template <typename Real>
+void PairConversionAmplitudes<Real>::sandwich(const spinor_t &bra,
+                                              const Real eps[4],
+                                              const Real p[4], Real m,
+                                              Real denom, bool eps_first,
+                                              const spinor_t &ket,
+                                              current_t &out)
+{
+   // Compute the current out^mu = bra [epsslash S(p) gamma^mu] ket if
+   // eps_first, otherwise bra [gamma^mu S(p) epsslash] ket, where bra
+   // is the spinor (not yet barred) of the outgoing fermion and S(p)
+   // is the fermion propagator with momentum p.
+
+   spinor_t s1, s2, s3;
+   if (eps_first) {
+      // For real eps and p, bra-bar epsslash (pslash + m) is the adjoint
+      // of (pslash + m) epsslash bra, so the propagator can be applied to
+      // the bra once instead of to gamma^mu ket for every mu.
+      slash(eps, bra, s1);
+      propagate(p, m, denom, s1, s2);
+      for (int mu=0; mu < 4; ++mu) {
+         gamma(mu, ket, s3);
+         out.c[mu] = bar(s2, s3);
+      }
+   }
+   else {
+      slash(eps, ket, s1);
+      propagate(p, m, denom, s1, s2);
+      for (int mu=0; mu < 4; ++mu) {
+         gamma(mu, s2, s3);
+         out.c[mu] = bar(bra, s3);
+      }
+   }
+}
+
+template <typename Real>
+void PairConversionAmplitudes<Real>::vector_current(const spinor_t &bra,
+                                                    const spinor_t &ket,
+                                                    current_t &out)
+{
+   // out^mu = bra-bar gamma^mu ket
+
+   spinor_t s;
+   for (int mu=0; mu < 4; ++mu) {
+      gamma(mu, ket, s);
+      out.c[mu] = bar(bra, s);
+   }
+}
+
+template <typename Real>
+Real PairConversionAmplitudes<Real>::PairMsqr(const long double k[4],
+                                              const long double pol[3],
+                                              long double poldeg,
+                                              const long double p1[4],
+                                              const long double p2[4],
+                                              long double mLepton,
+                                              Real *condition)
+{
+   // The lepton line runs from v(p1) to ubar(p2), with the photon and
+   // the Coulomb field attached in either order. The field supplies
+   // the momentum -q = p1 + p2 - k to the line.
+
+   long double q2 = 0;
+   Real rp1[4], rp2[4], p2k[4], kp1[4];
+   for (int i=0; i < 4; ++i) {
+      rp1[i] = p1[i];
+      rp2[i] = p2[i];
+      p2k[i] = p2[i] - k[i];
+      kp1[i] = k[i] - p1[i];
+      if (i > 0)
+         q2 += (k[i] - p1[i] - p2[i]) * (k[i] - p1[i] - p2[i]);
+   }
+   Real m = mLepton;
+   Real D1 = -2 * kdot(k, p2, mLepton);
+   Real D2 = -2 * kdot(k, p1, mLepton);
+   Real eps[2][4];
+   Real weight[2];
+   polarizations(k, pol, poldeg, eps, weight);
+
+   spinor_t v1[2], u2[2];
+   for (int s=0; s < 2; ++s) {
+      v_spinor(rp1, m, s, v1[s]);
+      u_spinor(rp2, m, s, u2[s]);
+   }
+   Real sum = 0;
+   Real sumabs = 0;
+   for (int j=0; j < 2; ++j) {
+      if (weight[j] == 0)
+         continue;
+      for (int s1=0; s1 < 2; ++s1) {
+         spinor_t a, b, c;
+         slash(eps[j], v1[s1], a);
+         propagate(kp1, m, D2, a, b);
+         gamma(0, b, c);
+         spinor_t g0v1;
+         gamma(0, v1[s1], g0v1);
+         for (int s2=0; s2 < 2; ++s2) {
+            complex_t A2 = bar(u2[s2], c);
+            slash(eps[j], u2[s2], a);
+            propagate(p2k, m, D1, a, b);
+            complex_t A1 = bar(b, g0v1);
+            sum += weight[j] * norm(A1 + A2);
+            sumabs += weight[j] * pow(abs(A1) + abs(A2), 2);
+         }
+      }
+   }
+   if (condition)
+      *condition = (k[0] / mLepton) * sqrt((sum > 0)? sumabs / sum : 1);
+   const long double e2 = 4 * M_PI / 137.035999084;
+   return sum * (e2 * e2 * e2 / (q2 * q2));
+}
+
+template <typename Real>
+Real PairConversionAmplitudes<Real>::TripletMsqr(const long double k[4],
+                                                 const long double pol[3],
+                                                 long double poldeg,
+                                                 const long double p1[4],
+                                                 const long double p2[4],
+                                                 const long double p3[4],
+                                                 long double mLepton,
+                                                 long double mTarget,
+                                                 bool exchange,
+                                                 Real *condition)
+{
+   // There are two classes of graphs, each with two time orderings.
+   // In the Bethe-Heitler graphs (A) the photon attaches to the pair
+   // line v(p1) -> ubar(p2), which exchanges a virtual photon of
+   // momentum p0 - p3 with the target line u(p0) -> ubar(p3). In the
+   // Compton graphs (B) the photon attaches to the target line, which
+   // emits the virtual photon p1 + p2 that creates the pair. With
+   // exchange, the same graphs with p2 and p3 interchanged enter with
+   // the opposite sign.
+
+   const long double p0[4] = {mTarget, 0, 0, 0};
+   Real rp0[4], rp1[4], rp2[4], rp3[4];
+   Real p2k[4], kp1[4], p0k[4], p3k[4];
+   for (int i=0; i < 4; ++i) {
+      rp0[i] = p0[i];
+      rp1[i] = p1[i];
+      rp2[i] = p2[i];
+      rp3[i] = p3[i];
+      p2k[i] = p2[i] - k[i];
+      kp1[i] = k[i] - p1[i];
+      p0k[i] = p0[i] + k[i];
+      p3k[i] = p3[i] - k[i];
+   }
+   long double p2sqr = p2[1]*p2[1] + p2[2]*p2[2] + p2[3]*p2[3];
+   long double p3sqr = p3[1]*p3[1] + p3[2]*p3[2] + p3[3]*p3[3];
+   long double m2 = mLepton * mLepton;
+   Real m = mLepton;
+   Real mT = mTarget;
+   Real DA1 = -2 * kdot(k, p2, mLepton);
+   Real DA2 = -2 * kdot(k, p1, mLepton);
+   Real DB1 = 2 * mTarget * k[0];
+   Real DB2 = -2 * kdot(k, p3, mTarget);
+   Real Q2 = -2 * mTarget * p3sqr / (p3[0] + mTarget);
+   Real P2 = 2 * m2 + 2 * pdot(p1, mLepton, p2, mLepton);
+   Real Q2x = -2 * mTarget * p2sqr / (p2[0] + mTarget);
+   Real P2x = 2 * m2 + 2 * pdot(p1, mLepton, p3, mLepton);
+   Real eps[2][4];
+   Real weight[2];
+   polarizations(k, pol, poldeg, eps, weight);
+
+   spinor_t u0[2], v1[2], u2[2], u3[2];
+   for (int s=0; s < 2; ++s) {
+      u_spinor(rp0, mT, s, u0[s]);
+      v_spinor(rp1, m, s, v1[s]);
+      u_spinor(rp2, m, s, u2[s]);
+      u_spinor(rp3, mT, s, u3[s]);
+   }
+   current_t J[2][2], jpair[2][2], Jx[2][2], jx[2][2];
+   for (int s=0; s < 2; ++s) {
+      for (int t=0; t < 2; ++t) {
+         vector_current(u3[s], u0[t], J[s][t]);
+         vector_current(u2[s], v1[t], jpair[s][t]);
+         if (exchange) {
+            vector_current(u2[s], u0[t], Jx[s][t]);
+            vector_current(u3[s], v1[t], jx[s][t]);
+         }
+      }
+   }
+
+   Real sum = 0;
+   Real sumabs = 0;
+   for (int j=0; j < 2; ++j) {
+      if (weight[j] == 0)
+         continue;
+      current_t LA1[2][2], LA2[2][2], TB1[2][2], TB2[2][2];
+      current_t LA1x[2][2], LA2x[2][2], TB1x[2][2], TB2x[2][2];
+      for (int s=0; s < 2; ++s) {
+         for (int t=0; t < 2; ++t) {
+            sandwich(u2[s], eps[j], p2k, m, DA1, true, v1[t], LA1[s][t]);
+            sandwich(u2[s], eps[j], kp1, m, DA2, false, v1[t], LA2[s][t]);
+            sandwich(u3[s], eps[j], p0k, mT, DB1, false, u0[t], TB1[s][t]);
+            sandwich(u3[s], eps[j], p3k, mT, DB2, true, u0[t], TB2[s][t]);
+            if (exchange) {
+               sandwich(u3[s], eps[j], p3k, m, DB2, true, v1[t], LA1x[s][t]);
+               sandwich(u3[s], eps[j], kp1, m, DA2, false, v1[t], LA2x[s][t]);
+               sandwich(u2[s], eps[j], p0k, mT, DB1, false, u0[t], TB1x[s][t]);
+               sandwich(u2[s], eps[j], p2k, mT, DA1, true, u0[t], TB2x[s][t]);
+            }
+         }
+      }
+      for (int s0=0; s0 < 2; ++s0) {
+         for (int s1=0; s1 < 2; ++s1) {
+            for (int s2=0; s2 < 2; ++s2) {
+               for (int s3=0; s3 < 2; ++s3) {
+                  complex_t A[8];
+                  A[0] = dot(LA1[s2][s1], J[s3][s0]) / Q2;
+                  A[1] = dot(LA2[s2][s1], J[s3][s0]) / Q2;
+                  A[2] = dot(jpair[s2][s1], TB1[s3][s0]) / P2;
+                  A[3] = dot(jpair[s2][s1], TB2[s3][s0]) / P2;
+                  int ngraphs = 4;
+                  if (exchange) {
+                     A[4] = -dot(LA1x[s3][s1], Jx[s2][s0]) / Q2x;
+                     A[5] = -dot(LA2x[s3][s1], Jx[s2][s0]) / Q2x;
+                     A[6] = -dot(jx[s3][s1], TB1x[s2][s0]) / P2x;
+                     A[7] = -dot(jx[s3][s1], TB2x[s2][s0]) / P2x;
+                     ngraphs = 8;
+                  }
+                  complex_t Asum = 0;
+                  Real Aabs = 0;
+                  for (int g=0; g < ngraphs; ++g) {
+                     Asum += A[g];
+                     Aabs += abs(A[g]);
+                  }
+                  sum += weight[j] * norm(Asum);
+                  sumabs += weight[j] * Aabs * Aabs;
+               }
+            }
+         }
+      }
+   }
+   if (condition)
+      *condition = (k[0] / mLepton) * sqrt((sum > 0)? sumabs / sum : 1);
+   const long double e2 = 4 * M_PI / 137.035999084;
+   return sum * (e2 * e2 * e2 / 2);
+}
+
+#endif
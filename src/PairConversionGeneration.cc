@@ -23,6 +23,16 @@
 //    Extended precision is needed to keep rounding errors in the sum over
 //    cancelling Feynman amplitudes from producing excessive rounding
 //    errors in the computation of the differential cross section.
+// 3. If the fast path is enabled, the forms of DiffXS_pair/triplet that
+//    take the photon polarization explicitly evaluate the same amplitudes
+//    with PairConversionAmplitudes in double precision instead, which is
+//    many times faster than the x87 arithmetic. Each double result comes
+//    with an estimate of its relative rounding error, and any point where
+//    it exceeds fFastPathTolerance is evaluated again by the same template
+//    in long double. The fast path returns the same differential cross
+//    sections as Dirac++, in the same units, so the two can be exchanged
+//    freely. The pairxs utility compares them over the phase space used
+//    by the generator.
 //
 // units:
 // Any length is in m; energy,momentum,mass in GeV (c=1); angles in
@@ -32,6 +42,7 @@
 #define BOOST_PYTHON_WRAPPING 1
 
 #include <PairConversionGeneration.hh>
+#include <PairConversionAmplitudes.hh>
 
 #include "Complex.h"
 #include "TCrossSection.h"
@@ -40,6 +51,7 @@
 #include "G4ios.hh"
 
 #include <iostream>
+#include <cfloat>
 
 inline unsigned int sqr(unsigned int x) { return x*x; }
 inline Int_t sqr(Int_t x) { return x*x; }
@@ -58,6 +70,10 @@ const TThreeVectorReal negZhat(0,0,-1);
 PairConversionGeneration::PairConversionGeneration(std::vector<double> Z,
                                                    std::vector<double> A,
                                                    std::vector<double> w)
+ : fFastPath(false),
+   fFastPathTolerance(1e-7),
+   fFastPathCount(0),
+   fFallbackCount(0)
 {
    if (Z.size() == 1) {
        fConverterZ = Z[0];
@@ -74,6 +90,16 @@ PairConversionGeneration::PairConversionGeneration(std::vector<double> Z,
 PairConversionGeneration::~PairConversionGeneration()
 {}
 
+void PairConversionGeneration::SetFastPath(bool enable, double tolerance)
+{
+   // Enable or disable evaluation of the cross sections in double
+   // precision, with tolerance the largest estimated relative rounding
+   // error that is accepted before a point is redone in long double.
+
+   fFastPath = enable;
+   fFastPathTolerance = tolerance;
+}
+
 LDouble_t PairConversionGeneration::FFatomic(LDouble_t qRecoil)
 {
    // return the atomic form factor of the pair converter
@@ -131,6 +157,7 @@ LDouble_t PairConversionGeneration::DiffXS_pair(const TPhoton &gIn,
    // depends on the crystal structure of the target atom, and so is left to
    // be carried out by more specialized code.  Units are barns/GeV^4.
 
+   TFourVectorReal qR(gIn.Mom() - eOut.Mom() - pOut.Mom());
    TPhoton g0(gIn);
    TLepton p1(pOut);
    TLepton e2(eOut);
@@ -141,7 +168,6 @@ LDouble_t PairConversionGeneration::DiffXS_pair(const TPhoton &gIn,
 
    // Multiply the basic cross section by the converter atomic form factor
    LDouble_t result = TCrossSection::PairProduction(g0, e2, p1);
-   TFourVectorReal qR(gIn.Mom() - eOut.Mom() - pOut.Mom());
    result *= sqr(fConverterZ * (1 - FFatomic(qR.Length())));
    return result * 1e-6;
 
@@ -188,17 +214,20 @@ LDouble_t PairConversionGeneration::DiffXS_triplet(const TPhoton &gIn,
    // fConverterZ electrons per atom, differential in
    //    (d^3 qR dphi+ dE+) = (M / 2 kin) (dM dqR^2 dphiR dphi+ dE+).
 
+   // Avoid double-counting due to identical fs electrons by requiring
+   // that e3 (recoil e-) have a lower momentum magnitude than e2.
+   if (eOut2.Mass() == eOut3.Mass() &&
+       eOut3.Mom().Length() > eOut2.Mom().Length())
+   {
+      return 0;
+   }
+
    TPhoton g0(gIn);
    TLepton e0(zeroVector, mElectron);
    TLepton p1(pOut);
    TLepton e2(eOut2);
    TLepton e3(eOut3);
 
-   // Avoid double-counting due to identical fs electrons by requiring
-   // that e3 (recoil e-) have a lower momentum magnitude than e2.
-   if (e2.Mass() == e3.Mass() && e3.Mom().Length() > e2.Mom().Length())
-      return 0;
-
    // Set the initial,final polarizations
    e0.SetPol(zeroVector);
    p1.AllPol();
@@ -211,4 +240,112 @@ LDouble_t PairConversionGeneration::DiffXS_triplet(const TPhoton &gIn,
    return result * 1e-6;
 }
 
+LDouble_t PairConversionGeneration::DiffXS_pair(const TPhoton &gIn,
+                                                const TThreeVectorReal &pol,
+                                                LDouble_t degree,
+                                                const TLepton &pOut,
+                                                const TLepton &eOut)
+{
+   // Same as DiffXS_pair(gIn, pOut, eOut), but with the plane of linear
+   // polarization of gIn and its degree given explicitly, with the same
+   // meaning as the arguments to TPhoton::SetPlanePolarization. Whatever
+   // polarization is set in gIn itself is ignored. The cross section is
+   // evaluated by the fast path if it is enabled, otherwise by Dirac++.
+
+   if (!fFastPath) {
+      TPhoton g0(gIn);
+      g0.SetPlanePolarization(pol, degree);
+      return DiffXS_pair(g0, pOut, eOut);
+   }
+
+   long double k[4], q1[4], q2[4], K[3], pol3[3];
+   for (int i=0; i < 4; ++i) {
+      k[i] = gIn.Mom()[i];
+      q1[i] = pOut.Mom()[i];
+      q2[i] = eOut.Mom()[i];
+      if (i > 0) {
+         K[i-1] = q1[i] + q2[i];
+         pol3[i-1] = pol[i];
+      }
+   }
+   LDouble_t mLepton = eOut.Mass();
+   double condition;
+   LDouble_t Msqr = PairConversionAmplitudes<double>::PairMsqr(k,
+                    pol3, degree, q1, q2, mLepton, &condition);
+   ++fFastPathCount;
+   if (condition * DBL_EPSILON > fFastPathTolerance) {
+      Msqr = PairConversionAmplitudes<long double>::PairMsqr(k,
+             pol3, degree, q1, q2, mLepton);
+      ++fFallbackCount;
+   }
+
+   // Phase space factor for d(sigma)/(dE dphi d^3q), where the polar
+   // angle of the lepton about the pair momentum K is fixed by energy
+   // conservation, converted to the Dirac++ units of microbarns/GeV^4
+   TFourVectorReal qR(gIn.Mom() - eOut.Mom() - pOut.Mom());
+   LDouble_t Kmag = sqrt(K[0]*K[0] + K[1]*K[1] + K[2]*K[2]);
+   LDouble_t result = Msqr * hbarcSqr /
+                      (8 * k[0] * Kmag * pow(2 * M_PI, 5));
+   result *= sqr(fConverterZ * (1 - FFatomic(qR.Length())));
+   return result * 1e-6;
+}
+
+LDouble_t PairConversionGeneration::DiffXS_triplet(const TPhoton &gIn,
+                                                   const TThreeVectorReal &pol,
+                                                   LDouble_t degree,
+                                                   const TLepton &pOut,
+                                                   const TLepton &eOut2,
+                                                   const TLepton &eOut3)
+{
+   // Same as DiffXS_triplet(gIn, pOut, eOut2, eOut3), but with the
+   // polarization of gIn given explicitly, as for DiffXS_pair above.
+
+   if (!fFastPath) {
+      TPhoton g0(gIn);
+      g0.SetPlanePolarization(pol, degree);
+      return DiffXS_triplet(g0, pOut, eOut2, eOut3);
+   }
+
+   // Avoid double-counting due to identical fs electrons, as above
+   if (eOut2.Mass() == eOut3.Mass() &&
+       eOut3.Mom().Length() > eOut2.Mom().Length())
+   {
+      return 0;
+   }
+
+   long double k[4], q1[4], q2[4], q3[4], K[3], pol3[3];
+   for (int i=0; i < 4; ++i) {
+      k[i] = gIn.Mom()[i];
+      q1[i] = pOut.Mom()[i];
+      q2[i] = eOut2.Mom()[i];
+      q3[i] = eOut3.Mom()[i];
+      if (i > 0) {
+         K[i-1] = q1[i] + q2[i];
+         pol3[i-1] = pol[i];
+      }
+   }
+   LDouble_t mLepton = eOut2.Mass();
+   bool exchange = (eOut2.Mass() == eOut3.Mass());
+   double condition;
+   LDouble_t Msqr = PairConversionAmplitudes<double>::TripletMsqr(k,
+                    pol3, degree, q1, q2, q3,
+                    mLepton, mElectron, exchange, &condition);
+   ++fFastPathCount;
+   if (condition * DBL_EPSILON > fFastPathTolerance) {
+      Msqr = PairConversionAmplitudes<long double>::TripletMsqr(k,
+             pol3, degree, q1, q2, q3,
+             mLepton, mElectron, exchange);
+      ++fFallbackCount;
+   }
+
+   // Phase space factor for d(sigma)/(d^3qR dphi+ dE+), as above
+   // but with the recoil electron carrying away energy E3
+   LDouble_t Kmag = sqrt(K[0]*K[0] + K[1]*K[1] + K[2]*K[2]);
+   LDouble_t result = Msqr * hbarcSqr /
+                      (32 * k[0] * mElectron * q3[0] * Kmag *
+                       pow(2 * M_PI, 5));
+   result *= fConverterZ * (1 - sqr(FFatomic(eOut3.Mom().Length())));
+   return result * 1e-6;
+}
+
 #endif
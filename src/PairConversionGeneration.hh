@@ -21,6 +21,17 @@
 //    Extended precision is needed to keep rounding errors in the sum over
 //    cancelling Feynman amplitudes from producing excessive rounding
 //    errors in the computation of the differential cross section.
+// 3. As an alternative to Dirac++, the same cross sections can be computed
+//    by the fast path in PairConversionAmplitudes.hh, which does the spinor
+//    algebra in double precision and falls back to long double only for
+//    the points where its own estimate of the rounding error exceeds a
+//    tolerance set by the user. The fallback is the same template code
+//    evaluated at higher precision, not an independent calculation, so
+//    Dirac++ remains the reference for the fast path. It is enabled with
+//    SetFastPath(), and taken only by the forms of DiffXS_pair and
+//    DiffXS_triplet that receive the photon polarization explicitly,
+//    because it cannot read the polarization back out of a TPhoton. The
+//    forms without it always evaluate the cross section with Dirac++.
 //
 // units:
 // Any length is in m; energy,momentum,mass in GeV (c=1); angles in
@@ -51,14 +62,31 @@ class PairConversionGeneration {
                          const TLepton &pOut, const TLepton &eOut);
    LDouble_t DiffXS_triplet(const TPhoton &gIn, const TLepton &pOut,
                             const TLepton &eOut2, const TLepton &eOut3);
+   LDouble_t DiffXS_pair(const TPhoton &gIn,
+                         const TThreeVectorReal &pol, LDouble_t degree,
+                         const TLepton &pOut, const TLepton &eOut);
+   LDouble_t DiffXS_triplet(const TPhoton &gIn,
+                            const TThreeVectorReal &pol, LDouble_t degree,
+                            const TLepton &pOut, const TLepton &eOut2,
+                            const TLepton &eOut3);
 
    const TThreeVectorReal &GetPolarization();
    unsigned int GetConverterZ();
    void SetConverterZ(unsigned int Z);
 
+   void SetFastPath(bool enable, double tolerance=1e-7);
+   bool GetFastPath() const;
+   long int GetFastPathCount() const;
+   long int GetFallbackCount() const;
+
  protected:
    unsigned int fConverterZ;  // atomic number of converter material
 
+   bool fFastPath;            // use PairConversionAmplitudes, not Dirac++
+   double fFastPathTolerance; // max relative rounding error in double
+   long int fFastPathCount;   // number of points evaluated in double
+   long int fFallbackCount;   // number of points redone in long double
+
  private:
    PairConversionGeneration(const PairConversionGeneration &src);
    PairConversionGeneration &operator=(const PairConversionGeneration &src);
@@ -74,5 +102,20 @@ inline void PairConversionGeneration::SetConverterZ(unsigned int Z)
    fConverterZ = Z;
 }
 
+inline bool PairConversionGeneration::GetFastPath() const
+{
+   return fFastPath;
+}
+
+inline long int PairConversionGeneration::GetFastPathCount() const
+{
+   return fFastPathCount;
+}
+
+inline long int PairConversionGeneration::GetFallbackCount() const
+{
+   return fFallbackCount;
+}
+
 #endif
 #endif
@@ -12,6 +12,8 @@
 #include <GlueXPrimaryGeneratorAction.hh>
 #include <GlueXPhysicsList.hh>
 #include <GlueXTimer.hh>
+#include <GlueXVoxelTuning.hh>
+#include <GlueXOverlapCheck.hh>
 #include <HddmOutput.hh>
 #include <Randomize.hh>
 
@@ -183,6 +185,14 @@ int main(int argc,char** argv)
    }
    runManager.SetUserInitialization(geometry);
 
+   // Standalone geometry validation (GEOMCHECK), check all placements
+   // for overlaps using the -t worker threads, and exit without
+   // running any events
+   if (GlueXOverlapCheck::Requested()) {
+      int noverlaps = GlueXOverlapCheck::Run(worker_threads);
+      exit((noverlaps > 0)? 1 : 0);
+   }
+
 #if G4VERSION_NUMBER >= 1030
 # if REDUCE_OPTIMIZATION_OF_CDC
    // Save some time at startup by reducing the level
@@ -195,6 +205,10 @@ int main(int argc,char** argv)
 # endif
 #endif
 
+   // Profile navigation per logical volume (GEOMPROFILE), or else apply
+   // the voxel tuning file written by an earlier profiling run
+   GlueXVoxelTuning::Configure();
+
    // Physics process initialization
    GlueXPhysicsList *physicslist = new GlueXPhysicsList();
    runManager.SetUserInitialization(physicslist);
@@ -5,7 +5,13 @@
 //         AdaptiverSampler::restoreState() can read the output
 //         file generated by adapt and see improvements in its
 //         sampling efficiency, provided that the distribution
-//         being sampled has not changed.
+//         being sampled has not changed. Input files may be
+//         in either the text or the binary state format, and
+//         the output is written in the format selected by -b.
+//         With -j the input files are read, and the tree is
+//         adapted, using several threads. The input statistics
+//         are always summed in the order the files are listed,
+//         so the output does not depend on the thread count.
 //
 // author: richard.t.jones at uconn.edu
 // version: february 23, 2016
@@ -15,6 +21,9 @@
 #include <iostream>
 #include <string>
 #include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <thread>
 
 #include "AdaptiveSampler.hh"
 
@@ -30,20 +39,81 @@ void usage() {
              << "     -t <threshold> : sampling threshold (%) [100]" << std::endl
              << "     -v <verbosity> : verbosity level [3]" << std::endl
              << "     -c <count> : internal generator check [0]" << std::endl
-             << "     -s : just report statistics, no optimization" << std::endl;
+             << "     -s : just report statistics, no optimization" << std::endl
+             << "     -b : write output in binary state format" << std::endl
+             << "     -j <threads> : number of threads to use [1]" << std::endl;
    exit(1);
 }
 
+AdaptiveSampler *load_states(const std::vector<std::string> &infiles,
+                             int nthreads)
+{
+   // Read the input files in groups of nthreads in parallel, each into
+   // its own sampler, then add them into the result one by one in the
+   // order they were listed, so that the sums come out exactly the same
+   // as when the files are merged serially. Files whose tree differs
+   // from the accumulated result are merged again from disk with
+   // mergeState, which knows how to combine different trees.
+
+   int Ndim;
+   int Nfixed;
+   if (!AdaptiveSampler::getStateDimensions(infiles[0], Ndim, Nfixed)) {
+      std::cerr << "adapt - error reading input file "
+                << infiles[0] << std::endl;
+      usage();
+   }
+   AdaptiveSampler *sampler = 0;
+   for (unsigned int first=0; first < infiles.size(); first += nthreads) {
+      unsigned int last = first + nthreads;
+      last = (last < infiles.size())? last : infiles.size();
+      std::vector<AdaptiveSampler*> parts(last - first);
+      std::vector<int> loaded(last - first);
+      std::vector<std::thread> threads;
+      for (unsigned int i=first; i < last; ++i) {
+         parts[i - first] = new AdaptiveSampler(Ndim, my_randoms, Nfixed);
+         threads.push_back(std::thread([&parts, &loaded, &infiles, first, i]() {
+            loaded[i - first] = parts[i - first]->mergeState(infiles[i]);
+         }));
+      }
+      for (unsigned int i=0; i < threads.size(); ++i)
+         threads[i].join();
+      for (unsigned int i=first; i < last; ++i) {
+         AdaptiveSampler *part = parts[i - first];
+         if (sampler == 0) {
+            sampler = part;
+            continue;
+         }
+         else if (loaded[i - first] && sampler->mergeStats(*part)) {
+            // mergeState takes the adaptation parameters from the file
+            sampler->setAdaptation_sampling_threshold(
+                     part->getAdaptation_sampling_threshold());
+            sampler->setAdaptation_efficiency_target(
+                     part->getAdaptation_efficiency_target());
+            sampler->setAdaptation_maximum_depth(
+                     part->getAdaptation_maximum_depth());
+            sampler->setAdaptation_maximum_cells(
+                     part->getAdaptation_maximum_cells());
+         }
+         else if (loaded[i - first]) {
+            sampler->mergeState(infiles[i]);
+         }
+         delete part;
+      }
+   }
+   return sampler;
+}
+
 int main(int argc, char **argv)
 {
    int Ndim=0;
-   int Nfixed=0;
    int do_optimization=1;
+   int nthreads=1;
+   AdaptiveSampler::state_format_t output_format=AdaptiveSampler::TEXT_FORMAT;
    double threshold=1;
    int verbosity_level=1;
    long int internal_check_count = 0;
    std::string outfile("adapted.astate");
-   AdaptiveSampler *sampler = 0;
+   std::vector<std::string> infiles;
    for (int iarg=1; iarg < argc; ++iarg) {
       char stropt[999] = "";
       int opt;
@@ -74,39 +144,34 @@ int main(int argc, char **argv)
             sscanf(argv[++iarg], "%ld", &internal_check_count);
          continue;
       }
+      else if ((opt = sscanf(argv[iarg], "-j %d", &nthreads))) {
+         if (opt == EOF)
+            sscanf(argv[++iarg], "%d", &nthreads);
+         if (nthreads > 0)
+            continue;
+         else
+            usage();
+      }
       else if (strncmp(argv[iarg], "-s", 2) == 0) {
          do_optimization = 0;
          continue;
       }
+      else if (strncmp(argv[iarg], "-b", 2) == 0) {
+         output_format = AdaptiveSampler::BINARY_FORMAT;
+         continue;
+      }
       else if (argv[iarg][0] == '-') {
          usage();
       }
-      else if (Ndim == 0) {
-         FILE *fin = fopen(argv[iarg], "r");
-         if (fin) {
-            if (fscanf(fin, "fNdim=%d\n", &Ndim) == 0) {
-               std::cerr << "adapt - invalid data in input file "
-                         << argv[iarg] << std::endl;
-               usage();
-            }
-            else if (fscanf(fin, "fNfixed=%d\n", &Nfixed) == 0) {
-               std::cerr << "adapt - invalid data in input file "
-                         << argv[iarg] << std::endl;
-               usage();
-            }
-            sampler = new AdaptiveSampler(Ndim, my_randoms, Nfixed);
-         }
-         else {
-            std::cerr << "adapt - error opening input file "
-                      << argv[iarg] << std::endl;
-            usage();
-         }
-      }
-      //std::cout << "reading from " << argv[iarg] << std::endl;
-      sampler->mergeState(argv[iarg]);
+      infiles.push_back(argv[iarg]);
    }
+   if (infiles.size() == 0)
+      usage();
+   AdaptiveSampler *sampler = load_states(infiles, nthreads);
    if (sampler == 0 || sampler->getNdim() == 0)
       usage();
+   Ndim = sampler->getNdim();
+   sampler->setAdaptation_threads(nthreads);
 
    if (internal_check_count > 0) {
       sampler->reset_stats();
@@ -189,7 +254,7 @@ int main(int argc, char **argv)
                    << std::endl;
    }
 
-   sampler->saveState(outfile, do_optimization);
+   sampler->saveState(outfile, do_optimization, output_format);
    if (verbosity_level > 2)
       sampler->display_tree(do_optimization);
    return (Na == 0);
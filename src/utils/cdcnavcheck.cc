@@ -0,0 +1,437 @@
+//
+// cdcnavcheck.cc : validation of the analytic CDC straw navigation
+//
+// author: agent at local
+// version: october 18, 2026
+//
+// usage: cdcnavcheck [options]
+//   where options may include any of the following
+//      -n <#> : number of random points to test, default 20000
+//      -L <val> : maximum proposed step length (mm), default 50
+//      -T <val> : tolerance on step length differences (mm), default 1e-6
+//      -r <val> : set initial random number seed to val
+//      -v : print every point where the two navigations disagree
+//
+// notes:
+//  1) A straw chamber modeled on the GlueX CDC is built in memory:
+//     28 rings of STRA/STLA straws of 7.8 mm radius and 1.5 m length,
+//     placed as individual G4PVPlacement daughters of a gas volume
+//     the way HddsG4Builder places them, with rings 5-12 and 17-24
+//     tilted at stereo angles of +-6 degrees and all other rings axial.
+//     The rings are packed as tightly as they can be without overlaps.
+//
+//  2) Two navigators are set up on the closed geometry, one with the
+//     standard G4VoxelNavigation and one with GlueXCDCNavigation in its
+//     place. At each random point (uniform over the volume of the gas)
+//     with a random isotropic direction and a random proposed step, both
+//     are asked to locate the point, compute the step, and relocate at
+//     the end of the step, and the volumes and step lengths they return
+//     are compared.
+//
+//  3) At the same points, the candidate straws returned by
+//     GlueXCDCNavigation::CollectCandidates are checked by brute force
+//     against every straw in the chamber, for each of the three kinds of
+//     query made by the navigation: straws that contain the point, straws
+//     within the safety margin of the point, and straws that intersect
+//     the step segment or come within the safety margin of points
+//     spaced 0.5 mm apart along it. Any straw of these that is missing from the candidates
+//     is counted as a miss. The number of candidates per segment query
+//     and the time taken by each navigator are reported at the end.
+//
+//  4) The exit status is 0 if no disagreements or misses were found.
+//
+
+#include <GlueXCDCNavigation.hh>
+
+#include <G4Version.hh>
+#include <G4Box.hh>
+#include <G4Tubs.hh>
+#include <G4LogicalVolume.hh>
+#include <G4PVPlacement.hh>
+#include <G4Transform3D.hh>
+#include <G4NistManager.hh>
+#include <G4Navigator.hh>
+#include <G4GeometryManager.hh>
+#include <G4RandomDirection.hh>
+#include <G4SystemOfUnits.hh>
+#include <G4PhysicalConstants.hh>
+#include <Randomize.hh>
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <string.h>
+#include <stdlib.h>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+
+int npoints(20000);
+double maxstep(50*mm);
+double tolerance(1e-6*mm);
+int seedVal(1);
+int verbose(0);
+
+const int nrings = 28;
+const double rstraw = 7.8*mm;
+const double zhalf = 750*mm;
+const double stereo = 6*deg;
+
+void usage()
+{
+   std::cout <<
+      "Usage: cdcnavcheck [options]\n"
+      "  where options may include any of the following\n"
+      "     -n <#> : number of random points to test, default 20000\n"
+      "     -L <val> : maximum proposed step length (mm), default 50\n"
+      "     -T <val> : tolerance on step length differences (mm), "
+      "default 1e-6\n"
+      "     -r <val> : set initial random number seed to val\n"
+      "     -v : print every point where the two navigations disagree\n"
+      << std::endl;
+   exit(1);
+}
+
+class CDCNavigationProbe : public GlueXCDCNavigation
+{
+   // Gives access to the straw ring tables that GlueXCDCNavigation
+   // builds for itself when it is constructed.
+
+ public:
+   static const straw_mother_t *GetMother(const G4LogicalVolume *logvol) {
+      return GetStrawMother(logvol);
+   }
+   static double GetSafetyMargin() {
+      return fSafetyMargin;
+   }
+};
+
+G4VPhysicalVolume *build_chamber(G4LogicalVolume *&gasLogical, int &nstraws)
+{
+   // Build the straw chamber inside a world box, and return the world.
+   // The ring radii and straw counts are chosen to pack the rings as
+   // closely as possible while leaving 5% clearance between straws.
+
+   G4NistManager *nist = G4NistManager::Instance();
+   G4Material *vacuum = nist->FindOrBuildMaterial("G4_Galactic");
+   G4Material *gas = nist->FindOrBuildMaterial("G4_CARBON_DIOXIDE");
+   G4Material *argon = nist->FindOrBuildMaterial("G4_Ar");
+
+   std::vector<double> radius(nrings);
+   std::vector<double> tilt(nrings);
+   std::vector<int> count(nrings);
+   double rlast = 10*cm - 2.1 * rstraw;
+   for (int r=0; r < nrings; ++r) {
+      int ring = r + 1;
+      tilt[r] = 0;
+      if (ring >= 5 && ring <= 8)
+         tilt[r] = stereo;
+      else if (ring >= 9 && ring <= 12)
+         tilt[r] = -stereo;
+      else if (ring >= 17 && ring <= 20)
+         tilt[r] = -stereo;
+      else if (ring >= 21 && ring <= 24)
+         tilt[r] = stereo;
+      radius[r] = rlast + 2.1 * rstraw;
+      count[r] = (int)(twopi * radius[r] * cos(tilt[r]) / (2.1 * rstraw));
+      double zt = zhalf * tan(tilt[r]);
+      rlast = sqrt(radius[r] * radius[r] + zt * zt);
+   }
+
+   G4Box *worldSolid = new G4Box("SITE", 1*m, 1*m, 1*m);
+   G4LogicalVolume *worldLogical = new G4LogicalVolume(worldSolid, vacuum,
+                                                       "SITE");
+   G4VPhysicalVolume *world = new G4PVPlacement(0, G4ThreeVector(),
+                                                worldLogical, "SITE",
+                                                0, false, 0);
+   G4Tubs *gasSolid = new G4Tubs("CDGS", radius[0] - 2 * rstraw,
+                                 rlast + 2 * rstraw,
+                                 zhalf + 2 * rstraw, 0, twopi);
+   gasLogical = new G4LogicalVolume(gasSolid, gas, "CDGS");
+   new G4PVPlacement(0, G4ThreeVector(), gasLogical, "CDGS",
+                     worldLogical, false, 1);
+
+   nstraws = 0;
+   for (int r=0; r < nrings; ++r) {
+      std::string name = (tilt[r] == 0)? "STRA" : "STLA";
+      G4Tubs *strawSolid = new G4Tubs(name, 0, rstraw,
+                                      zhalf / cos(tilt[r]), 0, twopi);
+      G4LogicalVolume *strawLogical = new G4LogicalVolume(strawSolid,
+                                                          argon, name);
+      double dphi = twopi / count[r];
+      double phi0 = (r % 2) * dphi / 2;
+      for (int n=0; n < count[r]; ++n) {
+         double phi = phi0 + n * dphi;
+         G4RotationMatrix rot;
+         rot.rotateX(-tilt[r]);
+         rot.rotateZ(phi);
+         G4ThreeVector pos(radius[r] * cos(phi), radius[r] * sin(phi), 0);
+         new G4PVPlacement(G4Transform3D(rot, pos), strawLogical, name,
+                           gasLogical, false, (r + 1) * 1000 + n + 1);
+         ++nstraws;
+      }
+   }
+   return world;
+}
+
+bool contains(const std::vector<int> &candidates, int daughter)
+{
+   return std::find(candidates.begin(), candidates.end(), daughter) !=
+          candidates.end();
+}
+
+struct straw_frame_t {
+   const G4VSolid *solid;
+   G4AffineTransform transform;
+};
+
+int main(int argc, char *argv[])
+{
+   for (int i=1; i < argc; ++i) {
+      if (strncmp(argv[i], "-n", 2) == 0) {
+         if (strlen(argv[i]) > 2)
+            npoints = std::atoi(&argv[i][2]);
+         else
+            npoints = std::atoi(argv[++i]);
+      }
+      else if (strncmp(argv[i], "-L", 2) == 0) {
+         if (strlen(argv[i]) > 2)
+            maxstep = std::atof(&argv[i][2]) * mm;
+         else
+            maxstep = std::atof(argv[++i]) * mm;
+      }
+      else if (strncmp(argv[i], "-T", 2) == 0) {
+         if (strlen(argv[i]) > 2)
+            tolerance = std::atof(&argv[i][2]) * mm;
+         else
+            tolerance = std::atof(argv[++i]) * mm;
+      }
+      else if (strncmp(argv[i], "-r", 2) == 0) {
+         if (strlen(argv[i]) > 2)
+            seedVal = std::atoi(&argv[i][2]);
+         else
+            seedVal = std::atoi(argv[++i]);
+      }
+      else if (strncmp(argv[i], "-v", 2) == 0) {
+         verbose = 1;
+      }
+      else {
+         usage();
+      }
+   }
+
+#if G4VERSION_NUMBER < 1040
+   std::cerr << "cdcnavcheck error - GlueXCDCNavigation requires "
+             << "Geant4 10.4 or later, cannot continue." << std::endl;
+   exit(1);
+#else
+   G4LogicalVolume *gasLogical;
+   int nstraws;
+   G4VPhysicalVolume *world = build_chamber(gasLogical, nstraws);
+   G4GeometryManager::GetInstance()->CloseGeometry(true, false, world);
+
+   G4Navigator voxnav;
+   voxnav.SetWorldVolume(world);
+   G4Navigator cdcnav;
+   cdcnav.SetWorldVolume(world);
+   cdcnav.SetVoxelNavigation(new CDCNavigationProbe());
+
+   const GlueXCDCNavigation::straw_mother_t *mother;
+   mother = CDCNavigationProbe::GetMother(gasLogical);
+   if (mother == 0) {
+      std::cerr << "cdcnavcheck error - the test chamber was not accepted "
+                << "by the straw ring model, cannot continue." << std::endl;
+      exit(1);
+   }
+   double margin = CDCNavigationProbe::GetSafetyMargin();
+
+   // Frames of all of the daughters of the gas volume, for brute force
+   std::vector<straw_frame_t> straws(gasLogical->GetNoDaughters());
+   for (unsigned int d=0; d < straws.size(); ++d) {
+      G4VPhysicalVolume *pvol = gasLogical->GetDaughter(d);
+      straws[d].solid = pvol->GetLogicalVolume()->GetSolid();
+      straws[d].transform = G4AffineTransform(pvol->GetRotation(),
+                                              pvol->GetTranslation());
+      straws[d].transform.Invert();
+   }
+
+   CLHEP::HepRandom::setTheSeed(seedVal);
+   const G4Tubs *gasSolid = (const G4Tubs*)gasLogical->GetSolid();
+   double rmin = gasSolid->GetInnerRadius();
+   double rmax = gasSolid->GetOuterRadius();
+   double zmax = gasSolid->GetZHalfLength();
+
+   typedef std::chrono::high_resolution_clock clock;
+   double time_voxel = 0;
+   double time_cdc = 0;
+   long int nlocate_diff = 0;
+   long int nstep_diff = 0;
+   long int nrelocate_diff = 0;
+   long int nin_gas = 0;
+   long int nsteps = 0;
+   long int nsegments = 0;
+   long int nmiss_point = 0;
+   long int nmiss_safety = 0;
+   long int nmiss_segment = 0;
+   long int ncandidates = 0;
+   std::vector<int> candidates;
+   for (int n=0; n < npoints; ++n) {
+      double r = sqrt(rmin * rmin + G4UniformRand() *
+                      (rmax * rmax - rmin * rmin));
+      double phi = twopi * G4UniformRand();
+      double z = zmax * (2 * G4UniformRand() - 1);
+      G4ThreeVector point(r * cos(phi), r * sin(phi), z);
+      G4ThreeVector dir = G4RandomDirection();
+      double proposed = maxstep * G4UniformRand();
+
+      // Locate, step and relocate with both navigators
+
+      G4VPhysicalVolume *vol0 = voxnav.LocateGlobalPointAndSetup(point, &dir,
+                                                                 false, false);
+      G4VPhysicalVolume *vol1 = cdcnav.LocateGlobalPointAndSetup(point, &dir,
+                                                                 false, false);
+      if (vol0 != vol1) {
+         ++nlocate_diff;
+         if (verbose) {
+            std::cout << "point " << n << " " << point
+                      << ": voxel navigation locates "
+                      << vol0->GetName() << " " << vol0->GetCopyNo()
+                      << ", CDC navigation locates "
+                      << vol1->GetName() << " " << vol1->GetCopyNo()
+                      << std::endl;
+         }
+         continue;
+      }
+      if (vol0->GetLogicalVolume() == gasLogical)
+         ++nin_gas;
+      double safety0, safety1;
+      ++nsteps;
+      clock::time_point t0 = clock::now();
+      double step0 = voxnav.ComputeStep(point, dir, proposed, safety0);
+      clock::time_point t1 = clock::now();
+      double step1 = cdcnav.ComputeStep(point, dir, proposed, safety1);
+      clock::time_point t2 = clock::now();
+      time_voxel += std::chrono::duration<double>(t1 - t0).count();
+      time_cdc += std::chrono::duration<double>(t2 - t1).count();
+      step0 = std::min(step0, proposed);
+      step1 = std::min(step1, proposed);
+      if (fabs(step0 - step1) > tolerance) {
+         ++nstep_diff;
+         if (verbose) {
+            std::cout << "point " << n << " " << point << " dir " << dir
+                      << ": voxel navigation step " << step0
+                      << ", CDC navigation step " << step1 << std::endl;
+         }
+      }
+      else if (step0 < proposed) {
+         G4ThreeVector end = point + step0 * dir;
+         voxnav.SetGeometricallyLimitedStep();
+         cdcnav.SetGeometricallyLimitedStep();
+         vol0 = voxnav.LocateGlobalPointAndSetup(end, &dir, true);
+         vol1 = cdcnav.LocateGlobalPointAndSetup(end, &dir, true);
+         if (vol0 != vol1) {
+            ++nrelocate_diff;
+            if (verbose) {
+               std::cout << "point " << n << " " << point << " dir " << dir
+                         << ": after step " << step0
+                         << " voxel navigation enters "
+                         << ((vol0)? vol0->GetName() : "nothing") << " "
+                         << ((vol0)? vol0->GetCopyNo() : 0)
+                         << ", CDC navigation enters "
+                         << ((vol1)? vol1->GetName() : "nothing") << " "
+                         << ((vol1)? vol1->GetCopyNo() : 0) << std::endl;
+            }
+         }
+      }
+
+      // Check the candidate straws against all straws by brute force,
+      // the gas volume being placed unrotated at the origin of the world
+
+      if (gasSolid->Inside(point) == kOutside)
+         continue;
+      G4ThreeVector zhat(0, 0, 1);
+      CDCNavigationProbe::CollectCandidates(*mother, point, zhat, 0, 0,
+                                            candidates);
+      for (unsigned int d=0; d < straws.size(); ++d) {
+         G4ThreeVector p = straws[d].transform.TransformPoint(point);
+         if (straws[d].solid->Inside(p) != kOutside &&
+             ! contains(candidates, d))
+         {
+            ++nmiss_point;
+            if (verbose) {
+               std::cout << "point " << n << " " << point
+                         << ": straw " << d << " contains the point "
+                         << "but is not a locate candidate" << std::endl;
+            }
+         }
+      }
+      CDCNavigationProbe::CollectCandidates(*mother, point, zhat, 0, margin,
+                                            candidates);
+      for (unsigned int d=0; d < straws.size(); ++d) {
+         G4ThreeVector p = straws[d].transform.TransformPoint(point);
+         if (straws[d].solid->DistanceToIn(p) <= margin &&
+             ! contains(candidates, d))
+         {
+            ++nmiss_safety;
+            if (verbose) {
+               std::cout << "point " << n << " " << point
+                         << ": straw " << d << " is within the margin "
+                         << "but is not a safety candidate" << std::endl;
+            }
+         }
+      }
+      double length = std::min(proposed, gasSolid->DistanceToOut(point, dir));
+      CDCNavigationProbe::CollectCandidates(*mother, point, dir, length,
+                                            margin, candidates);
+      ncandidates += candidates.size();
+      ++nsegments;
+      int nsamples = (int)ceil(length / (0.5*mm)) + 1;
+      for (unsigned int d=0; d < straws.size(); ++d) {
+         G4ThreeVector p = straws[d].transform.TransformPoint(point);
+         G4ThreeVector u = straws[d].transform.TransformAxis(dir);
+         if (straws[d].solid->DistanceToIn(p) > length + margin)
+            continue;
+         bool touched = (straws[d].solid->DistanceToIn(p, u) <= length);
+         for (int i=0; i < nsamples && ! touched; ++i) {
+            double t = length * i / std::max(nsamples - 1, 1);
+            touched = (straws[d].solid->DistanceToIn(p + t * u) <= margin);
+         }
+         if (touched && ! contains(candidates, d)) {
+            ++nmiss_segment;
+            if (verbose) {
+               std::cout << "point " << n << " " << point << " dir " << dir
+                         << " length " << length << ": straw " << d
+                         << " is reached but is not a step candidate"
+                         << std::endl;
+            }
+         }
+      }
+   }
+
+   std::cout << "cdcnavcheck: " << npoints << " points in a chamber of "
+             << nstraws << " straws in " << mother->rings.size()
+             << " rings, " << nin_gas << " of them in the gas"
+             << std::endl << std::endl
+             << "compared with voxel navigation:" << std::endl
+             << "   located in a different volume: " << nlocate_diff
+             << std::endl
+             << "   different step length: " << nstep_diff << std::endl
+             << "   entered a different volume: " << nrelocate_diff
+             << std::endl
+             << "   time per step: voxel " << time_voxel / (nsteps + 1e-99) * 1e6
+             << " us, CDC " << time_cdc / (nsteps + 1e-99) * 1e6 << " us, "
+             << "speedup " << time_voxel / (time_cdc + 1e-99) << std::endl
+             << std::endl
+             << "candidate straws missed, compared with brute force:"
+             << std::endl
+             << "   locate queries: " << nmiss_point << std::endl
+             << "   safety queries: " << nmiss_safety << std::endl
+             << "   step queries: " << nmiss_segment << std::endl
+             << "   candidates per step query: " << std::setprecision(3)
+             << ncandidates / (nsegments + 1e-99) << std::endl;
+
+   G4GeometryManager::GetInstance()->OpenGeometry(world);
+   return (nlocate_diff + nstep_diff + nrelocate_diff +
+           nmiss_point + nmiss_safety + nmiss_segment > 0);
+#endif
+}
@@ -11,6 +11,8 @@
 //      -m <val> : generate e+e- pairs with invariant mass >= val (GeV/c^2)
 //      -r <val> : set initial random number seed to val
 //      -R <run> : set simulation run number, default 9000
+//      -c <#> : number of events per output chunk, default 1000
+//      -o : write events to the output file in event number order
 //
 // notes:
 //  1) If option -m is not given then the full invariant mass spectrum
@@ -19,6 +21,15 @@
 //  2) The event count option -n <#> must be present, but it does not
 //     have to be first among options, as shown in the usage pattern.
 //
+//  3) Each thread serializes its events into memory in chunks of -c
+//     events, which a separate writer thread appends to the output file
+//     as they are completed. Chunks are assigned to threads round-robin,
+//     and thread i is seeded from the -r value and i, so the same set of
+//     events is generated for a given -r and -t, independent of thread
+//     scheduling. With -o the writer also restores the event number
+//     order, otherwise chunks are written in the order they finish.
+//     If -r is 0 (the default) every thread is randomly seeded.
+//
 // physics:
 //  1) The generator is based on the tree-level e+e- pair production
 //     process from elastic scattering from a free nucleon.
@@ -56,17 +67,32 @@
 #include <string>
 #include <string.h>
 #include <vector>
+#include <map>
+#include <sstream>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
 #include <stdexcept>
 
 double Ephoton(9.0);
 LDouble_t M12_minimum(0);
 int seedVal(0);
 uint runno(9000);
+long int chunksize(1000);
+int ordered_output(0);
 
-std::atomic<int> eventNo(0);
+std::mutex writer_mutex;
+std::condition_variable writer_cv;
+std::map<long int, std::string> writer_queue;
+long int writer_next_chunk(0);
+int writer_active_threads(0);
+double writer_busy_time(0);
 
-typename hddm_mc_s::ostream *esink;
+std::vector<double> worker_sum;
+std::vector<double> worker_sum2;
+std::vector<long int> worker_events;
+std::vector<double> worker_time;
 
 void usage()
 {
@@ -78,19 +104,82 @@ void usage()
       "     -m <val> : generate e+e- pairs with invariant mass >= val (GeV/c^2)\n"
       "     -r <val> : set initial random number seed to val\n"
       "     -R <run> : set simulation run number, default 9000\n"
+      "     -c <#> : number of events per output chunk, default 1000\n"
+      "     -o : write events to the output file in event number order\n"
       << std::endl;
    exit(1);
 }
 
-int generate(int nevents)
+void queue_chunk(long int chunk, std::string &data)
+{
+   // Pass a serialized chunk of events to the writer thread. To bound
+   // the memory held in the queue, wait while it is full unless this
+   // is the chunk the writer is waiting for next.
+
+   int max_queued = 4 * worker_events.size();
+   std::unique_lock<std::mutex> lock(writer_mutex);
+   while ((int)writer_queue.size() >= max_queued &&
+          chunk != writer_next_chunk)
+   {
+      writer_cv.wait(lock);
+   }
+   writer_queue[chunk].swap(data);
+   writer_cv.notify_all();
+}
+
+void write_chunks(std::ostream *fout)
 {
+   std::unique_lock<std::mutex> lock(writer_mutex);
+   while (true) {
+      std::map<long int, std::string>::iterator it = writer_queue.begin();
+      if (it != writer_queue.end() && (!ordered_output ||
+                                       it->first == writer_next_chunk ||
+                                       writer_active_threads == 0))
+      {
+         std::string data;
+         data.swap(it->second);
+         writer_queue.erase(it);
+         ++writer_next_chunk;
+         writer_cv.notify_all();
+         lock.unlock();
+         std::chrono::steady_clock::time_point t0;
+         t0 = std::chrono::steady_clock::now();
+         fout->write(data.data(), data.size());
+         writer_busy_time += std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - t0).count();
+         lock.lock();
+      }
+      else if (writer_active_threads == 0 && writer_queue.size() == 0) {
+         break;
+      }
+      else {
+         writer_cv.wait(lock);
+      }
+   }
+}
+
+int generate(int worker, int nthreads, long int nevents)
+{
+   std::chrono::steady_clock::time_point t0;
+   t0 = std::chrono::steady_clock::now();
+
    thread_local TRandom2 *randoms;
    randoms = new TRandom2(0);
-   randoms->SetSeed(seedVal);
+   randoms->SetSeed((seedVal == 0)? 0 : seedVal + 1000003 * worker);
+
+   // Serialize events into a private buffer, without the hddm header
+   // which is written to the output file only once, by main
+   std::ostringstream buffer;
+   hddm_mc_s::ostream *bsink = new hddm_mc_s::ostream(buffer);
+   buffer.str("");
 
+   long int nchunks = (nevents + chunksize - 1) / chunksize;
+   long int chunk = worker;
+   long int eventNo = chunk * chunksize;
    double sum(0);
    double sum2(0);
-   for (int n = 0; n < nevents; ++n) {
+   long int n;
+   for (n = 0; chunk < nchunks; ++n) {
       LDouble_t weight = 1;
       LDouble_t kin = Ephoton;
 
@@ -220,7 +309,7 @@ int generate(int nevents)
       // Keep statistics on the total cross section
       sum += weight * diffXS;
       sum2 += sqr(weight * diffXS);
-      if (n > 0 && n / 10000 * 10000 == n) {
+      if (worker == 0 && n > 0 && n / 10000 * 10000 == n) {
          std::cout << "est. total cross section after " 
                    << n << " events : " << sum / n 
                    << " +/- " << sqrt(sum2 - sqr(sum) / n) / n
@@ -242,9 +331,9 @@ int generate(int nevents)
       // seed4 = saved by analyzer, not to be reused
       hddm_mc_s::RandomList ranl = reactions(0).addRandoms();
       ranl().setSeed1(randoms->GetSeed());
-      ranl().setSeed2(gRandom->Integer(std::numeric_limits<int32_t>::max()));
-      ranl().setSeed3(gRandom->Integer(std::numeric_limits<int32_t>::max()));
-      ranl().setSeed4(gRandom->Integer(std::numeric_limits<int32_t>::max()));
+      ranl().setSeed2(randoms->Integer(std::numeric_limits<int32_t>::max()));
+      ranl().setSeed3(randoms->Integer(std::numeric_limits<int32_t>::max()));
+      ranl().setSeed4(randoms->Integer(std::numeric_limits<int32_t>::max()));
       hddm_mc_s::BeamList beams = reactions(0).addBeams();
       hddm_mc_s::MomentumList bmoms = beams(0).addMomenta();
       hddm_mc_s::PropertiesList bprops = beams(0).addPropertiesList();
@@ -312,21 +401,34 @@ int generate(int nevents)
       verts(0).getOrigin().setVx(0);
       verts(0).getOrigin().setVy(0);
       verts(0).getOrigin().setVz(0);
-      *esink << record;
-   }
-
-   std::cout << "est. total cross section after " 
-             << nevents << " events : " << sum / nevents 
-             << " +/- " << sqrt(sum2 - sqr(sum) / nevents) / nevents
-             << " ub" << std::endl;
+      *bsink << record;
 
+      // Hand each completed chunk to the writer thread
+      if (eventNo == nevents || eventNo % chunksize == 0) {
+         std::string data(buffer.str());
+         buffer.str("");
+         queue_chunk(chunk, data);
+         chunk += nthreads;
+         eventNo = chunk * chunksize;
+      }
+   }
+   delete bsink;
    delete randoms;
+
+   worker_sum[worker] = sum;
+   worker_sum2[worker] = sum2;
+   worker_events[worker] = n;
+   worker_time[worker] = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - t0).count();
+   std::unique_lock<std::mutex> lock(writer_mutex);
+   --writer_active_threads;
+   writer_cv.notify_all();
    return 0;
 }
 
 int main(int argc, char *argv[])
 {
-   int nevents(0);
+   long int nevents(0);
    int nthreads(1);
 
    std::string outfname;
@@ -338,9 +440,9 @@ int main(int argc, char *argv[])
       }
       else if (arg[1] == 'n') {
          if (strlen(arg) > 2)
-            nevents = std::atoi(arg+2);
+            nevents = std::atol(arg+2);
          else
-            nevents = atoi(argv[++iarg]);
+            nevents = atol(argv[++iarg]);
       }
       else if (arg[1] == 't') {
          if (strlen(arg) > 2)
@@ -372,11 +474,20 @@ int main(int argc, char *argv[])
          else
             runno = atoi(argv[++iarg]);
       }
+      else if (arg[1] == 'c') {
+         if (strlen(arg) > 2)
+            chunksize = std::atol(arg+2);
+         else
+            chunksize = atol(argv[++iarg]);
+      }
+      else if (arg[1] == 'o') {
+         ordered_output = 1;
+      }
       else {
          usage();
       }
    }
-   if (nevents == 0 || outfname.size() == 0)
+   if (nevents == 0 || outfname.size() == 0 || nthreads < 1 || chunksize < 1)
       usage();
 
    std::ofstream fout(outfname);
@@ -386,20 +497,46 @@ int main(int argc, char *argv[])
                 << std::endl;
       exit(2);
    }
-   esink = new hddm_mc_s::ostream(fout);
+   hddm_mc_s::ostream *esink = new hddm_mc_s::ostream(fout);
 
-   int nevents_per_thread = nevents / nthreads;
-   if (nevents_per_thread * nthreads < nevents)
-      nevents_per_thread += 1;
+   std::chrono::steady_clock::time_point t0;
+   t0 = std::chrono::steady_clock::now();
+   worker_sum.resize(nthreads);
+   worker_sum2.resize(nthreads);
+   worker_events.resize(nthreads);
+   worker_time.resize(nthreads);
+   writer_active_threads = nthreads;
    std::vector<std::thread> threads;
-   for (int n=0; n < nevents;) {
-      int ni(nevents_per_thread);
-      ni = (ni > nevents - n)? nevents - n : ni;
-      threads.push_back(std::thread(generate,ni));
-      n += ni;
+   for (int i=0; i < nthreads; ++i) {
+      threads.push_back(std::thread(generate, i, nthreads, nevents));
    }
-
+   std::thread writer(write_chunks, &fout);
    for (int i=0; i < (int)threads.size(); ++i) {
       threads[i].join();
    }
+   writer.join();
+   delete esink;
+   fout.close();
+   double elapsed = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - t0).count();
+
+   double sum(0);
+   double sum2(0);
+   for (int i=0; i < nthreads; ++i) {
+      sum += worker_sum[i];
+      sum2 += worker_sum2[i];
+      if (worker_events[i] > 0) {
+         std::cout << "thread " << i << " generated " << worker_events[i]
+                   << " events at " << worker_events[i] / worker_time[i]
+                   << " events/s" << std::endl;
+      }
+   }
+   std::cout << "est. total cross section after " 
+             << nevents << " events : " << sum / nevents 
+             << " +/- " << sqrt(sum2 - sqr(sum) / nevents) / nevents
+             << " ub" << std::endl
+             << nevents << " events written in " << elapsed << " s, "
+             << nevents / elapsed << " events/s, writer busy "
+             << 100 * writer_busy_time / elapsed << "% of the time"
+             << std::endl;
 }
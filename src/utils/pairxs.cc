@@ -0,0 +1,341 @@
+//
+// pairxs.cc : validation of the fast pair conversion cross sections
+//
+// author: agent at local
+// version: october 18, 2026
+//
+// usage: pairxs [options]
+//   where options may include any of the following
+//      -n <#> : number of phase space points to test, default 100000
+//      -E <val> : energy of incident photon (GeV), default 9.0 GeV
+//      -P <val> : linear polarization of incident photon, default 0.4
+//      -T <val> : rounding error tolerance of the fast path, default 1e-7
+//      -m : generate mu+mu- pairs instead of e+e- pairs
+//      -r <val> : set initial random number seed to val
+//      -v : print every point where the two disagree beyond tolerance
+//
+// notes:
+//  1) The phase space points are generated the same way as in
+//     GlueXBeamConversionProcess::GenerateBeamPairConversion, without
+//     importance sampling, so that both the pair (atomic coherent) and
+//     triplet (incoherent) cross sections are tested over the whole
+//     region that the simulation visits, including the very forward
+//     regions where the Feynman amplitudes cancel most strongly.
+//
+//  2) At each point the cross section is computed twice, once with
+//     Dirac++ in long double and once with the double precision fast
+//     path in PairConversionAmplitudes, and the relative difference
+//     is accumulated. Both are called through the same interface with
+//     the photon polarization passed explicitly, the reference having
+//     the fast path disabled so that it is evaluated by Dirac++. The
+//     integrated cross sections and the time taken by each method are
+//     reported at the end, together with the fraction of points where
+//     the fast path fell back to long double.
+//
+
+#include <PairConversionGeneration.hh>
+#include <TPhoton.h>
+#include <TLepton.h>
+#include <TLorentzBoost.h>
+#include <constants.h>
+#include <sqr.h>
+
+#include <TRandom2.h>
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <string.h>
+#include <vector>
+#include <chrono>
+
+int npoints(100000);
+double Ephoton(9.0);
+double polarization(0.4);
+double tolerance(1e-7);
+int muonpairs(0);
+int seedVal(0);
+int verbose(0);
+
+void usage()
+{
+   std::cout <<
+      "Usage: pairxs [options]\n"
+      "  where options may include any of the following\n"
+      "     -n <#> : number of phase space points to test, default 100000\n"
+      "     -E <val> : energy of incident photon (GeV), default 9.0\n"
+      "     -P <val> : linear polarization of incident photon, default 0.4\n"
+      "     -T <val> : rounding error tolerance of the fast path, default 1e-7\n"
+      "     -m : generate mu+mu- pairs instead of e+e- pairs\n"
+      "     -r <val> : set initial random number seed to val\n"
+      "     -v : print every point where the two disagree beyond tolerance\n"
+      << std::endl;
+   exit(1);
+}
+
+struct comparison_t {
+   const char *name;
+   long int npoints;
+   double sum_reference;
+   double sum_fast;
+   double max_reldiff;
+   double sum_reldiff2;
+   double time_reference;
+   double time_fast;
+   comparison_t(const char *n) : name(n), npoints(0),
+                                 sum_reference(0), sum_fast(0),
+                                 max_reldiff(0), sum_reldiff2(0),
+                                 time_reference(0), time_fast(0) {}
+};
+
+void compare(comparison_t &comp, LDouble_t weight,
+             LDouble_t (*eval)(PairConversionGeneration *gen, void *args),
+             void *args, PairConversionGeneration *reference,
+             PairConversionGeneration *fast)
+{
+   typedef std::chrono::high_resolution_clock clock;
+   clock::time_point t0 = clock::now();
+   LDouble_t xs0 = eval(reference, args);
+   clock::time_point t1 = clock::now();
+   LDouble_t xs1 = eval(fast, args);
+   clock::time_point t2 = clock::now();
+   comp.time_reference += std::chrono::duration<double>(t1 - t0).count();
+   comp.time_fast += std::chrono::duration<double>(t2 - t1).count();
+   comp.sum_reference += xs0 * weight;
+   comp.sum_fast += xs1 * weight;
+   ++comp.npoints;
+   if (xs0 > 0) {
+      double reldiff = fabs(xs1 / xs0 - 1);
+      comp.sum_reldiff2 += reldiff * reldiff;
+      if (reldiff > comp.max_reldiff)
+         comp.max_reldiff = reldiff;
+      if (verbose && reldiff > tolerance) {
+         std::cout << comp.name << " point " << comp.npoints
+                   << ": Dirac++ " << xs0 << ", fast path " << xs1
+                   << ", relative difference " << reldiff << std::endl;
+      }
+   }
+}
+
+struct pair_args_t {
+   TPhoton *gIn;
+   TThreeVectorReal *pol;
+   TLepton *pOut;
+   TLepton *eOut;
+   TLepton *eOut3;
+};
+
+LDouble_t eval_pair(PairConversionGeneration *gen, void *args)
+{
+   pair_args_t *a = (pair_args_t*)args;
+   return gen->DiffXS_pair(*a->gIn, *a->pol, a->pol->Length(),
+                           *a->pOut, *a->eOut);
+}
+
+LDouble_t eval_triplet(PairConversionGeneration *gen, void *args)
+{
+   pair_args_t *a = (pair_args_t*)args;
+   return gen->DiffXS_triplet(*a->gIn, *a->pol, a->pol->Length(),
+                              *a->pOut, *a->eOut, *a->eOut3);
+}
+
+void report(const comparison_t &comp)
+{
+   if (comp.npoints == 0)
+      return;
+   std::cout << std::endl << comp.name << " cross section, "
+             << comp.npoints << " points" << std::endl
+             << "   Dirac++ integral:   " << comp.sum_reference / npoints
+             << " b" << std::endl
+             << "   fast path integral: " << comp.sum_fast / npoints
+             << " b" << std::endl
+             << "   max relative difference: " << comp.max_reldiff
+             << std::endl
+             << "   rms relative difference: "
+             << sqrt(comp.sum_reldiff2 / comp.npoints) << std::endl
+             << "   time per point: Dirac++ "
+             << comp.time_reference / comp.npoints * 1e6 << " us, "
+             << "fast path "
+             << comp.time_fast / comp.npoints * 1e6 << " us, "
+             << "speedup " << comp.time_reference / (comp.time_fast + 1e-99)
+             << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+   for (int i=1; i < argc; ++i) {
+      if (strncmp(argv[i], "-n", 2) == 0) {
+         if (strlen(argv[i]) > 2)
+            npoints = std::atoi(&argv[i][2]);
+         else
+            npoints = std::atoi(argv[++i]);
+      }
+      else if (strncmp(argv[i], "-E", 2) == 0) {
+         if (strlen(argv[i]) > 2)
+            Ephoton = std::atof(&argv[i][2]);
+         else
+            Ephoton = std::atof(argv[++i]);
+      }
+      else if (strncmp(argv[i], "-P", 2) == 0) {
+         if (strlen(argv[i]) > 2)
+            polarization = std::atof(&argv[i][2]);
+         else
+            polarization = std::atof(argv[++i]);
+      }
+      else if (strncmp(argv[i], "-T", 2) == 0) {
+         if (strlen(argv[i]) > 2)
+            tolerance = std::atof(&argv[i][2]);
+         else
+            tolerance = std::atof(argv[++i]);
+      }
+      else if (strncmp(argv[i], "-r", 2) == 0) {
+         if (strlen(argv[i]) > 2)
+            seedVal = std::atoi(&argv[i][2]);
+         else
+            seedVal = std::atoi(argv[++i]);
+      }
+      else if (strncmp(argv[i], "-m", 2) == 0) {
+         muonpairs = 1;
+      }
+      else if (strncmp(argv[i], "-v", 2) == 0) {
+         verbose = 1;
+      }
+      else {
+         usage();
+      }
+   }
+
+   std::vector<double> Z(1, 4);    // 4Be converter, as in the simulation
+   std::vector<double> A(1, 9.012);
+   std::vector<double> w(1, 1);
+   PairConversionGeneration reference(Z, A, w);
+   PairConversionGeneration fast(Z, A, w);
+   fast.SetFastPath(true, tolerance);
+
+   TRandom2 randoms(0);
+   randoms.SetSeed(seedVal);
+
+   LDouble_t mLepton = (muonpairs)? mMuon : mElectron;
+   LDouble_t kin = Ephoton;
+   comparison_t triplet("triplet");
+   comparison_t pair("pair");
+   for (int n=0; n < npoints; ++n) {
+      LDouble_t weight = 1;
+
+      // Generate uniform in E+, phi12, phiR, as in the simulation
+      LDouble_t Epos = mLepton + randoms.Uniform(kin - mLepton);
+      weight *= kin - mLepton;
+      LDouble_t phi12 = randoms.Uniform(2*PI_);
+      weight *= 2*PI_;
+      LDouble_t phiR = randoms.Uniform(2*PI_);
+      weight *= 2*PI_;
+
+      // Generate Mpair as 1 / (M [M^2 + Mcut^2])
+      LDouble_t Mmin = 2 * mLepton;
+      LDouble_t Mcut = 10 * mLepton;
+      LDouble_t um0 = 1 + sqr(Mcut / Mmin);
+      LDouble_t um = pow(um0, randoms.Uniform(1));
+      LDouble_t Mpair = Mcut / sqrt(um - 1 + 1e-99);
+      weight *= Mpair * (sqr(Mcut) + sqr(Mpair)) * log(um0) / (2 * sqr(Mcut));
+
+      // Generate qR^2 with weight 1 / [qR^2 sqrt(qRcut^2 + qR^2)]
+      LDouble_t qRmin = sqr(Mpair) /(2 * kin);
+      LDouble_t qRcut = 2 * mLepton;
+      LDouble_t uq0 = qRmin / (qRcut + sqrt(sqr(qRcut) + sqr(qRmin)));
+      LDouble_t uq = pow(uq0, randoms.Uniform(1));
+      LDouble_t qR = 2 * qRcut * uq / (1 - sqr(uq));
+      LDouble_t qR2 = qR * qR;
+      weight *= qR2 * sqrt(1 + qR2 / sqr(qRcut)) * (-2 * log(uq0));
+      weight *= Mpair / (2 * kin);
+
+      // Photon plane polarized at a random azimuth
+      LDouble_t phipol = randoms.Uniform(2*PI_);
+      TThreeVectorReal pol(polarization * cos(phipol),
+                           polarization * sin(phipol), 0);
+      TPhoton gIn;
+      gIn.SetMom(TThreeVectorReal(0, 0, kin));
+      gIn.SetPlanePolarization(pol, pol.Length());
+      TLepton p1(mLepton);
+      TLepton e2(mLepton);
+      TLepton e3(mElectron);
+      pair_args_t args = {&gIn, &pol, &p1, &e2, &e3};
+
+      LDouble_t k12star2 = sqr(Mpair / 2) - sqr(mLepton);
+      if (k12star2 < 0)
+         continue;
+      LDouble_t k12star = sqrt(k12star2);
+
+      // Triplet kinematics, with a free recoil electron
+      LDouble_t E3 = sqrt(qR2 + sqr(mElectron));
+      LDouble_t E12 = kin + mElectron - E3;
+      LDouble_t costhetaR = (sqr(Mpair) / 2 + (kin + mElectron) *
+                             (E3 - mElectron)) / (kin * qR);
+      if (E12 > Mpair && Epos < E12 - mLepton && fabs(costhetaR) <= 1) {
+         LDouble_t q12mag = sqrt(sqr(E12) - sqr(Mpair));
+         LDouble_t costhetastar = (Epos - E12 / 2) * Mpair /
+                                  (k12star * q12mag);
+         if (fabs(costhetastar) <= 1) {
+            LDouble_t sinthetaR = sqrt(1 - sqr(costhetaR));
+            TFourVectorReal q3(E3, qR * sinthetaR * cos(phiR),
+                                   qR * sinthetaR * sin(phiR),
+                                   qR * costhetaR);
+            LDouble_t sinthetastar = sqrt(1 - sqr(costhetastar));
+            TThreeVectorReal k12(k12star * sinthetastar * cos(phi12),
+                                 k12star * sinthetastar * sin(phi12),
+                                 k12star * costhetastar);
+            TFourVectorReal q1(Mpair / 2, k12);
+            TFourVectorReal q2(Mpair / 2, -k12);
+            TLorentzBoost toLab(q3[1] / E12, q3[2] / E12,
+                                (q3[3] - kin) / E12);
+            q1.Boost(toLab);
+            q2.Boost(toLab);
+            p1.SetMom(q1);
+            e2.SetMom(q2);
+            e3.SetMom(q3);
+            compare(triplet, weight, eval_triplet, &args, &reference, &fast);
+         }
+      }
+
+      // Pair kinematics, with the atom absorbing zero energy
+      LDouble_t Eneg = kin - Epos;
+      costhetaR = (sqr(Mpair) + qR2) / (2 * kin * qR);
+      if (kin > Mpair && Eneg > mLepton && fabs(costhetaR) <= 1) {
+         LDouble_t q12mag = sqrt(sqr(kin) - sqr(Mpair));
+         LDouble_t costhetastar = (Epos - kin / 2) * Mpair /
+                                  (k12star * q12mag);
+         if (fabs(costhetastar) <= 1) {
+            LDouble_t sinthetaR = sqrt(1 - sqr(costhetaR));
+            TThreeVectorReal q3(qR * sinthetaR * cos(phiR),
+                                qR * sinthetaR * sin(phiR),
+                                qR * costhetaR);
+            LDouble_t sinthetastar = sqrt(1 - sqr(costhetastar));
+            TThreeVectorReal k12(k12star * sinthetastar * cos(phi12),
+                                 k12star * sinthetastar * sin(phi12),
+                                 k12star * costhetastar);
+            TFourVectorReal q1(Mpair / 2, k12);
+            TFourVectorReal q2(Mpair / 2, -k12);
+            TLorentzBoost toLab(q3[1] / kin, q3[2] / kin,
+                                (q3[3] - kin) / kin);
+            q1.Boost(toLab);
+            q2.Boost(toLab);
+            p1.SetMom(q1);
+            e2.SetMom(q2);
+            compare(pair, weight, eval_pair, &args, &reference, &fast);
+         }
+      }
+   }
+
+   std::cout << "pairxs: " << npoints << " points at E = " << Ephoton
+             << " GeV, polarization " << polarization
+             << ", tolerance " << tolerance << std::endl;
+   report(triplet);
+   report(pair);
+   std::cout << std::endl
+             << "fast path evaluations: " << fast.GetFastPathCount()
+             << ", redone in long double: " << fast.GetFallbackCount()
+             << " (" << std::setprecision(3)
+             << 100. * fast.GetFallbackCount() /
+                (fast.GetFastPathCount() + 1e-99)
+             << "%)" << std::endl;
+   return 0;
+}
@@ -9,6 +9,13 @@
 // reference: G. Zech and B. Aslan, "A Multivariate Two-Sample Test 
 //            Based on the Concept of Minimum Energy", PHYSTAT2003,
 //            SLAC, Stanford, California, September 8-11, 2003.
+//
+// The tiled engine (option -t) computes the same sums as the default
+// engine, but replaces the per-partition branches in the inner loop
+// by dense sums over 0/1 partition membership that vectorize well,
+// and streams the samples from the input files in blocks. For samples
+// too large for the exact sum, option -a estimates it from a random
+// subset of the pairs, with an error estimate.
 
 #define USE_OPENMP_MULTITHREADING 1
 
@@ -19,7 +26,11 @@
 #include <sstream>
 #include <vector>
 #include <map>
+#include <algorithm>
+#include <chrono>
+#include <random>
 #include <math.h>
+#include <stdint.h>
 
 #include <TFile.h>
 #include <TTree.h>
@@ -65,6 +76,19 @@ void usage()
              << "        sample interaction energy, default double" << std::endl
              << "   -g : use a CUDA kernel to compute the sample" << std::endl
              << "        interaction energy on a gpu, implies -f" << std::endl
+             << "   -t : use the tiled SIMD engine, which reads the" << std::endl
+             << "        samples from the input files block by block" << std::endl
+             << "        instead of holding them in memory, combine" << std::endl
+             << "        with -f for single precision pair energies" << std::endl
+             << "   -x : cross-check the tiled engine against the" << std::endl
+             << "        default double precision engine and report" << std::endl
+             << "        the largest difference and the timing" << std::endl
+             << "   -a <k> : estimate the energy from a random subset" << std::endl
+             << "        of about <k> pairs per sample instead of all" << std::endl
+             << "        pairs, and report its statistical error and" << std::endl
+             << "        the permutation p-value with 95% bounds, so" << std::endl
+             << "        the time grows as N*<k> instead of N^2, can" << std::endl
+             << "        be combined with -f, double value" << std::endl
              << "   -s <seed> : set random number generator <seed>" << std::endl
              << "        when setting up the data set partitions," << std::endl
              << "        randomized by default, unsigned int value" << std::endl
@@ -471,6 +495,630 @@ void compute_energy(const char *sample1, const char *sample2,
    }
 }
 
+// Streaming access to the joint sample, sample1 followed by sample2,
+// for the tiled engine. Only the standardized coordinates and weights
+// of the range of entries asked for are held in memory at any time,
+// stored component-by-component so that the distance kernel can be
+// vectorized across samples.
+
+class sample_stream {
+ public:
+   sample_stream(const char *infile1, const char *sample1,
+                 const char *infile2, const char *sample2,
+                 const std::vector<int> &include_list);
+   ~sample_stream();
+
+   long int size() const { return fSize[0] + fSize[1]; }
+   long int size1() const { return fSize[0]; }
+   int dim() const { return fComponent.size(); }
+
+   template <typename REAL>
+   void read(long int i0, long int i1, std::vector<REAL> &x,
+                                       std::vector<REAL> &w);
+
+ protected:
+   const double *read_entry(long int i);
+
+   TFile *fFile[2];
+   TTree *fTree[2];
+   long int fSize[2];
+   std::vector<double> fBuffer[2];
+   std::vector<int> fComponent;
+   std::vector<double> fScale;
+};
+
+sample_stream::sample_stream(const char *infile1, const char *sample1,
+                             const char *infile2, const char *sample2,
+                             const std::vector<int> &include_list)
+{
+   const char *infile[2] = {infile1, infile2};
+   const char *sample_name[2] = {sample1, sample2};
+   int dlen[2];
+   for (int s=0; s < 2; ++s) {
+      fFile[s] = new TFile(infile[s]);
+      fTree[s] = (TTree*)fFile[s]->Get(sample_name[s]);
+      if (fTree[s] == NULL) {
+         std::cerr << "samplesep.sample_stream error - sample named " 
+                   << sample_name[s] << " not found in " << infile[s]
+                   << std::endl;
+         exit(9);
+      }
+      TLeaf *lsample = fTree[s]->GetLeaf("dsample", "d");
+      dlen[s] = lsample->GetLenStatic();
+      fBuffer[s].resize(dlen[s]);
+      fTree[s]->SetBranchAddress("dsample", fBuffer[s].data());
+      fSize[s] = fTree[s]->GetEntries();
+   }
+   if (dlen[0] != dlen[1]) {
+      std::cerr << "samplesep.sample_stream error - samples " 
+                << sample1 << " and " << sample2
+                << " cannot be compared, different dimensions "
+                << dlen[0] - 1 << " != " << dlen[1] - 1
+                << std::endl;
+      exit(9);
+   }
+   for (int k=0; k < dlen[0] - 1; ++k) {
+      if (include_list.size() == 0 ||
+          (k < (int)include_list.size() && include_list[k] > 0))
+      {
+         fComponent.push_back(k);
+      }
+   }
+   if (size() == 0 || fComponent.size() == 0) {
+      std::cerr << "samplesep.sample_stream error - "
+                << "zero sample size, nothing to do."
+                << std::endl;
+      exit(9);
+   }
+
+   // first pass through both samples to standardize the components
+   std::vector<std::vector<double> > dMoments(dim(), {0,0,0});
+   for (long int i=0; i < size(); ++i) {
+      const double *d = read_entry(i);
+      double w = d[dlen[0] - 1];
+      for (int k=0; k < dim(); ++k) {
+         double a = d[fComponent[k]];
+         dMoments[k][0] += w;
+         dMoments[k][1] += w * a;
+         dMoments[k][2] += w * a * a;
+      }
+   }
+   for (int k=0; k < dim(); ++k) {
+      if (dMoments[k][0] == 0) {
+         std::cout << "bad moments in component " 
+                   << k << ":" << dMoments[k][0]
+                   << std::endl;
+         exit(9);
+      }
+      double mean = dMoments[k][1] / dMoments[k][0];
+      double vari = dMoments[k][2] / dMoments[k][0] - mean * mean;
+      if (vari == 0) {
+         std::cout << "bad variance component " << k 
+                   << ":" << "mean,vari=" << mean << "," << vari
+                   << std::endl;
+         exit(9);
+      }
+      fScale.push_back(1 / sqrt(fabs(vari)));
+   }
+}
+
+sample_stream::~sample_stream()
+{
+   delete fFile[0];
+   delete fFile[1];
+}
+
+const double *sample_stream::read_entry(long int i)
+{
+   int s = (i < fSize[0])? 0 : 1;
+   fTree[s]->GetEntry((s == 0)? i : i - fSize[0]);
+   return fBuffer[s].data();
+}
+
+template <typename REAL>
+void sample_stream::read(long int i0, long int i1, std::vector<REAL> &x,
+                                                   std::vector<REAL> &w)
+{
+   // Fill x with the standardized coordinates of entries [i0,i1) in
+   // the joint sample, stored as x[k * (i1 - i0) + i], and w with
+   // their weights.
+
+   int n = i1 - i0;
+   x.resize(dim() * n);
+   w.resize(n);
+   for (int i=0; i < n; ++i) {
+      const double *d = read_entry(i0 + i);
+      for (int k=0; k < dim(); ++k)
+         x[k * n + i] = d[fComponent[k]] * fScale[k];
+      w[i] = d[fBuffer[0].size() - 1];
+   }
+}
+
+// Innermost kernels of the tiled engine. On x86_64 they are compiled for
+// both the baseline instruction set and AVX2+FMA, with the choice made
+// at run time. Elsewhere they are compiled once for the target machine.
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define TILE_KERNEL __attribute__((target_clones("arch=haswell","default")))
+#else
+#define TILE_KERNEL
+#endif
+
+const int TILE_ROWS(64);
+const int TILE_COLS(128);
+const int TILE_PARTITIONS(32);
+
+template <typename REAL>
+inline __attribute__((always_inline))
+void distance_tile_body(int dim, int ni, int nj,
+                        const REAL *xi, int stride_i, const REAL *wi,
+                        const REAL *xj, int stride_j, const REAL *wj,
+                        long int i0, long int j0, REAL *E)
+{
+   // Fill E[i * TILE_COLS + j] with w_i w_j / (r_ij^2 + 1e-4) for the
+   // ni x nj sub-matrix of pairs, and zero for pairs with j <= i.
+
+   for (int i=0; i < ni; ++i) {
+      REAL *Ei = E + i * TILE_COLS;
+      for (int j=0; j < nj; ++j)
+         Ei[j] = 1e-4;
+      for (int k=0; k < dim; ++k) {
+         REAL xik = xi[k * stride_i + i];
+         const REAL *xjk = xj + k * stride_j;
+         for (int j=0; j < nj; ++j)
+            Ei[j] += (xik - xjk[j]) * (xik - xjk[j]);
+      }
+      for (int j=0; j < nj; ++j)
+         Ei[j] = wi[i] * wj[j] / Ei[j];
+      for (int j=0; j < nj && j0 + j <= i0 + i; ++j)
+         Ei[j] = 0;
+      for (int j=nj; j < TILE_COLS; ++j)
+         Ei[j] = 0;
+   }
+}
+
+template <typename REAL>
+inline __attribute__((always_inline))
+void partition_tile_body(int ni, const REAL *E, const REAL *X, REAL *Y)
+{
+   // Fill Y[i * TILE_PARTITIONS + n] with sum_j E[i,j] X[j,n], where
+   // X[j,n] is 1 if sample j is in group b of partition n, otherwise 0.
+   // The TILE_PARTITIONS sums for each row are kept in registers.
+
+   for (int i=0; i < ni; ++i) {
+      const REAL *Ei = E + i * TILE_COLS;
+      REAL acc[TILE_PARTITIONS] = {0};
+      for (int j=0; j < TILE_COLS; ++j) {
+         const REAL e = Ei[j];
+         const REAL *Xj = X + j * TILE_PARTITIONS;
+         for (int n=0; n < TILE_PARTITIONS; ++n)
+            acc[n] += e * Xj[n];
+      }
+      for (int n=0; n < TILE_PARTITIONS; ++n)
+         Y[i * TILE_PARTITIONS + n] = acc[n];
+   }
+}
+
+TILE_KERNEL
+void distance_tile(int dim, int ni, int nj,
+                   const double *xi, int stride_i, const double *wi,
+                   const double *xj, int stride_j, const double *wj,
+                   long int i0, long int j0, double *E)
+{
+   distance_tile_body<double>(dim, ni, nj, xi, stride_i, wi,
+                              xj, stride_j, wj, i0, j0, E);
+}
+
+TILE_KERNEL
+void distance_tile(int dim, int ni, int nj,
+                   const float *xi, int stride_i, const float *wi,
+                   const float *xj, int stride_j, const float *wj,
+                   long int i0, long int j0, float *E)
+{
+   distance_tile_body<float>(dim, ni, nj, xi, stride_i, wi,
+                             xj, stride_j, wj, i0, j0, E);
+}
+
+TILE_KERNEL
+void partition_tile(int ni, const double *E, const double *X, double *Y)
+{
+   partition_tile_body<double>(ni, E, X, Y);
+}
+
+TILE_KERNEL
+void partition_tile(int ni, const float *E, const float *X, float *Y)
+{
+   partition_tile_body<float>(ni, E, X, Y);
+}
+
+void make_partitions(long int Nsample, long int Nsample1,
+                     std::vector<uint64_t> &xbits)
+{
+   // Partition bits are drawn with the same sequence of shuffles as
+   // compute_energy, and stored one bit per sample per partition,
+   // set if the sample is in group b of that partition.
+
+   const int W = Npartitions / 64;
+   if (Npartitions % TILE_PARTITIONS != 0 || Npartitions % 64 != 0) {
+      std::cerr << "samplesep.make_partitions error - "
+                << "number of partitions must be a multiple of 64."
+                << std::endl;
+      exit(9);
+   }
+   xbits.assign(Nsample * W, 0);
+   if (random_seed == 0)
+      std::srand(std::time(0));
+   else
+      std::srand(random_seed);
+   std::vector<int> p0;
+   for (int i=0; i < Nsample; ++i)
+      p0.push_back(i);
+   for (int n=0; n < (int)Npartitions; ++n) {
+      std::vector<int> p = p0;
+      if (n > 0)
+         std::random_shuffle(p.begin(), p.end());
+      for (int i=0; i < Nsample; ++i) {
+         if (p[i] >= Nsample1)
+            xbits[i * W + n / 64] |= 1ULL << (n % 64);
+      }
+   }
+}
+
+inline double partition_energy(double S, double S1, double S11,
+                               double aCharge, double bCharge)
+{
+   // The partition sums of compute_energy follow from the identities
+   //     sum_aa = S - S1 + S11,  sum_ab = S1 - 2 S11,  sum_bb = S11
+   // where, with x_i = 1 for samples in group b and 0 otherwise,
+   //     S = sum_{i<j} E_ij,  S1 = sum_{i<j} E_ij (x_i + x_j),
+   //     S11 = sum_{i<j} E_ij x_i x_j.
+
+   return (S - S1 + S11) / (aCharge * aCharge) +
+          S11 / (bCharge * bCharge) -
+          (S1 - 2 * S11) / (aCharge * bCharge);
+}
+
+template <typename REAL>
+void tiled_block_sums(int dim, int ni, int nj,
+                      const REAL *xi, const REAL *wi,
+                      const REAL *xj, const REAL *wj,
+                      long int i0, long int j0, const uint64_t *xbits,
+                      double &S, std::vector<double> &S1,
+                      std::vector<double> &S11)
+{
+   // Add the contributions of pairs (i0+i, j0+j) with i in [0,ni),
+   // j in [0,nj) and j0+j > i0+i to the sums S, S1 and S11. The
+   // coordinates are stored component-major, x[k * n + i], and the
+   // partition bits of sample i are at xbits[i * Npartitions/64].
+
+   const int W = Npartitions / 64;
+
+   // The partition bits of the column samples, expanded to 0/1 values,
+   // in sub-tiles of TILE_COLS samples by TILE_PARTITIONS partitions.
+   const int ntile_cols = (nj + TILE_COLS - 1) / TILE_COLS;
+   const int ntile_parts = Npartitions / TILE_PARTITIONS;
+   const int tile_size = TILE_COLS * TILE_PARTITIONS;
+   std::vector<REAL> Xexp(ntile_cols * ntile_parts * tile_size);
+   for (int j=0; j < nj; ++j) {
+      int jt = j / TILE_COLS;
+      const uint64_t *bits = &xbits[(j0 + j) * W];
+      for (int n=0; n < (int)Npartitions; ++n) {
+         int pt = n / TILE_PARTITIONS;
+         Xexp[(jt * ntile_parts + pt) * tile_size +
+              (j % TILE_COLS) * TILE_PARTITIONS + n % TILE_PARTITIONS]
+            = (bits[n / 64] >> (n % 64)) & 1;
+      }
+   }
+
+   std::vector<double> rowsum(ni);
+   std::vector<double> colsum(nj);
+
+#if USE_OPENMP_MULTITHREADING
+  #pragma omp parallel
+#endif
+   {
+      std::vector<REAL> E(TILE_ROWS * TILE_COLS);
+      std::vector<REAL> Y(TILE_ROWS * TILE_PARTITIONS);
+      std::vector<double> S11_(Npartitions);
+      std::vector<double> colsum_(nj);
+      double S_(0);
+
+#if USE_OPENMP_MULTITHREADING
+  #pragma omp for schedule(dynamic)
+#endif
+      for (int it=0; it < ni; it += TILE_ROWS) {
+         int nit = (it + TILE_ROWS < ni)? TILE_ROWS : ni - it;
+         for (int jt=0; jt * TILE_COLS < nj; ++jt) {
+            int njt = (nj - jt * TILE_COLS < TILE_COLS)?
+                      nj - jt * TILE_COLS : TILE_COLS;
+            if (j0 + jt * TILE_COLS + njt <= i0 + it + 1)
+               continue;
+            distance_tile(dim, nit, njt, &xi[it], ni, &wi[it],
+                          &xj[jt * TILE_COLS], nj, &wj[jt * TILE_COLS],
+                          i0 + it, j0 + jt * TILE_COLS, E.data());
+            for (int i=0; i < nit; ++i) {
+               double r(0);
+               for (int j=0; j < njt; ++j) {
+                  r += E[i * TILE_COLS + j];
+                  colsum_[jt * TILE_COLS + j] += E[i * TILE_COLS + j];
+               }
+               rowsum[it + i] += r;
+               S_ += r;
+            }
+            for (int pt=0; pt < ntile_parts; ++pt) {
+               partition_tile(nit, E.data(),
+                              &Xexp[(jt * ntile_parts + pt) * tile_size],
+                              Y.data());
+               for (int i=0; i < nit; ++i) {
+                  const uint64_t *bits = &xbits[(i0 + it + i) * W];
+                  for (int n=0; n < TILE_PARTITIONS; ++n) {
+                     int np = pt * TILE_PARTITIONS + n;
+                     if ((bits[np / 64] >> (np % 64)) & 1)
+                        S11_[np] += Y[i * TILE_PARTITIONS + n];
+                  }
+               }
+            }
+         }
+      }
+
+#if USE_OPENMP_MULTITHREADING
+  #pragma omp critical
+#endif
+      {
+         S += S_;
+         for (int n=0; n < (int)Npartitions; ++n)
+            S11[n] += S11_[n];
+         for (int j=0; j < nj; ++j)
+            colsum[j] += colsum_[j];
+      }
+   }
+
+   for (int i=0; i < ni; ++i) {
+      const uint64_t *bits = &xbits[(i0 + i) * W];
+      for (int n=0; n < (int)Npartitions; ++n) {
+         if ((bits[n / 64] >> (n % 64)) & 1)
+            S1[n] += rowsum[i];
+      }
+   }
+   for (int j=0; j < nj; ++j) {
+      const uint64_t *bits = &xbits[(j0 + j) * W];
+      for (int n=0; n < (int)Npartitions; ++n) {
+         if ((bits[n / 64] >> (n % 64)) & 1)
+            S1[n] += colsum[j];
+      }
+   }
+}
+
+template <typename REAL>
+void compute_energy_tiled(sample_stream &stream, std::vector<double> &energy)
+{
+   // Tiled version of compute_energy. The per-pair, per-partition
+   // branches of the reference implementation are replaced by the
+   // sums S, S1 and S11 described in partition_energy. S1 only needs
+   // the row and column sums of E, and S11 is a dense matrix product
+   // that is computed tile by tile. The sum over pairs is divided
+   // into the same M x M blocks as in compute_energy, so that partial
+   // results from option -w can be compared one-to-one.
+
+   const long int Nsample = stream.size();
+   const int W = Npartitions / 64;
+   std::vector<uint64_t> xbits;
+   make_partitions(Nsample, stream.size1(), xbits);
+
+   const int M(1024);
+   std::vector<double> aCharge(Npartitions);
+   std::vector<double> bCharge(Npartitions);
+   std::vector<REAL> xi, wi, xj, wj;
+   for (long int i0=0; i0 < Nsample; i0 += M) {
+      long int i1 = (i0 + M < Nsample)? i0 + M : Nsample;
+      stream.read(i0, i1, xi, wi);
+      for (long int i=i0; i < i1; ++i) {
+         for (int n=0; n < (int)Npartitions; ++n) {
+            if ((xbits[i * W + n / 64] >> (n % 64)) & 1)
+               bCharge[n] += wi[i - i0];
+            else
+               aCharge[n] += wi[i - i0];
+         }
+      }
+   }
+
+   double S(0);
+   std::vector<double> S1(Npartitions);
+   std::vector<double> S11(Npartitions);
+
+   const long int N = (Nsample + M - 1) / M;
+   long int block_count = N * (N + 1) / 2;
+   long int block_start = block_count * work_set / work_sets;
+   long int block_end = block_count * (work_set + 1) / work_sets;
+   long int row_loaded = -1;
+   for (long int block = block_start; block < block_end; ++block) {
+      long int block_idy = (N + 0.5) - sqrt(sqr(N + 0.5) - 2 * block);
+      long int block_idx = block - (N - 1) * block_idy + 
+                           block_idy * (block_idy - 1) / 2;
+      long int i0 = block_idy * M;
+      long int i1 = (i0 + M < Nsample)? i0 + M : Nsample;
+      long int j0 = block_idx * M;
+      long int j1 = (j0 + M < Nsample)? j0 + M : Nsample;
+      if (block_idy != row_loaded) {
+         stream.read(i0, i1, xi, wi);
+         row_loaded = block_idy;
+      }
+      stream.read(j0, j1, xj, wj);
+      tiled_block_sums(stream.dim(), i1 - i0, j1 - j0,
+                       xi.data(), wi.data(), xj.data(), wj.data(),
+                       i0, j0, xbits.data(), S, S1, S11);
+
+      std::cout << "completed block " << block 
+                << "(" << block_idx << "," << block_idy << ")"
+                << "\r" << std::flush;
+   }
+   for (int n=0; n < (int)Npartitions; ++n) {
+      energy.push_back(partition_energy(S, S1[n], S11[n],
+                                        aCharge[n], bCharge[n]));
+   }
+   std::cout << std::endl;
+}
+
+template <typename REAL>
+void compute_energy_approx(sample_stream &stream, double pairs_per_sample,
+                           std::vector<double> &energy,
+                           std::vector<double> &error)
+{
+   // Estimate the energy sums of compute_energy_tiled from a random
+   // subset of the pairs, as an incomplete U-statistic, in a time that
+   // grows as Nsample * pairs_per_sample instead of Nsample^2. The
+   // joint sample is put in a random order, the upper triangle of
+   // pairs is divided into blocks of M x M in that order, and blocks
+   // are drawn at random (with replacement) until about
+   // Nsample * pairs_per_sample pairs have been summed. Each block
+   // gives an unbiased estimate of the energy of every partition,
+   // and the spread of these estimates between blocks gives the
+   // statistical error of their mean, returned in error. If the
+   // requested number of pairs covers the whole triangle, every
+   // block is summed once and the result is exact.
+
+   const long int Nsample = stream.size();
+   const int dim = stream.dim();
+   const int W = Npartitions / 64;
+   std::vector<uint64_t> xbits;
+   make_partitions(Nsample, stream.size1(), xbits);
+
+   // The shuffle that defines the pair blocks continues the random
+   // sequence used for the partitions, and is independent of them.
+   std::vector<REAL> x, w;
+   stream.read(0, Nsample, x, w);
+   std::vector<long int> order;
+   for (long int i=0; i < Nsample; ++i)
+      order.push_back(i);
+   std::random_shuffle(order.begin(), order.end());
+   std::vector<REAL> xs(dim * Nsample);
+   std::vector<REAL> ws(Nsample);
+   std::vector<uint64_t> xbitss(Nsample * W);
+   for (long int i=0; i < Nsample; ++i) {
+      for (int k=0; k < dim; ++k)
+         xs[k * Nsample + i] = x[k * Nsample + order[i]];
+      ws[i] = w[order[i]];
+      for (int iw=0; iw < W; ++iw)
+         xbitss[i * W + iw] = xbits[order[i] * W + iw];
+   }
+   std::vector<REAL>().swap(x);
+   std::vector<uint64_t>().swap(xbits);
+
+   std::vector<double> aCharge(Npartitions);
+   std::vector<double> bCharge(Npartitions);
+   for (long int i=0; i < Nsample; ++i) {
+      for (int n=0; n < (int)Npartitions; ++n) {
+         if ((xbitss[i * W + n / 64] >> (n % 64)) & 1)
+            bCharge[n] += ws[i];
+         else
+            aCharge[n] += ws[i];
+      }
+   }
+
+   const int M(256);
+   const long int N = (Nsample + M - 1) / M;
+   long int block_count = N * (N + 1) / 2;
+   double pairs_wanted = pairs_per_sample * Nsample;
+   long int block_draws = ceil(pairs_wanted / ((double)M * M));
+   block_draws = (block_draws < 2)? 2 : block_draws;
+   int exhaustive = (block_draws >= block_count);
+   if (exhaustive)
+      block_draws = block_count;
+
+   std::mt19937_64 block_generator((random_seed == 0)? 
+                                   std::time(0) : random_seed);
+   std::uniform_int_distribution<long int> block_picker(0, block_count - 1);
+   std::vector<double> Esum(Npartitions);
+   std::vector<double> E2sum(Npartitions);
+   std::vector<REAL> xi(dim * M), xj(dim * M);
+   for (long int draw=0; draw < block_draws; ++draw) {
+      long int block = (exhaustive)? draw : block_picker(block_generator);
+      long int block_idy = (N + 0.5) - sqrt(sqr(N + 0.5) - 2 * block);
+      long int block_idx = block - (N - 1) * block_idy + 
+                           block_idy * (block_idy - 1) / 2;
+      long int i0 = block_idy * M;
+      long int i1 = (i0 + M < Nsample)? i0 + M : Nsample;
+      long int j0 = block_idx * M;
+      long int j1 = (j0 + M < Nsample)? j0 + M : Nsample;
+      int ni = i1 - i0;
+      int nj = j1 - j0;
+      for (int k=0; k < dim; ++k) {
+         std::copy(&xs[k * Nsample + i0], &xs[k * Nsample + i1],
+                   &xi[k * ni]);
+         std::copy(&xs[k * Nsample + j0], &xs[k * Nsample + j1],
+                   &xj[k * nj]);
+      }
+      double S(0);
+      std::vector<double> S1(Npartitions);
+      std::vector<double> S11(Npartitions);
+      tiled_block_sums(dim, ni, nj, xi.data(), &ws[i0], xj.data(), &ws[j0],
+                       i0, j0, xbitss.data(), S, S1, S11);
+      for (int n=0; n < (int)Npartitions; ++n) {
+         double En = partition_energy(S, S1[n], S11[n],
+                                      aCharge[n], bCharge[n]);
+         Esum[n] += En;
+         E2sum[n] += En * En;
+      }
+
+      std::cout << "completed block " << draw << " of " << block_draws
+                << "\r" << std::flush;
+   }
+   for (int n=0; n < (int)Npartitions; ++n) {
+      if (exhaustive) {
+         energy.push_back(Esum[n]);
+         error.push_back(0);
+      }
+      else {
+         double mean = Esum[n] / block_draws;
+         double vari = (E2sum[n] / block_draws - mean * mean) *
+                       block_draws / (block_draws - 1.);
+         energy.push_back(mean * block_count);
+         error.push_back(sqrt(fabs(vari) / block_draws) * block_count);
+      }
+   }
+   std::cout << std::endl;
+   std::cout << "summed " << block_draws << " of " << block_count
+             << " blocks of " << M << "x" << M << " sample pairs"
+             << std::endl;
+}
+
+void cross_check_energy(const char *infile1, const char *sample1,
+                        const char *infile2, const char *sample2,
+                        const std::vector<int> &include_list,
+                        std::vector<double> &energy)
+{
+   // Run the reference and tiled engines with the same partitions and
+   // report the largest relative difference in the partition energies,
+   // together with the time taken by each. The reference result is
+   // returned in energy.
+
+   if (random_seed == 0)
+      random_seed = std::time(0);
+   read_sample(infile1, sample1, include_list);
+   read_sample(infile2, sample2, include_list);
+   auto t0 = std::chrono::steady_clock::now();
+   compute_energy(sample1, sample2, energy);
+   auto t1 = std::chrono::steady_clock::now();
+   sample_stream stream(infile1, sample1, infile2, sample2, include_list);
+   std::vector<double> tenergy;
+   compute_energy_tiled<double>(stream, tenergy);
+   auto t2 = std::chrono::steady_clock::now();
+   double maxdiff(0);
+   for (int n=0; n < (int)energy.size(); ++n) {
+      double diff = fabs(tenergy[n] - energy[n]) /
+                    (fabs(energy[n]) + 1e-300);
+      maxdiff = (diff > maxdiff)? diff : maxdiff;
+   }
+   std::chrono::duration<double> dt1 = t1 - t0;
+   std::chrono::duration<double> dt2 = t2 - t1;
+   std::cout << "cross-check of tiled engine: max relative difference "
+             << maxdiff << " over " << energy.size() << " partitions"
+             << std::endl
+             << "   reference engine " << dt1.count() << " s, "
+             << "tiled engine " << dt2.count() << " s"
+             << std::endl;
+}
+
 #ifdef __CUDACC__
 void compute_energy_gpu(const char *sample1, const char *sample2,
                         std::vector<float> &energy)
@@ -511,6 +1159,9 @@ void parse_ilist(const char *ilist, std::vector<int> &include_list)
 int main(int argc, char *argv[]) {
    int singleprec(0);
    int usegpu(0);
+   int tiled(0);
+   int crosscheck(0);
+   double approx_pairs(0);
    int nfile(0);
    char *infile[2] = {0,0};
    char *sname[2] = {0,0};
@@ -520,6 +1171,18 @@ int main(int argc, char *argv[]) {
          singleprec = 1;
       else if (strstr(argv[i], "-c") == argv[i])
          usegpu = 1;
+      else if (strstr(argv[i], "-t") == argv[i])
+         tiled = 1;
+      else if (strstr(argv[i], "-x") == argv[i])
+         crosscheck = 1;
+      else if (strstr(argv[i], "-a") == argv[i]) {
+         if (strlen(argv[i]) > 2)
+            approx_pairs = strtod(argv[i] + 2, 0);
+         else
+            approx_pairs = strtod(argv[++i], 0);
+         if (approx_pairs <= 0)
+            usage();
+      }
       else if (strstr(argv[i], "-i") == argv[i]) {
          if (strlen(argv[i]) > 2)
             parse_ilist(argv[i] + 2, include_list);
@@ -563,11 +1226,14 @@ int main(int argc, char *argv[]) {
    *(sname[0]++) = 0;
    *(sname[1]++) = 0;
 
-   read_sample(infile[0], sname[0], include_list);
-   read_sample(infile[1], sname[1], include_list);
+   if (usegpu || !(tiled || crosscheck || approx_pairs > 0)) {
+      read_sample(infile[0], sname[0], include_list);
+      read_sample(infile[1], sname[1], include_list);
+   }
 
    std::vector<float> fenergy;
    std::vector<double> denergy;
+   std::vector<double> derror;
 
    if (usegpu) {
       compute_energy_gpu(sname[0], sname[1], fenergy);
@@ -587,7 +1253,7 @@ int main(int argc, char *argv[]) {
                    << " sigma" << std::endl;
       }
    }
-   else if (singleprec) {
+   else if (singleprec && !(tiled || crosscheck || approx_pairs > 0)) {
       compute_energy(sname[0], sname[1], fenergy);
       if (fenergy.size() > 0) {
          double moment[3] = {0,0,0};
@@ -606,7 +1272,31 @@ int main(int argc, char *argv[]) {
       }
    }
    else {
-      compute_energy(sname[0], sname[1], denergy);
+      if (approx_pairs > 0) {
+         sample_stream stream(infile[0], sname[0], infile[1], sname[1],
+                              include_list);
+         if (singleprec)
+            compute_energy_approx<float>(stream, approx_pairs,
+                                         denergy, derror);
+         else
+            compute_energy_approx<double>(stream, approx_pairs,
+                                          denergy, derror);
+      }
+      else if (crosscheck) {
+         cross_check_energy(infile[0], sname[0], infile[1], sname[1],
+                            include_list, denergy);
+      }
+      else if (tiled) {
+         sample_stream stream(infile[0], sname[0], infile[1], sname[1],
+                              include_list);
+         if (singleprec)
+            compute_energy_tiled<float>(stream, denergy);
+         else
+            compute_energy_tiled<double>(stream, denergy);
+      }
+      else {
+         compute_energy(sname[0], sname[1], denergy);
+      }
       if (denergy.size() > 0) {
          double moment[3] = {0,0,0};
          for (int i=1; i < (int)denergy.size(); ++i) {
@@ -621,6 +1311,25 @@ int main(int argc, char *argv[]) {
                    << std::endl;
          std::cout << "significance is " << (denergy[0] - mean) / sqrt(vari)
                    << " sigma" << std::endl;
+         if (derror.size() > 0) {
+            double elow = denergy[0] - 1.96 * derror[0];
+            double ehigh = denergy[0] + 1.96 * derror[0];
+            double pval[3] = {0,0,0};
+            for (int i=1; i < (int)denergy.size(); ++i) {
+               pval[0] += (denergy[i] >= denergy[0]) / moment[0];
+               pval[1] += (denergy[i] >= ehigh) / moment[0];
+               pval[2] += (denergy[i] >= elow) / moment[0];
+            }
+            std::cout << "approximate energy " << denergy[0]
+                      << " +/- " << derror[0] << ", 95% CL ["
+                      << elow << "," << ehigh << "]" << std::endl;
+            std::cout << "significance is " 
+                      << (denergy[0] - mean) / sqrt(vari) << " +/- "
+                      << derror[0] / sqrt(vari) << " sigma" << std::endl;
+            std::cout << "permutation p-value is " << pval[0]
+                      << ", 95% CL [" << pval[1] << "," << pval[2] << "]"
+                      << std::endl;
+         }
       }
    }
 
@@ -637,6 +1346,8 @@ int main(int argc, char *argv[]) {
          hen.SetBinContent(i+1, fenergy[i]);
       for (int i=0; i < (int)denergy.size(); ++i)
          hen.SetBinContent(i+1, denergy[i]);
+      for (int i=0; i < (int)derror.size(); ++i)
+         hen.SetBinError(i+1, derror[i]);
       hen.Write();
    }
    return 0;
@@ -0,0 +1,159 @@
+#!/usr/bin/python
+#
+# bcalfastshower.py - script to compare the BCAL hits from full shower
+#                     simulation with those from the parametrized fast
+#                     shower model enabled by the BCALFASTSIM card.
+#
+# author: agent at local
+# version: october 18, 2026
+#
+# usage pattern:
+#   1) simulate the same event sample twice, once without BCALFASTSIM
+#      and once with it, writing output to full.hddm and fast.hddm
+#   2) bcalfastshower.py full.hddm fast.hddm bcalshower.dat
+#   3) copy the suggested parameters into bcalshower.dat and repeat
+#      until the distributions agree within their errors.
+
+import sys
+import math
+import hddm_s
+
+# radiation lengths per BCAL layer, used to translate a shift in the
+# mean layer of the shower energy into a shift in the shower maximum
+x0_per_layer = 1.5
+
+def usage():
+   print("Usage: bcalfastshower.py <full.hddm> <fast.hddm> [<params>]")
+   print("  where full.hddm and fast.hddm are hdgeant4 output files")
+   print("  for the same events made without and with the BCALFASTSIM")
+   print("  card, and params is the shower parameter table used to make")
+   print("  fast.hddm, if any.")
+   sys.exit(1)
+
+def read_hits(infile):
+   """
+   Read the BCAL hits from an hddm output file and return a dictionary
+   of lists of cell-level and event-level quantities.
+   """
+   hits = {"E": [], "t": [], "Eup": [], "tup": [], "Edown": [],
+           "tdown": [], "Etot": [], "ncells": [], "layer": [],
+           "sector": []}
+   for rec in hddm_s.istream(infile):
+      Etot = 0
+      Elayer = 0
+      ncells = 0
+      cells = []
+      for cell in rec.getBcalCells():
+         Ecell = 0
+         for hit in cell.getBcalTruthHits():
+            hits["E"].append(hit.E)
+            hits["t"].append(hit.t)
+            Ecell += hit.E
+         for hit in cell.getBcalSiPMUpHits():
+            hits["Eup"].append(hit.E)
+            hits["tup"].append(hit.t)
+         for hit in cell.getBcalSiPMDownHits():
+            hits["Edown"].append(hit.E)
+            hits["tdown"].append(hit.t)
+         if Ecell > 0:
+            ncells += 1
+            Etot += Ecell
+            Elayer += Ecell * cell.layer
+            cells.append((Ecell, (cell.module - 1) * 4 + cell.sector - 1))
+      if Etot == 0:
+         continue
+      hits["Etot"].append(Etot)
+      hits["ncells"].append(ncells)
+      hits["layer"].append(Elayer / Etot)
+      # energy-weighted rms spread in sector, relative to the centroid
+      # of the event, with care for the wrap-around at 192 sectors
+      smax = max(cells)[1]
+      ds = [((s - smax + 96) % 192) - 96 for (E, s) in cells]
+      s1 = sum(cells[i][0] * ds[i] for i in range(len(cells))) / Etot
+      s2 = sum(cells[i][0] * ds[i]**2 for i in range(len(cells))) / Etot
+      hits["sector"].append(math.sqrt(max(s2 - s1**2, 0)))
+   return hits
+
+def mean(values):
+   if len(values) == 0:
+      return 0
+   return sum(values) / float(len(values))
+
+def compare(values1, values2, nbins=50):
+   """
+   Compare the shapes of two distributions, returning the chi-square
+   per bin of their unit-normalized histograms over a common range.
+   """
+   if len(values1) == 0 or len(values2) == 0:
+      return float("nan")
+   allv = sorted(values1 + values2)
+   vmin = allv[len(allv) // 200]
+   vmax = allv[-1 - len(allv) // 200]
+   if vmax <= vmin:
+      return 0
+   h1 = [0] * nbins
+   h2 = [0] * nbins
+   for (vals, h) in ((values1, h1), (values2, h2)):
+      for v in vals:
+         b = int((v - vmin) / (vmax - vmin) * nbins)
+         if b >= 0 and b < nbins:
+            h[b] += 1
+   n1 = float(sum(h1))
+   n2 = float(sum(h2))
+   chisq = 0
+   nfilled = 0
+   for b in range(nbins):
+      if h1[b] + h2[b] == 0:
+         continue
+      var = h1[b] / n1**2 + h2[b] / n2**2
+      chisq += (h1[b] / n1 - h2[b] / n2)**2 / var
+      nfilled += 1
+   return chisq / max(nfilled, 1)
+
+def read_params(infile):
+   params = {"escale": [1.0], "tmax": [-0.5, 0.5],
+             "rcore": [0.10, 0.20], "rtail": [0.60, 0.60]}
+   for line in open(infile):
+      fields = line.split()
+      if len(fields) > 1 and fields[0] in params:
+         params[fields[0]] = [float(f) for f in fields[1:]]
+   return params
+
+if len(sys.argv) < 3 or len(sys.argv) > 4:
+   usage()
+full = read_hits(sys.argv[1])
+fast = read_hits(sys.argv[2])
+if len(sys.argv) == 4:
+   params = read_params(sys.argv[3])
+else:
+   params = read_params("/dev/null")
+
+print("{0:>24s} {1:>12s} {2:>12s} {3:>10s}".format("quantity", "full mean",
+                                                  "fast mean", "chisq/bin"))
+for (key, title) in (("E", "cell energy (GeV)"),
+                     ("t", "cell time (ns)"),
+                     ("Eup", "upstream energy (GeV)"),
+                     ("tup", "upstream time (ns)"),
+                     ("Edown", "downstream energy (GeV)"),
+                     ("tdown", "downstream time (ns)"),
+                     ("Etot", "event energy (GeV)"),
+                     ("ncells", "cells per event"),
+                     ("layer", "mean layer"),
+                     ("sector", "sector spread")):
+   print("{0:>24s} {1:12.5g} {2:12.5g} {3:10.3f}".format(title,
+         mean(full[key]), mean(fast[key]), compare(full[key], fast[key])))
+
+# Suggest new shower parameters from the differences in the means
+if mean(fast["Etot"]) > 0 and mean(fast["sector"]) > 0:
+   escale = params["escale"][0] * mean(full["Etot"]) / mean(fast["Etot"])
+   dtmax = (mean(full["layer"]) - mean(fast["layer"])) * x0_per_layer
+   rscale = mean(full["sector"]) / mean(fast["sector"])
+   print("")
+   print("suggested shower parameters:")
+   print("escale {0:.4f}".format(escale))
+   print("tmax {0:.3f} {1:.3f}".format(params["tmax"][0] + dtmax,
+                                       params["tmax"][1] + dtmax))
+   print("rcore {0:.3f} {1:.3f}".format(params["rcore"][0] * rscale,
+                                        params["rcore"][1] * rscale))
+   print("rtail {0:.3f} {1:.3f}".format(params["rtail"][0] * rscale,
+                                        params["rtail"][1] * rscale))